@@ -224,6 +224,7 @@ include(${CCF_DIR}/cmake/quickjs.cmake)
 include(${CCF_DIR}/cmake/sss.cmake)
 
 find_package(CURL REQUIRED)
+find_package(ZLIB REQUIRED)
 
 # Unit test wrapper
 function(add_unit_test name)
@@ -263,6 +264,7 @@ if("sgx" IN_LIST TARGET)
             ccfcrypto.host
             evercrypt.host
             CURL::libcurl
+            ZLIB::ZLIB
   )
   enable_quote_code(cchost)
 
@@ -292,6 +294,7 @@ if("virtual" IN_LIST TARGET)
             ccfcrypto.host
             evercrypt.host
             CURL::libcurl
+            ZLIB::ZLIB
   )
 
   install(TARGETS cchost.virtual DESTINATION bin)
@@ -335,6 +335,17 @@ namespace ccfapp
         Procs::SMALL_BANKING_WRITE_CHECK,
         json_adapter(writeCheck),
         HandlerRegistry::Write);
+
+      const auto& a = tables.accounts.get_name();
+      const auto& b = tables.savings.get_name();
+      const auto& c = tables.checkings.get_name();
+      declare_access(Procs::SMALL_BANKING_CREATE, {a, b, c}, {a, b, c});
+      declare_access(Procs::SMALL_BANKING_CREATE_BATCH, {a, b, c}, {a, b, c});
+      declare_access(Procs::SMALL_BANKING_BALANCE, {a, b, c}, {});
+      declare_access(Procs::SMALL_BANKING_TRANSACT_SAVINGS, {a, b}, {b});
+      declare_access(Procs::SMALL_BANKING_DEPOSIT_CHECKING, {a, c}, {c});
+      declare_access(Procs::SMALL_BANKING_AMALGAMATE, {a, b, c}, {b, c});
+      declare_access(Procs::SMALL_BANKING_WRITE_CHECK, {a, b, c}, {c});
     }
   };
 
@@ -349,6 +360,7 @@ namespace ccfapp
       sb_handlers(store)
     {
       disable_request_storing();
+      enable_parallel_execution();
     }
   };
 
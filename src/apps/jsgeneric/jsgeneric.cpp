@@ -1,10 +1,14 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the Apache 2.0 License.
+#include "ds/spinlock.h"
 #include "enclave/appinterface.h"
 #include "node/rpc/userfrontend.h"
 #include "quickjs.h"
 
 #include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace ccfapp
@@ -95,11 +99,225 @@ namespace ccfapp
     return JS_NULL;
   }
 
+  // A handler script and its QuickJS bytecode
+  struct CompiledScript
+  {
+    std::string text;
+    std::vector<uint8_t> bytecode;
+  };
+
+  // A QuickJS runtime, kept by each thread and reused for all the requests it
+  // executes. Each request runs in a new context with the CCF bindings
+  // installed, so that a handler cannot leave state in the global object, in
+  // the built-in prototypes or in top-level declarations for later requests.
+  class JSWorker
+  {
+  private:
+    JSRuntime* rt;
+
+    // Only used to compile scripts, which does not run them
+    JSContext* compile_ctx;
+
+    struct ContextDeleter
+    {
+      void operator()(JSContext* ctx)
+      {
+        JS_FreeContext(ctx);
+      }
+    };
+
+    JSWorker()
+    {
+      rt = JS_NewRuntime();
+      if (rt == nullptr)
+      {
+        throw std::runtime_error("Failed to initialise QuickJS runtime");
+      }
+
+      compile_ctx = JS_NewContext(rt);
+      if (compile_ctx == nullptr)
+      {
+        JS_FreeRuntime(rt);
+        throw std::runtime_error("Failed to initialise QuickJS context");
+      }
+    }
+
+  public:
+    using Context = std::unique_ptr<JSContext, ContextDeleter>;
+
+    JSWorker(const JSWorker&) = delete;
+
+    ~JSWorker()
+    {
+      JS_FreeContext(compile_ctx);
+      JS_FreeRuntime(rt);
+    }
+
+    static JSWorker& get()
+    {
+      static thread_local JSWorker worker;
+      return worker;
+    }
+
+    JSContext* compile_context()
+    {
+      return compile_ctx;
+    }
+
+    /** Create a context to run a request in
+     *
+     * @return Context with the CCF bindings installed, freed when it goes out
+     * of scope
+     */
+    Context create_context()
+    {
+      Context ctx(JS_NewContext(rt));
+      if (ctx == nullptr)
+      {
+        throw std::runtime_error("Failed to initialise QuickJS context");
+      }
+
+      auto global_obj = JS_GetGlobalObject(ctx.get());
+
+      auto console = JS_NewObject(ctx.get());
+      JS_SetPropertyStr(
+        ctx.get(),
+        console,
+        "log",
+        JS_NewCFunction(ctx.get(), ccfapp::js_print, "log", 1));
+      JS_SetPropertyStr(ctx.get(), global_obj, "console", console);
+
+      auto log = JS_NewObject(ctx.get());
+      JS_SetPropertyStr(
+        ctx.get(),
+        log,
+        "get",
+        JS_NewCFunction(ctx.get(), ccfapp::js_get, "get", 1));
+      JS_SetPropertyStr(
+        ctx.get(),
+        log,
+        "put",
+        JS_NewCFunction(ctx.get(), ccfapp::js_put, "put", 2));
+      auto tables_ = JS_NewObject(ctx.get());
+      JS_SetPropertyStr(ctx.get(), tables_, "log", log);
+      JS_SetPropertyStr(ctx.get(), global_obj, "tables", tables_);
+
+      JS_FreeValue(ctx.get(), global_obj);
+      return ctx;
+    }
+
+    /** Compile a handler script to bytecode
+     *
+     * @param ctx Context to compile in
+     * @param code Source of the script
+     * @param path Name of the script, used in error messages
+     *
+     * @return Bytecode, empty if the script could not be compiled. The
+     * exception is left pending in the context.
+     */
+    static std::vector<uint8_t> compile(
+      JSContext* ctx, const std::string& code, const std::string& path)
+    {
+      JSValue fn = JS_Eval(
+        ctx,
+        code.c_str(),
+        code.size(),
+        path.c_str(),
+        JS_EVAL_TYPE_GLOBAL | JS_EVAL_FLAG_COMPILE_ONLY);
+      if (JS_IsException(fn))
+        return {};
+
+      size_t size;
+      auto buf = JS_WriteObject(ctx, &size, fn, JS_WRITE_OBJ_BYTECODE);
+      JS_FreeValue(ctx, fn);
+      if (buf == nullptr)
+        return {};
+
+      std::vector<uint8_t> bytecode(buf, buf + size);
+      js_free(ctx, buf);
+      return bytecode;
+    }
+
+    /** Run a compiled handler script
+     *
+     * The bytecode is read in the context that runs it, since a function runs
+     * in the context it was read in.
+     *
+     * @return Value of the script, which is an exception if it threw
+     */
+    static JSValue run(JSContext* ctx, const CompiledScript& script)
+    {
+      auto fn = JS_ReadObject(
+        ctx,
+        script.bytecode.data(),
+        script.bytecode.size(),
+        JS_READ_OBJ_BYTECODE);
+      if (JS_IsException(fn))
+        return fn;
+
+      return JS_EvalFunction(ctx, fn);
+    }
+  };
+
+  // Bytecode of the app scripts, shared by all threads. Scripts are compiled
+  // when they are written to the app_scripts table. Since a write may later be
+  // rolled back, the cached entry is only used if its text matches the
+  // script read by the transaction, and is otherwise replaced.
+  class ScriptCache
+  {
+  private:
+    SpinLock lock;
+    std::unordered_map<std::string, std::shared_ptr<const CompiledScript>>
+      scripts;
+
+  public:
+    std::shared_ptr<const CompiledScript> compile(
+      JSContext* ctx, const std::string& method, const std::string& text)
+    {
+      auto bytecode =
+        JSWorker::compile(ctx, text, fmt::format("app_scripts::{}", method));
+      if (bytecode.empty())
+        return nullptr;
+
+      auto script = std::make_shared<const CompiledScript>(
+        CompiledScript{text, std::move(bytecode)});
+
+      std::lock_guard<SpinLock> guard(lock);
+      scripts[method] = script;
+      return script;
+    }
+
+    void remove(const std::string& method)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      scripts.erase(method);
+    }
+
+    /** Get the compiled script for a method
+     *
+     * @return Compiled script, nullptr if the script could not be compiled.
+     * The exception is then pending in ctx.
+     */
+    std::shared_ptr<const CompiledScript> get(
+      JSContext* ctx, const std::string& method, const std::string& text)
+    {
+      {
+        std::lock_guard<SpinLock> guard(lock);
+        auto it = scripts.find(method);
+        if (it != scripts.end() && it->second->text == text)
+          return it->second;
+      }
+
+      return compile(ctx, method, text);
+    }
+  };
+
   class JSHandlers : public UserHandlerRegistry
   {
   private:
     NetworkTables& network;
     LogTable& log_table;
+    ScriptCache script_cache;
 
   public:
     JSHandlers(NetworkTables& network) :
@@ -109,6 +327,26 @@ namespace ccfapp
     {
       auto& tables = *network.tables;
 
+      network.app_scripts.set_local_hook(
+        [this](kv::Version, const Scripts::State&, const Scripts::Write& w) {
+          for (const auto& [method, script] : w)
+          {
+            if (Scripts::deleted(script.version) || !script.value.text)
+            {
+              script_cache.remove(method);
+            }
+            else
+            {
+              auto ctx = JSWorker::get().compile_context();
+              if (!script_cache.compile(ctx, method, *script.value.text))
+              {
+                JS_FreeValue(ctx, JS_GetException(ctx));
+                LOG_FAIL_FMT("Could not compile script for {}", method);
+              }
+            }
+          }
+        });
+
       auto default_handler = [this](RequestArgs& args) {
         const auto method = args.rpc_ctx->get_method();
         const auto local_method = method.substr(method.find_first_not_of('/'));
@@ -131,56 +369,31 @@ namespace ccfapp
           return;
         }
 
-        JSRuntime* rt = JS_NewRuntime();
-        if (rt == nullptr)
+        if (!handler_script.value().text.has_value())
         {
-          throw std::runtime_error("Failed to initialise QuickJS runtime");
+          throw std::runtime_error("Could not find script text");
         }
 
-        JSContext* ctx = JS_NewContext(rt);
-        if (ctx == nullptr)
-        {
-          JS_FreeRuntime(rt);
-          throw std::runtime_error("Failed to initialise QuickJS context");
-        }
+        auto context = JSWorker::get().create_context();
+        auto ctx = context.get();
 
         auto ltv = args.tx.get_view(log_table);
         JS_SetContextOpaque(ctx, (void*)ltv);
 
         auto global_obj = JS_GetGlobalObject(ctx);
-
-        auto console = JS_NewObject(ctx);
-        JS_SetPropertyStr(
-          ctx,
-          console,
-          "log",
-          JS_NewCFunction(ctx, ccfapp::js_print, "log", 1));
-        JS_SetPropertyStr(ctx, global_obj, "console", console);
-
-        auto log = JS_NewObject(ctx);
-        JS_SetPropertyStr(
-          ctx, log, "get", JS_NewCFunction(ctx, ccfapp::js_get, "get", 1));
-        JS_SetPropertyStr(
-          ctx, log, "put", JS_NewCFunction(ctx, ccfapp::js_put, "put", 2));
-        auto tables_ = JS_NewObject(ctx);
-        JS_SetPropertyStr(ctx, tables_, "log", log);
-        JS_SetPropertyStr(ctx, global_obj, "tables", tables_);
-
         const auto& request_body = args.rpc_ctx->get_request_body();
         auto args_str = JS_NewStringLen(
           ctx, (const char*)request_body.data(), request_body.size());
         JS_SetPropertyStr(ctx, global_obj, "args", args_str);
         JS_FreeValue(ctx, global_obj);
 
-        if (!handler_script.value().text.has_value())
-        {
-          throw std::runtime_error("Could not find script text");
-        }
+        JSValue val = JS_EXCEPTION;
+        auto script = script_cache.get(
+          ctx, local_method, handler_script.value().text.value());
+        if (script != nullptr)
+          val = JSWorker::run(ctx, *script);
 
-        std::string code = handler_script.value().text.value();
-        auto path = fmt::format("app_scripts::{}", local_method);
-        JSValue val = JS_Eval(
-          ctx, code.c_str(), code.size(), path.c_str(), JS_EVAL_TYPE_GLOBAL);
+        JS_SetContextOpaque(ctx, nullptr);
 
         auto status = true;
 
@@ -200,11 +413,9 @@ namespace ccfapp
         auto response = nlohmann::json::parse(cstr);
 
         JS_FreeCString(ctx, cstr);
+        JS_FreeValue(ctx, rval);
         JS_FreeValue(ctx, val);
 
-        JS_FreeContext(ctx);
-        JS_FreeRuntime(rt);
-
         args.rpc_ctx->set_response_status(HTTP_STATUS_OK);
         args.rpc_ctx->set_response_body(
           jsonrpc::pack(response, jsonrpc::Pack::Text));
@@ -0,0 +1,174 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "ds/logger.h"
+#include "enclave/appinterface.h"
+#include "http/http_rpc_context.h"
+#include "node/encryptor.h"
+#include "node/genesisgen.h"
+#include "node/rpc/jsonrpc.h"
+#include "node/rpc/test/node_stub.h"
+#include "runtime_config/default_whitelists.h"
+#include "tls/keypair.h"
+
+#include <doctest/doctest.h>
+#include <string>
+#include <vector>
+
+using namespace ccfapp;
+using namespace ccf;
+using namespace std;
+using namespace nlohmann;
+
+auto kp = tls::make_key_pair();
+
+using TResponse = http::SimpleResponseProcessor::Response;
+
+TResponse parse_response(const vector<uint8_t>& v)
+{
+  http::SimpleResponseProcessor processor;
+  http::ResponseParser parser(processor);
+
+  const auto parsed_count = parser.execute(v.data(), v.size());
+  REQUIRE(parsed_count == v.size());
+  REQUIRE(processor.received.size() == 1);
+
+  return processor.received.front();
+}
+
+json check_success(const vector<uint8_t>& v)
+{
+  const auto response = parse_response(v);
+  REQUIRE(response.status == HTTP_STATUS_OK);
+  return jsonrpc::unpack(response.body, jsonrpc::Pack::Text);
+}
+
+// Keeps the messages logged by the app, to check those logged outside of a
+// request
+class JSLogger : public logger::JsonLogger
+{
+public:
+  static inline vector<string> messages;
+
+  JSLogger() : JsonLogger("") {}
+
+  void write(const std::string& log_line) override
+  {
+    auto j = nlohmann::json::parse(log_line);
+    REQUIRE(j.find("msg") != j.end());
+    messages.push_back(j["msg"].get<string>());
+  }
+};
+
+bool logged(const string& msg)
+{
+  for (const auto& m : JSLogger::messages)
+  {
+    if (m.find(msg) != string::npos)
+      return true;
+  }
+  return false;
+}
+
+auto user_caller = kp -> self_sign("CN=name");
+auto user_caller_der = tls::make_verifier(user_caller) -> der_cert_data();
+
+auto init_frontend(
+  NetworkTables& network, GenesisGenerator& gen, StubNotifier& notifier)
+{
+  gen.add_user(user_caller);
+
+  for (const auto& wl : default_whitelists)
+    gen.set_whitelist(wl.first, wl.second);
+
+  gen.finalize();
+  return get_rpc_handler(network, notifier);
+}
+
+kv::Version set_handler(
+  NetworkTables& network, const string& method, const Script& h)
+{
+  Store::Tx tx;
+  tx.get_view(network.app_scripts)->put(method, h);
+  REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  return tx.commit_version();
+}
+
+std::vector<uint8_t> make_pc(const string& method)
+{
+  auto request = http::Request(method);
+  request.set_header(
+    http::headers::CONTENT_TYPE, http::headervalues::contenttype::JSON);
+  return request.build_request();
+}
+
+TEST_CASE("simple js apps")
+{
+  NetworkTables network;
+  auto encryptor = std::make_shared<ccf::NullTxEncryptor>();
+  network.tables->set_encryptor(encryptor);
+  Store::Tx gen_tx;
+  GenesisGenerator gen(network, gen_tx);
+  gen.init_values();
+  StubNotifier notifier;
+  auto frontend = init_frontend(network, gen, notifier);
+  logger::config::loggers().emplace_back(std::make_unique<JSLogger>());
+  auto user_session = std::make_shared<enclave::SessionContext>(
+    enclave::InvalidSessionId, user_caller_der);
+
+  auto call = [&](const string& method) {
+    auto rpc_ctx = enclave::make_rpc_context(user_session, make_pc(method));
+    return frontend->process(rpc_ctx).value();
+  };
+
+  SUBCASE("scripts are compiled when written")
+  {
+    JSLogger::messages.clear();
+    set_handler(network, "broken", {"return ("});
+    CHECK(logged("Could not compile script for broken"));
+
+    const auto response = parse_response(call("broken"));
+    CHECK(response.status == HTTP_STATUS_INTERNAL_SERVER_ERROR);
+
+    JSLogger::messages.clear();
+    set_handler(network, "broken", {"[1, 2].length"});
+    CHECK_FALSE(logged("Could not compile script"));
+    CHECK(check_success(call("broken")) == 2);
+  }
+
+  SUBCASE("scripts are recompiled after a rollback")
+  {
+    const auto v1 = set_handler(network, "version", {"'v1'"});
+    CHECK(check_success(call("version")) == "v1");
+
+    set_handler(network, "version", {"'v2'"});
+    CHECK(check_success(call("version")) == "v2");
+
+    // The cached bytecode is still that of v2, which is no longer in the store
+    network.tables->rollback(v1);
+    CHECK(check_success(call("version")) == "v1");
+  }
+
+  SUBCASE("requests do not share state")
+  {
+    constexpr auto pollute = R"xxx(
+      let declared = 1;
+      globalThis.leaked = true;
+      Object.prototype.polluted = true;
+      declared
+    )xxx";
+    set_handler(network, "pollute", {pollute});
+
+    constexpr auto check = R"xxx(
+      [typeof leaked, typeof declared, ({}).polluted === undefined]
+    )xxx";
+    set_handler(network, "check", {check});
+
+    // A top-level declaration can be made again by the next request
+    CHECK(check_success(call("pollute")) == 1);
+    CHECK(check_success(call("pollute")) == 1);
+
+    const auto expected = json::array({"undefined", "undefined", true});
+    CHECK(check_success(call("check")) == expected);
+  }
+}
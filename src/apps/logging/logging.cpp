@@ -97,10 +97,10 @@ namespace ccfapp
       // SNIPPET_END: record
 
       // SNIPPET_START: get
-      auto get = [this](Store::Tx& tx, nlohmann::json&& params) {
+      auto get = [this](Store::ReadOnlyTx& tx, nlohmann::json&& params) {
         const auto in = params.get<LoggingGet::In>();
         auto view = tx.get_view(records);
-        auto r = view->get(in.id);
+        auto r = view.get(in.id);
 
         if (r.has_value())
           return make_success(LoggingGet::Out{r.value()});
@@ -136,7 +136,8 @@ namespace ccfapp
       // SNIPPET_END: record_public
 
       // SNIPPET_START: get_public
-      auto get_public = [this](Store::Tx& tx, nlohmann::json&& params) {
+      auto get_public = [this](
+                          Store::ReadOnlyTx& tx, nlohmann::json&& params) {
         const auto validation_error =
           validate(params, get_public_params_schema);
 
@@ -147,7 +148,7 @@ namespace ccfapp
 
         auto view = tx.get_view(public_records);
         const auto id = params["id"];
-        auto r = view->get(id);
+        auto r = view.get(id);
 
         if (r.has_value())
         {
@@ -114,6 +114,12 @@ namespace ccfapp
       }
       tsr = std::make_unique<AppTsr>(network, app_tables);
 
+      // Handlers and their environment are read from app_scripts
+      network.app_scripts.set_local_hook(
+        [this](kv::Version, const Scripts::State&, const Scripts::Write&) {
+          tsr->invalidate();
+        });
+
       auto default_handler = [this](RequestArgs& args, nlohmann::json&&) {
         const auto method = args.rpc_ctx->get_method();
         const auto local_method = method.substr(method.find_first_not_of('/'));
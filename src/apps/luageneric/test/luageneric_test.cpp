@@ -308,6 +308,44 @@ TEST_CASE("simple lua apps")
     check_error(
       frontend->process(put_ctx).value(), HTTP_STATUS_INTERNAL_SERVER_ERROR);
   }
+
+  SUBCASE("changes to the environment do not leak between calls")
+  {
+    constexpr auto change_env = R"xxx(
+      tables, gov_tables, args = ...
+      env.error_codes.OK = 0
+      setmetatable(env, {__index = function() return "leaked" end})
+      leaked = true
+      local hidden = not pcall(
+        function() getmetatable(tables.priv0).get = nil end)
+      return env.succ(hidden)
+    )xxx";
+    set_handler(network, "change_env", {change_env});
+
+    constexpr auto read_env = R"xxx(
+      tables, gov_tables, args = ...
+      return env.succ({
+        ok = env.error_codes.OK,
+        missing = env.missing == nil,
+        leaked = leaked == nil,
+        get = tables.priv0:get(1) == nil
+      })
+    )xxx";
+    set_handler(network, "read_env", {read_env});
+
+    // Both calls run on the same pooled interpreter
+    const auto change_packed = make_pc("change_env", {});
+    auto change_ctx = enclave::make_rpc_context(user_session, change_packed);
+    check_success(frontend->process(change_ctx).value(), true);
+
+    const auto read_packed = make_pc("read_env", {});
+    auto read_ctx = enclave::make_rpc_context(user_session, read_packed);
+    const nlohmann::json expected = {{"ok", HTTP_STATUS_OK},
+                                     {"missing", true},
+                                     {"leaked", true},
+                                     {"get", true}};
+    check_success(frontend->process(read_ctx).value(), expected);
+  }
 }
 
 TEST_CASE("simple bank")
@@ -87,10 +87,11 @@ namespace consensus
       const uint8_t*& data, size_t& size)
     {
       auto entry_len = serialized::read<uint32_t>(data, size);
-      std::vector<uint8_t> entry(data, data + entry_len);
-
+      const auto entry_start = data;
       serialized::skip(data, size, entry_len);
 
+      std::vector<uint8_t> entry(entry_start, entry_start + entry_len);
+
       return std::make_pair(std::move(entry), true);
     }
 
@@ -103,5 +104,37 @@ namespace consensus
     {
       RINGBUFFER_WRITE_MESSAGE(consensus::ledger_truncate, to_host, idx);
     }
+
+    /**
+     * Record that the entry at a given index is a signature transaction, so
+     * that the host can make the ledger durable up to it.
+     *
+     * @param idx Index of the signature
+     */
+    void signature(Index idx)
+    {
+      RINGBUFFER_WRITE_MESSAGE(consensus::ledger_signature, to_host, idx);
+    }
+
+    /**
+     * Mark the ledger as committed up to a given index.
+     *
+     * @param idx Index of the last committed entry
+     */
+    void commit(Index idx)
+    {
+      RINGBUFFER_WRITE_MESSAGE(consensus::ledger_commit, to_host, idx);
+    }
+
+    /**
+     * Discard the ledger and start it after a given index, when the state up
+     * to that index was installed from a snapshot.
+     *
+     * @param idx Index of the snapshot
+     */
+    void init(Index idx)
+    {
+      RINGBUFFER_WRITE_MESSAGE(consensus::ledger_init, to_host, idx);
+    }
   };
 }
\ No newline at end of file
@@ -19,11 +19,27 @@ namespace consensus
     DEFINE_RINGBUFFER_MSG_TYPE(ledger_no_entry),
     ///@}
 
+    /// Request a range of log entries, to read ahead. Enclave -> Host
+    DEFINE_RINGBUFFER_MSG_TYPE(ledger_get_range),
+
+    /// Respond to ledger_get_range with a prefix of the range, empty if its
+    /// first entry is not in the log. Host -> Enclave
+    DEFINE_RINGBUFFER_MSG_TYPE(ledger_entries),
+
     ///@{
     /// Modify the local log. Enclave -> Host
     DEFINE_RINGBUFFER_MSG_TYPE(ledger_append),
     DEFINE_RINGBUFFER_MSG_TYPE(ledger_truncate),
+    DEFINE_RINGBUFFER_MSG_TYPE(ledger_signature),
+    DEFINE_RINGBUFFER_MSG_TYPE(ledger_commit),
+    DEFINE_RINGBUFFER_MSG_TYPE(ledger_init),
     ///@}
+
+    /// Report the last ledger entry that is durable. Host -> Enclave
+    DEFINE_RINGBUFFER_MSG_TYPE(ledger_durable),
+
+    /// Store a snapshot of the key-value store. Enclave -> Host
+    DEFINE_RINGBUFFER_MSG_TYPE(snapshot),
   };
 }
 
@@ -31,7 +47,25 @@ DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(consensus::ledger_get, consensus::Index);
 DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
   consensus::ledger_entry, std::vector<uint8_t>);
 DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(consensus::ledger_no_entry);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  consensus::ledger_get_range,
+  uint64_t /* token */,
+  consensus::Index /* from */,
+  consensus::Index /* to */);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  consensus::ledger_entries,
+  uint64_t /* token */,
+  consensus::Index /* from */,
+  std::vector<uint8_t> /* framed entries */);
 DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
   consensus::ledger_append, std::vector<uint8_t>);
 DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
   consensus::ledger_truncate, consensus::Index);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  consensus::ledger_signature, consensus::Index);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(consensus::ledger_commit, consensus::Index);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(consensus::ledger_init, consensus::Index);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  consensus::ledger_durable, consensus::Index);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  consensus::snapshot, consensus::Index, std::vector<uint8_t>);
@@ -16,7 +16,6 @@
 #include "ds/logger.h"
 #include "enclave/rpcmap.h"
 #include "enclave/rpcsessions.h"
-#include "host/ledger.h"
 #include "kv/kvtypes.h"
 #include "node/nodetypes.h"
 
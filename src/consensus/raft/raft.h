@@ -5,13 +5,16 @@
 #include "ds/logger.h"
 #include "ds/serialized.h"
 #include "ds/spinlock.h"
+#include "ds/tracing.h"
 #include "kv/kvtypes.h"
 #include "node/nodetypes.h"
 #include "rafttypes.h"
 
 #include <algorithm>
 #include <deque>
+#include <functional>
 #include <list>
+#include <map>
 #include <random>
 #include <unordered_map>
 #include <vector>
@@ -41,6 +44,12 @@ namespace raft
         return 0;
 
       auto it = upper_bound(terms.begin(), terms.end(), idx);
+
+      // Indices preceding the first known term (e.g. when starting from a
+      // snapshot) are unknown
+      if (it == terms.begin())
+        return 0;
+
       return (it - terms.begin()) - 1;
     }
   };
@@ -56,12 +65,40 @@ namespace raft
       Candidate
     };
 
+    struct InFlight
+    {
+      Index start_idx;
+      Index end_idx;
+      // Time at which the append entries was sent
+      std::chrono::milliseconds sent_at;
+      // Entries acknowledged by the node when the append entries was sent
+      Index delivered;
+    };
+
     struct NodeState
     {
       // the highest matching index with the node that was confirmed
       Index match_idx;
       // the highest index sent to the node
       Index sent_idx;
+
+      // Append entries sent to the node and not yet acknowledged, oldest
+      // first. Acknowledgements are cumulative, so a single response can
+      // acknowledge several of them.
+      std::deque<InFlight> in_flight = {};
+      // Total number of entries acknowledged by the node
+      Index delivered = 0;
+      // Smoothed round trip time of append entries, in milliseconds
+      double rtt = 0;
+      // Estimated replication bandwidth, in entries per millisecond
+      double bandwidth = 0;
+      // Index from which entries were last sent again after a failure, and
+      // when
+      Index resent_idx = 0;
+      std::chrono::milliseconds resent_at = {};
+      // Highest read round acknowledged by the node, as echoed in its
+      // responses to append entries of the current term
+      uint64_t read_round = 0;
     };
 
     struct Configuration
@@ -88,6 +125,8 @@ namespace raft
 
     State state;
     std::chrono::milliseconds timeout_elapsed;
+    // Time elapsed since startup, as reported by periodic()
+    std::chrono::milliseconds current_time;
 
     // Timeouts
     std::chrono::milliseconds request_timeout;
@@ -115,12 +154,40 @@ namespace raft
     // should be replicated
     std::optional<Index> recovery_max_index;
 
+    // Reads waiting for a read index from the leader, and then for the
+    // commit index to reach it, by request id
+    struct PendingRead
+    {
+      std::function<void(bool)> cb;
+      std::optional<Index> read_idx;
+      std::chrono::milliseconds sent_at;
+    };
+    uint64_t next_read_id = 0;
+    std::map<uint64_t, PendingRead> pending_reads;
+
+    // On the leader, read index requests waiting for the leadership to be
+    // confirmed. Requests received while a read round is in progress are
+    // confirmed together by the next round.
+    struct ReadIndexRequest
+    {
+      NodeId from;
+      uint64_t id;
+      Index read_idx;
+      uint64_t round;
+    };
+    std::deque<ReadIndexRequest> read_index_requests;
+    uint64_t read_round = 0;
+
     // Randomness
     std::uniform_int_distribution<int> distrib;
     std::default_random_engine rand;
 
   public:
     static constexpr size_t append_entries_size_limit = 20000;
+    // Bounds on the number of append entries in flight to each node. Within
+    // these, the window covers the measured bandwidth-delay product.
+    static constexpr size_t min_in_flight = 4;
+    static constexpr size_t max_in_flight = 256;
     std::unique_ptr<LedgerProxy> ledger;
     std::shared_ptr<ChannelProxy> channels;
 
@@ -145,6 +212,7 @@ namespace raft
 
       state(Follower),
       timeout_elapsed(0),
+      current_time(0),
 
       request_timeout(request_timeout_),
       election_timeout(election_timeout_),
@@ -255,11 +323,57 @@ namespace raft
       become_leader();
     }
 
+    void init_as_follower(Index index, Term term)
+    {
+      // This should only be called when the node has installed a snapshot of
+      // the store at index, before it has received any append entries. The
+      // ledger does not contain any entry up to and including index.
+      std::lock_guard<SpinLock> guard(lock);
+      current_term = term;
+      last_idx = index;
+      commit_idx = index;
+      term_history.update(index, term);
+      ledger->init(index);
+      become_follower(term);
+    }
+
     Index get_last_idx()
     {
       return last_idx;
     }
 
+    /** Wait until a read of the local store is linearizable
+     *
+     * The leader's commit index is fetched once the leader has confirmed,
+     * with a round of append entries acknowledged by a majority of nodes,
+     * that it is still the leader. cb is then called with true once the
+     * local commit index reaches it, or with false if any of this fails, in
+     * which case the read should be sent to the leader instead. cb is called
+     * with the Raft lock held, and must not call back into Raft.
+     *
+     * @param cb Called once the read can proceed
+     *
+     * @return false if this is not a follower with a known leader, in which
+     * case cb is never called
+     */
+    bool read_index(std::function<void(bool)> cb)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+
+      if (state != Follower || leader_id == NoNode)
+        return false;
+
+      const auto id = next_read_id++;
+      pending_reads.emplace(id, PendingRead{cb, std::nullopt, current_time});
+
+      LOG_DEBUG_FMT(
+        "Send read index {} from {} to {}", id, local_id, leader_id);
+      ReadIndex ri = {raft_read_index, local_id, current_term, id};
+      channels->send_authenticated(
+        ccf::NodeMsgType::consensus_msg, leader_id, ri);
+      return true;
+    }
+
     Index get_commit_idx()
     {
       std::lock_guard<SpinLock> guard(lock);
@@ -331,6 +445,9 @@ namespace raft
 
         last_idx = index;
         auto s = write_to_ledger(*data);
+        if (globally_committable)
+          ledger->signature(index);
+        tracing::Versions::get().record(index, tracing::Stage::Replicate);
         entry_size_not_limited += s;
         entry_count++;
 
@@ -383,6 +500,14 @@ namespace raft
           recv_request_vote_response(data, size);
           break;
 
+        case raft_read_index:
+          recv_read_index(data, size);
+          break;
+
+        case raft_read_index_response:
+          recv_read_index_response(data, size);
+          break;
+
         default:
         {}
       }
@@ -392,6 +517,7 @@ namespace raft
     {
       std::lock_guard<SpinLock> guard(lock);
       timeout_elapsed += elapsed;
+      current_time += elapsed;
 
       if (state == Leader)
       {
@@ -401,15 +527,47 @@ namespace raft
           timeout_elapsed = 0ms;
 
           update_batch_size();
-          // Send newly available entries to all nodes.
-          for (const auto& it : nodes)
+          // Send newly available entries to all nodes, as far as their window
+          // allows. If the oldest append entries in flight to a node has not
+          // been acknowledged in time, assume that it was lost and send again
+          // everything that follows the last acknowledged index.
+          for (auto& it : nodes)
           {
-            send_append_entries(it.first, it.second.sent_idx + 1);
+            auto& node = it.second;
+            if (
+              !node.in_flight.empty() &&
+              current_time - node.in_flight.front().sent_at >=
+                retransmit_timeout(node))
+            {
+              LOG_DEBUG_FMT(
+                "Append entries to {} timed out, resending from {}",
+                it.first,
+                node.match_idx + 1);
+              resend_append_entries(it.first, node);
+            }
+            else
+            {
+              send_append_entries(it.first, node.sent_idx + 1);
+            }
           }
         }
       }
       else
       {
+        // Reads that the leader did not respond to in time are given up
+        for (auto it = pending_reads.begin(); it != pending_reads.end();)
+        {
+          if (
+            !it->second.read_idx.has_value() &&
+            current_time - it->second.sent_at >= election_timeout)
+          {
+            it->second.cb(false);
+            it = pending_reads.erase(it);
+          }
+          else
+            ++it;
+        }
+
         if (timeout_elapsed >= election_timeout)
         {
           // Start an election.
@@ -443,19 +601,52 @@ namespace raft
       return term_history.term_at(idx);
     }
 
+    std::chrono::milliseconds retransmit_timeout(const NodeState& node)
+    {
+      // Leave the node enough time to respond under load, but resend before
+      // it would start an election
+      const auto rto = std::max(
+        request_timeout * 2,
+        std::chrono::milliseconds((int64_t)(node.rtt * 4)));
+      return std::min(rto, election_timeout);
+    }
+
+    size_t window_size(const NodeState& node)
+    {
+      // Keep twice the bandwidth-delay product in flight, so that the node
+      // does not go idle while waiting for the next append entries
+      const auto bdp = node.bandwidth * std::max(node.rtt, 1.0);
+      const auto window = (size_t)(2 * bdp / entries_batch_size) + 1;
+      return std::clamp(window, min_in_flight, max_in_flight);
+    }
+
+    void resend_append_entries(NodeId to, NodeState& node)
+    {
+      node.in_flight.clear();
+      node.resent_idx = node.match_idx + 1;
+      node.resent_at = current_time;
+      send_append_entries(to, node.resent_idx);
+    }
+
     void send_append_entries(NodeId to, Index start_idx)
     {
+      const auto window = window_size(nodes.at(to));
+      const auto& in_flight = nodes.at(to).in_flight;
+
       Index end_idx = (last_idx == 0) ?
         0 :
         std::min(start_idx + entries_batch_size, last_idx);
 
       for (Index i = end_idx; i < last_idx; i += entries_batch_size)
       {
+        if (in_flight.size() >= window)
+          return;
+
         send_append_entries_range(to, start_idx, i);
         start_idx = std::min(i + 1, last_idx);
       }
 
-      if (last_idx == 0 || end_idx <= last_idx)
+      if ((last_idx == 0 || end_idx <= last_idx) && in_flight.size() < window)
       {
         send_append_entries_range(to, start_idx, last_idx);
       }
@@ -482,12 +673,15 @@ namespace raft
                           current_term,
                           prev_term,
                           commit_idx,
-                          term_of_idx};
+                          term_of_idx,
+                          read_round};
 
       auto& node = nodes.at(to);
 
       // Record the most recent index we have sent to this node.
       node.sent_idx = end_idx;
+      node.in_flight.push_back(
+        {start_idx, end_idx, current_time, node.delivered});
 
       // The host will append log entries to this message when it is
       // sent to the destination node.
@@ -552,7 +746,7 @@ namespace raft
           "Recv append entries to {} from {} but our term is later",
           local_id,
           r.from_node);
-        send_append_entries_response(r.from_node, false);
+        send_append_entries_response(r.from_node, false, r.read_round);
         return;
       }
 
@@ -580,7 +774,7 @@ namespace raft
             prev_term,
             r.prev_term);
         }
-        send_append_entries_response(r.from_node, false);
+        send_append_entries_response(r.from_node, false, r.read_round);
         return;
       }
 
@@ -591,6 +785,11 @@ namespace raft
         r.idx,
         r.prev_idx);
 
+      // Entries are recorded in the ledger first, and then deserialised
+      // together so that the store can decode them concurrently
+      std::vector<std::vector<uint8_t>> entries;
+      bool suspended = false;
+
       for (Index i = r.prev_idx + 1; i <= r.idx; i++)
       {
         if (i <= last_idx)
@@ -613,7 +812,7 @@ namespace raft
             // whole batch
             LOG_INFO_FMT(
               "Replication suspended: {} > {}", i, recovery_max_index.value());
-            send_append_entries_response(r.from_node, false);
+            send_append_entries_response(r.from_node, false, r.read_round);
             return;
           }
           else
@@ -624,8 +823,8 @@ namespace raft
               "Replication suspended up to {} but deserialised up to {}",
               recovery_max_index.value(),
               i - 1);
-            send_append_entries_response(r.from_node, true);
-            return;
+            suspended = true;
+            break;
           }
         }
 
@@ -645,13 +844,25 @@ namespace raft
 
           last_idx = r.prev_idx;
           ledger->truncate(r.prev_idx);
-          send_append_entries_response(r.from_node, false);
+          send_append_entries_response(r.from_node, false, r.read_round);
           return;
         }
 
-        Term sig_term = 0;
-        auto deserialise_success =
-          store->deserialise(ret.first, public_only, &sig_term);
+        entries.push_back(std::move(ret.first));
+      }
+
+      const auto first_idx = last_idx - entries.size() + 1;
+      auto results = store->deserialise_batch(entries, public_only);
+
+      for (size_t j = 0; j < entries.size(); ++j)
+      {
+        const Index i = first_idx + j;
+
+        if (j >= results.size())
+          throw std::logic_error(
+            "Follower failed to apply log entry " + std::to_string(i));
+
+        auto [deserialise_success, sig_term] = results[j];
 
         switch (deserialise_success)
         {
@@ -663,6 +874,7 @@ namespace raft
           case kv::DeserialiseSuccess::PASS_SIGNATURE:
             LOG_DEBUG_FMT("Deserialising signature at {}", i);
             committable_indices.push_back(i);
+            ledger->signature(i);
             if (sig_term)
               term_history.update(commit_idx + 1, sig_term);
             break;
@@ -675,6 +887,12 @@ namespace raft
         }
       }
 
+      if (suspended)
+      {
+        send_append_entries_response(r.from_node, true, r.read_round);
+        return;
+      }
+
       // Update the current leader because we accepted entries.
       if (leader_id != r.from_node)
       {
@@ -682,13 +900,13 @@ namespace raft
         LOG_DEBUG_FMT("Node {} thinks leader is {}", local_id, leader_id);
       }
 
-      send_append_entries_response(r.from_node, true);
+      send_append_entries_response(r.from_node, true, r.read_round);
       commit_if_possible(r.leader_commit_idx);
 
       term_history.update(commit_idx + 1, r.term_of_idx);
     }
 
-    void send_append_entries_response(NodeId to, bool answer)
+    void send_append_entries_response(NodeId to, bool answer, uint64_t round)
     {
       LOG_DEBUG_FMT(
         "Send append entries response from {} to {} for index {}: {}",
@@ -697,8 +915,12 @@ namespace raft
         last_idx,
         answer);
 
-      AppendEntriesResponse response = {
-        raft_append_entries_response, local_id, current_term, last_idx, answer};
+      AppendEntriesResponse response = {raft_append_entries_response,
+                                        local_id,
+                                        current_term,
+                                        last_idx,
+                                        answer,
+                                        round};
 
       channels->send_authenticated(
         ccf::NodeMsgType::consensus_msg, to, response);
@@ -743,7 +965,18 @@ namespace raft
         become_follower(r.term);
         return;
       }
-      else if (current_term != r.term)
+
+      // A response in the current term shows that the node still followed
+      // this leader after receiving the append entries it responds to, even
+      // if it is stale or failed. Responses to append entries sent before a
+      // read round started do not count towards it.
+      if (current_term == r.term && r.read_round > node->second.read_round)
+      {
+        node->second.read_round = r.read_round;
+        confirm_read_indices();
+      }
+
+      if (current_term != r.term)
       {
         // Stale response, discard if success.
         // Otherwise reset sent_idx and try again.
@@ -767,16 +1000,33 @@ namespace raft
       }
 
       // Update next and match for the responding node.
-      node->second.match_idx = std::min(r.last_log_idx, last_idx);
+      auto& ns = node->second;
+      ns.match_idx = std::min(r.last_log_idx, last_idx);
 
       if (!r.success)
       {
+        // All the append entries in flight after a missing one fail. Only
+        // the first of these failures is acted upon: the others arrive
+        // within a round trip of the entries being sent again.
+        if (
+          ns.resent_idx == ns.match_idx + 1 &&
+          (current_time - ns.resent_at).count() < std::max(ns.rtt, 1.0))
+        {
+          LOG_DEBUG_FMT(
+            "Recv append entries response to {} from {}: failed, already "
+            "resent from {}",
+            local_id,
+            r.from_node,
+            ns.resent_idx);
+          return;
+        }
+
         // Failed due to log inconsistency. Reset sent_idx and try again.
         LOG_DEBUG_FMT(
           "Recv append entries response to {} from {}: failed",
           local_id,
           r.from_node);
-        send_append_entries(r.from_node, node->second.match_idx + 1);
+        resend_append_entries(r.from_node, ns);
         return;
       }
 
@@ -785,7 +1035,229 @@ namespace raft
         local_id,
         r.from_node,
         r.last_log_idx);
+      update_in_flight(ns);
       update_commit();
+      confirm_read_indices();
+
+      // Responses free up the window, so that the next entries are sent as
+      // soon as the node is ready for them rather than at the next periodic
+      // call. Partial batches are only sent if the node would otherwise be
+      // idle.
+      if (
+        state == Leader && ns.sent_idx < last_idx &&
+        (last_idx - ns.sent_idx >= entries_batch_size || ns.in_flight.empty()))
+      {
+        send_append_entries(r.from_node, ns.sent_idx + 1);
+      }
+    }
+
+    void update_in_flight(NodeState& node)
+    {
+      // Responses are cumulative: all the append entries up to the matching
+      // index have been received
+      std::optional<InFlight> last_acked;
+      while (!node.in_flight.empty() &&
+             node.in_flight.front().end_idx <= node.match_idx)
+      {
+        const auto& f = node.in_flight.front();
+        node.delivered += f.end_idx + 1 - f.start_idx;
+        last_acked = f;
+        node.in_flight.pop_front();
+      }
+
+      if (!last_acked.has_value())
+        return;
+
+      // Sample the round trip time and the rate at which entries were
+      // acknowledged while the most recent of these was in flight
+      const double rtt = (current_time - last_acked->sent_at).count();
+      node.rtt = (node.rtt == 0) ? rtt : (7 * node.rtt + rtt) / 8;
+
+      const double rate =
+        (node.delivered - last_acked->delivered) / std::max(rtt, 1.0);
+      node.bandwidth = (rate > node.bandwidth) ?
+        rate :
+        (7 * node.bandwidth + rate) / 8;
+    }
+
+    void recv_read_index(const uint8_t* data, size_t size)
+    {
+      ReadIndex r;
+
+      try
+      {
+        r = channels->template recv_authenticated<ReadIndex>(data, size);
+      }
+      catch (const std::logic_error& err)
+      {
+        LOG_FAIL_FMT(err.what());
+        return;
+      }
+
+      // The commit index is only known to be the latest once an entry of the
+      // current term has been committed
+      if (
+        state != Leader || r.term != current_term ||
+        nodes.find(r.from_node) == nodes.end() ||
+        get_term_internal(commit_idx) != current_term)
+      {
+        LOG_DEBUG_FMT(
+          "Recv read index {} to {} from {}: cannot serve it",
+          r.id,
+          local_id,
+          r.from_node);
+        send_read_index_response(r.from_node, r.id, 0, false);
+        return;
+      }
+
+      read_index_requests.push_back(
+        {r.from_node, r.id, commit_idx, read_round + 1});
+
+      if (read_index_requests.front().round > read_round)
+        start_read_round();
+    }
+
+    void start_read_round()
+    {
+      // The leadership is confirmed once a majority of nodes have
+      // acknowledged append entries sent from now on
+      read_round++;
+      LOG_DEBUG_FMT("Start read round {} on {}", read_round, local_id);
+
+      for (const auto& it : nodes)
+        send_append_entries(it.first, it.second.sent_idx + 1);
+
+      confirm_read_indices();
+    }
+
+    void confirm_read_indices()
+    {
+      if (state != Leader || read_index_requests.empty())
+        return;
+
+      auto confirmed = std::numeric_limits<uint64_t>::max();
+
+      for (auto& c : configurations)
+      {
+        // The majority must be checked separately for each active
+        // configuration.
+        std::vector<uint64_t> rounds;
+        rounds.reserve(c.nodes.size() + 1);
+
+        for (auto node : c.nodes)
+        {
+          if (node == local_id)
+            rounds.push_back(read_round);
+          else
+            rounds.push_back(nodes.at(node).read_round);
+        }
+
+        sort(rounds.begin(), rounds.end());
+        confirmed = std::min(confirmed, rounds.at((rounds.size() - 1) / 2));
+      }
+
+      while (!read_index_requests.empty() &&
+             read_index_requests.front().round <= confirmed)
+      {
+        const auto& r = read_index_requests.front();
+        send_read_index_response(r.from, r.id, r.read_idx, true);
+        read_index_requests.pop_front();
+      }
+
+      if (
+        !read_index_requests.empty() &&
+        read_index_requests.front().round > read_round)
+        start_read_round();
+    }
+
+    void send_read_index_response(
+      NodeId to, uint64_t id, Index read_idx, bool success)
+    {
+      LOG_DEBUG_FMT(
+        "Send read index response {} from {} to {}: {} ({})",
+        id,
+        local_id,
+        to,
+        read_idx,
+        success);
+
+      ReadIndexResponse response = {raft_read_index_response,
+                                    local_id,
+                                    current_term,
+                                    id,
+                                    read_idx,
+                                    success};
+
+      channels->send_authenticated(
+        ccf::NodeMsgType::consensus_msg, to, response);
+    }
+
+    void recv_read_index_response(const uint8_t* data, size_t size)
+    {
+      ReadIndexResponse r;
+
+      try
+      {
+        r = channels->template recv_authenticated<ReadIndexResponse>(
+          data, size);
+      }
+      catch (const std::logic_error& err)
+      {
+        LOG_FAIL_FMT(err.what());
+        return;
+      }
+
+      auto read = pending_reads.find(r.id);
+      if (read == pending_reads.end())
+        return;
+
+      if (!r.success || r.term != current_term || r.from_node != leader_id)
+      {
+        LOG_DEBUG_FMT(
+          "Recv read index response {} to {} from {}: failed",
+          r.id,
+          local_id,
+          r.from_node);
+        auto cb = std::move(read->second.cb);
+        pending_reads.erase(read);
+        cb(false);
+        return;
+      }
+
+      LOG_DEBUG_FMT(
+        "Recv read index response {} to {} from {}: {}",
+        r.id,
+        local_id,
+        r.from_node,
+        r.read_idx);
+      read->second.read_idx = r.read_idx;
+      complete_reads();
+    }
+
+    void complete_reads()
+    {
+      for (auto it = pending_reads.begin(); it != pending_reads.end();)
+      {
+        const auto& read_idx = it->second.read_idx;
+        if (read_idx.has_value() && read_idx.value() <= commit_idx)
+        {
+          it->second.cb(true);
+          it = pending_reads.erase(it);
+        }
+        else
+          ++it;
+      }
+    }
+
+    void abort_reads()
+    {
+      for (auto& it : pending_reads)
+        it.second.cb(false);
+      pending_reads.clear();
+
+      for (const auto& r : read_index_requests)
+        send_read_index_response(r.from, r.id, 0, false);
+      read_index_requests.clear();
     }
 
     void send_request_vote(NodeId to)
@@ -976,6 +1448,7 @@ namespace raft
 
     void become_candidate()
     {
+      abort_reads();
       state = Candidate;
       leader_id = NoNode;
       voted_for = local_id;
@@ -1002,6 +1475,7 @@ namespace raft
       }
 
       committable_indices.clear();
+      abort_reads();
       state = Leader;
       leader_id = local_id;
 
@@ -1024,6 +1498,7 @@ namespace raft
       {
         it->second.match_idx = 0;
         it->second.sent_idx = next - 1;
+        it->second.in_flight.clear();
 
         // Send an empty append_entries to all nodes.
         send_append_entries(it->first, next);
@@ -1032,6 +1507,7 @@ namespace raft
 
     void become_follower(Term term)
     {
+      abort_reads();
       state = Follower;
       leader_id = NoNode;
       restart_election_timeout();
@@ -1133,11 +1609,15 @@ namespace raft
         return;
 
       commit_idx = idx;
+      tracing::Versions::get().global_commit(idx);
 
       LOG_DEBUG_FMT("Compacting...");
       store->compact(idx);
+      ledger->commit(idx);
       LOG_DEBUG_FMT("Commit on {}: {}", local_id, idx);
 
+      complete_reads();
+
       // Examine all configurations that are followed by a globally committed
       // configuration.
       bool changed = false;
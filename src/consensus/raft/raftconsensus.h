@@ -49,6 +49,11 @@ namespace raft
       raft->force_become_leader(seqno, view, terms, commit_seqno);
     }
 
+    void init_as_backup(SeqNo seqno, View view) override
+    {
+      raft->init_as_follower(seqno, view);
+    }
+
     bool replicate(const kv::BatchVector& entries) override
     {
       return raft->replicate(entries);
@@ -74,6 +79,11 @@ namespace raft
       return raft->leader();
     }
 
+    bool read_index(std::function<void(bool)> cb) override
+    {
+      return raft->read_index(cb);
+    }
+
     void recv_message(OArray&& data) override
     {
       return raft->recv_message(data.data(), data.size());
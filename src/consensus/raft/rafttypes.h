@@ -8,6 +8,7 @@
 #include <chrono>
 #include <cstdint>
 #include <limits>
+#include <vector>
 
 namespace raft
 {
@@ -29,12 +30,42 @@ namespace raft
       Term* term = nullptr) = 0;
     virtual void compact(Index v) = 0;
     virtual void rollback(Index v) = 0;
+
+    /** Deserialise consecutive entries, as deserialise would one after the
+     * other, stopping after the first one that fails
+     *
+     * Implementations may decode the entries concurrently, as long as they
+     * are applied in order.
+     *
+     * @param entries Entries to deserialise, which may be moved from
+     * @param public_only If true, only public maps are deserialised
+     *
+     * @return The result of deserialising each entry, and the term of the
+     * signature it contains if any
+     */
+    virtual std::vector<std::pair<S, Term>> deserialise_batch(
+      std::vector<std::vector<uint8_t>>& entries, bool public_only = false)
+    {
+      std::vector<std::pair<S, Term>> results;
+      results.reserve(entries.size());
+
+      for (const auto& entry : entries)
+      {
+        Term term = 0;
+        auto success = deserialise(entry, public_only, &term);
+        results.emplace_back(success, term);
+        if (success == S::FAILED)
+          break;
+      }
+
+      return results;
+    }
   };
 
   template <typename T, typename S>
   class Adaptor : public Store<S>
   {
-  private:
+  protected:
     std::weak_ptr<T> x;
 
   public:
@@ -73,6 +104,8 @@ namespace raft
     raft_append_entries_response,
     raft_request_vote,
     raft_request_vote_response,
+    raft_read_index,
+    raft_read_index_response,
   };
 
 #pragma pack(push, 1)
@@ -89,6 +122,8 @@ namespace raft
     Term prev_term;
     Index leader_commit_idx;
     Term term_of_idx;
+    // Read round in progress on the leader when this was sent
+    uint64_t read_round;
   };
 
   struct AppendEntriesResponse : RaftHeader
@@ -96,6 +131,8 @@ namespace raft
     Term term;
     Index last_log_idx;
     bool success;
+    // Read round of the append entries this responds to
+    uint64_t read_round;
   };
 
   struct RequestVote : RaftHeader
@@ -114,5 +151,22 @@ namespace raft
     Term term;
     bool vote_granted;
   };
+
+  struct ReadIndex : RaftHeader
+  {
+    Term term;
+    // Identifies the request on the requesting node
+    uint64_t id;
+  };
+
+  struct ReadIndexResponse : RaftHeader
+  {
+    Term term;
+    uint64_t id;
+    // Commit index of the leader when the request was received, confirmed
+    // by a majority of nodes since
+    Index read_idx;
+    bool success;
+  };
 #pragma pack(pop)
 }
\ No newline at end of file
@@ -64,6 +64,22 @@ namespace raft
 #endif
     }
 
+    void signature(Index idx) {}
+
+    void commit(Index idx) {}
+
+    void init(Index idx)
+    {
+      // Entries up to idx are not available, but keep ledger[i - 1] as the
+      // entry at index i
+      ledger.clear();
+      ledger.resize(idx);
+#ifdef STUB_LOG
+      std::cout << "  KV" << _id << "->>Node" << _id << ": init i: " << idx
+                << std::endl;
+#endif
+    }
+
     void reset_skip_count()
     {
       skip_count = 0;
@@ -80,6 +96,8 @@ namespace raft
       sent_request_vote_response;
     std::list<std::pair<NodeId, AppendEntriesResponse>>
       sent_append_entries_response;
+    std::list<std::pair<NodeId, ReadIndex>> sent_read_index;
+    std::list<std::pair<NodeId, ReadIndexResponse>> sent_read_index_response;
 
     ChannelStubProxy() {}
 
@@ -111,10 +129,25 @@ namespace raft
       sent_append_entries_response.push_back(std::make_pair(to, data));
     }
 
+    void send_authenticated(
+      const ccf::NodeMsgType& msg_type, NodeId to, const ReadIndex& data)
+    {
+      sent_read_index.push_back(std::make_pair(to, data));
+    }
+
+    void send_authenticated(
+      const ccf::NodeMsgType& msg_type,
+      NodeId to,
+      const ReadIndexResponse& data)
+    {
+      sent_read_index_response.push_back(std::make_pair(to, data));
+    }
+
     size_t sent_msg_count() const
     {
       return sent_request_vote.size() + sent_request_vote_response.size() +
-        sent_append_entries.size() + sent_append_entries_response.size();
+        sent_append_entries.size() + sent_append_entries_response.size() +
+        sent_read_index.size() + sent_read_index_response.size();
     }
 
     template <class T>
@@ -378,6 +378,189 @@ DOCTEST_TEST_CASE(
       }));
 }
 
+DOCTEST_TEST_CASE("Read index" * doctest::test_suite("multiple"))
+{
+  auto kv_store0 = std::make_shared<StoreSig>(0);
+  auto kv_store1 = std::make_shared<StoreSig>(1);
+  auto kv_store2 = std::make_shared<StoreSig>(2);
+
+  raft::NodeId node_id0(0);
+  raft::NodeId node_id1(1);
+  raft::NodeId node_id2(2);
+
+  ms request_timeout(10);
+
+  TRaft r0(
+    std::make_unique<Adaptor>(kv_store0),
+    std::make_unique<raft::LedgerStubProxy>(node_id0),
+    std::make_shared<raft::ChannelStubProxy>(),
+    node_id0,
+    request_timeout,
+    ms(20));
+  TRaft r1(
+    std::make_unique<Adaptor>(kv_store1),
+    std::make_unique<raft::LedgerStubProxy>(node_id1),
+    std::make_shared<raft::ChannelStubProxy>(),
+    node_id1,
+    request_timeout,
+    ms(100));
+  TRaft r2(
+    std::make_unique<Adaptor>(kv_store2),
+    std::make_unique<raft::LedgerStubProxy>(node_id2),
+    std::make_shared<raft::ChannelStubProxy>(),
+    node_id2,
+    request_timeout,
+    ms(50));
+
+  std::unordered_set<raft::NodeId> config = {node_id0, node_id1, node_id2};
+  r0.add_configuration(0, config);
+  r1.add_configuration(0, config);
+  r2.add_configuration(0, config);
+
+  map<raft::NodeId, TRaft*> nodes;
+  nodes[node_id0] = &r0;
+  nodes[node_id1] = &r1;
+  nodes[node_id2] = &r2;
+
+  DOCTEST_INFO("A node without a leader cannot read");
+  DOCTEST_REQUIRE_FALSE(r1.read_index([](bool) {}));
+
+  r0.periodic(std::chrono::milliseconds(200));
+  DOCTEST_REQUIRE(2 == dispatch_all(nodes, r0.channels->sent_request_vote));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r1.channels->sent_request_vote_response));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r2.channels->sent_request_vote_response));
+  DOCTEST_REQUIRE(2 == dispatch_all(nodes, r0.channels->sent_append_entries));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r1.channels->sent_append_entries_response));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r2.channels->sent_append_entries_response));
+
+  DOCTEST_INFO("The leader is a node that cannot read through a read index");
+  DOCTEST_REQUIRE_FALSE(r0.read_index([](bool) {}));
+
+  DOCTEST_INFO("No read index until an entry is committed in the new term");
+  {
+    std::optional<bool> result;
+    DOCTEST_REQUIRE(r1.read_index([&result](bool ok) { result = ok; }));
+    DOCTEST_REQUIRE(1 == dispatch_all(nodes, r1.channels->sent_read_index));
+    DOCTEST_REQUIRE(r0.channels->sent_append_entries.size() == 0);
+    DOCTEST_REQUIRE(
+      1 ==
+      dispatch_all_and_DOCTEST_CHECK(
+        nodes, r0.channels->sent_read_index_response, [](const auto& msg) {
+          DOCTEST_REQUIRE(!msg.success);
+        }));
+    DOCTEST_REQUIRE(result == false);
+  }
+
+  std::vector<uint8_t> entry = {1, 2, 3};
+  auto data = std::make_shared<std::vector<uint8_t>>(entry);
+  DOCTEST_REQUIRE(r0.replicate(kv::BatchVector{{1, data, true}}));
+  r0.periodic(request_timeout);
+  DOCTEST_REQUIRE(2 == dispatch_all(nodes, r0.channels->sent_append_entries));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r1.channels->sent_append_entries_response));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r2.channels->sent_append_entries_response));
+  DOCTEST_REQUIRE(r0.get_commit_idx() == 1);
+  DOCTEST_REQUIRE(r1.get_commit_idx() == 0);
+
+  DOCTEST_INFO("The leadership is confirmed by a majority before responding");
+  std::optional<bool> result1;
+  std::optional<bool> result2;
+  {
+    DOCTEST_REQUIRE(r1.read_index([&result1](bool ok) { result1 = ok; }));
+    DOCTEST_REQUIRE(1 == dispatch_all(nodes, r1.channels->sent_read_index));
+    DOCTEST_REQUIRE(r0.channels->sent_read_index_response.size() == 0);
+    DOCTEST_REQUIRE(r0.channels->sent_append_entries.size() == 2);
+
+    // Requests received during a read round wait for the next one
+    DOCTEST_REQUIRE(r2.read_index([&result2](bool ok) { result2 = ok; }));
+    DOCTEST_REQUIRE(1 == dispatch_all(nodes, r2.channels->sent_read_index));
+    DOCTEST_REQUIRE(r0.channels->sent_read_index_response.size() == 0);
+    DOCTEST_REQUIRE(r0.channels->sent_append_entries.size() == 2);
+
+    DOCTEST_REQUIRE(2 == dispatch_all(nodes, r0.channels->sent_append_entries));
+    DOCTEST_REQUIRE(
+      1 == dispatch_all(nodes, r1.channels->sent_append_entries_response));
+    DOCTEST_REQUIRE(r0.channels->sent_read_index_response.size() == 1);
+    DOCTEST_REQUIRE(r0.channels->sent_append_entries.size() == 2);
+  }
+
+  DOCTEST_INFO("The read proceeds once the commit index reaches the index");
+  {
+    DOCTEST_REQUIRE(
+      1 ==
+      dispatch_all_and_DOCTEST_CHECK(
+        nodes, r0.channels->sent_read_index_response, [](const auto& msg) {
+          DOCTEST_REQUIRE(msg.success);
+          DOCTEST_REQUIRE(msg.read_idx == 1);
+        }));
+    DOCTEST_REQUIRE(r1.get_commit_idx() == 1);
+    DOCTEST_REQUIRE(result1 == true);
+  }
+
+  DOCTEST_INFO("The next read round confirms the queued request");
+  {
+    DOCTEST_REQUIRE(2 == dispatch_all(nodes, r0.channels->sent_append_entries));
+    DOCTEST_REQUIRE(
+      2 == dispatch_all(nodes, r2.channels->sent_append_entries_response));
+    DOCTEST_REQUIRE(
+      1 == dispatch_all(nodes, r0.channels->sent_read_index_response));
+    DOCTEST_REQUIRE(result2 == true);
+  }
+
+  DOCTEST_INFO("Acks to append entries sent before a round do not confirm it");
+  {
+    dispatch_all(nodes, r1.channels->sent_append_entries_response);
+    DOCTEST_REQUIRE(r0.channels->sent_msg_count() == 0);
+
+    DOCTEST_REQUIRE(r0.replicate(kv::BatchVector{{2, data, true}}));
+    r0.periodic(request_timeout);
+    DOCTEST_REQUIRE(2 == dispatch_all(nodes, r0.channels->sent_append_entries));
+
+    // The round's append entries end at the same index as those acked below.
+    // The read index is the commit index when the request is received.
+    std::optional<bool> result;
+    DOCTEST_REQUIRE(r1.read_index([&result](bool ok) { result = ok; }));
+    DOCTEST_REQUIRE(1 == dispatch_all(nodes, r1.channels->sent_read_index));
+    DOCTEST_REQUIRE(r0.channels->sent_append_entries.size() == 2);
+
+    DOCTEST_REQUIRE(
+      1 ==
+      dispatch_all_and_DOCTEST_CHECK(
+        nodes, r1.channels->sent_append_entries_response, [](const auto& msg) {
+          DOCTEST_REQUIRE(msg.last_log_idx == 2);
+        }));
+    DOCTEST_REQUIRE(
+      1 == dispatch_all(nodes, r2.channels->sent_append_entries_response));
+    DOCTEST_REQUIRE(r0.get_commit_idx() == 2);
+    DOCTEST_REQUIRE(r0.channels->sent_read_index_response.size() == 0);
+
+    DOCTEST_REQUIRE(2 == dispatch_all(nodes, r0.channels->sent_append_entries));
+    DOCTEST_REQUIRE(
+      1 == dispatch_all(nodes, r1.channels->sent_append_entries_response));
+    DOCTEST_REQUIRE(
+      1 ==
+      dispatch_all_and_DOCTEST_CHECK(
+        nodes, r0.channels->sent_read_index_response, [](const auto& msg) {
+          DOCTEST_REQUIRE(msg.success);
+          DOCTEST_REQUIRE(msg.read_idx == 1);
+        }));
+    DOCTEST_REQUIRE(result == true);
+  }
+
+  DOCTEST_INFO("Pending reads fail when the leader changes");
+  {
+    std::optional<bool> result;
+    DOCTEST_REQUIRE(r1.read_index([&result](bool ok) { result = ok; }));
+    r1.periodic(std::chrono::milliseconds(1000));
+    DOCTEST_REQUIRE(result == false);
+  }
+}
+
 DOCTEST_TEST_CASE("Multiple nodes late join" * doctest::test_suite("multiple"))
 {
   auto kv_store0 = std::make_shared<Store>(0);
@@ -760,17 +943,137 @@ DOCTEST_TEST_CASE("Exceed append entries limit")
   r2.channels->sent_append_entries_response.pop_front();
   r0.recv_message(reinterpret_cast<uint8_t*>(&aer), sizeof(aer));
 
-  DOCTEST_REQUIRE(
-    (r0.channels->sent_append_entries.size() > num_small_entries_sent &&
-     r0.channels->sent_append_entries.size() <=
-       num_small_entries_sent + num_big_entries));
-  auto sent_entries = dispatch_all(nodes, r0.channels->sent_append_entries);
+  // Node 0 only keeps a window of append entries in flight to Node 2, and
+  // sends the next ones as Node 2 responds
+  size_t sent_entries = 0;
+  while (r0.channels->sent_append_entries.size() > 0)
+  {
+    DOCTEST_REQUIRE(
+      r0.channels->sent_append_entries.size() <= r0.max_in_flight);
+    sent_entries += dispatch_all(nodes, r0.channels->sent_append_entries);
+    dispatch_all(nodes, r2.channels->sent_append_entries_response);
+  }
   DOCTEST_REQUIRE(
     (sent_entries > num_small_entries_sent &&
      sent_entries <= num_small_entries_sent + num_big_entries));
   DOCTEST_REQUIRE(r2.ledger->ledger.size() == individual_entries);
 }
 
+DOCTEST_TEST_CASE("Append entries in flight are bounded by a window")
+{
+  auto kv_store0 = std::make_shared<Store>(0);
+  auto kv_store1 = std::make_shared<Store>(1);
+
+  raft::NodeId node_id0(0);
+  raft::NodeId node_id1(1);
+
+  ms request_timeout(10);
+
+  TRaft r0(
+    std::make_unique<Adaptor>(kv_store0),
+    std::make_unique<raft::LedgerStubProxy>(node_id0),
+    std::make_shared<raft::ChannelStubProxy>(),
+    node_id0,
+    request_timeout,
+    ms(100));
+  TRaft r1(
+    std::make_unique<Adaptor>(kv_store1),
+    std::make_unique<raft::LedgerStubProxy>(node_id1),
+    std::make_shared<raft::ChannelStubProxy>(),
+    node_id1,
+    request_timeout,
+    ms(1000));
+
+  std::unordered_set<raft::NodeId> config0 = {node_id0, node_id1};
+  r0.add_configuration(0, config0);
+  r1.add_configuration(0, config0);
+
+  map<raft::NodeId, TRaft*> nodes;
+  nodes[node_id0] = &r0;
+  nodes[node_id1] = &r1;
+
+  r0.periodic(std::chrono::milliseconds(200));
+
+  DOCTEST_REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_request_vote));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r1.channels->sent_request_vote_response));
+  DOCTEST_REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_append_entries));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r1.channels->sent_append_entries_response));
+
+  // Each entry fills a whole append entries
+  auto data =
+    std::make_shared<std::vector<uint8_t>>(r0.append_entries_size_limit, 1);
+  const size_t num_entries = 10;
+
+  DOCTEST_INFO("Only a window of append entries is sent without responses");
+  {
+    for (size_t i = 1; i <= num_entries; ++i)
+      DOCTEST_REQUIRE(r0.replicate(kv::BatchVector{{i, data, true}}));
+
+    DOCTEST_REQUIRE(
+      r0.channels->sent_append_entries.size() == r0.min_in_flight);
+    DOCTEST_REQUIRE(
+      r0.min_in_flight ==
+      dispatch_all(nodes, r0.channels->sent_append_entries));
+  }
+
+  DOCTEST_INFO("A single response acknowledges all append entries in flight");
+  {
+    DOCTEST_REQUIRE(
+      r1.channels->sent_append_entries_response.size() == r0.min_in_flight);
+    auto aer = r1.channels->sent_append_entries_response.back().second;
+    r1.channels->sent_append_entries_response.clear();
+    DOCTEST_REQUIRE(aer.last_log_idx == r0.min_in_flight);
+    r0.recv_message(reinterpret_cast<uint8_t*>(&aer), sizeof(aer));
+
+    // The measured bandwidth opens the window beyond its minimum, so that
+    // all remaining entries are sent straight away
+    DOCTEST_REQUIRE(
+      r0.channels->sent_append_entries.size() > r0.min_in_flight);
+    DOCTEST_REQUIRE(
+      r0.channels->sent_append_entries.back().second.idx == num_entries);
+  }
+
+  DOCTEST_INFO("Failures caused by the same lost append entries resend once");
+  {
+    r0.channels->sent_append_entries.pop_front();
+    const auto failed = dispatch_all(nodes, r0.channels->sent_append_entries);
+    DOCTEST_REQUIRE(
+      failed ==
+      dispatch_all_and_DOCTEST_CHECK(
+        nodes, r1.channels->sent_append_entries_response, [](const auto& msg) {
+          DOCTEST_REQUIRE(!msg.success);
+          DOCTEST_REQUIRE(msg.last_log_idx == TRaft::min_in_flight);
+        }));
+
+    raft::Index prev_idx = r0.min_in_flight;
+    dispatch_all_and_DOCTEST_CHECK(
+      nodes, r0.channels->sent_append_entries, [&prev_idx](const auto& msg) {
+        DOCTEST_REQUIRE(msg.prev_idx == prev_idx);
+        prev_idx = msg.idx;
+      });
+    DOCTEST_REQUIRE(prev_idx == num_entries);
+    DOCTEST_REQUIRE(r1.ledger->ledger.size() == num_entries);
+  }
+
+  DOCTEST_INFO("Lost append entries are resent after a timeout");
+  {
+    r1.channels->sent_append_entries_response.clear();
+
+    // Entries are still in flight, so only a heartbeat is sent
+    r0.periodic(request_timeout);
+    DOCTEST_REQUIRE(r0.channels->sent_append_entries.size() == 1);
+    r0.channels->sent_append_entries.clear();
+
+    r0.periodic(request_timeout);
+    DOCTEST_REQUIRE(r0.channels->sent_append_entries.size() > 0);
+    DOCTEST_REQUIRE(
+      r0.channels->sent_append_entries.front().second.prev_idx ==
+      r0.min_in_flight);
+  }
+}
+
 // Reproduces issue described here: https://github.com/microsoft/CCF/issues/521
 // Once this is fixed test will need to be modified since right now it
 // DOCTEST_CHECKs that the issue stands
@@ -2,11 +2,17 @@
 // Licensed under the Apache 2.0 License.
 #include "hash.h"
 
+#include <cstring>
 #include <mbedtls/sha256.h>
 #include <stdexcept>
 
+#if defined(__x86_64__)
+#  include <immintrin.h>
+#endif
+
 extern "C"
 {
+#include <evercrypt/EverCrypt_AutoConfig2.h>
 #include <evercrypt/EverCrypt_Hash.h>
 }
 
@@ -51,4 +57,228 @@ crypto::Sha256Hash::Sha256Hash() : h{0} {}
 crypto::Sha256Hash::Sha256Hash(initializer_list<CBuffer> il) : h{0}
 {
   evercrypt_sha256(il, h.data());
-}
\ No newline at end of file
+}
+#if defined(__x86_64__)
+namespace
+{
+  constexpr uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+  constexpr uint32_t sha256_h0[8] = {0x6a09e667,
+                                     0xbb67ae85,
+                                     0x3c6ef372,
+                                     0xa54ff53a,
+                                     0x510e527f,
+                                     0x9b05688c,
+                                     0x1f83d9ab,
+                                     0x5be0cd19};
+
+  constexpr size_t block_size = 64;
+
+  // Number of blocks in the padded message: at least one byte of padding
+  // and the 8 byte length must follow the message
+  size_t padded_blocks(size_t size)
+  {
+    return (size + 1 + 8 + block_size - 1) / block_size;
+  }
+
+  // Write block b of the padded message into block.
+  //
+  // evercrypt_sha256 passes the start of the input to
+  // EverCrypt_Hash_update_last, which hashes it as the trailing partial
+  // block. That block is taken from the start of the input here too, so that
+  // digests (and so Merkle leaves) do not depend on how they were computed.
+  void padded_block(const CBuffer& m, size_t b, uint8_t* block)
+  {
+    const size_t offset = b * block_size;
+    const size_t full_blocks_size = m.n - (m.n % block_size);
+    size_t n = 0;
+    if (offset < m.n)
+    {
+      n = std::min(block_size, m.n - offset);
+      const auto src = offset < full_blocks_size ?
+        m.p + offset :
+        m.p + (offset - full_blocks_size);
+      memcpy(block, src, n);
+    }
+    memset(block + n, 0, block_size - n);
+
+    if (offset + n == m.n && n < block_size)
+      block[n] = 0x80;
+
+    if (b == padded_blocks(m.n) - 1)
+    {
+      const uint64_t bits = static_cast<uint64_t>(m.n) * 8;
+      for (size_t i = 0; i < 8; ++i)
+        block[block_size - 1 - i] = static_cast<uint8_t>(bits >> (8 * i));
+    }
+  }
+}
+
+#  define ROTR(x, n) \
+    _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#  define XOR3(a, b, c) _mm256_xor_si256(_mm256_xor_si256(a, b), c)
+#  define ADD(a, b) _mm256_add_epi32(a, b)
+
+__attribute__((target("avx2"))) void crypto::Sha256Hash::avx2_sha256(
+  const CBuffer* inputs, size_t n, Sha256Hash* hs)
+{
+  if (n > AVX2_LANES)
+    throw std::logic_error("Too many inputs for avx2_sha256");
+
+  // Lanes past n hash an empty message, and are ignored
+  const CBuffer* msgs[AVX2_LANES];
+  alignas(32) uint32_t blocks[AVX2_LANES];
+  size_t max_blocks = 0;
+  for (size_t l = 0; l < AVX2_LANES; ++l)
+  {
+    msgs[l] = l < n ? &inputs[l] : &nullb;
+    blocks[l] = padded_blocks(msgs[l]->n);
+    max_blocks = std::max<size_t>(max_blocks, blocks[l]);
+  }
+  const __m256i lane_blocks =
+    _mm256_load_si256(reinterpret_cast<const __m256i*>(blocks));
+
+  __m256i state[8];
+  for (size_t i = 0; i < 8; ++i)
+    state[i] = _mm256_set1_epi32(sha256_h0[i]);
+
+  uint8_t block[block_size];
+  alignas(32) uint32_t words[16][AVX2_LANES];
+
+  for (size_t b = 0; b < max_blocks; ++b)
+  {
+    // Transpose the big-endian words of each lane's block
+    for (size_t l = 0; l < AVX2_LANES; ++l)
+    {
+      if (b < blocks[l])
+        padded_block(*msgs[l], b, block);
+      else
+        memset(block, 0, block_size);
+
+      for (size_t t = 0; t < 16; ++t)
+      {
+        words[t][l] = (uint32_t)block[4 * t] << 24 |
+          (uint32_t)block[4 * t + 1] << 16 | (uint32_t)block[4 * t + 2] << 8 |
+          (uint32_t)block[4 * t + 3];
+      }
+    }
+
+    __m256i w[64];
+    for (size_t t = 0; t < 16; ++t)
+      w[t] = _mm256_load_si256(reinterpret_cast<const __m256i*>(words[t]));
+
+    for (size_t t = 16; t < 64; ++t)
+    {
+      const auto s0 = XOR3(
+        ROTR(w[t - 15], 7),
+        ROTR(w[t - 15], 18),
+        _mm256_srli_epi32(w[t - 15], 3));
+      const auto s1 = XOR3(
+        ROTR(w[t - 2], 17),
+        ROTR(w[t - 2], 19),
+        _mm256_srli_epi32(w[t - 2], 10));
+      w[t] = ADD(ADD(w[t - 16], s0), ADD(w[t - 7], s1));
+    }
+
+    auto a = state[0], b_ = state[1], c = state[2], d = state[3],
+         e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (size_t t = 0; t < 64; ++t)
+    {
+      const auto S1 = XOR3(ROTR(e, 6), ROTR(e, 11), ROTR(e, 25));
+      const auto ch =
+        _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+      const auto t1 = ADD(
+        ADD(ADD(h, S1), ADD(ch, _mm256_set1_epi32(sha256_k[t]))), w[t]);
+      const auto S0 = XOR3(ROTR(a, 2), ROTR(a, 13), ROTR(a, 22));
+      const auto maj = XOR3(
+        _mm256_and_si256(a, b_),
+        _mm256_and_si256(a, c),
+        _mm256_and_si256(b_, c));
+      const auto t2 = ADD(S0, maj);
+
+      h = g;
+      g = f;
+      f = e;
+      e = ADD(d, t1);
+      d = c;
+      c = b_;
+      b_ = a;
+      a = ADD(t1, t2);
+    }
+
+    // Only update the lanes whose message has a block b
+    const __m256i active =
+      _mm256_cmpgt_epi32(lane_blocks, _mm256_set1_epi32(b));
+    const __m256i next[8] = {a, b_, c, d, e, f, g, h};
+    for (size_t i = 0; i < 8; ++i)
+    {
+      state[i] =
+        _mm256_blendv_epi8(state[i], ADD(state[i], next[i]), active);
+    }
+  }
+
+  alignas(32) uint32_t out[8][AVX2_LANES];
+  for (size_t i = 0; i < 8; ++i)
+    _mm256_store_si256(reinterpret_cast<__m256i*>(out[i]), state[i]);
+
+  for (size_t l = 0; l < n; ++l)
+  {
+    for (size_t i = 0; i < 8; ++i)
+    {
+      hs[l].h[4 * i] = static_cast<uint8_t>(out[i][l] >> 24);
+      hs[l].h[4 * i + 1] = static_cast<uint8_t>(out[i][l] >> 16);
+      hs[l].h[4 * i + 2] = static_cast<uint8_t>(out[i][l] >> 8);
+      hs[l].h[4 * i + 3] = static_cast<uint8_t>(out[i][l]);
+    }
+  }
+}
+
+#  undef ROTR
+#  undef XOR3
+#  undef ADD
+#else
+void crypto::Sha256Hash::avx2_sha256(const CBuffer*, size_t, Sha256Hash*)
+{
+  throw std::logic_error("avx2_sha256 is not supported on this platform");
+}
+#endif
+
+vector<crypto::Sha256Hash> crypto::Sha256Hash::batch(
+  const vector<CBuffer>& inputs)
+{
+  vector<Sha256Hash> hs(inputs.size());
+
+#if defined(__x86_64__)
+  // The SHA extensions hash a single input faster than AVX2 lanes do
+  if (
+    inputs.size() > 1 && !EverCrypt_AutoConfig2_has_shaext() &&
+    EverCrypt_AutoConfig2_has_avx2())
+  {
+    for (size_t i = 0; i < inputs.size(); i += AVX2_LANES)
+    {
+      avx2_sha256(
+        inputs.data() + i,
+        std::min(AVX2_LANES, inputs.size() - i),
+        hs.data() + i);
+    }
+    return hs;
+  }
+#endif
+
+  for (size_t i = 0; i < inputs.size(); ++i)
+    evercrypt_sha256({inputs[i]}, hs[i].h.data());
+
+  return hs;
+}
@@ -8,6 +8,7 @@
 #include <fmt/format.h>
 #include <msgpack-c/msgpack.hpp>
 #include <ostream>
+#include <vector>
 
 namespace crypto
 {
@@ -23,6 +24,22 @@ namespace crypto
     static void mbedtls_sha256(std::initializer_list<CBuffer> il, uint8_t* h);
     static void evercrypt_sha256(std::initializer_list<CBuffer> il, uint8_t* h);
 
+    /** Number of inputs hashed at once by avx2_sha256
+     */
+    static constexpr size_t AVX2_LANES = 8;
+
+    /** Hash up to AVX2_LANES inputs at once, in the lanes of AVX2
+     * registers. Must only be called if the CPU supports AVX2.
+     */
+    static void avx2_sha256(const CBuffer* inputs, size_t n, Sha256Hash* hs);
+
+    /** Hash each of the inputs, as Sha256Hash({input}) would
+     *
+     * Each input is hashed with the SHA extensions if the CPU has them.
+     * Otherwise, if it supports AVX2, inputs are hashed AVX2_LANES at a time.
+     */
+    static std::vector<Sha256Hash> batch(const std::vector<CBuffer>& inputs);
+
     friend std::ostream& operator<<(
       std::ostream& os, const crypto::Sha256Hash& h)
     {
@@ -7,12 +7,38 @@
 #include "error.h"
 #include "tls/error_string.h"
 
+#include <cstring>
 #include <mbedtls/aes.h>
 #include <mbedtls/error.h>
 #include <mbedtls/gcm.h>
 
+extern "C"
+{
+#include <evercrypt/EverCrypt_AutoConfig2.h>
+#include <evercrypt/EverCrypt_Vale.h>
+}
+
 namespace crypto
 {
+  // AES-256 has 15 round keys, AES-128 11
+  static constexpr size_t ROUND_KEYS_SIZE = 15 * 16;
+
+  static size_t pad(size_t n)
+  {
+    return (n + GCM_SIZE_PADDING - 1) / GCM_SIZE_PADDING * GCM_SIZE_PADDING;
+  }
+
+  // EverCrypt reads and writes the last block of each buffer whole. Buffers
+  // that do not end on a block boundary, and are not known to be padded, are
+  // copied to this thread's scratch space first.
+  static std::vector<uint8_t>& scratch(size_t size)
+  {
+    static thread_local std::vector<uint8_t> s;
+    if (s.size() < size)
+      s.resize(size);
+    return s;
+  }
+
   KeyAesGcm::KeyAesGcm(CBuffer rawKey)
   {
     for (uint32_t i = 0; i < ctxs.size(); ++i)
@@ -48,9 +74,27 @@ namespace crypto
         throw std::logic_error(tls::error_string(rc));
       }
     }
+
+    const auto n_bits = rawKey.rawSize() * 8;
+    if (
+      (n_bits >= 256 || (n_bits >= 128 && n_bits < 192)) &&
+      EverCrypt_AutoConfig2_has_aesni() &&
+      EverCrypt_AutoConfig2_has_pclmulqdq() && EverCrypt_AutoConfig2_has_avx())
+    {
+      aes256 = n_bits >= 256;
+      round_keys.resize(ROUND_KEYS_SIZE);
+      if (aes256)
+        old_aes256_key_expansion(
+          const_cast<uint8_t*>(rawKey.p), round_keys.data());
+      else
+        old_aes128_key_expansion(
+          const_cast<uint8_t*>(rawKey.p), round_keys.data());
+    }
   }
 
-  KeyAesGcm::KeyAesGcm(KeyAesGcm&& that)
+  KeyAesGcm::KeyAesGcm(KeyAesGcm&& that) :
+    round_keys(std::move(that.round_keys)),
+    aes256(that.aes256)
   {
     ctxs = that.ctxs;
 
@@ -72,6 +116,67 @@ namespace crypto
     }
   }
 
+  void KeyAesGcm::evercrypt_encrypt(
+    CBuffer iv,
+    const uint8_t* plain,
+    size_t size,
+    CBuffer aad,
+    uint8_t* cipher,
+    uint8_t tag[GCM_SIZE_TAG]) const
+  {
+    uint8_t iv_block[GCM_SIZE_PADDING] = {};
+    memcpy(iv_block, iv.p, GCM_SIZE_IV);
+
+    gcm_args args{const_cast<uint8_t*>(plain),
+                  size,
+                  const_cast<uint8_t*>(aad.p),
+                  aad.n,
+                  iv_block,
+                  const_cast<uint8_t*>(round_keys.data()),
+                  cipher,
+                  tag};
+
+    if (aes256)
+      old_gcm256_encrypt(&args);
+    else
+      old_gcm128_encrypt(&args);
+  }
+
+  bool KeyAesGcm::evercrypt_decrypt(
+    CBuffer iv,
+    const uint8_t tag[GCM_SIZE_TAG],
+    const uint8_t* cipher,
+    size_t size,
+    CBuffer aad,
+    uint8_t* plain) const
+  {
+    uint8_t iv_block[GCM_SIZE_PADDING] = {};
+    memcpy(iv_block, iv.p, GCM_SIZE_IV);
+
+    // Decryption must not be in place, as the tag is computed as the
+    // plaintext is written
+    gcm_args args{const_cast<uint8_t*>(cipher),
+                  size,
+                  const_cast<uint8_t*>(aad.p),
+                  aad.n,
+                  iv_block,
+                  const_cast<uint8_t*>(round_keys.data()),
+                  plain,
+                  const_cast<uint8_t*>(tag)};
+
+    const auto rc = aes256 ? old_gcm256_decrypt(&args) :
+                             old_gcm128_decrypt(&args);
+    if (rc != 0)
+    {
+      // As with mbedtls, the unauthenticated plaintext is not returned
+      if (size > 0)
+        memset(plain, 0, size);
+      return false;
+    }
+
+    return true;
+  }
+
   void KeyAesGcm::encrypt(
     CBuffer iv,
     CBuffer plain,
@@ -79,6 +184,35 @@ namespace crypto
     uint8_t* cipher,
     uint8_t tag[GCM_SIZE_TAG]) const
   {
+    if (use_evercrypt(iv))
+    {
+      const auto plain_size = plain.n % GCM_SIZE_PADDING ? pad(plain.n) : 0;
+      const auto aad_size = aad.n % GCM_SIZE_PADDING ? pad(aad.n) : 0;
+      if (plain_size == 0 && aad_size == 0)
+      {
+        evercrypt_encrypt(iv, plain.p, plain.n, aad, cipher, tag);
+        return;
+      }
+
+      auto& s = scratch(plain_size + aad_size);
+      if (aad_size != 0)
+      {
+        memcpy(s.data() + plain_size, aad.p, aad.n);
+        aad.p = s.data() + plain_size;
+      }
+
+      if (plain_size == 0)
+      {
+        evercrypt_encrypt(iv, plain.p, plain.n, aad, cipher, tag);
+        return;
+      }
+
+      memcpy(s.data(), plain.p, plain.n);
+      evercrypt_encrypt(iv, s.data(), plain.n, aad, s.data(), tag);
+      memcpy(cipher, s.data(), plain.n);
+      return;
+    }
+
     auto ctx = ctxs[thread_ids[std::this_thread::get_id()]];
     int rc = mbedtls_gcm_crypt_and_tag(
       ctx,
@@ -99,6 +233,18 @@ namespace crypto
     }
   }
 
+  void KeyAesGcm::encrypt_in_place(
+    CBuffer iv, Buffer data, CBuffer aad, uint8_t tag[GCM_SIZE_TAG]) const
+  {
+    if (use_evercrypt(iv))
+    {
+      evercrypt_encrypt(iv, data.p, data.n, aad, data.p, tag);
+      return;
+    }
+
+    encrypt(iv, data, aad, data.p, tag);
+  }
+
   bool KeyAesGcm::decrypt(
     CBuffer iv,
     const uint8_t tag[GCM_SIZE_TAG],
@@ -106,6 +252,40 @@ namespace crypto
     CBuffer aad,
     uint8_t* plain) const
   {
+    if (use_evercrypt(iv))
+    {
+      // The plaintext is written to scratch space if it would overwrite the
+      // ciphertext, or if its last block is partial
+      const auto cipher_size =
+        cipher.n % GCM_SIZE_PADDING || cipher.p == plain ? pad(cipher.n) : 0;
+      const auto plain_size = cipher.n % GCM_SIZE_PADDING ? pad(cipher.n) : 0;
+      const auto aad_size = aad.n % GCM_SIZE_PADDING ? pad(aad.n) : 0;
+      if (cipher_size == 0 && aad_size == 0)
+        return evercrypt_decrypt(iv, tag, cipher.p, cipher.n, aad, plain);
+
+      auto& s = scratch(cipher_size + plain_size + aad_size);
+      if (aad_size != 0)
+      {
+        memcpy(s.data() + cipher_size + plain_size, aad.p, aad.n);
+        aad.p = s.data() + cipher_size + plain_size;
+      }
+
+      auto in = cipher.p;
+      if (cipher_size != 0)
+      {
+        memcpy(s.data(), cipher.p, cipher.n);
+        in = s.data();
+      }
+
+      if (plain_size == 0)
+        return evercrypt_decrypt(iv, tag, in, cipher.n, aad, plain);
+
+      auto out = s.data() + cipher_size;
+      auto ret = evercrypt_decrypt(iv, tag, in, cipher.n, aad, out);
+      memcpy(plain, out, cipher.n);
+      return ret;
+    }
+
     auto ctx = ctxs[thread_ids[std::this_thread::get_id()]];
     return !mbedtls_gcm_auth_decrypt(
       ctx,
@@ -12,6 +12,9 @@ namespace crypto
   constexpr size_t GCM_SIZE_KEY = 32;
   constexpr size_t GCM_SIZE_TAG = 16;
   constexpr size_t GCM_SIZE_IV = 12;
+  // The hardware-accelerated implementation of AES-GCM reads and writes the
+  // last block of its buffers whole, past their end if it is partial
+  constexpr size_t GCM_SIZE_PADDING = 16;
 
   template <size_t SIZE_IV = GCM_SIZE_IV>
   struct GcmHeader
@@ -117,6 +120,33 @@ namespace crypto
       array<mbedtls_gcm_context*, enclave::ThreadMessaging::max_num_threads>
         ctxs;
 
+    // Round keys for EverCrypt's AES-GCM, which uses AES-NI and PCLMULQDQ.
+    // Empty if the CPU does not support them or the key is 192 bits long, in
+    // which case mbedtls is used instead. EverCrypt only supports 12 byte IVs.
+    std::vector<uint8_t> round_keys;
+    bool aes256 = false;
+
+    bool use_evercrypt(CBuffer iv) const
+    {
+      return !round_keys.empty() && iv.n == GCM_SIZE_IV;
+    }
+
+    void evercrypt_encrypt(
+      CBuffer iv,
+      const uint8_t* plain,
+      size_t size,
+      CBuffer aad,
+      uint8_t* cipher,
+      uint8_t tag[GCM_SIZE_TAG]) const;
+
+    bool evercrypt_decrypt(
+      CBuffer iv,
+      const uint8_t tag[GCM_SIZE_TAG],
+      const uint8_t* cipher,
+      size_t size,
+      CBuffer aad,
+      uint8_t* plain) const;
+
   public:
     KeyAesGcm(CBuffer rawKey);
     KeyAesGcm(const KeyAesGcm& that) = delete;
@@ -130,6 +160,14 @@ namespace crypto
       uint8_t* cipher,
       uint8_t tag[GCM_SIZE_TAG]) const;
 
+    /** Encrypt data in place, without copying it
+     *
+     * data and aad must each be followed by at least GCM_SIZE_PADDING bytes
+     * owned by the caller. Those after data may be overwritten.
+     */
+    void encrypt_in_place(
+      CBuffer iv, Buffer data, CBuffer aad, uint8_t tag[GCM_SIZE_TAG]) const;
+
     bool decrypt(
       CBuffer iv,
       const uint8_t tag[GCM_SIZE_TAG],
@@ -11,6 +11,11 @@
 #include <mbedtls/pem.h>
 #include <vector>
 
+extern "C"
+{
+#include <evercrypt/EverCrypt_AutoConfig2.h>
+}
+
 using namespace crypto;
 using namespace std;
 
@@ -76,6 +81,109 @@ TEST_CASE("EverCrypt SHA256 no-collision check")
   REQUIRE(h1 != h2);
 }
 
+TEST_CASE("SHA256 batch consistency test")
+{
+  ::EverCrypt_AutoConfig2_init();
+
+  // Sizes around block boundaries, for more inputs than there are AVX2 lanes
+  std::vector<std::vector<uint8_t>> data;
+  for (size_t size : {0, 1, 55, 56, 63, 64, 65, 119, 128, 1000, 4097})
+  {
+    std::vector<uint8_t> d(size);
+    for (unsigned i = 0; i < size; i++)
+      d[i] = i + size;
+    data.push_back(d);
+  }
+
+  std::vector<CBuffer> inputs(data.begin(), data.end());
+  auto hs = crypto::Sha256Hash::batch(inputs);
+  REQUIRE(hs.size() == inputs.size());
+  for (size_t i = 0; i < inputs.size(); i++)
+    REQUIRE(hs[i] == crypto::Sha256Hash({inputs[i]}));
+
+  if (EverCrypt_AutoConfig2_has_avx2())
+  {
+    for (size_t i = 0; i < inputs.size(); i += Sha256Hash::AVX2_LANES)
+    {
+      const auto n = std::min(Sha256Hash::AVX2_LANES, inputs.size() - i);
+      std::vector<crypto::Sha256Hash> avx2_hs(n);
+      crypto::Sha256Hash::avx2_sha256(inputs.data() + i, n, avx2_hs.data());
+      for (size_t j = 0; j < n; j++)
+        REQUIRE(avx2_hs[j] == crypto::Sha256Hash({inputs[i + j]}));
+    }
+  }
+}
+
+TEST_CASE("AES-GCM EverCrypt and mbedtls consistency")
+{
+  ::EverCrypt_AutoConfig2_init();
+
+  for (size_t key_size : {16, 32})
+  {
+    const std::vector<uint8_t> raw_key(key_size, '$');
+    KeyAesGcm k(raw_key);
+    // Without AES-NI, keys are backed by mbedtls
+    EverCrypt_AutoConfig2_disable_aesni();
+    KeyAesGcm k_mbedtls(raw_key);
+    ::EverCrypt_AutoConfig2_init();
+
+    // Sizes around block boundaries, for the plaintext and additional data
+    for (size_t size : {0, 1, 15, 16, 17, 100, 1024, 1025})
+    {
+      for (size_t aad_size : {0, 1, 16, 33})
+      {
+        std::vector<uint8_t> plain(size), aad(aad_size);
+        for (unsigned i = 0; i < size; i++)
+          plain[i] = i + size;
+        for (unsigned i = 0; i < aad_size; i++)
+          aad[i] = i * 3;
+
+        GcmHeader<> h;
+        h.set_iv_seq(size * 100 + aad_size);
+        GcmHeader<> h_mbedtls = h;
+
+        std::vector<uint8_t> cipher(size), cipher_mbedtls(size);
+        k.encrypt(h.get_iv(), plain, aad, cipher.data(), h.tag);
+        k_mbedtls.encrypt(
+          h.get_iv(), plain, aad, cipher_mbedtls.data(), h_mbedtls.tag);
+        REQUIRE(cipher == cipher_mbedtls);
+        REQUIRE(memcmp(h.tag, h_mbedtls.tag, GCM_SIZE_TAG) == 0);
+
+        // In place, in buffers followed by padding
+        std::vector<uint8_t> data(size + GCM_SIZE_PADDING);
+        std::copy(plain.begin(), plain.end(), data.begin());
+        std::vector<uint8_t> padded_aad(aad_size + GCM_SIZE_PADDING);
+        std::copy(aad.begin(), aad.end(), padded_aad.begin());
+        GcmHeader<> h_in_place = h;
+        k.encrypt_in_place(
+          h.get_iv(),
+          {data.data(), size},
+          {padded_aad.data(), aad_size},
+          h_in_place.tag);
+        data.resize(size);
+        REQUIRE(data == cipher);
+        REQUIRE(memcmp(h.tag, h_in_place.tag, GCM_SIZE_TAG) == 0);
+
+        std::vector<uint8_t> decrypted(size);
+        REQUIRE(k.decrypt(
+          h.get_iv(), h.tag, cipher_mbedtls, aad, decrypted.data()));
+        REQUIRE(decrypted == plain);
+        REQUIRE(k_mbedtls.decrypt(
+          h.get_iv(), h.tag, cipher, aad, decrypted.data()));
+        REQUIRE(decrypted == plain);
+        REQUIRE(k.decrypt(h.get_iv(), h.tag, data, aad, data.data()));
+        REQUIRE(data == plain);
+
+        h.tag[0]++;
+        REQUIRE_FALSE(
+          k.decrypt(h.get_iv(), h.tag, cipher, aad, decrypted.data()));
+        REQUIRE_FALSE(
+          k_mbedtls.decrypt(h.get_iv(), h.tag, cipher, aad, decrypted.data()));
+      }
+    }
+  }
+}
+
 TEST_CASE("Public key encryption")
 {
   std::string plaintext = "This is a plaintext message to encrypt";
@@ -3,8 +3,14 @@
 #pragma once
 
 #include <array>
-#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <new>
 #include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace champ
@@ -13,6 +19,12 @@ namespace champ
   // from 'Fast and Lean Immutable Multi-Maps on the JVM based on Heterogeneous
   // Hash-Array Mapped Tries' by Michael J. Steindorfer and Jurgen J. Vinju
   // (https://arxiv.org/pdf/1608.01036.pdf).
+  //
+  // Nodes are intrusively reference counted and allocated from per-thread
+  // pools. Each node is a single allocation holding its bitmaps, its entries
+  // and pointers to its sub-nodes. Small, trivially copyable entries are
+  // stored inline in the node, larger ones are boxed and shared between
+  // versions of the map.
 
   static constexpr size_t index_mask_bits = 5;
   static constexpr size_t index_mask = (1 << index_mask_bits) - 1;
@@ -67,10 +79,126 @@ namespace champ
     {
       return (_bits & ((uint32_t)1 << idx)) != 0;
     }
+
+    // Number of bits set below idx
+    constexpr SmallIndex pop_below(SmallIndex idx) const
+    {
+      return Bitmap(_bits & ~((uint32_t)-1 << idx)).pop();
+    }
+  };
+
+  // Reference counting policies. A map that is only ever copied and released
+  // by a single thread at a time can use plain counters. Maps whose versions
+  // are shared between threads (such as the kv::Map states read by
+  // transactions on worker threads) must use atomic counters.
+  struct SingleThreaded
+  {
+    using Count = uint32_t;
+
+    static void acquire(Count& c)
+    {
+      ++c;
+    }
+
+    // Returns true if this was the last reference
+    static bool release(Count& c)
+    {
+      return --c == 0;
+    }
   };
 
-  template <class K, class V, class H>
-  struct SubNodes;
+  struct ThreadSafe
+  {
+    using Count = std::atomic<uint32_t>;
+
+    static void acquire(Count& c)
+    {
+      c.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static bool release(Count& c)
+    {
+      return c.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+  };
+
+  // Size-classed free lists of node-sized blocks. Each thread has its own
+  // pool, so allocation and deallocation never synchronise. A block released
+  // on a different thread than the one that allocated it simply joins the
+  // releasing thread's pool. The pool is trivially destructible so that it
+  // stays usable while static maps are destroyed; the blocks it holds when a
+  // thread exits are not returned to the system, which is bounded by
+  // max_free_blocks per size class.
+  class NodePool
+  {
+  public:
+    static constexpr size_t granularity = 16;
+    static constexpr size_t max_block_size = 1024;
+    static constexpr size_t max_free_blocks = 256;
+
+  private:
+    struct FreeBlock
+    {
+      FreeBlock* next;
+    };
+
+    struct FreeList
+    {
+      FreeBlock* head = nullptr;
+      size_t count = 0;
+    };
+
+    std::array<FreeList, max_block_size / granularity> free_lists;
+
+    static size_t size_class(size_t size)
+    {
+      return (size - 1) / granularity;
+    }
+
+    static NodePool& local()
+    {
+      static thread_local NodePool pool;
+      return pool;
+    }
+
+  public:
+    static void* allocate(size_t size)
+    {
+      if (size > max_block_size)
+        return ::operator new(size);
+
+      auto& list = local().free_lists[size_class(size)];
+      if (list.head == nullptr)
+        return ::operator new((size_class(size) + 1) * granularity);
+
+      auto block = list.head;
+      list.head = block->next;
+      list.count--;
+      return block;
+    }
+
+    static void deallocate(void* p, size_t size)
+    {
+      if (size > max_block_size)
+      {
+        ::operator delete(p);
+        return;
+      }
+
+      auto& list = local().free_lists[size_class(size)];
+      if (list.count >= max_free_blocks)
+      {
+        ::operator delete(p);
+        return;
+      }
+
+      auto block = static_cast<FreeBlock*>(p);
+      block->next = list.head;
+      list.head = block;
+      list.count++;
+    }
+  };
+  static_assert(std::is_trivially_destructible_v<NodePool>);
 
   template <class K, class V>
   struct Entry
@@ -78,7 +206,7 @@ namespace champ
     K key;
     V value;
 
-    Entry(K k, V v) : key(k), value(v) {}
+    Entry(const K& k, const V& v) : key(k), value(v) {}
 
     const V* getp(const K& k) const
     {
@@ -89,41 +217,199 @@ namespace champ
     }
   };
 
-  template <class K, class V, class H>
-  using Node = std::shared_ptr<void>;
+  static constexpr size_t max_inline_entry_size = 32;
+
+  template <class K, class V>
+  static constexpr bool inline_entry = std::is_trivially_copyable_v<K> &&
+    std::is_trivially_copyable_v<V> &&
+    sizeof(Entry<K, V>) <= max_inline_entry_size;
+
+  // An entry slot in a node. Inline slots hold the entry itself, so that
+  // lookups don't chase a pointer and copying a node copies the entries.
+  template <class K, class V, class R, bool Inline = inline_entry<K, V>>
+  class Slot
+  {
+    Entry<K, V> entry;
+
+  public:
+    Slot(const K& k, const V& v) : entry(k, v) {}
+
+    const Entry<K, V>& get() const
+    {
+      return entry;
+    }
+  };
+
+  // Boxed slots share a single reference counted entry between all the
+  // nodes (and versions of the map) that contain it.
+  template <class K, class V, class R>
+  class Slot<K, V, R, false>
+  {
+    struct Box
+    {
+      typename R::Count rc;
+      Entry<K, V> entry;
+
+      Box(const K& k, const V& v) : rc(1), entry(k, v) {}
+    };
+
+    Box* box;
+
+  public:
+    Slot(const K& k, const V& v)
+    {
+      auto p = NodePool::allocate(sizeof(Box));
+      try
+      {
+        box = new (p) Box(k, v);
+      }
+      catch (...)
+      {
+        NodePool::deallocate(p, sizeof(Box));
+        throw;
+      }
+    }
+
+    Slot(const Slot& that) : box(that.box)
+    {
+      R::acquire(box->rc);
+    }
+
+    Slot(Slot&& that) noexcept : box(that.box)
+    {
+      that.box = nullptr;
+    }
+
+    Slot& operator=(Slot that) noexcept
+    {
+      std::swap(box, that.box);
+      return *this;
+    }
+
+    ~Slot()
+    {
+      if (box != nullptr && R::release(box->rc))
+      {
+        box->~Box();
+        NodePool::deallocate(box, sizeof(Box));
+      }
+    }
 
-  template <class K, class V, class H>
+    const Entry<K, V>& get() const
+    {
+      return box->entry;
+    }
+  };
+
+  template <class K, class V, class H, class R>
   struct Collisions
   {
-    std::array<std::vector<std::shared_ptr<Entry<K, V>>>, collision_bins> bins;
+    using Slot = champ::Slot<K, V, R>;
+
+    mutable typename R::Count rc;
+    std::array<std::vector<Slot>, collision_bins> bins;
+
+    Collisions() : rc(1) {}
+
+    Collisions(const Collisions& that) : rc(1), bins(that.bins) {}
+
+    static Collisions* create()
+    {
+      return create_from(Collisions());
+    }
+
+    static Collisions* create_from(const Collisions& that)
+    {
+      auto p = NodePool::allocate(sizeof(Collisions));
+      try
+      {
+        return new (p) Collisions(that);
+      }
+      catch (...)
+      {
+        NodePool::deallocate(p, sizeof(Collisions));
+        throw;
+      }
+    }
+
+    static void acquire(const Collisions* c)
+    {
+      R::acquire(c->rc);
+    }
+
+    static void release(const Collisions* c)
+    {
+      auto n = const_cast<Collisions*>(c);
+      if (R::release(n->rc))
+      {
+        n->~Collisions();
+        NodePool::deallocate(n, sizeof(Collisions));
+      }
+    }
 
     const V* getp(Hash hash, const K& k) const
     {
       const auto idx = mask(hash, collision_depth);
       const auto& bin = bins[idx];
-      for (const auto& node : bin)
+      for (const auto& slot : bin)
       {
-        if (k == node->key)
-          return &node->value;
+        if (k == slot.get().key)
+          return &slot.get().value;
       }
       return nullptr;
     }
 
-    bool put_mut(Hash hash, const K& k, const V& v)
+    // Returns a new node with k set to v, and whether k was inserted
+    std::pair<Collisions*, bool> put(Hash hash, const K& k, const V& v) const
     {
-      const auto idx = mask(hash, collision_depth);
-      auto& bin = bins[idx];
-      for (size_t i = 0; i < bin.size(); ++i)
+      auto c = create_from(*this);
+      auto& bin = c->bins[mask(hash, collision_depth)];
+      for (auto it = bin.begin(); it != bin.end(); ++it)
       {
-        const auto& entry = bin[i];
-        if (k == entry->key)
+        if (k == it->get().key)
         {
-          bin[i] = std::make_shared<Entry<K, V>>(k, v);
-          return false;
+          bin.erase(it);
+          bin.emplace_back(k, v);
+          return std::make_pair(c, false);
         }
       }
-      bin.push_back(std::make_shared<Entry<K, V>>(k, v));
-      return true;
+      bin.emplace_back(k, v);
+      return std::make_pair(c, true);
+    }
+
+    // Returns a new node without k, which must be present
+    Collisions* remove(Hash hash, const K& k) const
+    {
+      auto c = create_from(*this);
+      auto& bin = c->bins[mask(hash, collision_depth)];
+      for (auto it = bin.begin(); it != bin.end(); ++it)
+      {
+        if (k == it->get().key)
+        {
+          bin.erase(it);
+          break;
+        }
+      }
+      return c;
+    }
+
+    size_t size() const
+    {
+      size_t n = 0;
+      for (const auto& bin : bins)
+        n += bin.size();
+      return n;
+    }
+
+    // Only valid if there is at least one entry
+    const Slot& first() const
+    {
+      for (const auto& bin : bins)
+      {
+        if (!bin.empty())
+          return bin.front();
+      }
+      throw std::logic_error("No entry in collision node");
     }
 
     template <class F>
@@ -131,193 +417,508 @@ namespace champ
     {
       for (const auto& bin : bins)
       {
-        for (const auto& entry : bin)
-          if (!f(entry->key, entry->value))
+        for (const auto& slot : bin)
+          if (!f(slot.get().key, slot.get().value))
             return false;
       }
       return true;
     }
   };
 
-  template <class K, class V, class H>
-  struct SubNodes
+  // A trie node. Nodes are immutable once built: every update builds new
+  // nodes along the path to the updated key, and shares the rest. A node is
+  // a single block laid out as the node itself, then one slot per bit set in
+  // data_map, then one pointer per bit set in node_map. Sub-nodes at
+  // collision_depth are Collisions, all others are SubNodes.
+  template <class K, class V, class H, class R>
+  class SubNodes
   {
-    std::vector<Node<K, V, H>> nodes;
-    Bitmap node_map;
-    Bitmap data_map;
+  public:
+    using Slot = champ::Slot<K, V, R>;
+    using Coll = Collisions<K, V, H, R>;
 
-    SubNodes() {}
+  private:
+    static_assert(alignof(Slot) <= NodePool::granularity);
 
-    SubNodes(std::vector<Node<K, V, H>> ns) : nodes(ns) {}
+    mutable typename R::Count rc;
+    const Bitmap node_map;
+    const Bitmap data_map;
+    const SmallIndex depth;
 
-    SubNodes(std::vector<Node<K, V, H>> ns, Bitmap nm, Bitmap dm) :
-      nodes(ns),
+    SubNodes(SmallIndex depth_, Bitmap nm, Bitmap dm) :
+      rc(1),
       node_map(nm),
-      data_map(dm)
+      data_map(dm),
+      depth(depth_)
     {}
 
-    SmallIndex compressed_idx(SmallIndex idx) const
+    static constexpr size_t align_up(size_t n, size_t a)
     {
-      if (!node_map.check(idx) && !data_map.check(idx))
-        return (SmallIndex)-1;
+      return (n + a - 1) / a * a;
+    }
 
-      const auto mask = Bitmap(~((uint32_t)-1 << idx));
-      if (data_map.check(idx))
-        return (data_map & mask).pop();
+    static constexpr size_t slots_offset()
+    {
+      return align_up(sizeof(SubNodes), alignof(Slot));
+    }
 
-      return data_map.pop() + (node_map & mask).pop();
+    static constexpr size_t children_offset(size_t slots)
+    {
+      return align_up(slots_offset() + slots * sizeof(Slot), alignof(void*));
     }
 
-    const V* getp(SmallIndex depth, Hash hash, const K& k) const
+    static constexpr size_t block_size(size_t slots, size_t children)
     {
-      const auto idx = mask(hash, depth);
-      const auto c_idx = compressed_idx(idx);
+      return children_offset(slots) + children * sizeof(void*);
+    }
 
-      if (c_idx == (SmallIndex)-1)
-        return nullptr;
+    size_t block_size() const
+    {
+      return block_size(data_map.pop(), node_map.pop());
+    }
 
-      if (data_map.check(idx))
-        return node_as<Entry<K, V>>(c_idx)->getp(k);
+    const Slot* slots() const
+    {
+      return reinterpret_cast<const Slot*>(
+        reinterpret_cast<const uint8_t*>(this) + slots_offset());
+    }
 
-      if (depth == (collision_depth - 1))
-        return node_as<Collisions<K, V, H>>(c_idx)->getp(hash, k);
+    const void* const* children() const
+    {
+      return reinterpret_cast<const void* const*>(
+        reinterpret_cast<const uint8_t*>(this) +
+        children_offset(data_map.pop()));
+    }
 
-      return node_as<SubNodes<K, V, H>>(c_idx)->getp(depth + 1, hash, k);
+    bool has_sub_nodes() const
+    {
+      return depth < (collision_depth - 1);
     }
 
-    bool put_mut(SmallIndex depth, Hash hash, const K& k, const V& v)
+    const SubNodes* child_node(SmallIndex i) const
     {
-      const auto idx = mask(hash, depth);
-      auto c_idx = compressed_idx(idx);
+      return static_cast<const SubNodes*>(children()[i]);
+    }
+
+    const Coll* child_collisions(SmallIndex i) const
+    {
+      return static_cast<const Coll*>(children()[i]);
+    }
 
-      if (c_idx == (SmallIndex)-1)
+    void acquire_child(const void* c) const
+    {
+      if (has_sub_nodes())
+        acquire(static_cast<const SubNodes*>(c));
+      else
+        Coll::acquire(static_cast<const Coll*>(c));
+    }
+
+    void release_child(const void* c) const
+    {
+      if (has_sub_nodes())
+        release(static_cast<const SubNodes*>(c));
+      else
+        Coll::release(static_cast<const Coll*>(c));
+    }
+
+    // Builds a new node. make_slot(dst, i) must construct the i-th slot in
+    // place, and make_child(i) must return an owned reference to the i-th
+    // child.
+    template <class FS, class FC>
+    static SubNodes* create(
+      SmallIndex depth, Bitmap nm, Bitmap dm, FS&& make_slot, FC&& make_child)
+    {
+      const auto n_slots = dm.pop();
+      const auto n_children = nm.pop();
+      const auto size = block_size(n_slots, n_children);
+
+      auto p = NodePool::allocate(size);
+      auto node = new (p) SubNodes(depth, nm, dm);
+
+      auto s = const_cast<Slot*>(node->slots());
+      SmallIndex i = 0;
+      try
       {
-        data_map = data_map.set(idx);
-        c_idx = compressed_idx(idx);
-        nodes.insert(
-          nodes.begin() + c_idx, std::make_shared<Entry<K, V>>(k, v));
-        return true;
+        for (; i < n_slots; ++i)
+          make_slot(s + i, i);
+      }
+      catch (...)
+      {
+        while (i > 0)
+          s[--i].~Slot();
+        node->~SubNodes();
+        NodePool::deallocate(p, size);
+        throw;
       }
 
+      auto c = reinterpret_cast<const void**>(
+        static_cast<uint8_t*>(p) + children_offset(n_slots));
+      for (SmallIndex j = 0; j < n_children; ++j)
+        c[j] = make_child(j);
+
+      return node;
+    }
+
+    // Returns a new node, at depth, holding two entries with different keys
+    static const void* create_pair(
+      SmallIndex depth,
+      const Slot& s0,
+      Hash h0,
+      const K& k1,
+      const V& v1,
+      Hash h1)
+    {
+      if (depth == collision_depth)
+      {
+        auto c = Coll::create();
+        c->bins[mask(h0, collision_depth)].push_back(s0);
+        c->bins[mask(h1, collision_depth)].emplace_back(k1, v1);
+        return c;
+      }
+
+      const auto idx0 = mask(h0, depth);
+      const auto idx1 = mask(h1, depth);
+
+      if (idx0 == idx1)
+      {
+        auto child = create_pair(depth + 1, s0, h0, k1, v1, h1);
+        return create(
+          depth,
+          Bitmap().set(idx0),
+          Bitmap(),
+          [](Slot*, SmallIndex) {},
+          [child](SmallIndex) { return child; });
+      }
+
+      return create(
+        depth,
+        Bitmap(),
+        Bitmap().set(idx0).set(idx1),
+        [&](Slot* dst, SmallIndex i) {
+          if ((i == 0) == (idx0 < idx1))
+            new (dst) Slot(s0);
+          else
+            new (dst) Slot(k1, v1);
+        },
+        [](SmallIndex) { return nullptr; });
+    }
+
+  public:
+    SubNodes(const SubNodes&) = delete;
+    SubNodes& operator=(const SubNodes&) = delete;
+
+    ~SubNodes()
+    {
+      const auto n_slots = data_map.pop();
+      auto s = const_cast<Slot*>(slots());
+      for (SmallIndex i = 0; i < n_slots; ++i)
+        s[i].~Slot();
+
+      const auto n_children = node_map.pop();
+      const auto kids = children();
+      for (SmallIndex i = 0; i < n_children; ++i)
+        release_child(kids[i]);
+    }
+
+    static SubNodes* create_empty()
+    {
+      return create(
+        0,
+        Bitmap(),
+        Bitmap(),
+        [](Slot*, SmallIndex) {},
+        [](SmallIndex) { return nullptr; });
+    }
+
+    static void acquire(const SubNodes* n)
+    {
+      R::acquire(n->rc);
+    }
+
+    static void release(const SubNodes* n)
+    {
+      if (R::release(n->rc))
+      {
+        const auto size = n->block_size();
+        auto p = const_cast<SubNodes*>(n);
+        p->~SubNodes();
+        NodePool::deallocate(p, size);
+      }
+    }
+
+    const V* getp(Hash hash, const K& k) const
+    {
+      const auto idx = mask(hash, depth);
+
+      if (data_map.check(idx))
+        return slots()[data_map.pop_below(idx)].get().getp(k);
+
+      if (!node_map.check(idx))
+        return nullptr;
+
+      const auto c_idx = node_map.pop_below(idx);
+      if (has_sub_nodes())
+        return child_node(c_idx)->getp(hash, k);
+
+      return child_collisions(c_idx)->getp(hash, k);
+    }
+
+    // Returns a new node with k set to v, and whether k was inserted
+    std::pair<SubNodes*, bool> put(Hash hash, const K& k, const V& v) const
+    {
+      const auto idx = mask(hash, depth);
+      const auto s_idx = data_map.pop_below(idx);
+      const auto c_idx = node_map.pop_below(idx);
+      const auto kids = children();
+      const auto copy_child = [this, kids](SmallIndex i) {
+        acquire_child(kids[i]);
+        return kids[i];
+      };
+
       if (node_map.check(idx))
       {
-        bool insert;
-        if (depth < (collision_depth - 1))
-        {
-          auto sn = *node_as<SubNodes<K, V, H>>(c_idx);
-          insert = sn.put_mut(depth + 1, hash, k, v);
-          nodes[c_idx] = std::make_shared<SubNodes<K, V, H>>(std::move(sn));
-        }
+        const void* child;
+        bool inserted;
+        if (has_sub_nodes())
+          std::tie(child, inserted) = child_node(c_idx)->put(hash, k, v);
         else
-        {
-          auto sn = *node_as<Collisions<K, V, H>>(c_idx);
-          insert = sn.put_mut(hash, k, v);
-          nodes[c_idx] = std::make_shared<Collisions<K, V, H>>(std::move(sn));
-        }
-        return insert;
+          std::tie(child, inserted) = child_collisions(c_idx)->put(hash, k, v);
+
+        auto node = create(
+          depth,
+          node_map,
+          data_map,
+          [this](Slot* dst, SmallIndex i) { new (dst) Slot(slots()[i]); },
+          [&](SmallIndex i) { return i == c_idx ? child : copy_child(i); });
+        return std::make_pair(node, inserted);
       }
 
-      const auto& entry0 = node_as<Entry<K, V>>(c_idx);
-      if (k == entry0->key)
+      if (!data_map.check(idx))
       {
-        nodes[c_idx] = std::make_shared<Entry<K, V>>(k, v);
-        return false;
+        auto node = create(
+          depth,
+          node_map,
+          data_map.set(idx),
+          [&](Slot* dst, SmallIndex i) {
+            if (i < s_idx)
+              new (dst) Slot(slots()[i]);
+            else if (i == s_idx)
+              new (dst) Slot(k, v);
+            else
+              new (dst) Slot(slots()[i - 1]);
+          },
+          copy_child);
+        return std::make_pair(node, true);
       }
 
-      if (depth < (collision_depth - 1))
+      const auto& slot0 = slots()[s_idx];
+      if (k == slot0.get().key)
       {
-        const auto hash0 = H()(entry0->key);
-        const auto idx0 = mask(hash0, depth + 1);
-        auto sub_node =
-          SubNodes<K, V, H>({entry0}, Bitmap(0), Bitmap(0).set(idx0));
-        sub_node.put_mut(depth + 1, hash, k, v);
-
-        nodes.erase(nodes.begin() + c_idx);
-        data_map = data_map.clear(idx);
-        node_map = node_map.set(idx);
-        c_idx = compressed_idx(idx);
-        nodes.insert(
-          nodes.begin() + c_idx,
-          std::make_shared<SubNodes<K, V, H>>(std::move(sub_node)));
+        auto node = create(
+          depth,
+          node_map,
+          data_map,
+          [&](Slot* dst, SmallIndex i) {
+            if (i == s_idx)
+              new (dst) Slot(k, v);
+            else
+              new (dst) Slot(slots()[i]);
+          },
+          copy_child);
+        return std::make_pair(node, false);
+      }
+
+      // Both entries move to a new sub-node
+      const auto child = create_pair(
+        depth + 1, slot0, H()(slot0.get().key), k, v, hash);
+      auto node = create(
+        depth,
+        node_map.set(idx),
+        data_map.clear(idx),
+        [&](Slot* dst, SmallIndex i) {
+          new (dst) Slot(slots()[i < s_idx ? i : i + 1]);
+        },
+        [&](SmallIndex i) {
+          if (i < c_idx)
+            return copy_child(i);
+          else if (i == c_idx)
+            return child;
+          else
+            return copy_child(i - 1);
+        });
+      return std::make_pair(node, true);
+    }
+
+    // Returns a new node without k, which must be present. If a sub-node is
+    // left with a single entry, the entry is moved into this node so that the
+    // trie stays compact, and lookups and iteration don't go through chains
+    // of single-entry nodes.
+    SubNodes* remove(Hash hash, const K& k) const
+    {
+      const auto idx = mask(hash, depth);
+      const auto s_idx = data_map.pop_below(idx);
+      const auto c_idx = node_map.pop_below(idx);
+      const auto kids = children();
+      const auto copy_child = [this, kids](SmallIndex i) {
+        acquire_child(kids[i]);
+        return kids[i];
+      };
+
+      if (data_map.check(idx))
+      {
+        return create(
+          depth,
+          node_map,
+          data_map.clear(idx),
+          [&](Slot* dst, SmallIndex i) {
+            new (dst) Slot(slots()[i < s_idx ? i : i + 1]);
+          },
+          copy_child);
+      }
+
+      const void* child = nullptr;
+      const Slot* inlined = nullptr;
+      bool empty;
+
+      if (has_sub_nodes())
+      {
+        auto sn = child_node(c_idx)->remove(hash, k);
+        empty = sn->data_map.pop() == 0 && sn->node_map.pop() == 0;
+        if (sn->data_map.pop() == 1 && sn->node_map.pop() == 0)
+          inlined = sn->slots();
+        child = sn;
       }
       else
       {
-        auto sub_node = Collisions<K, V, H>();
-        const auto hash0 = H()(entry0->key);
-        const auto idx0 = mask(hash0, collision_depth);
-        sub_node.bins[idx0].push_back(entry0);
-        const auto idx1 = mask(hash, collision_depth);
-        sub_node.bins[idx1].push_back(std::make_shared<Entry<K, V>>(k, v));
-
-        nodes.erase(nodes.begin() + c_idx);
-        data_map = data_map.clear(idx);
-        node_map = node_map.set(idx);
-        c_idx = compressed_idx(idx);
-        nodes.insert(
-          nodes.begin() + c_idx,
-          std::make_shared<Collisions<K, V, H>>(std::move(sub_node)));
+        auto sn = child_collisions(c_idx)->remove(hash, k);
+        const auto n = sn->size();
+        empty = n == 0;
+        if (n == 1)
+          inlined = &sn->first();
+        child = sn;
       }
-      return true;
-    }
 
-    std::pair<std::shared_ptr<SubNodes<K, V, H>>, bool> put(
-      SmallIndex depth, Hash hash, const K& k, const V& v) const
-    {
-      auto node = *this;
-      auto r = node.put_mut(depth, hash, k, v);
-      return std::make_pair(
-        std::make_shared<SubNodes<K, V, H>>(std::move(node)), r);
+      SubNodes* node;
+      try
+      {
+        if (inlined == nullptr && !empty)
+        {
+          return create(
+            depth,
+            node_map,
+            data_map,
+            [this](Slot* dst, SmallIndex i) { new (dst) Slot(slots()[i]); },
+            [&](SmallIndex i) { return i == c_idx ? child : copy_child(i); });
+        }
+
+        const auto new_data_map = inlined ? data_map.set(idx) : data_map;
+        node = create(
+          depth,
+          node_map.clear(idx),
+          new_data_map,
+          [&](Slot* dst, SmallIndex i) {
+            if (i < s_idx)
+              new (dst) Slot(slots()[i]);
+            else if (inlined == nullptr)
+              new (dst) Slot(slots()[i]);
+            else if (i == s_idx)
+              new (dst) Slot(*inlined);
+            else
+              new (dst) Slot(slots()[i - 1]);
+          },
+          [&](SmallIndex i) { return copy_child(i < c_idx ? i : i + 1); });
+      }
+      catch (...)
+      {
+        release_child(child);
+        throw;
+      }
+
+      release_child(child);
+      return node;
     }
 
     template <class F>
-    bool foreach(SmallIndex depth, F&& f) const
+    bool foreach(F&& f) const
     {
-      const auto entries = data_map.pop();
-      for (SmallIndex i = 0; i < entries; ++i)
+      const auto n_slots = data_map.pop();
+      for (SmallIndex i = 0; i < n_slots; ++i)
       {
-        const auto& entry = node_as<Entry<K, V>>(i);
-        if (!f(entry->key, entry->value))
+        const auto& entry = slots()[i].get();
+        if (!f(entry.key, entry.value))
           return false;
       }
-      for (size_t i = entries; i < nodes.size(); ++i)
+
+      const auto n_children = node_map.pop();
+      const auto kids = children();
+      for (SmallIndex i = 0; i < n_children; ++i)
       {
-        if (depth == (collision_depth - 1))
+        if (has_sub_nodes())
         {
-          if (!node_as<Collisions<K, V, H>>(i)->foreach(std::forward<F>(f)))
+          if (!static_cast<const SubNodes*>(kids[i])->foreach(
+                std::forward<F>(f)))
             return false;
         }
         else
         {
-          if (!node_as<SubNodes<K, V, H>>(i)->foreach(
-                depth + 1, std::forward<F>(f)))
+          if (!static_cast<const Coll*>(kids[i])->foreach(std::forward<F>(f)))
             return false;
         }
       }
       return true;
     }
-
-  private:
-    template <class A>
-    const std::shared_ptr<A>& node_as(SmallIndex c_idx) const
-    {
-      return reinterpret_cast<const std::shared_ptr<A>&>(nodes[c_idx]);
-    }
   };
 
-  template <class K, class V, class H = std::hash<K>>
+  template <class K, class V, class H = std::hash<K>, class R = SingleThreaded>
   class Map
   {
   private:
-    std::shared_ptr<SubNodes<K, V, H>> root;
+    using Node = SubNodes<K, V, H, R>;
+
+    // An empty map has no root
+    const Node* root = nullptr;
     size_t _size = 0;
 
-    Map(std::shared_ptr<SubNodes<K, V, H>> root_, size_t size_) :
-      root(root_),
-      _size(size_)
-    {}
+    Map(const Node* root_, size_t size_) : root(root_), _size(size_) {}
 
   public:
-    Map() : root(std::make_shared<SubNodes<K, V, H>>()) {}
+    Map() = default;
+
+    Map(const Map& that) : root(that.root), _size(that._size)
+    {
+      if (root != nullptr)
+        Node::acquire(root);
+    }
+
+    Map(Map&& that) : root(that.root), _size(that._size)
+    {
+      that.root = nullptr;
+      that._size = 0;
+    }
+
+    Map& operator=(const Map& that)
+    {
+      if (that.root != nullptr)
+        Node::acquire(that.root);
+      if (root != nullptr)
+        Node::release(root);
+      root = that.root;
+      _size = that._size;
+      return *this;
+    }
+
+    Map& operator=(Map&& that)
+    {
+      std::swap(root, that.root);
+      std::swap(_size, that._size);
+      return *this;
+    }
+
+    ~Map()
+    {
+      if (root != nullptr)
+        Node::release(root);
+    }
 
     size_t size() const
     {
@@ -331,7 +932,7 @@ namespace champ
 
     std::optional<V> get(const K& key) const
     {
-      auto v = root->getp(0, H()(key), key);
+      auto v = getp(key);
 
       if (v)
         return *v;
@@ -341,23 +942,46 @@ namespace champ
 
     const V* getp(const K& key) const
     {
-      return root->getp(0, H()(key), key);
+      if (root == nullptr)
+        return nullptr;
+
+      return root->getp(H()(key), key);
     }
 
-    const Map<K, V, H> put(const K& key, const V& value) const
+    const Map<K, V, H, R> put(const K& key, const V& value) const
     {
-      auto r = root->put(0, H()(key), key, value);
+      if (root == nullptr)
+      {
+        Map empty_root(Node::create_empty(), 0);
+        return empty_root.put(key, value);
+      }
+
+      auto r = root->put(H()(key), key, value);
       auto size_ = _size;
       if (r.second)
         size_++;
 
-      return Map(std::move(r.first), size_);
+      return Map(r.first, size_);
+    }
+
+    const Map<K, V, H, R> remove(const K& key) const
+    {
+      if (getp(key) == nullptr)
+        return *this;
+
+      if (_size == 1)
+        return Map();
+
+      return Map(root->remove(H()(key), key), _size - 1);
     }
 
     template <class F>
     bool foreach(F&& f) const
     {
-      return root->foreach(0, std::forward<F>(f));
+      if (root == nullptr)
+        return true;
+
+      return root->foreach(std::forward<F>(f));
     }
   };
 }
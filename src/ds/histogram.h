@@ -6,6 +6,7 @@
 #  include <intrin.h>
 #endif
 
+#include <atomic>
 #include <cassert>
 #include <chrono>
 #include <limits>
@@ -113,16 +114,46 @@ namespace histogram
     static constexpr size_t SIGNIFICANT = (size_t)1 << SIGNIFICANT_BITS;
     static constexpr size_t SIGNIFICANT_MASK = (SIGNIFICANT >> 1) - 1;
 
-    V low;
-    V high;
+    // A histogram is only recorded into by a single thread, but may be merged
+    // by others while it is, so its counters are relaxed atomics. A merge is
+    // then a snapshot that may miss the values being recorded concurrently,
+    // and whose counters may not all be from the same instant.
+    std::atomic<V> low;
+    std::atomic<V> high;
 
-    size_t underflow = 0;
-    size_t overflow = 0;
-    size_t count[BUCKETS];
+    std::atomic<size_t> underflow = 0;
+    std::atomic<size_t> overflow = 0;
+    std::atomic<size_t> count[BUCKETS] = {};
 
     This* next;
 
+    template <typename T>
+    static T load(const std::atomic<T>& a)
+    {
+      return a.load(std::memory_order_relaxed);
+    }
+
+    // Only called by the thread recording into the histogram, so does not
+    // need an atomic read-modify-write
+    template <typename T>
+    static void store(std::atomic<T>& a, T value)
+    {
+      a.store(value, std::memory_order_relaxed);
+    }
+
+    static void increment(std::atomic<size_t>& a)
+    {
+      store(a, load(a) + 1);
+    }
+
   public:
+    // Not registered with any Global, for instance to merge others into
+    Histogram() :
+      low((std::numeric_limits<V>::max)()),
+      high((std::numeric_limits<V>::min)()),
+      next(nullptr)
+    {}
+
     Histogram(Global<This>& g) :
       low((std::numeric_limits<V>::max)()),
       high((std::numeric_limits<V>::min)()),
@@ -131,48 +162,54 @@ namespace histogram
       g.add(*this);
     }
 
+    // Copies are not registered with any Global
+    Histogram(const This& that) : Histogram()
+    {
+      add(that);
+    }
+
     void record(V value)
     {
-      if (value < low)
-        low = value;
+      if (value < load(low))
+        store(low, value);
 
-      if (value > high)
-        high = value;
+      if (value > load(high))
+        store(high, value);
 
       if (value < LOW)
       {
-        underflow++;
+        increment(underflow);
       }
       else if (value >= HIGH)
       {
-        overflow++;
+        increment(overflow);
       }
       else
       {
         auto i = get_index(value);
         assert(i < BUCKETS);
-        count[i]++;
+        increment(count[i]);
       }
     }
 
     V get_low()
     {
-      return low;
+      return load(low);
     }
 
     V get_high()
     {
-      return high;
+      return load(high);
     }
 
     size_t get_underflow()
     {
-      return underflow;
+      return load(underflow);
     }
 
     size_t get_overflow()
     {
-      return overflow;
+      return load(overflow);
     }
 
     size_t get_buckets()
@@ -185,7 +222,7 @@ namespace histogram
       if (index >= BUCKETS)
         return 0;
 
-      return count[index];
+      return load(count[index]);
     }
 
     std::pair<V, V> get_range(size_t index)
@@ -196,29 +233,31 @@ namespace histogram
       return std::make_pair(get_value(index), get_value(index + 1) - 1);
     }
 
-    void add(Histogram<V, LOW, HIGH, SIGNIFICANT_BITS>& that)
+    // Called by the thread that owns this histogram, while that may be
+    // recorded into by another thread
+    void add(const Histogram<V, LOW, HIGH, SIGNIFICANT_BITS>& that)
     {
-      low = std::min(low, that.low);
-      high = std::max(high, that.high);
-      underflow += that.underflow;
-      overflow += that.overflow;
+      store(low, std::min(load(low), load(that.low)));
+      store(high, std::max(load(high), load(that.high)));
+      store(underflow, load(underflow) + load(that.underflow));
+      store(overflow, load(overflow) + load(that.overflow));
 
       for (size_t i = 0; i < BUCKETS; i++)
-        count[i] += that.count[i];
+        store(count[i], load(count[i]) + load(that.count[i]));
     }
 
     void print(std::stringstream& ss)
     {
-      ss << "\tLow: " << low << std::endl
-         << "\tHigh: " << high << std::endl
-         << "\tUnderflow: " << underflow << std::endl
-         << "\tOverflow: " << underflow << std::endl;
+      ss << "\tLow: " << get_low() << std::endl
+         << "\tHigh: " << get_high() << std::endl
+         << "\tUnderflow: " << get_underflow() << std::endl
+         << "\tOverflow: " << get_overflow() << std::endl;
 
       for (size_t i = 0; i < BUCKETS; i++)
       {
         auto r = get_range(i);
         ss << "\t" << std::get<0>(r) << ".." << std::get<1>(r) << ": "
-           << count[i] << std::endl;
+           << get_count(i) << std::endl;
       }
     }
 
@@ -229,7 +268,7 @@ namespace histogram
       for (size_t i = 0; i < BUCKETS; i++)
       {
         auto r = get_range(i);
-        range_counts.insert({{std::get<0>(r), std::get<1>(r)}, count[i]});
+        range_counts.insert({{std::get<0>(r), std::get<1>(r)}, get_count(i)});
       }
       return range_counts;
     }
@@ -290,6 +329,13 @@ namespace histogram
       head = &histogram;
     }
 
+    void merge(H& result)
+    {
+      std::lock_guard<std::mutex> lock(m);
+      for (H* p = head; p != nullptr; p = p->next)
+        result.add(*p);
+    }
+
     void print()
     {
       std::lock_guard<std::mutex> lock(m);
@@ -17,7 +17,11 @@
 #include <optional>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <variant>
 
 extern std::map<std::thread::id, uint16_t> thread_ids;
 
@@ -296,6 +300,20 @@ namespace logger
     {
       return l >= level();
     }
+
+    // Messages used by the binary logging mode (see binary::Out). The mode is
+    // disabled unless both are set.
+    static inline int& site_msg()
+    {
+      static int the_msg = ringbuffer::Const::msg_none;
+      return the_msg;
+    }
+
+    static inline int& binary_msg()
+    {
+      static int the_msg = ringbuffer::Const::msg_none;
+      return the_msg;
+    }
   };
 
   class LogLine
@@ -472,6 +490,397 @@ namespace logger
   };
 #endif
 
+  /** Binary logging
+   *
+   * Inside the enclave, lines logged with a literal format string are not
+   * formatted there. Each call site is registered with the host the first
+   * time it logs, with its format string. Its lines are then written as the
+   * id of the call site followed by the raw arguments, encoded in a
+   * per-thread staging buffer that is copied to the ringbuffer in one write.
+   * The host formats them as they are received.
+   */
+  namespace binary
+  {
+    enum class ArgType : uint8_t
+    {
+      Int = 0,
+      UInt,
+      Double,
+      Bool,
+      Char,
+      String,
+      Pointer
+    };
+
+    inline void put(std::vector<uint8_t>& buf, const void* p, size_t size)
+    {
+      const auto offset = buf.size();
+      buf.resize(offset + size);
+      std::memcpy(buf.data() + offset, p, size);
+    }
+
+    template <typename T>
+    inline void put_arg(std::vector<uint8_t>& buf, ArgType type, T value)
+    {
+      buf.push_back(static_cast<uint8_t>(type));
+      put(buf, &value, sizeof(value));
+    }
+
+    inline void put_string(
+      std::vector<uint8_t>& buf, const char* s, size_t size)
+    {
+      buf.push_back(static_cast<uint8_t>(ArgType::String));
+      const auto size32 = static_cast<uint32_t>(size);
+      put(buf, &size32, sizeof(size32));
+      put(buf, s, size);
+    }
+
+    /// Whether an argument of type T can be sent to the host as is. Other
+    /// types (user types with operator<<, enums, fmt::join, etc.) would have
+    /// to be formatted here, without the format spec of their placeholder,
+    /// so lines with such arguments are formatted eagerly instead.
+    template <typename T>
+    constexpr bool is_encodable()
+    {
+      using U = std::decay_t<T>;
+      return std::is_arithmetic_v<U> || std::is_pointer_v<U> ||
+        std::is_convertible_v<const T&, std::string_view>;
+    }
+
+    /// Encode an argument, of a type for which is_encodable holds
+    template <typename T>
+    inline void encode(std::vector<uint8_t>& buf, const T& t)
+    {
+      static_assert(is_encodable<T>(), "Argument cannot be encoded");
+
+      using U = std::decay_t<T>;
+      if constexpr (std::is_same_v<U, bool>)
+        put_arg(buf, ArgType::Bool, static_cast<uint8_t>(t));
+      else if constexpr (std::is_same_v<U, char>)
+        put_arg(buf, ArgType::Char, t);
+      else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>)
+        put_arg(buf, ArgType::Int, static_cast<int64_t>(t));
+      else if constexpr (std::is_integral_v<U>)
+        put_arg(buf, ArgType::UInt, static_cast<uint64_t>(t));
+      else if constexpr (std::is_floating_point_v<U>)
+        put_arg(buf, ArgType::Double, static_cast<double>(t));
+      else if constexpr (
+        std::is_same_v<U, const char*> || std::is_same_v<U, char*>)
+        put_string(buf, t, std::strlen(t));
+      else if constexpr (std::is_convertible_v<const T&, std::string_view>)
+      {
+        const std::string_view sv(t);
+        put_string(buf, sv.data(), sv.size());
+      }
+      else
+        put_arg(buf, ArgType::Pointer, reinterpret_cast<uintptr_t>(t));
+    }
+
+    /** Format arguments encoded with encode
+     *
+     * @param format Format string
+     * @param data Encoded arguments
+     * @param size Size of data
+     *
+     * @return Formatted string
+     */
+    inline std::string format(
+      const std::string& format, const uint8_t* data, size_t size)
+    {
+      using Value = std::variant<
+        int64_t,
+        uint64_t,
+        double,
+        bool,
+        char,
+        std::string,
+        const void*>;
+      std::vector<Value> values;
+
+      auto get = [&](void* p, size_t n) {
+        if (n > size)
+          throw std::logic_error("Truncated log line arguments");
+        std::memcpy(p, data, n);
+        data += n;
+        size -= n;
+      };
+
+      while (size > 0)
+      {
+        uint8_t type;
+        get(&type, sizeof(type));
+        switch (static_cast<ArgType>(type))
+        {
+          case ArgType::Int:
+          {
+            int64_t v;
+            get(&v, sizeof(v));
+            values.emplace_back(v);
+            break;
+          }
+          case ArgType::UInt:
+          {
+            uint64_t v;
+            get(&v, sizeof(v));
+            values.emplace_back(v);
+            break;
+          }
+          case ArgType::Double:
+          {
+            double v;
+            get(&v, sizeof(v));
+            values.emplace_back(v);
+            break;
+          }
+          case ArgType::Bool:
+          {
+            uint8_t v;
+            get(&v, sizeof(v));
+            values.emplace_back(v != 0);
+            break;
+          }
+          case ArgType::Char:
+          {
+            char v;
+            get(&v, sizeof(v));
+            values.emplace_back(v);
+            break;
+          }
+          case ArgType::String:
+          {
+            uint32_t n;
+            get(&n, sizeof(n));
+            std::string v(n, '\0');
+            get(v.data(), n);
+            values.emplace_back(std::move(v));
+            break;
+          }
+          case ArgType::Pointer:
+          {
+            uintptr_t v;
+            get(&v, sizeof(v));
+            values.emplace_back(reinterpret_cast<const void*>(v));
+            break;
+          }
+          default:
+            throw std::logic_error(
+              fmt::format("Unknown log line argument type {}", type));
+        }
+      }
+
+      // Only built once values is complete, as args refer to its elements
+      std::vector<fmt::format_args::format_arg> args;
+      args.reserve(values.size());
+      for (const auto& v : values)
+      {
+        std::visit(
+          [&args](const auto& a) {
+            args.push_back(fmt::internal::make_arg<fmt::format_context>(a));
+          },
+          v);
+      }
+
+      return fmt::vformat(
+        format,
+        fmt::format_args(
+          args.data(), static_cast<fmt::format_args::size_type>(args.size())));
+    }
+
+    /// A logging call site
+    struct Site
+    {
+      const Level level;
+      const char* const file;
+      const size_t line;
+
+      // 0 until the site is registered with the host
+      std::atomic<uint32_t> id = 0;
+      std::atomic<bool> registering = false;
+
+      Site(Level level, const char* file, size_t line) :
+        level(level),
+        file(file),
+        line(line)
+      {}
+    };
+
+    struct Out
+    {
+      static inline std::vector<uint8_t>& staging()
+      {
+        thread_local std::vector<uint8_t> buf;
+        return buf;
+      }
+
+      /** Write a line in binary, registering its call site first if needed
+       *
+       * @return false if nothing was written, because one of the arguments
+       * cannot be encoded or the call site is being registered by another
+       * thread
+       */
+      template <typename... Args>
+      static bool write(
+        ringbuffer::AbstractWriter& writer,
+        Site& site,
+        const char* format,
+        std::chrono::milliseconds elapsed,
+        uint16_t thread_id,
+        const Args&... args)
+      {
+        if constexpr (!(is_encodable<Args>() && ...))
+          return false;
+        else
+          return write_binary(
+            writer, site, format, elapsed, thread_id, args...);
+      }
+
+    private:
+      template <typename... Args>
+      static bool write_binary(
+        ringbuffer::AbstractWriter& writer,
+        Site& site,
+        const char* format,
+        std::chrono::milliseconds elapsed,
+        uint16_t thread_id,
+        const Args&... args)
+      {
+        auto id = site.id.load(std::memory_order_acquire);
+        if (id == 0)
+        {
+          if (site.registering.exchange(true))
+            return false;
+
+          static std::atomic<uint32_t> next_id = 1;
+          id = next_id++;
+          writer.write(
+            config::site_msg(),
+            id,
+            std::string(site.file),
+            site.line,
+            site.level,
+            std::string(format));
+          site.id.store(id, std::memory_order_release);
+        }
+
+        // Same layout as the serialised log_binary message
+        auto& buf = staging();
+        buf.clear();
+        put(buf, &elapsed, sizeof(elapsed));
+        put(buf, &id, sizeof(id));
+        put(buf, &thread_id, sizeof(thread_id));
+        (encode(buf, args), ...);
+
+        const auto marker = writer.prepare(config::binary_msg(), buf.size());
+        writer.write_bytes(marker, buf.data(), buf.size());
+        writer.finish(marker);
+        return true;
+      }
+    };
+  }
+
+  /// Output of LOG_*_FMT
+  struct FmtOut
+  {
+    template <size_t N, typename... Args>
+    static void write(
+      binary::Site& site, const char (&format)[N], const Args&... args)
+    {
+#ifdef INSIDE_ENCLAVE
+      if (config::binary_msg() != ringbuffer::Const::msg_none)
+      {
+        thread_local uint16_t thread_id =
+          thread_ids[std::this_thread::get_id()];
+        if (binary::Out::write(
+              *config::writer(),
+              site,
+              format,
+              config::elapsed_ms(),
+              thread_id,
+              args...))
+          return;
+      }
+#endif
+      write_formatted(site, fmt::format(format, args...));
+    }
+
+    // Format strings that are not literals may change from one call to the
+    // next, so they are always formatted here
+    template <typename S, typename... Args>
+    static void write(binary::Site& site, const S& format, const Args&... args)
+    {
+      write_formatted(site, fmt::format(format, args...));
+    }
+
+    static void write_formatted(binary::Site& site, const std::string& msg)
+    {
+      Out() == LogLine(site.level, site.file, site.line) << msg << std::endl;
+    }
+  };
+
+#ifndef INSIDE_ENCLAVE
+  namespace binary
+  {
+    struct SiteInfo
+    {
+      std::string file;
+      size_t line;
+      Level level;
+      std::string format;
+    };
+
+    // Call sites registered by the enclave, by id
+    static inline std::unordered_map<uint32_t, SiteInfo>& sites()
+    {
+      static std::unordered_map<uint32_t, SiteInfo> the_sites;
+      return the_sites;
+    }
+
+    /** Format and write a binary line received from the enclave
+     *
+     * @param elapsed Milliseconds elapsed in the enclave when it was logged
+     * @param id Id of its call site
+     * @param thread_id Enclave thread that logged it
+     * @param data Encoded arguments
+     * @param size Size of data
+     */
+    static inline void write(
+      std::chrono::milliseconds elapsed,
+      uint32_t id,
+      uint16_t thread_id,
+      const uint8_t* data,
+      size_t size)
+    {
+      auto search = sites().find(id);
+      if (search == sites().end())
+      {
+        logger::Out::write(
+          __FILE__,
+          __LINE__,
+          Level::FAIL,
+          thread_id,
+          fmt::format("Received log line from unknown call site {}\n", id));
+        return;
+      }
+
+      const auto& site = search->second;
+      std::string msg;
+      try
+      {
+        msg = format(site.format, data, size);
+      }
+      catch (const std::exception& e)
+      {
+        msg = fmt::format(
+          "{} (unable to format arguments: {})", site.format, e.what());
+      }
+      msg += "\n";
+
+      logger::Out::write(
+        site.file, site.line, site.level, thread_id, msg, elapsed.count());
+    }
+  }
+#endif
+
   // The == operator is being used to:
   // 1. Be a lower precedence than <<, such that using << on the LogLine will
   // happen before the LogLine is "equalitied" with the Out.
@@ -480,28 +889,40 @@ namespace logger
   // This allows:
   // LOG_DEBUG << "info" << std::endl;
 
+  // Each LOG_*_FMT call site has its own binary::Site, registered with the
+  // host by the first line it logs
+#define LOG_FMT(LEVEL, ...) \
+  do \
+  { \
+    if (logger::config::ok(LEVEL)) \
+    { \
+      static logger::binary::Site log_site_(LEVEL, __FILE__, __LINE__); \
+      logger::FmtOut::write(log_site_, __VA_ARGS__); \
+    } \
+  } while (0)
+
 #define LOG_TRACE \
   logger::config::ok(logger::TRACE) && \
     logger::Out() == logger::LogLine(logger::TRACE, __FILE__, __LINE__)
-#define LOG_TRACE_FMT(...) LOG_TRACE << fmt::format(__VA_ARGS__) << std::endl
+#define LOG_TRACE_FMT(...) LOG_FMT(logger::TRACE, __VA_ARGS__)
 
 #define LOG_DEBUG \
   logger::config::ok(logger::DBG) && \
     logger::Out() == logger::LogLine(logger::DBG, __FILE__, __LINE__)
-#define LOG_DEBUG_FMT(...) LOG_DEBUG << fmt::format(__VA_ARGS__) << std::endl
+#define LOG_DEBUG_FMT(...) LOG_FMT(logger::DBG, __VA_ARGS__)
 
 #define LOG_INFO \
   logger::config::ok(logger::INFO) && \
     logger::Out() == logger::LogLine(logger::INFO, __FILE__, __LINE__)
-#define LOG_INFO_FMT(...) LOG_INFO << fmt::format(__VA_ARGS__) << std::endl
+#define LOG_INFO_FMT(...) LOG_FMT(logger::INFO, __VA_ARGS__)
 
 #define LOG_FAIL \
   logger::config::ok(logger::FAIL) && \
     logger::Out() == logger::LogLine(logger::FAIL, __FILE__, __LINE__)
-#define LOG_FAIL_FMT(...) LOG_FAIL << fmt::format(__VA_ARGS__) << std::endl
+#define LOG_FAIL_FMT(...) LOG_FMT(logger::FAIL, __VA_ARGS__)
 
 #define LOG_FATAL \
   logger::config::ok(logger::FATAL) && \
     logger::Out() == logger::LogLine(logger::FATAL, __FILE__, __LINE__)
-#define LOG_FATAL_FMT(...) LOG_FATAL << fmt::format(__VA_ARGS__) << std::endl
+#define LOG_FATAL_FMT(...) LOG_FMT(logger::FATAL, __VA_ARGS__)
 }
\ No newline at end of file
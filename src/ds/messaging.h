@@ -15,6 +15,7 @@
 namespace messaging
 {
   using Handler = std::function<void(const uint8_t*, size_t)>;
+  using BatchHandler = std::function<void(const ringbuffer::Batch&)>;
 
   class no_handler : public std::logic_error
   {
@@ -33,8 +34,13 @@ namespace messaging
     char const* const name;
 
     std::map<MessageType, Handler> handlers;
+    std::map<MessageType, BatchHandler> batch_handlers;
     std::map<MessageType, char const*> message_labels;
 
+    // Incremented whenever a handler is removed, so that a batch being
+    // dispatched message by message can tell if its handler is still valid
+    size_t removals = 0;
+
     std::string get_error_prefix()
     {
       return std::string("[") + std::string(name) + std::string("] ");
@@ -77,17 +83,33 @@ namespace messaging
       MessageType m, char const* message_label, Handler h)
     {
       // Check for presence first, so we only copy if we're actually inserting
-      auto it = handlers.find(m);
-      if (it != handlers.end())
+      check_unhandled(m, message_label);
+
+      LOG_DEBUG_FMT("Setting handler for {} ({})", message_label, m);
+      handlers.emplace(m, h);
+
+      if (message_label != nullptr)
       {
-        throw already_handled(
-          get_error_prefix() + "MessageType " + std::to_string(m) +
-          " already handled by " + get_message_name(m) +
-          ", cannot set handler for " + build_message_name(m, message_label));
+        message_labels.emplace(m, message_label);
       }
+    }
 
-      LOG_DEBUG_FMT("Setting handler for {} ({})", message_label, m);
-      handlers.insert(it, {m, h});
+    /** Set a callback for batches of this message type
+     *
+     * As set_message_handler, but the handler receives runs of consecutive
+     * messages of this type at once. A message type may have either a batch
+     * handler or a single message handler.
+     *
+     * @throws already_handled if a handler is already registered for
+     * this type.
+     */
+    void set_batch_handler(
+      MessageType m, char const* message_label, BatchHandler h)
+    {
+      check_unhandled(m, message_label);
+
+      LOG_DEBUG_FMT("Setting batch handler for {} ({})", message_label, m);
+      batch_handlers.emplace(m, h);
 
       if (message_label != nullptr)
       {
@@ -104,8 +126,7 @@ namespace messaging
      */
     void remove_message_handler(MessageType m)
     {
-      auto it = handlers.find(m);
-      if (it == handlers.end())
+      if (handlers.erase(m) == 0 && batch_handlers.erase(m) == 0)
       {
         throw no_handler(
           get_error_prefix() +
@@ -113,7 +134,7 @@ namespace messaging
           get_message_name(m));
       }
 
-      handlers.erase(it);
+      ++removals;
     }
 
     /** Is handler already registered for this message type
@@ -123,7 +144,8 @@ namespace messaging
      */
     bool has_handler(MessageType m)
     {
-      return handlers.find(m) != handlers.end();
+      return handlers.find(m) != handlers.end() ||
+        batch_handlers.find(m) != batch_handlers.end();
     }
 
     /** Dispatch a single message
@@ -138,14 +160,78 @@ namespace messaging
       auto it = handlers.find(m);
       if (it == handlers.end())
       {
-        throw no_handler(
-          get_error_prefix() +
-          "No handler for this message: " + get_message_name(m));
+        auto bit = batch_handlers.find(m);
+        if (bit == batch_handlers.end())
+        {
+          throw_no_handler(m);
+        }
+
+        ringbuffer::MessageView view{data, size};
+        bit->second({(ringbuffer::Message)m, &view, 1});
+        return;
       }
 
       // Handlers may register or remove handlers, so iterator is invalidated
       it->second(data, size);
     }
+
+    /** Dispatch a batch of messages of the same type
+     *
+     * The handler is looked up once for the whole batch. If the type has a
+     * single message handler, it is called for each message in turn.
+     *
+     * @throws no_handler if no handler is registered for this type.
+     */
+    void dispatch_batch(const ringbuffer::Batch& batch)
+    {
+      auto m = (MessageType)batch.m;
+
+      auto bit = batch_handlers.find(m);
+      if (bit != batch_handlers.end())
+      {
+        bit->second(batch);
+        return;
+      }
+
+      for (size_t i = 0; i < batch.count;)
+      {
+        auto it = handlers.find(m);
+        if (it == handlers.end())
+        {
+          // The handler may have been replaced by a batch handler
+          dispatch(m, batch.messages[i].data, batch.messages[i].size);
+          ++i;
+          continue;
+        }
+
+        // Handlers may remove handlers, so only reuse the iterator while none
+        // have been removed
+        const auto r = removals;
+        for (; i < batch.count && removals == r; ++i)
+        {
+          it->second(batch.messages[i].data, batch.messages[i].size);
+        }
+      }
+    }
+
+  private:
+    void check_unhandled(MessageType m, char const* message_label)
+    {
+      if (has_handler(m))
+      {
+        throw already_handled(
+          get_error_prefix() + "MessageType " + std::to_string(m) +
+          " already handled by " + get_message_name(m) +
+          ", cannot set handler for " + build_message_name(m, message_label));
+      }
+    }
+
+    [[noreturn]] void throw_no_handler(MessageType m)
+    {
+      throw no_handler(
+        get_error_prefix() +
+        "No handler for this message: " + get_message_name(m));
+    }
   };
 
   using RingbufferDispatcher = Dispatcher<ringbuffer::Message>;
@@ -170,6 +256,12 @@ namespace messaging
       dispatcher.set_message_handler(std::forward<Ts>(ts)...);
     }
 
+    template <typename... Ts>
+    void set_batch_handler(Ts&&... ts)
+    {
+      dispatcher.set_batch_handler(std::forward<Ts>(ts)...);
+    }
+
     void set_finished(bool v = true)
     {
       finished.store(v);
@@ -181,12 +273,12 @@ namespace messaging
 
       while (!finished.load() && total_read < max_messages)
       {
-        // Read one at a time so we don't process any after being told to stop
-        auto read = r.read(
-          1,
-          [& d = dispatcher](
-            ringbuffer::Message m, const uint8_t* data, size_t size) {
-            d.dispatch(m, data, size);
+        // Dispatch runs of messages of the same type together. Stop after the
+        // batch in which we are told to stop, leaving later messages unread.
+        auto read = r.read_batch(
+          max_messages - total_read, [this](const ringbuffer::Batch& batch) {
+            dispatcher.dispatch_batch(batch);
+            return !finished.load();
           });
 
         total_read += read;
@@ -236,4 +328,7 @@ namespace messaging
   // will read it as the original lambda.
 #define DISPATCHER_SET_MESSAGE_HANDLER(DISP, MSG, ...) \
   DISP.set_message_handler(MSG, #MSG, __VA_ARGS__)
+
+#define DISPATCHER_SET_BATCH_HANDLER(DISP, MSG, ...) \
+  DISP.set_batch_handler(MSG, #MSG, __VA_ARGS__)
 }
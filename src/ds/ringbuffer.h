@@ -4,6 +4,7 @@
 
 #include "ringbuffer_types.h"
 
+#include <array>
 #include <atomic>
 #include <cstring>
 #include <functional>
@@ -29,6 +30,39 @@ namespace ringbuffer
 {
   using Handler = std::function<void(Message, const uint8_t*, size_t)>;
 
+  struct MessageView
+  {
+    const uint8_t* data;
+    size_t size;
+  };
+
+  // A run of consecutive messages of the same type. The messages are only
+  // valid for the duration of the handler call.
+  struct Batch
+  {
+    Message m;
+    const MessageView* messages;
+    size_t count;
+
+    const MessageView* begin() const
+    {
+      return messages;
+    }
+
+    const MessageView* end() const
+    {
+      return messages + count;
+    }
+
+    size_t size() const
+    {
+      return count;
+    }
+  };
+
+  // Returns false if no further batches should be read
+  using BatchHandler = std::function<bool(const Batch&)>;
+
   // Align by cacheline to avoid false sharing
   static constexpr size_t CACHELINE_SIZE = 64;
 
@@ -111,6 +145,8 @@ namespace ringbuffer
     Var v;
 
   public:
+    static constexpr size_t max_batch_size = 64;
+
     Reader(const size_t size) :
       buffer(size, 0),
       c(buffer.data(), size),
@@ -167,6 +203,86 @@ namespace ringbuffer
       return count;
     }
 
+    /** Read messages, grouping consecutive messages of the same type
+     *
+     * f is called once per batch, with at most max_batch_size messages. If it
+     * returns false, no further messages are read.
+     *
+     * @return The number of messages read
+     */
+    size_t read_batch(size_t limit, BatchHandler f)
+    {
+      auto mask = c.size - 1;
+      auto hd = v.head.load(std::memory_order_acquire);
+      auto hd_index = hd & mask;
+      auto block = c.size - hd_index;
+      size_t advance = 0;
+      size_t count = 0;
+      bool stop = false;
+
+      // Kept on the stack, since a Reader may be shared with an enclave
+      std::array<MessageView, max_batch_size> views;
+      Batch batch{Const::msg_none, views.data(), 0};
+
+      auto flush = [&]() {
+        if (batch.count == 0)
+          return;
+
+        count += batch.count;
+        stop = !f(batch);
+        batch.count = 0;
+      };
+
+      while ((advance < block) && (count + batch.count < limit))
+      {
+        auto msg_index = hd_index + advance;
+        auto header = read64(msg_index);
+        auto size = length(header);
+
+        // If we see a pending write, we're done.
+        if ((size & pending_write_flag) != 0u)
+          break;
+
+        auto m = message(header);
+
+        if (m == Const::msg_none)
+        {
+          // There is no message here, we're done.
+          break;
+        }
+        else if (m == Const::msg_pad)
+        {
+          // If we see padding, skip it.
+          advance += size;
+          continue;
+        }
+
+        if (batch.count > 0 && (m != batch.m || batch.count == views.size()))
+        {
+          flush();
+          if (stop)
+            break;
+        }
+
+        batch.m = m;
+        views[batch.count++] = {
+          c.buffer + msg_index + Const::header_size(), (size_t)size};
+        advance += Const::entry_size(size);
+      }
+
+      if (!stop)
+        flush();
+
+      if (advance > 0)
+      {
+        // Zero the buffer and advance the head.
+        ::memset(c.buffer + hd_index, 0, advance);
+        v.head.store(hd + advance, std::memory_order_release);
+      }
+
+      return count;
+    }
+
   private:
     uint64_t read64(size_t index)
     {
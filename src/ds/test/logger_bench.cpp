@@ -2,6 +2,7 @@
 // Licensed under the Apache 2.0 License.
 #define PICOBENCH_IMPLEMENT_WITH_MAIN
 #include "../logger.h"
+#include "../ringbuffer_types.h"
 
 #include <picobench/picobench.hpp>
 
@@ -124,6 +125,83 @@ static void log_rejected_fmt(picobench::state& s)
   reset_loggers();
 }
 
+// Discards messages, to measure the cost of logging inside the enclave
+// independently of the host
+class NullWriter : public ringbuffer::AbstractWriter
+{
+public:
+  WriteMarker prepare(
+    ringbuffer::Message, size_t, bool, size_t*) override
+  {
+    return 0;
+  }
+
+  void finish(const WriteMarker&) override {}
+
+  WriteMarker write_bytes(
+    const WriteMarker& marker, const uint8_t*, size_t) override
+  {
+    return marker;
+  }
+};
+
+enum : ringbuffer::Message
+{
+  bench_log_msg = ringbuffer::Const::msg_min,
+  bench_log_site,
+  bench_log_binary
+};
+
+// How lines were written from the enclave before binary logging: formatted
+// there, and copied to the ringbuffer as strings
+static void enclave_formatted(picobench::state& s)
+{
+  NullWriter w;
+  const std::string file(__FILE__);
+  {
+    picobench::scope scope(s);
+
+    for (size_t i = 0; i < s.iterations(); ++i)
+    {
+      std::ostringstream ss;
+      ss << fmt::format("Replicated on leader {}: {}{}", 1, i, " committable")
+         << std::endl;
+      w.write(
+        bench_log_msg,
+        std::chrono::milliseconds(i),
+        file,
+        (size_t)__LINE__,
+        logger::INFO,
+        (uint16_t)0,
+        ss.str());
+    }
+  }
+}
+
+static void enclave_binary(picobench::state& s)
+{
+  NullWriter w;
+  logger::config::site_msg() = bench_log_site;
+  logger::config::binary_msg() = bench_log_binary;
+  static logger::binary::Site site(logger::INFO, __FILE__, __LINE__);
+  {
+    picobench::scope scope(s);
+
+    for (size_t i = 0; i < s.iterations(); ++i)
+    {
+      logger::binary::Out::write(
+        w,
+        site,
+        "Replicated on leader {}: {}{}",
+        std::chrono::milliseconds(i),
+        0,
+        1,
+        i,
+        " committable");
+    }
+  }
+}
+
 const std::vector<int> sizes = {1000};
 
 PICOBENCH_SUITE("logger");
@@ -145,6 +223,10 @@ PICOBENCH(json_reject).iterations(sizes).samples(10);
 auto json_reject_fmt = log_rejected_fmt<LoggerKind::JSON>;
 PICOBENCH(json_reject_fmt).iterations(sizes).samples(10);
 
+PICOBENCH_SUITE("enclave");
+PICOBENCH(enclave_formatted).iterations(sizes).samples(10).baseline();
+PICOBENCH(enclave_binary).iterations(sizes).samples(10);
+
 // The enabled benchmarks are artifically cheap since they talk to a broken
 // stream, skipping the cost of _actually writing something_. To compare this,
 // uncomment the lines below (~3x slower)
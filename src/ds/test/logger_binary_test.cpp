@@ -0,0 +1,178 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#include "../logger.h"
+
+#include "../ringbuffer.h"
+#include "../serialized.h"
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+enum : ringbuffer::Message
+{
+  DEFINE_RINGBUFFER_MSG_TYPE(test_log_site),
+  DEFINE_RINGBUFFER_MSG_TYPE(test_log_binary),
+};
+
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  test_log_site, uint32_t, std::string, size_t, logger::Level, std::string);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  test_log_binary,
+  std::chrono::milliseconds,
+  uint32_t,
+  uint16_t,
+  serializer::ByteRange);
+
+struct Custom
+{
+  int n;
+};
+
+std::ostream& operator<<(std::ostream& os, const Custom& c)
+{
+  return os << "Custom(" << c.n << ")";
+}
+
+enum Unscoped
+{
+  A = 0,
+  B = 1
+};
+
+// Write a line in binary, and format it as the host would
+template <size_t N, typename... Args>
+std::string round_trip(
+  logger::binary::Site& site, const char (&format)[N], const Args&... args)
+{
+  ringbuffer::Reader r(1 << 12);
+  ringbuffer::Writer w(r);
+
+  REQUIRE(logger::binary::Out::write(
+    w, site, format, std::chrono::milliseconds(42), 3, args...));
+
+  std::string result;
+  r.read(-1, [&](ringbuffer::Message m, const uint8_t* data, size_t size) {
+    if (m == test_log_site)
+    {
+      auto [id, file, line, level, f] =
+        ringbuffer::read_message<test_log_site>(data, size);
+      REQUIRE(file == site.file);
+      REQUIRE(line == site.line);
+      REQUIRE(level == site.level);
+      logger::binary::sites()[id] = {file, line, level, f};
+    }
+    else if (m == test_log_binary)
+    {
+      auto [elapsed, id, thread_id, body] =
+        ringbuffer::read_message<test_log_binary>(data, size);
+      REQUIRE(elapsed.count() == 42);
+      REQUIRE(thread_id == 3);
+      REQUIRE(id == site.id);
+      result = logger::binary::format(
+        logger::binary::sites()[id].format, body.data, body.size);
+    }
+  });
+
+  return result;
+}
+
+TEST_CASE("Binary log lines are formatted as by fmt")
+{
+  logger::config::site_msg() = test_log_site;
+  logger::config::binary_msg() = test_log_binary;
+
+  logger::binary::Site site(logger::DBG, __FILE__, __LINE__);
+
+  INFO("No arguments");
+  CHECK(round_trip(site, "Hello") == "Hello");
+  CHECK(site.id != 0);
+
+  INFO("Site is only registered once");
+  const auto id = site.id.load();
+  CHECK(round_trip(site, "Hello") == "Hello");
+  CHECK(site.id == id);
+
+  INFO("Arguments of each type");
+  const std::string s = "a string";
+  const std::string_view sv = "a view";
+  const char* cs = "a C string";
+  const int* p = nullptr;
+  logger::binary::Site all(logger::FATAL, __FILE__, __LINE__);
+  constexpr auto format = "{} {} {} {} {} {:x} {:.2f} {} {} {} {} {} {}";
+  const auto expected = fmt::format(
+    format,
+    -1,
+    (uint8_t)2,
+    std::numeric_limits<uint64_t>::max(),
+    std::numeric_limits<int64_t>::min(),
+    (short)-5,
+    255,
+    3.14159,
+    true,
+    'c',
+    s,
+    sv,
+    cs,
+    (const void*)p);
+  CHECK(
+    round_trip(
+      all,
+      "{} {} {} {} {} {:x} {:.2f} {} {} {} {} {} {}",
+      -1,
+      (uint8_t)2,
+      std::numeric_limits<uint64_t>::max(),
+      std::numeric_limits<int64_t>::min(),
+      (short)-5,
+      255,
+      3.14159,
+      true,
+      'c',
+      s,
+      sv,
+      cs,
+      p) == expected);
+
+  INFO("Positional arguments");
+  logger::binary::Site positional(logger::DBG, __FILE__, __LINE__);
+  CHECK(round_trip(positional, "{1}-{0}", 1, "two") == "two-1");
+}
+
+TEST_CASE("Lines with arguments that cannot be encoded are not written")
+{
+  logger::config::site_msg() = test_log_site;
+  logger::config::binary_msg() = test_log_binary;
+
+  ringbuffer::Reader r(1 << 12);
+  ringbuffer::Writer w(r);
+
+  // Formatting these in the enclave would lose the spec of their placeholder,
+  // so they are left to the eager path
+  const std::vector<uint8_t> digest = {10, 11};
+  logger::binary::Site site(logger::DBG, __FILE__, __LINE__);
+  CHECK_FALSE(logger::binary::Out::write(
+    w,
+    site,
+    "digest: {:02x}",
+    std::chrono::milliseconds(0),
+    0,
+    fmt::join(digest, "")));
+  CHECK_FALSE(logger::binary::Out::write(
+    w, site, "{} {}", std::chrono::milliseconds(0), 0, Custom{7}, B));
+  CHECK(site.id == 0);
+  CHECK(r.read(-1, [](ringbuffer::Message, const uint8_t*, size_t) {}) == 0);
+}
+
+TEST_CASE("Sites being registered by another thread are not written")
+{
+  logger::config::site_msg() = test_log_site;
+  logger::config::binary_msg() = test_log_binary;
+
+  ringbuffer::Reader r(1 << 12);
+  ringbuffer::Writer w(r);
+
+  logger::binary::Site site(logger::DBG, __FILE__, __LINE__);
+  site.registering = true;
+  CHECK_FALSE(logger::binary::Out::write(
+    w, site, "Hello {}", std::chrono::milliseconds(0), 0, 1));
+  CHECK(r.read(-1, [](ringbuffer::Message, const uint8_t*, size_t) {}) == 0);
+}
@@ -4,16 +4,48 @@
 #include "../champmap.h"
 #include "../rbmap.h"
 
+#include <atomic>
+#include <new>
 #include <picobench/picobench.hpp>
 
 using namespace std;
 
+// Count heap allocations, so that benchmarks can report allocations per
+// operation as their result
+static std::atomic<size_t> allocations = 0;
+
+void* operator new(size_t size)
+{
+  allocations++;
+  auto p = malloc(size);
+  if (p == nullptr)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  free(p);
+}
+
 using K = uint64_t;
 using V = std::vector<uint64_t>;
 
+// Small enough to be stored inline in the nodes of a champ::Map
+using SmallV = uint64_t;
+
 static size_t val_size = 32;
 
-static V gen_val(size_t size)
+template <class T>
+static T gen_val(size_t size);
+
+template <>
+V gen_val<V>(size_t size)
 {
   V v;
 
@@ -25,10 +57,19 @@ static V gen_val(size_t size)
   return v;
 }
 
+template <>
+SmallV gen_val<SmallV>(size_t size)
+{
+  return size;
+}
+
+template <class M>
+using ValueOf = std::decay_t<decltype(*std::declval<M>().getp(0))>;
+
 template <class M>
 static const M gen_map(size_t size)
 {
-  auto v = gen_val(val_size);
+  auto v = gen_val<ValueOf<M>>(val_size);
 
   M map;
   for (uint64_t i = 0; i < size; ++i)
@@ -53,8 +94,9 @@ template <class M>
 static void benchmark_put(picobench::state& s)
 {
   size_t size = s.iterations();
-  auto v = gen_val(val_size);
+  auto v = gen_val<ValueOf<M>>(val_size);
   auto map = gen_map<M>(size);
+  const size_t allocations_before = allocations;
   s.start_timer();
   for (auto _ : s)
   {
@@ -64,6 +106,7 @@ static void benchmark_put(picobench::state& s)
     clobber_memory();
   }
   s.stop_timer();
+  s.set_result((allocations - allocations_before) / size);
 }
 
 template <class M>
@@ -124,6 +167,15 @@ auto bench_rb_map_put = benchmark_put<RBMap<K, V>>;
 PICOBENCH(bench_rb_map_put).iterations(sizes).samples(10).baseline();
 auto bench_champ_map_put = benchmark_put<champ::Map<K, V>>;
 PICOBENCH(bench_champ_map_put).iterations(sizes).samples(10);
+auto bench_champ_map_put_atomic =
+  benchmark_put<champ::Map<K, V, std::hash<K>, champ::ThreadSafe>>;
+PICOBENCH(bench_champ_map_put_atomic).iterations(sizes).samples(10);
+
+PICOBENCH_SUITE("put small");
+auto bench_rb_map_put_small = benchmark_put<RBMap<K, SmallV>>;
+PICOBENCH(bench_rb_map_put_small).iterations(sizes).samples(10).baseline();
+auto bench_champ_map_put_small = benchmark_put<champ::Map<K, SmallV>>;
+PICOBENCH(bench_champ_map_put_small).iterations(sizes).samples(10);
 
 PICOBENCH_SUITE("get");
 auto bench_rb_map_get = benchmark_get<RBMap<K, V>>;
@@ -135,6 +187,12 @@ PICOBENCH(bench_champ_map_get).iterations(sizes).samples(10);
 auto bench_champ_map_getp = benchmark_getp<champ::Map<K, V>>;
 PICOBENCH(bench_champ_map_getp).iterations(sizes).samples(10);
 
+PICOBENCH_SUITE("getp small");
+auto bench_rb_map_getp_small = benchmark_getp<RBMap<K, SmallV>>;
+PICOBENCH(bench_rb_map_getp_small).iterations(sizes).samples(10).baseline();
+auto bench_champ_map_getp_small = benchmark_getp<champ::Map<K, SmallV>>;
+PICOBENCH(bench_champ_map_getp_small).iterations(sizes).samples(10);
+
 const std::vector<int> for_sizes = {32 << 4, 32 << 5, 32 << 6};
 
 PICOBENCH_SUITE("foreach");
@@ -5,6 +5,7 @@
 #include "../rbmap.h"
 
 #include <doctest/doctest.h>
+#include <map>
 #include <random>
 
 using namespace std;
@@ -136,3 +137,104 @@ TEST_CASE("persistent map operations")
     champ = champ_new;
   }
 }
+
+template <class T>
+T make_value(uint64_t v);
+
+template <>
+V make_value<V>(uint64_t v)
+{
+  return v;
+}
+
+template <>
+string make_value<string>(uint64_t v)
+{
+  // Long enough not to fit inline in the map's nodes
+  return string(64, 'x') + to_string(v);
+}
+
+// Small entries are stored inline in the nodes, large ones are boxed
+TEST_CASE_TEMPLATE(
+  "persistent map removal",
+  M,
+  champ::Map<K, V, H>,
+  champ::Map<K, string, H, champ::ThreadSafe>)
+{
+  using MV = decay_t<decltype(*M().getp(0))>;
+
+  random_device rand_dev;
+  auto seed = rand_dev();
+  INFO("seed: " << seed);
+  mt19937 gen(seed);
+
+  // The model is a plain map, copied alongside each version of the champ
+  std::map<K, MV> model;
+  M champ;
+
+  auto check = [](const std::map<K, MV>& m, const M& c) {
+    REQUIRE(c.size() == m.size());
+    size_t n = 0;
+    c.foreach([&](const auto& k, const auto& v) {
+      n++;
+      auto it = m.find(k);
+      REQUIRE(it != m.end());
+      REQUIRE(it->second == v);
+      return true;
+    });
+    REQUIRE(n == m.size());
+    for (const auto& [k, v] : m)
+      REQUIRE(c.get(k) == v);
+  };
+
+  vector<K> keys;
+  for (uint64_t i = 0; i < 1000; ++i)
+  {
+    auto prev_model = model;
+    auto prev_champ = champ;
+
+    if (keys.empty() || gen() % 3 != 0)
+    {
+      auto k = gen();
+      auto v = make_value<MV>(i);
+      keys.push_back(k);
+      model[k] = v;
+      champ = champ.put(k, v);
+    }
+    else
+    {
+      uniform_int_distribution<> gen_idx(0, keys.size() - 1);
+      auto i = gen_idx(gen);
+      auto k = keys[i];
+      keys.erase(keys.begin() + i);
+
+      model.erase(k);
+      champ = champ.remove(k);
+      REQUIRE(!champ.get(k).has_value());
+    }
+
+    INFO("check consistency of persistent maps");
+    check(model, champ);
+
+    INFO("check persistence of previous versions");
+    check(prev_model, prev_champ);
+  }
+
+  INFO("removing an absent key is a no-op");
+  {
+    auto k = gen();
+    while (model.find(k) != model.end())
+      k = gen();
+    auto c = champ.remove(k);
+    check(model, c);
+  }
+
+  INFO("remove all keys");
+  for (auto k : keys)
+  {
+    champ = champ.remove(k);
+    model.erase(k);
+  }
+  check(model, champ);
+  REQUIRE(champ.empty());
+}
@@ -254,6 +254,89 @@ TEST_CASE("Basic message loop" * doctest::test_suite("messaging"))
   }
 }
 
+TEST_CASE("Batch handlers" * doctest::test_suite("messaging"))
+{
+  enum : Message
+  {
+    add = Const::msg_min,
+    set,
+    finish
+  };
+
+  BufferProcessor bp;
+
+  Reader loop_src(1 << 10);
+  Writer test_filler(loop_src);
+
+  size_t x = 0;
+  size_t batches = 0;
+
+  DISPATCHER_SET_BATCH_HANDLER(bp, add, [&](const Batch& batch) {
+    ++batches;
+    for (const auto& msg : batch)
+    {
+      auto data = msg.data;
+      auto size = msg.size;
+      x += serialized::read<uint8_t>(data, size);
+    }
+  });
+  DISPATCHER_SET_MESSAGE_HANDLER(bp, set, [&](const uint8_t* data, size_t size) {
+    x = serialized::read<uint8_t>(data, size);
+  });
+  DISPATCHER_SET_MESSAGE_HANDLER(
+    bp, finish, [&](const uint8_t*, size_t) { bp.set_finished(); });
+
+  SUBCASE("Batch and message handlers are exclusive")
+  {
+    REQUIRE_THROWS_AS(
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        bp, add, [](const uint8_t*, size_t) {}),
+      messaging::already_handled);
+    REQUIRE_THROWS_AS(
+      DISPATCHER_SET_BATCH_HANDLER(bp, set, [](const Batch&) {}),
+      messaging::already_handled);
+  }
+
+  SUBCASE("Consecutive messages are passed to batch handlers together")
+  {
+    for (uint8_t i = 1; i <= 4; ++i)
+      test_filler.write(add, i);
+    test_filler.write(set, (uint8_t)100);
+    test_filler.write(add, (uint8_t)5);
+    test_filler.write(finish);
+
+    REQUIRE(bp.run(loop_src) == 7);
+    REQUIRE(x == 105);
+    REQUIRE(batches == 2);
+  }
+
+  SUBCASE("Batch handlers receive single dispatched messages")
+  {
+    const uint8_t n = 7;
+    bp.get_dispatcher().dispatch(add, &n, sizeof(n));
+    REQUIRE(x == n);
+    REQUIRE(batches == 1);
+  }
+
+  SUBCASE("Message handlers can be replaced while dispatching a batch")
+  {
+    auto& d = bp.get_dispatcher();
+    d.remove_message_handler(set);
+    DISPATCHER_SET_MESSAGE_HANDLER(d, set, [&](const uint8_t*, size_t) {
+      d.remove_message_handler(set);
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        d, set, [&](const uint8_t*, size_t) { x += 10; });
+    });
+
+    for (size_t i = 0; i < 3; ++i)
+      test_filler.write(set, (uint8_t)0);
+    test_filler.write(finish);
+
+    REQUIRE(bp.run(loop_src) == 4);
+    REQUIRE(x == 20);
+  }
+}
+
 TEST_CASE("Multiple threads" * doctest::test_suite("messaging"))
 {
   enum : Message
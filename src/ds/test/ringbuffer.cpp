@@ -438,6 +438,72 @@ TEST_CASE("Ring buffer with mixed messages" * doctest::test_suite("ringbuffer"))
   }
 }
 
+TEST_CASE("Batched reads" * doctest::test_suite("ringbuffer"))
+{
+  constexpr size_t size = 1 << 12;
+
+  Reader r(size);
+  Writer w(r);
+
+  std::vector<std::pair<Message, size_t>> batches;
+  auto record = [&](const Batch& batch) {
+    for (const auto& msg : batch)
+    {
+      handle_message(batch.m, msg.data, msg.size);
+    }
+    batches.emplace_back(batch.m, batch.size());
+    return true;
+  };
+
+  INFO("Consecutive messages of the same type are batched");
+  {
+    for (uint8_t i = 0; i < 3; ++i)
+      REQUIRE(w.try_write(small_message, i));
+    REQUIRE(w.try_write(empty_message));
+    for (uint8_t i = 0; i < 2; ++i)
+      REQUIRE(w.try_write(small_message, i));
+
+    REQUIRE(r.read_batch(-1, record) == 6);
+    REQUIRE(
+      batches ==
+      std::vector<std::pair<Message, size_t>>{
+        {small_message, 3}, {empty_message, 1}, {small_message, 2}});
+    REQUIRE(r.read_batch(-1, record) == 0);
+  }
+
+  INFO("Batches respect the limit and the maximum batch size");
+  {
+    batches.clear();
+    const auto count = Reader::max_batch_size + 10;
+    for (size_t i = 0; i < count; ++i)
+      REQUIRE(w.try_write(small_message, (uint8_t)i));
+
+    REQUIRE(r.read_batch(5, record) == 5);
+    REQUIRE(r.read_batch(-1, record) == count - 5);
+    REQUIRE(
+      batches ==
+      std::vector<std::pair<Message, size_t>>{
+        {small_message, 5},
+        {small_message, Reader::max_batch_size},
+        {small_message, count - 5 - Reader::max_batch_size}});
+  }
+
+  INFO("Returning false stops reading, leaving later messages");
+  {
+    batches.clear();
+    REQUIRE(w.try_write(small_message, (uint8_t)1));
+    REQUIRE(w.try_write(empty_message));
+    REQUIRE(w.try_write(small_message, (uint8_t)2));
+
+    REQUIRE(r.read_batch(-1, [&](const Batch& batch) {
+      record(batch);
+      return false;
+    }) == 1);
+    REQUIRE(r.read(-1, handle_message) == 2);
+    REQUIRE(last_message_body[0] == 2);
+  }
+}
+
 TEST_CASE("Multiple threads can wait" * doctest::test_suite("ringbuffer"))
 {
   constexpr size_t size = 32u;
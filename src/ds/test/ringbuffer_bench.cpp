@@ -30,7 +30,17 @@ void sleep_handler(ringbuffer::Message m, const uint8_t*, size_t)
   std::this_thread::sleep_for(t);
 }
 
+// Calls the per-message handler for each message of the batch, without the
+// std::function indirection of each Reader::read callback
 template <ReadHandler H>
+bool batch_handler(const Batch& batch)
+{
+  for (const auto& msg : batch)
+    H(batch.m, msg.data, msg.size);
+  return true;
+}
+
+template <ReadHandler H, bool Batched>
 static void write_impl(
   picobench::state& s,
   size_t buf_size,
@@ -72,7 +82,11 @@ static void write_impl(
 
   while (reads < total_messages)
   {
-    auto read_count = r.read(-1, H);
+    size_t read_count;
+    if constexpr (Batched)
+      read_count = r.read_batch(-1, batch_handler<H>);
+    else
+      read_count = r.read(-1, H);
     reads += read_count;
     CCF_PAUSE();
   }
@@ -105,12 +119,13 @@ template <
   size_t BufSize = DefaultBufSize,
   size_t MessageSize = DefaultMessageSize,
   size_t WriterCount = DefaultWriterCount,
-  ReadHandler H = nop_handler>
+  ReadHandler H = nop_handler,
+  bool Batched = false>
 static void specialize(picobench::state& s)
 {
   const auto msg_count = s.iterations();
 
-  write_impl<H>(s, BufSize, MessageSize, WriterCount, msg_count);
+  write_impl<H, Batched>(s, BufSize, MessageSize, WriterCount, msg_count);
 }
 
 //
@@ -181,3 +196,14 @@ auto spin_200 = specialize<32, 1, 4, spin_pause_handler<200>>;
 FIXED_PICO(spin_200);
 auto spin_400 = specialize<32, 1, 4, spin_pause_handler<400>>;
 FIXED_PICO(spin_400);
+
+PICOBENCH_SUITE("batched reads (64k buffer, 16b per-message, 4 writers)");
+auto unbatched_64k = specialize<1 << 16, 16, 4>;
+FIXED_PICO(unbatched_64k);
+auto batched_64k = specialize<1 << 16, 16, 4, nop_handler, true>;
+FIXED_PICO(batched_64k);
+auto unbatched_spin_64k = specialize<1 << 16, 16, 4, spin_pause_handler<10>>;
+FIXED_PICO(unbatched_spin_64k);
+auto batched_spin_64k =
+  specialize<1 << 16, 16, 4, spin_pause_handler<10>, true>;
+FIXED_PICO(batched_spin_64k);
@@ -0,0 +1,276 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "ds/logger.h"
+#include "ds/ringbuffer_types.h"
+#include "ds/spinlock.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+
+namespace tracing
+{
+  /** Request tracing
+   *
+   * A sample of the requests received by the enclave are traced: each of them
+   * is given a trace id, and an event is emitted to the host whenever it
+   * reaches one of the stages below. Events are small fixed-size ringbuffer
+   * messages, dropped rather than waited for if the ringbuffer is full, and
+   * requests that are not sampled only cost a thread-local counter increment.
+   */
+  enum class Stage : uint8_t
+  {
+    // Bytes of the request received by the session
+    Recv = 0,
+    // Request parsed, and about to be dispatched to a frontend
+    HandleRequest,
+    // Frontend about to execute the handler
+    Execute,
+    // Handler executed, transaction about to be committed to the kv
+    Commit,
+    // Transaction handed to consensus for replication
+    Replicate,
+    // Transaction committed to the kv
+    Committed,
+    // Transaction globally committed
+    GlobalCommit
+  };
+
+  inline const char* stage_name(Stage s)
+  {
+    switch (s)
+    {
+      case Stage::Recv:
+        return "recv";
+      case Stage::HandleRequest:
+        return "handle_request";
+      case Stage::Execute:
+        return "execute";
+      case Stage::Commit:
+        return "commit";
+      case Stage::Replicate:
+        return "replicate";
+      case Stage::Committed:
+        return "committed";
+      case Stage::GlobalCommit:
+        return "global_commit";
+      default:
+        return "unknown";
+    }
+  }
+
+  using TraceId = uint64_t;
+  static constexpr TraceId NoTrace = 0;
+
+  using Clock = std::chrono::steady_clock;
+
+  /// Tracing related ringbuffer messages
+  enum : ringbuffer::Message
+  {
+    /// A traced request reached a stage. Enclave -> Host
+    DEFINE_RINGBUFFER_MSG_TYPE(trace_event),
+  };
+
+  struct config
+  {
+    // One request in every sample_interval is traced, 0 to disable tracing
+    static inline std::atomic<size_t>& sample_interval()
+    {
+      static std::atomic<size_t> the_interval = 0;
+      return the_interval;
+    }
+
+    static inline ringbuffer::WriterPtr& writer()
+    {
+      static ringbuffer::WriterPtr the_writer;
+      return the_writer;
+    }
+  };
+
+  inline bool enabled()
+  {
+    return config::sample_interval() != 0 && config::writer() != nullptr;
+  }
+
+  /** Emit an event for a traced request
+   *
+   * @param id Trace id of the request, nothing is emitted for NoTrace
+   * @param stage Stage the request reached
+   * @param seqno Sequence number of the transaction of the request, if known
+   */
+  inline void record(TraceId id, Stage stage, uint64_t seqno = 0)
+  {
+    if (id == NoTrace || config::writer() == nullptr)
+      return;
+
+    const uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+                          Clock::now().time_since_epoch())
+                          .count();
+#ifdef INSIDE_ENCLAVE
+    const uint16_t thread_id = thread_ids[std::this_thread::get_id()];
+#else
+    const uint16_t thread_id = 0;
+#endif
+
+    RINGBUFFER_TRY_WRITE_MESSAGE(
+      trace_event,
+      config::writer(),
+      id,
+      static_cast<uint8_t>(stage),
+      thread_id,
+      us,
+      seqno);
+  }
+
+  /** Decide whether to trace a new request, and if so emit its first event
+   *
+   * @return Trace id of the new request, or NoTrace if it is not sampled
+   */
+  inline TraceId start()
+  {
+    const auto interval = config::sample_interval().load();
+    if (interval == 0)
+      return NoTrace;
+
+    thread_local size_t count = 0;
+    if (++count % interval != 0)
+      return NoTrace;
+
+    static std::atomic<TraceId> next_id = NoTrace + 1;
+    const auto id = next_id++;
+    record(id, Stage::Recv);
+    return id;
+  }
+
+  /** Trace id of the request executing on this thread, so that the stages
+   * reached below the frontend (kv commit, replication) can be attributed
+   * to it
+   */
+  inline TraceId& current()
+  {
+    thread_local TraceId the_current = NoTrace;
+    return the_current;
+  }
+
+  /// Sets the trace id of the request executing on this thread, in scope
+  class Scope
+  {
+  private:
+    TraceId previous;
+
+  public:
+    Scope(TraceId id) : previous(current())
+    {
+      current() = id;
+    }
+
+    ~Scope()
+    {
+      current() = previous;
+    }
+  };
+
+  /** Trace ids of the transactions committed by traced requests, by version,
+   * until they are globally committed
+   */
+  class Versions
+  {
+  private:
+    // Traced transactions committed beyond this many are not traced further
+    static constexpr size_t max_versions = 1024;
+
+    SpinLock lock;
+    std::map<uint64_t, TraceId> versions;
+    std::atomic<size_t> count = 0;
+
+  public:
+    static Versions& get()
+    {
+      static Versions the_versions;
+      return the_versions;
+    }
+
+    /** Attribute version to the request executing on this thread, if traced
+     *
+     * @param version Version of the transaction being committed
+     */
+    void add(uint64_t version)
+    {
+      const auto id = current();
+      if (id == NoTrace)
+        return;
+
+      std::lock_guard<SpinLock> guard(lock);
+      if (versions.size() < max_versions)
+      {
+        versions[version] = id;
+        count = versions.size();
+      }
+    }
+
+    /** Emit an event for version if it was committed by a traced request
+     *
+     * @param version Version of the transaction
+     * @param stage Stage reached by the transaction
+     */
+    void record(uint64_t version, Stage stage)
+    {
+      if (count == 0)
+        return;
+
+      TraceId id = NoTrace;
+      {
+        std::lock_guard<SpinLock> guard(lock);
+        auto search = versions.find(version);
+        if (search == versions.end())
+          return;
+        id = search->second;
+      }
+      tracing::record(id, stage, version);
+    }
+
+    /** Emit the GlobalCommit events of all the traced transactions up to
+     * version, which are then not traced further
+     *
+     * @param version Globally committed version
+     */
+    void global_commit(uint64_t version)
+    {
+      if (count == 0)
+        return;
+
+      std::lock_guard<SpinLock> guard(lock);
+      auto end = versions.upper_bound(version);
+      for (auto it = versions.begin(); it != end; ++it)
+        tracing::record(it->second, Stage::GlobalCommit, it->first);
+      versions.erase(versions.begin(), end);
+      count = versions.size();
+    }
+
+    /** Forget the traced transactions after version, which have been rolled
+     * back
+     *
+     * @param version Last version that is kept
+     */
+    void rollback(uint64_t version)
+    {
+      if (count == 0)
+        return;
+
+      std::lock_guard<SpinLock> guard(lock);
+      versions.erase(versions.upper_bound(version), versions.end());
+      count = versions.size();
+    }
+  };
+}
+
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  tracing::trace_event,
+  tracing::TraceId,
+  uint8_t /* stage */,
+  uint16_t /* thread id */,
+  uint64_t /* microseconds */,
+  uint64_t /* seqno, 0 if unknown */);
@@ -5,6 +5,7 @@
 #include "crypto/hash.h"
 #include "ds/logger.h"
 #include "ds/oversized.h"
+#include "ds/tracing.h"
 #include "interface.h"
 #include "node/entities.h"
 #include "node/networkstate.h"
@@ -58,7 +59,10 @@ namespace enclave
       consensus_type(consensus_type_)
     {
       logger::config::msg() = AdminMessage::log_msg;
+      logger::config::site_msg() = AdminMessage::log_site;
+      logger::config::binary_msg() = AdminMessage::log_binary;
       logger::config::writer() = writer_factory.create_writer_to_outside();
+      tracing::config::writer() = writer_factory.create_writer_to_outside();
 
       REGISTER_FRONTEND(
         rpc_map,
@@ -76,6 +80,7 @@ namespace enclave
         fe->set_sig_intervals(
           signature_intervals.sig_max_tx, signature_intervals.sig_max_ms);
         fe->set_cmd_forwarder(cmd_forwarder);
+        fe->set_rpc_responder(rpcsessions);
       }
 
       node.initialize(consensus_config, n2n_channels, rpc_map, cmd_forwarder);
@@ -100,6 +105,7 @@ namespace enclave
 
       start_type = start_type_;
       ccf_config = ccf_config_;
+      tracing::config::sample_interval() = ccf_config.trace_sample_interval;
 
       auto r = node.create({start_type, ccf_config});
       if (!r.second)
@@ -214,24 +220,27 @@ namespace enclave
 
         DISPATCHER_SET_MESSAGE_HANDLER(
           bp,
-          consensus::ledger_entry,
+          consensus::ledger_entries,
           [this](const uint8_t* data, size_t size) {
-            auto [body] =
-              ringbuffer::read_message<consensus::ledger_entry>(data, size);
-            if (node.is_reading_public_ledger())
-              node.recover_public_ledger_entry(body);
-            else if (node.is_reading_private_ledger())
-              node.recover_private_ledger_entry(body);
-            else
-              LOG_FAIL_FMT("Cannot recover ledger entry: Unexpected state");
+            auto [token, from, body] =
+              ringbuffer::read_message<consensus::ledger_entries>(data, size);
+            node.recv_ledger_entries(token, from, body.data(), body.size());
           });
 
         DISPATCHER_SET_MESSAGE_HANDLER(
           bp,
-          consensus::ledger_no_entry,
+          consensus::ledger_durable,
           [this](const uint8_t* data, size_t size) {
-            ringbuffer::read_message<consensus::ledger_no_entry>(data, size);
-            node.recover_ledger_end();
+            auto [idx] =
+              ringbuffer::read_message<consensus::ledger_durable>(data, size);
+            node.set_ledger_durable_idx(idx);
+          });
+
+        DISPATCHER_SET_MESSAGE_HANDLER(
+          bp, ccf::merkle_nodes, [this](const uint8_t* data, size_t size) {
+            auto [token, body] =
+              ringbuffer::read_message<ccf::merkle_nodes>(data, size);
+            node.recv_merkle_nodes(token, body.data(), body.size());
           });
 
         rpcsessions->register_message_handlers(bp.get_dispatcher());
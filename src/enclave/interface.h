@@ -60,17 +60,28 @@ struct CCFConfig
     std::string target_port;
     std::vector<uint8_t> network_cert;
     size_t join_timer;
-    MSGPACK_DEFINE(target_host, target_port, network_cert, join_timer);
+    // Latest snapshot available to the host, if any
+    std::vector<uint8_t> snapshot;
+    MSGPACK_DEFINE(
+      target_host, target_port, network_cert, join_timer, snapshot);
   };
   Joining joining = {};
 
+  size_t snapshot_tx_interval = 0;
+
+  // One request in every trace_sample_interval is traced (see tracing.h), 0
+  // to disable tracing
+  size_t trace_sample_interval = 0;
+
   MSGPACK_DEFINE(
     consensus_config,
     node_info_network,
     domain,
     signature_intervals,
     genesis,
-    joining);
+    joining,
+    snapshot_tx_interval,
+    trace_sample_interval);
 };
 
 /// General administrative messages
@@ -79,6 +90,13 @@ enum AdminMessage : ringbuffer::Message
   /// Log message. Enclave -> Host
   DEFINE_RINGBUFFER_MSG_TYPE(log_msg),
 
+  /// Register a logging call site and its format string. Enclave -> Host
+  DEFINE_RINGBUFFER_MSG_TYPE(log_site),
+
+  /// Log message from a registered call site, with its arguments encoded by
+  /// logger::binary::encode. Enclave -> Host
+  DEFINE_RINGBUFFER_MSG_TYPE(log_binary),
+
   /// Fatal error message. Enclave -> Host
   DEFINE_RINGBUFFER_MSG_TYPE(fatal_error_msg),
 
@@ -103,6 +121,19 @@ DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
   logger::Level,
   uint16_t,
   std::string);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  AdminMessage::log_site,
+  uint32_t,
+  std::string,
+  size_t,
+  logger::Level,
+  std::string);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  AdminMessage::log_binary,
+  std::chrono::milliseconds,
+  uint32_t,
+  uint16_t,
+  serializer::ByteRange);
 DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(AdminMessage::fatal_error_msg, std::string);
 DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
   AdminMessage::sealed_secrets, kv::Version, std::vector<uint8_t>);
@@ -2,6 +2,7 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 
+#include "ds/tracing.h"
 #include "node/clientsignatures.h"
 #include "node/entities.h"
 
@@ -51,6 +52,14 @@ namespace enclave
     {}
   };
 
+  enum class ReadIndexState
+  {
+    None,
+    Pending,
+    Reached,
+    Failed
+  };
+
   class RpcContext
   {
   public:
@@ -61,6 +70,13 @@ namespace enclave
 
     bool is_create_request = false;
 
+    // Linearizable reads on a backup wait for the commit index to reach the
+    // primary's (see kv::Consensus::read_index) before they are executed
+    ReadIndexState read_index = ReadIndexState::None;
+
+    // Set if the request was sampled for tracing (see tracing::start)
+    tracing::TraceId trace_id = tracing::NoTrace;
+
     RpcContext(std::shared_ptr<SessionContext> s) : session(s) {}
 
     RpcContext(
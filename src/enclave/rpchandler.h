@@ -20,6 +20,8 @@ namespace enclave
     virtual void set_sig_intervals(size_t sig_max_tx_, size_t sig_max_ms_) = 0;
     virtual void set_cmd_forwarder(
       std::shared_ptr<AbstractForwarder> cmd_forwarder_) = 0;
+    virtual void set_rpc_responder(
+      std::shared_ptr<AbstractRPCResponder> rpcresponder_) = 0;
     virtual void tick(std::chrono::milliseconds elapsed_ms_count) {}
     virtual void open() = 0;
     virtual bool is_open() = 0;
@@ -28,6 +30,15 @@ namespace enclave
     virtual std::optional<std::vector<uint8_t>> process(
       std::shared_ptr<RpcContext> ctx) = 0;
 
+    // Used by rpcendpoint to pick which of num_workers worker threads an
+    // incoming client RPC is processed on. If nullopt, it is processed on the
+    // thread of the session it was received on
+    virtual std::optional<uint16_t> schedule(
+      std::shared_ptr<RpcContext> ctx, uint16_t num_workers)
+    {
+      return std::nullopt;
+    }
+
     // Used by PBFT to execute commands
     struct ProcessPbftResp
     {
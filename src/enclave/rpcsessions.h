@@ -120,19 +120,33 @@ namespace enclave
           accept(id);
         });
 
-      DISPATCHER_SET_MESSAGE_HANDLER(
-        disp, tls::tls_inbound, [this](const uint8_t* data, size_t size) {
-          auto [id, body] =
-            ringbuffer::read_message<tls::tls_inbound>(data, size);
-
-          auto search = sessions.find(id);
-          if (search == sessions.end())
+      DISPATCHER_SET_BATCH_HANDLER(
+        disp, tls::tls_inbound, [this](const ringbuffer::Batch& batch) {
+          // Consecutive messages are often for the same session, so only look
+          // it up when the session changes
+          std::shared_ptr<Endpoint> session;
+          size_t session_id = 0;
+
+          for (const auto& msg : batch)
           {
-            throw std::logic_error(
-              "tls_inbound for unknown session: " + std::to_string(id));
+            auto [id, body] =
+              ringbuffer::read_message<tls::tls_inbound>(msg.data, msg.size);
+
+            if (session == nullptr || id != session_id)
+            {
+              auto search = sessions.find(id);
+              if (search == sessions.end())
+              {
+                throw std::logic_error(
+                  "tls_inbound for unknown session: " + std::to_string(id));
+              }
+
+              session = search->second;
+              session_id = id;
+            }
+
+            session->recv(body.data, body.size);
           }
-
-          search->second->recv(body.data, body.size);
         });
 
       DISPATCHER_SET_MESSAGE_HANDLER(
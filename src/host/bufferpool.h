@@ -0,0 +1,61 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace asynchost
+{
+  // Fixed-size buffers for socket reads and writes, reused rather than
+  // allocated for each operation. Buffers are allocated with new[], so a
+  // buffer that is never returned to the pool can be released with delete[].
+  // Only used from the uv loop thread.
+  class BufferPool
+  {
+  public:
+    static constexpr size_t buffer_size = 16384;
+
+  private:
+    static constexpr size_t max_free_buffers = 1024;
+    std::vector<uint8_t*> free_buffers;
+
+  public:
+    ~BufferPool()
+    {
+      for (auto b : free_buffers)
+        delete[] b;
+    }
+
+    uint8_t* get()
+    {
+      if (free_buffers.empty())
+        return new uint8_t[buffer_size];
+
+      auto b = free_buffers.back();
+      free_buffers.pop_back();
+      return b;
+    }
+
+    void put(uint8_t* b)
+    {
+      if (free_buffers.size() < max_free_buffers)
+        free_buffers.push_back(b);
+      else
+        delete[] b;
+    }
+
+    size_t free_count() const
+    {
+      return free_buffers.size();
+    }
+
+    static BufferPool& instance()
+    {
+      // Never destroyed, since connections may return buffers during exit
+      static auto pool = new BufferPool;
+      return *pool;
+    }
+  };
+}
@@ -48,6 +48,23 @@ namespace asynchost
             file_name, line_number, log_level, thread_id, msg, elapsed.count());
         });
 
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        bp, AdminMessage::log_site, [](const uint8_t* data, size_t size) {
+          auto [id, file_name, line_number, log_level, format] =
+            ringbuffer::read_message<AdminMessage::log_site>(data, size);
+
+          logger::binary::sites()[id] = {
+            file_name, line_number, log_level, format};
+        });
+
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        bp, AdminMessage::log_binary, [](const uint8_t* data, size_t size) {
+          auto [elapsed, id, thread_id, args] =
+            ringbuffer::read_message<AdminMessage::log_binary>(data, size);
+
+          logger::binary::write(elapsed, id, thread_id, args.data, args.size);
+        });
+
       DISPATCHER_SET_MESSAGE_HANDLER(
         bp,
         AdminMessage::fatal_error_msg,
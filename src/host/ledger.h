@@ -3,141 +3,1244 @@
 #pragma once
 
 #include "consensus/ledgerenclavetypes.h"
+#include "ds/files.h"
 #include "ds/logger.h"
 #include "ds/messaging.h"
+#include "ds/serializer.h"
 
+#include <algorithm>
+#include <chrono>
+#include <climits>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
+#include <deque>
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <memory>
+#include <optional>
 #include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
+#include <uv.h>
 #include <vector>
+#include <zlib.h>
 
 namespace asynchost
 {
-  class Ledger
+  static constexpr size_t frame_header_size = sizeof(uint32_t);
+
+  // A ledger is a directory of chunk files, each holding the framed entries
+  // for a contiguous range of indices:
+  // - ledger_<start> is a chunk that may still be written to or truncated.
+  // - ledger_<start>-<end>.committed is a sealed chunk, whose entries are
+  // all committed. It is never modified again and is read through mmap.
+  // - ledger_<start>-<end>.index holds the offsets of the entries in the
+  // corresponding sealed chunk, so that it does not need to be scanned.
+  // - ledger_<start>-<end>.committed.z is a sealed chunk that has been
+  // compressed, as the size of its uncompressed contents followed by the
+  // zlib stream of these contents. It is decompressed in memory, on the host
+  // loop, when read.
+  static constexpr auto ledger_prefix = "ledger_";
+  static constexpr auto ledger_committed_suffix = ".committed";
+  static constexpr auto ledger_index_suffix = ".index";
+  static constexpr auto ledger_compressed_suffix = ".z";
+
+  class LedgerFile
   {
   private:
-    static constexpr size_t frame_header_size = sizeof(uint32_t);
+    const std::string dir;
+    // Index of the first entry in the chunk
+    const size_t start_idx;
+    // Index of the last entry in the chunk, only known up front for sealed
+    // chunks, whose offsets are loaded lazily
+    size_t end_idx = 0;
+    bool committed;
+    bool compressed = false;
 
-    // This uses C stdio instead of fstream because an fstream
-    // cannot be truncated.
-    FILE* file;
+    // Offsets of the entries in the chunk, and of the end of the last entry
     std::vector<size_t> positions;
-    size_t total_len;
-    ringbuffer::WriterPtr to_enclave;
+    size_t total_len = 0;
+    bool positions_loaded;
+
+    int fd = -1;
+
+    // Entries are staged in memory and written to the file together by
+    // flush(). Buffers are kept across flushes to reuse their allocations.
+    std::vector<std::vector<uint8_t>> pending;
+    size_t pending_count = 0;
+    size_t written_len = 0;
+    size_t synced_len = 0;
+
+    // Contents of a sealed chunk, either mapped from the file or, if the
+    // chunk is compressed, decompressed in memory
+    const uint8_t* mapping = nullptr;
+    size_t mapping_size = 0;
+    std::vector<uint8_t> decompressed;
+
+    std::string file_name() const
+    {
+      if (committed)
+        return fmt::format(
+          "{}{}-{}{}{}",
+          ledger_prefix,
+          start_idx,
+          end_idx,
+          ledger_committed_suffix,
+          compressed ? ledger_compressed_suffix : "");
+      else
+        return fmt::format("{}{}", ledger_prefix, start_idx);
+    }
+
+    std::string index_name() const
+    {
+      return fmt::format(
+        "{}{}-{}{}", ledger_prefix, start_idx, end_idx, ledger_index_suffix);
+    }
+
+    std::string path(const std::string& name) const
+    {
+      return fmt::format("{}/{}", dir, name);
+    }
+
+    // Rebuilds the offsets from the frame headers in [data, data + len)
+    void scan(const uint8_t* data, size_t len)
+    {
+      positions.clear();
+      size_t pos = 0;
+
+      while (len - pos >= frame_header_size)
+      {
+        uint32_t size;
+        memcpy(&size, data + pos, frame_header_size);
+
+        if (len - pos - frame_header_size < size)
+          throw std::logic_error(
+            fmt::format("Malformed ledger file {}", file_name()));
+
+        positions.push_back(pos);
+        pos += (size + frame_header_size);
+      }
+
+      if (pos != len)
+        throw std::logic_error(
+          fmt::format("Malformed ledger file {}", file_name()));
+
+      total_len = pos;
+    }
+
+    void map()
+    {
+      if (mapping != nullptr)
+        return;
+
+      if (compressed)
+      {
+        decompress();
+        return;
+      }
+
+      auto p = path(file_name());
+      auto fd = open(p.c_str(), O_RDONLY);
+      if (fd == -1)
+        throw std::logic_error(
+          fmt::format("Unable to open ledger file {}: {}", p, strerror(errno)));
+
+      struct stat st;
+      if (fstat(fd, &st) != 0)
+      {
+        close(fd);
+        throw std::logic_error(
+          fmt::format("Failed to stat ledger file {}: {}", p, strerror(errno)));
+      }
+
+      mapping_size = st.st_size;
+      auto m = mmap(nullptr, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+      close(fd);
+
+      if (m == MAP_FAILED)
+        throw std::logic_error(
+          fmt::format("Failed to map ledger file {}: {}", p, strerror(errno)));
+
+      mapping = static_cast<const uint8_t*>(m);
+    }
+
+    void decompress()
+    {
+      auto data = files::slurp(path(file_name()));
+      const uint8_t* p = data.data();
+      size_t size = data.size();
+      auto len = serialized::read<uint64_t>(p, size);
+
+      decompressed.resize(len);
+      uLongf out_len = len;
+      if (
+        uncompress(decompressed.data(), &out_len, p, size) != Z_OK ||
+        out_len != len)
+      {
+        decompressed.clear();
+        throw std::logic_error(
+          fmt::format("Malformed compressed ledger file {}", file_name()));
+      }
+
+      mapping = decompressed.data();
+      mapping_size = len;
+    }
+
+    // Size of the contents of a sealed chunk, read from its header if it is
+    // compressed so that it is not decompressed until an entry is read
+    size_t contents_size()
+    {
+      if (!compressed || mapping != nullptr)
+      {
+        map();
+        return mapping_size;
+      }
+
+      auto p = path(file_name());
+      auto fd = open(p.c_str(), O_RDONLY);
+      if (fd == -1)
+        throw std::logic_error(
+          fmt::format("Unable to open ledger file {}: {}", p, strerror(errno)));
+
+      uint64_t len;
+      auto rc = pread(fd, &len, sizeof(len), 0);
+      close(fd);
+      if (rc != sizeof(len))
+        throw std::logic_error(
+          fmt::format("Malformed compressed ledger file {}", file_name()));
+
+      return len;
+    }
+
+    void load_positions()
+    {
+      if (positions_loaded)
+        return;
+
+      auto index = files::slurp(path(index_name()), true);
+      auto count = end_idx - start_idx + 1;
+
+      if (index.size() == (count + 1) * sizeof(uint64_t))
+      {
+        positions.resize(count);
+        auto offsets = reinterpret_cast<const uint64_t*>(index.data());
+        std::copy(offsets, offsets + count, positions.begin());
+        total_len = offsets[count];
+      }
+      else
+      {
+        // The index is missing or was not fully written, rebuild it
+        LOG_FAIL_FMT("Rebuilding ledger index {}", index_name());
+        map();
+        scan(mapping, mapping_size);
+        write_index();
+      }
+
+      if (positions.size() != count || total_len != contents_size())
+        throw std::logic_error(
+          fmt::format("Ledger index {} does not match chunk", index_name()));
+
+      positions_loaded = true;
+    }
+
+    // Write a file durably, so that it either exists in full or not at all
+    static void write_file(
+      const std::string& p, const void* data, size_t size)
+    {
+      auto tmp = p + ".tmp";
+      auto f = fopen(tmp.c_str(), "wb");
+      if (!f)
+        throw std::logic_error(fmt::format("Unable to create {}", tmp));
+
+      auto ok = fwrite(data, size, 1, f) == 1;
+      ok = ok && fflush(f) == 0 && fsync(fileno(f)) == 0;
+      fclose(f);
+
+      if (!ok || rename(tmp.c_str(), p.c_str()) != 0)
+        throw std::logic_error(fmt::format("Failed to write {}", p));
+    }
+
+    void write_index()
+    {
+      std::vector<uint64_t> offsets(positions.begin(), positions.end());
+      offsets.push_back(total_len);
+
+      write_file(
+        path(index_name()), offsets.data(), sizeof(uint64_t) * offsets.size());
+    }
+
+    void open_file(int flags)
+    {
+      auto p = path(file_name());
+      fd = open(p.c_str(), flags, 0644);
+      if (fd == -1)
+        throw std::logic_error(
+          fmt::format("Unable to open ledger file {}: {}", p, strerror(errno)));
+    }
 
   public:
-    Ledger(
-      const std::string& filename,
-      ringbuffer::AbstractWriterFactory& writer_factory) :
-      file(NULL),
-      to_enclave(writer_factory.create_writer_to_inside())
+    // Create a new, empty chunk starting at start_idx
+    LedgerFile(const std::string& dir_, size_t start_idx_) :
+      dir(dir_),
+      start_idx(start_idx_),
+      committed(false),
+      positions_loaded(true)
+    {
+      open_file(O_RDWR | O_CREAT | O_TRUNC);
+    }
+
+    // Open an existing chunk. Sealed chunks are not read until an entry is
+    // requested from them.
+    LedgerFile(
+      const std::string& dir_,
+      size_t start_idx_,
+      std::optional<size_t> committed_end_idx,
+      bool compressed_ = false) :
+      dir(dir_),
+      start_idx(start_idx_),
+      committed(committed_end_idx.has_value()),
+      compressed(compressed_),
+      positions_loaded(!committed)
     {
-      file = fopen(filename.c_str(), "r+b");
+      if (committed)
+      {
+        end_idx = committed_end_idx.value();
+        return;
+      }
 
-      if (!file)
-        file = fopen(filename.c_str(), "w+b");
+      open_file(O_RDWR);
 
-      if (!file)
-        throw std::logic_error("Unable to open or create ledger file");
+      // Only chunks that have not been sealed are scanned on startup. They
+      // are bounded by the chunk size.
+      auto data = files::slurp(path(file_name()));
+      scan(data.data(), data.size());
+      written_len = total_len;
+    }
+
+    LedgerFile(const LedgerFile& that) = delete;
+
+    ~LedgerFile()
+    {
+      unmap();
 
-      fseeko(file, 0, SEEK_END);
-      auto len = ftello(file);
-      if (len == 1)
+      if (fd != -1)
       {
-        std::stringstream ss;
-        ss << "Failed to tell file size: " << strerror(errno);
-        throw std::logic_error(ss.str());
+        try
+        {
+          flush();
+        }
+        catch (const std::exception& e)
+        {
+          LOG_FAIL_FMT("{}", e.what());
+        }
+        close(fd);
       }
-      fseeko(file, 0, SEEK_SET);
-      size_t pos = 0;
-      uint32_t size = 0;
+    }
+
+    size_t get_start_idx() const
+    {
+      return start_idx;
+    }
+
+    size_t get_last_idx() const
+    {
+      return committed ? end_idx : start_idx + positions.size() - 1;
+    }
+
+    size_t get_size() const
+    {
+      return total_len;
+    }
+
+    bool is_committed() const
+    {
+      return committed;
+    }
+
+    bool is_compressed() const
+    {
+      return compressed;
+    }
 
-      while (len >= frame_header_size)
+    size_t get_pending_count() const
+    {
+      return pending_count;
+    }
+
+    bool is_synced() const
+    {
+      return pending_count == 0 && synced_len == written_len;
+    }
+
+    // Stage an entry, to be written by the next flush()
+    void write_entry(const uint8_t* data, size_t size)
+    {
+      if (committed)
+        throw std::logic_error("Cannot write to a committed ledger file");
+
+      if (pending_count == pending.size())
+        pending.emplace_back();
+
+      auto& buffer = pending[pending_count++];
+      buffer.resize(size + frame_header_size);
+
+      uint32_t frame = (uint32_t)size;
+      memcpy(buffer.data(), &frame, frame_header_size);
+      if (size > 0)
+        memcpy(buffer.data() + frame_header_size, data, size);
+
+      positions.push_back(total_len);
+      total_len += buffer.size();
+    }
+
+    // Write all staged entries to the file, with as few syscalls as possible
+    void flush()
+    {
+      size_t done = 0;
+      while (done < pending_count)
       {
-        if (fread(&size, frame_header_size, 1, file) != 1)
-          throw std::logic_error("Failed to read from file");
+        std::vector<iovec> iov;
+        auto count = std::min(pending_count - done, (size_t)IOV_MAX);
+        size_t len = 0;
+        for (size_t i = done; i < done + count; ++i)
+        {
+          iov.push_back({pending[i].data(), pending[i].size()});
+          len += pending[i].size();
+        }
 
-        len -= frame_header_size;
+        size_t written = 0;
+        auto it = iov.begin();
+        while (written < len)
+        {
+          auto rc = pwritev(fd, &*it, iov.end() - it, written_len + written);
+          if (rc < 0)
+          {
+            if (errno == EINTR)
+              continue;
+            throw std::logic_error(fmt::format(
+              "Failed to write to ledger file {}: {}",
+              file_name(),
+              strerror(errno)));
+          }
+
+          // Skip over what was written, in case of a partial write
+          written += rc;
+          while (rc > 0 && (size_t)rc >= it->iov_len)
+          {
+            rc -= it->iov_len;
+            ++it;
+          }
+          if (rc > 0)
+          {
+            it->iov_base = static_cast<uint8_t*>(it->iov_base) + rc;
+            it->iov_len -= rc;
+          }
+        }
 
-        if (len < size)
-          throw std::logic_error("Malformed ledger file");
+        written_len += len;
+        done += count;
+      }
 
-        fseeko(file, size, SEEK_CUR);
-        len -= size;
+      pending_count = 0;
+    }
 
-        positions.push_back(pos);
-        pos += (size + frame_header_size);
+    // Make all entries written so far durable
+    void sync()
+    {
+      flush();
+
+      if (synced_len == written_len)
+        return;
+
+      if (fdatasync(fd) != 0)
+        throw std::logic_error(fmt::format(
+          "Failed to sync ledger file {}: {}", file_name(), strerror(errno)));
+
+      synced_len = written_len;
+    }
+
+    size_t framed_entries_size(size_t from, size_t to)
+    {
+      load_positions();
+
+      auto first = from - start_idx;
+      auto last = to - start_idx + 1;
+
+      auto end = last == positions.size() ? total_len : positions.at(last);
+      return end - positions.at(first);
+    }
+
+    /** Call f on the framed entries from index from to index to
+     *
+     * Entries in a sealed chunk are passed in place from the mapped file, or
+     * from its decompressed contents.
+     */
+    template <typename F>
+    void read_framed_entries(size_t from, size_t to, F&& f)
+    {
+      auto size = framed_entries_size(from, to);
+      auto offset = positions.at(from - start_idx);
+
+      if (committed)
+      {
+        map();
+        f(mapping + offset, size);
+        return;
       }
 
-      total_len = pos;
+      flush();
 
-      if (len != 0)
-        throw std::logic_error("Malformed ledger file");
+      std::vector<uint8_t> entries(size);
+      if (pread(fd, entries.data(), size, offset) != (ssize_t)size)
+        throw std::logic_error("Failed to read from file");
+
+      f(entries.data(), size);
     }
 
-    Ledger(const Ledger& that) = delete;
+    // Discard all entries after idx
+    void truncate(size_t idx)
+    {
+      // Nothing to discard, which is always the case for a committed chunk
+      // truncated at or after its last entry
+      if (idx >= get_last_idx())
+        return;
 
-    ~Ledger()
+      if (committed)
+        throw std::logic_error(fmt::format(
+          "Cannot truncate committed ledger file {} at {}", file_name(), idx));
+
+      auto count = idx + 1 - start_idx;
+
+      flush();
+
+      total_len = positions.at(count);
+      positions.resize(count);
+
+      if (ftruncate(fd, total_len))
+        throw std::logic_error("Failed to truncate file");
+
+      written_len = total_len;
+      synced_len = std::min(synced_len, total_len);
+    }
+
+    /** Seal the chunk once all its entries are committed
+     *
+     * The chunk is made durable, its index is written and it is renamed so
+     * that it is not scanned again on startup.
+     */
+    void commit()
+    {
+      if (committed)
+        return;
+
+      flush();
+      if (fsync(fd) != 0)
+        throw std::logic_error(
+          fmt::format("Failed to sync ledger file: {}", strerror(errno)));
+
+      close(fd);
+      fd = -1;
+      synced_len = written_len;
+
+      auto uncommitted_name = file_name();
+      end_idx = get_last_idx();
+
+      // The index is written first so that a sealed chunk always has one,
+      // unless it is lost afterwards in which case it is rebuilt on read
+      write_index();
+
+      committed = true;
+      if (rename(
+            path(uncommitted_name).c_str(), path(file_name()).c_str()) != 0)
+        throw std::logic_error(fmt::format(
+          "Failed to commit ledger file {}: {}",
+          uncommitted_name,
+          strerror(errno)));
+
+      LOG_DEBUG_FMT("Ledger committed {}", file_name());
+    }
+
+    /** Path of the uncompressed contents of a sealed chunk, from which
+     * compress_file builds its compressed version
+     */
+    std::string uncompressed_path() const
+    {
+      if (!committed || compressed)
+        throw std::logic_error(
+          fmt::format("Ledger file {} is not sealed", file_name()));
+
+      return path(file_name());
+    }
+
+    /** Write the compressed version of a sealed chunk next to it
+     *
+     * This only reads and writes files, and does not touch any LedgerFile,
+     * so that it can run off the host loop while the chunk is being read.
+     * The compressed chunk is durable once this returns, and replaces the
+     * uncompressed one when use_compressed is called.
+     *
+     * @param p Path of the uncompressed chunk
+     * @param level zlib compression level, from 1 (fastest) to 9 (smallest)
+     *
+     * @return Size of the compressed chunk, or nothing if it would not be any
+     * smaller and was not written
+     */
+    static std::optional<size_t> compress_file(const std::string& p, int level)
+    {
+      auto contents = files::slurp(p);
+
+      uLongf len = compressBound(contents.size());
+      std::vector<uint8_t> data(sizeof(uint64_t) + len);
+      const uint64_t size = contents.size();
+      memcpy(data.data(), &size, sizeof(size));
+
+      auto rc = compress2(
+        data.data() + sizeof(size), &len, contents.data(), size, level);
+      if (rc != Z_OK)
+        throw std::logic_error(
+          fmt::format("Failed to compress ledger file {}: {}", p, rc));
+
+      data.resize(sizeof(size) + len);
+      if (data.size() >= size)
+        return std::nullopt;
+
+      // The uncompressed chunk is only removed once the compressed one is
+      // durable. If both exist on startup, the uncompressed one is removed.
+      write_file(p + ledger_compressed_suffix, data.data(), data.size());
+      return data.size();
+    }
+
+    // Switch a sealed chunk to the compressed file written by compress_file
+    void use_compressed()
+    {
+      auto p = uncompressed_path();
+      unmap();
+      compressed = true;
+      ::remove(p.c_str());
+    }
+
+    // Release the contents of a sealed chunk, which are mapped or
+    // decompressed again when an entry is next read
+    void unmap()
+    {
+      if (mapping == nullptr)
+        return;
+
+      if (compressed)
+        std::vector<uint8_t>().swap(decompressed);
+      else
+        munmap(const_cast<uint8_t*>(mapping), mapping_size);
+
+      mapping = nullptr;
+      mapping_size = 0;
+    }
+
+    /** Delete the chunk from disk
+     *
+     * @param with_index Whether to also delete the index of a sealed chunk,
+     * which is shared by its compressed and uncompressed versions
+     */
+    void remove(bool with_index = true)
     {
-      if (file)
+      unmap();
+
+      if (fd != -1)
       {
-        fflush(file);
-        fclose(file);
+        close(fd);
+        fd = -1;
       }
+      pending_count = 0;
+
+      ::remove(path(file_name()).c_str());
+      if (committed && with_index)
+        ::remove(path(index_name()).c_str());
+    }
+  };
+
+  // When the entries written to the ledger are made durable. Syncs are
+  // grouped: a single fdatasync covers all the entries written since the
+  // previous one. If no condition is set, the ledger is never synced
+  // explicitly, except when chunks are sealed.
+  struct LedgerSyncPolicy
+  {
+    // Sync once this many entries have been written since the last sync
+    size_t max_entries = 0;
+    // Sync once the oldest entry written since the last sync is this old
+    std::chrono::milliseconds max_delay = std::chrono::milliseconds(0);
+    // Sync once a signature transaction has been written
+    bool on_signature = false;
+  };
+
+  // The most recently written framed entries, kept in memory in a ring
+  // buffer of a fixed size. Followers that lag behind are mostly sent
+  // entries from the cache, rather than from the ledger files. Each entry is
+  // contiguous in the buffer, so that a range of entries is read in at most
+  // two pieces.
+  class LedgerCache
+  {
+  private:
+    struct Entry
+    {
+      size_t offset;
+      size_t size;
+    };
+
+    std::vector<uint8_t> buffer;
+    // Cached entries, in order, the first one being at index first_idx
+    std::deque<Entry> entries;
+    size_t first_idx = 0;
+
+    bool contains(size_t from, size_t to) const
+    {
+      return from >= first_idx && from <= to &&
+        to < first_idx + entries.size();
+    }
+
+  public:
+    LedgerCache(size_t size) : buffer(size) {}
+
+    /** Add the entry at index idx. Entries are added in order, or the
+     * cache is cleared.
+     */
+    void write_entry(size_t idx, const uint8_t* data, size_t size)
+    {
+      const auto framed_size = size + frame_header_size;
+      if (idx != first_idx + entries.size() || framed_size > buffer.size())
+      {
+        clear(idx);
+        if (framed_size > buffer.size())
+        {
+          first_idx = idx + 1;
+          return;
+        }
+      }
+
+      auto offset =
+        entries.empty() ? 0 : entries.back().offset + entries.back().size;
+      if (offset + framed_size > buffer.size())
+        offset = 0;
+
+      // Evict the oldest entries, which the new one overwrites
+      while (!entries.empty() &&
+             entries.front().offset < offset + framed_size &&
+             entries.front().offset + entries.front().size > offset)
+      {
+        entries.pop_front();
+        first_idx++;
+      }
+
+      uint32_t frame = (uint32_t)size;
+      memcpy(buffer.data() + offset, &frame, frame_header_size);
+      if (size > 0)
+        memcpy(buffer.data() + offset + frame_header_size, data, size);
+      entries.push_back({offset, framed_size});
+    }
+
+    /** Call f on the framed entries from index from to index to, in at most
+     * two contiguous pieces
+     *
+     * @return false if the entries are not all in the cache
+     */
+    template <typename F>
+    bool read_framed_entries(size_t from, size_t to, F&& f) const
+    {
+      if (!contains(from, to))
+        return false;
+
+      auto it = entries.begin() + (from - first_idx);
+      const auto end = entries.begin() + (to - first_idx + 1);
+      while (it != end)
+      {
+        const auto offset = it->offset;
+        auto size = it->size;
+        for (++it; it != end && it->offset == offset + size; ++it)
+          size += it->size;
+
+        f(buffer.data() + offset, size);
+      }
+
+      return true;
+    }
+
+    std::optional<size_t> framed_entries_size(size_t from, size_t to) const
+    {
+      if (!contains(from, to))
+        return std::nullopt;
+
+      size_t size = 0;
+      for (auto i = from; i <= to; ++i)
+        size += entries[i - first_idx].size;
+      return size;
+    }
+
+    // Discard all entries after idx
+    void truncate(size_t idx)
+    {
+      while (!entries.empty() && first_idx + entries.size() - 1 > idx)
+        entries.pop_back();
+
+      if (entries.empty())
+        first_idx = idx + 1;
+    }
+
+    // Discard all entries, the next one written being at index idx
+    void clear(size_t idx)
+    {
+      entries.clear();
+      first_idx = idx;
+    }
+  };
+
+  class Ledger
+  {
+  private:
+    // Entries are added to a response to ledger_get_range until it is at
+    // least this large, well under the maximum ringbuffer message size
+    static constexpr size_t max_read_range_size = 1 << 20;
+
+    const std::string dir;
+    // Size past which a chunk is no longer written to. It is sealed as soon
+    // as its last entry is committed.
+    const size_t chunk_threshold;
+    // zlib level at which sealed chunks are compressed, 0 if they are not
+    const int compression_level;
+
+    // Compressed chunks whose decompressed contents are held in memory, most
+    // recently read last. Entries are mostly read from the chunks in order,
+    // when catching up a node or on recovery, so only a few are kept.
+    static constexpr size_t max_decompressed_chunks = 2;
+    std::deque<LedgerFile*> decompressed;
+
+    // Chunks, ordered by start index. Sealed chunks always precede the
+    // chunks that are still open.
+    std::vector<std::unique_ptr<LedgerFile>> files;
+
+    // Index of the entry preceding the first entry in the ledger. This is
+    // not 0 when the node started from a snapshot at that index.
+    size_t start_idx = 0;
+    size_t last_idx = 0;
+    size_t committed_idx = 0;
+
+    const LedgerSyncPolicy sync_policy;
+    // Last entry known to be durable, reported to the enclave
+    size_t durable_idx = 0;
+    // Last entry that is a signature transaction
+    size_t signature_idx = 0;
+    std::optional<std::chrono::steady_clock::time_point> first_unsynced;
+
+    LedgerCache cache;
+
+    ringbuffer::WriterPtr to_enclave;
+
+    // Sealed chunks are compressed on the libuv thread pool, so that the host
+    // loop is not blocked for the whole compression. The compressed chunk
+    // is swapped in on the loop once it is durable.
+    struct Compression
+    {
+      uv_work_t req;
+      // Reset when the ledger is destroyed
+      std::shared_ptr<Ledger*> ledger;
+      std::string path;
+      size_t start_idx;
+      size_t end_idx;
+      int level;
+      std::optional<size_t> compressed_size;
+      std::string error;
+    };
+    std::shared_ptr<Ledger*> self;
+
+    void compress(LedgerFile& f)
+    {
+      auto c = new Compression;
+      c->req.data = c;
+      c->ledger = self;
+      c->path = f.uncompressed_path();
+      c->start_idx = f.get_start_idx();
+      c->end_idx = f.get_last_idx();
+      c->level = compression_level;
+
+      int rc;
+      if (
+        (rc = uv_queue_work(
+           uv_default_loop(), &c->req, on_compress, on_compressed)) < 0)
+      {
+        LOG_FAIL_FMT(
+          "Unable to compress ledger file {}: {}", c->path, uv_strerror(rc));
+        delete c;
+      }
+    }
+
+    // Runs on the thread pool
+    static void on_compress(uv_work_t* req)
+    {
+      auto c = static_cast<Compression*>(req->data);
+      try
+      {
+        c->compressed_size = LedgerFile::compress_file(c->path, c->level);
+      }
+      catch (const std::exception& e)
+      {
+        c->error = e.what();
+      }
+    }
+
+    // Runs on the loop
+    static void on_compressed(uv_work_t* req, int status)
+    {
+      std::unique_ptr<Compression> c(static_cast<Compression*>(req->data));
+      auto ledger = *c->ledger;
+
+      if (status < 0 || !c->error.empty())
+      {
+        LOG_FAIL_FMT(
+          "Failed to compress ledger file {}: {}",
+          c->path,
+          status < 0 ? uv_strerror(status) : c->error);
+        return;
+      }
+
+      // If the ledger is gone, the uncompressed chunk is removed on startup
+      if (!c->compressed_size.has_value() || ledger == nullptr)
+        return;
+
+      auto f = ledger->find_sealed(*c);
+      if (f == nullptr)
+      {
+        // The chunk was discarded while it was being compressed
+        ::remove((c->path + ledger_compressed_suffix).c_str());
+        return;
+      }
+
+      f->use_compressed();
+
+      LOG_DEBUG_FMT(
+        "Ledger compressed {} to {} bytes",
+        c->path,
+        c->compressed_size.value());
+    }
+
+    // The sealed, uncompressed chunk that a compression was started for
+    LedgerFile* find_sealed(const Compression& c)
+    {
+      for (auto& f : files)
+      {
+        if (
+          f->get_start_idx() == c.start_idx && f->is_committed() &&
+          !f->is_compressed() && f->get_last_idx() == c.end_idx)
+          return f.get();
+      }
+      return nullptr;
+    }
+
+    template <typename F>
+    void for_each_open_file(F&& f)
+    {
+      // Only the last chunks, that are not sealed, can have unwritten or
+      // unsynced entries
+      for (auto it = files.rbegin();
+           it != files.rend() && !(*it)->is_committed();
+           ++it)
+        f(**it);
+    }
+
+    LedgerFile* find_file(size_t idx)
+    {
+      if ((idx <= start_idx) || (idx > last_idx))
+        return nullptr;
+
+      auto it = std::upper_bound(
+        files.begin(),
+        files.end(),
+        idx,
+        [](size_t i, const std::unique_ptr<LedgerFile>& f) {
+          return i < f->get_start_idx();
+        });
+
+      return std::prev(it)->get();
+    }
+
+    // Record that an entry is about to be read from file, releasing the
+    // contents of the compressed chunks that have not been read recently
+    void touch(LedgerFile* file)
+    {
+      if (!file->is_compressed())
+        return;
+
+      auto it = std::find(decompressed.begin(), decompressed.end(), file);
+      if (it != decompressed.end())
+        decompressed.erase(it);
+      decompressed.push_back(file);
+
+      while (decompressed.size() > max_decompressed_chunks)
+      {
+        decompressed.front()->unmap();
+        decompressed.pop_front();
+      }
+    }
+
+    void load()
+    {
+      auto d = opendir(dir.c_str());
+      if (d == nullptr)
+        throw std::logic_error(
+          fmt::format("Unable to open ledger directory {}", dir));
+
+      const std::string prefix(ledger_prefix);
+      const std::string committed_suffix(ledger_committed_suffix);
+      const std::string compressed_suffix(
+        std::string(ledger_committed_suffix) + ledger_compressed_suffix);
+
+      for (auto e = readdir(d); e != nullptr; e = readdir(d))
+      {
+        std::string name(e->d_name);
+        if (name.rfind(prefix, 0) != 0)
+          continue;
+
+        auto range = name.substr(prefix.size());
+        std::optional<size_t> end;
+
+        bool compressed =
+          range.size() > compressed_suffix.size() &&
+          range.compare(
+            range.size() - compressed_suffix.size(),
+            compressed_suffix.size(),
+            compressed_suffix) == 0;
+        if (compressed)
+          range.resize(range.size() - std::strlen(ledger_compressed_suffix));
+
+        if (
+          range.size() > committed_suffix.size() &&
+          range.compare(
+            range.size() - committed_suffix.size(),
+            committed_suffix.size(),
+            committed_suffix) == 0)
+        {
+          range.resize(range.size() - committed_suffix.size());
+          auto sep = range.find('-');
+          if (sep == std::string::npos)
+            continue;
+
+          end = std::stoull(range.substr(sep + 1));
+          range.resize(sep);
+        }
+
+        if (
+          range.empty() ||
+          range.find_first_not_of("0123456789") != std::string::npos)
+          continue;
+
+        auto start = std::stoull(range);
+        files.push_back(
+          std::make_unique<LedgerFile>(dir, start, end, compressed));
+      }
+
+      closedir(d);
+
+      // If the node stopped while a chunk was being compressed, it is found
+      // both compressed and uncompressed: the compressed one sorts first, and
+      // the uncompressed one is removed
+      std::sort(files.begin(), files.end(), [](const auto& a, const auto& b) {
+        if (a->get_start_idx() != b->get_start_idx())
+          return a->get_start_idx() < b->get_start_idx();
+        return a->is_compressed() && !b->is_compressed();
+      });
+
+      for (auto it = files.begin(); it != files.end();)
+      {
+        if (
+          it != files.begin() &&
+          (*std::prev(it))->get_start_idx() == (*it)->get_start_idx() &&
+          (*std::prev(it))->is_compressed() && (*it)->is_committed())
+        {
+          LOG_INFO_FMT(
+            "Removing ledger chunk at {}, superseded by compressed chunk",
+            (*it)->get_start_idx());
+          (*it)->remove(false);
+          it = files.erase(it);
+        }
+        else
+          ++it;
+      }
+
+      // Chunks that were created but never written to are discarded
+      while (!files.empty() && !files.back()->is_committed() &&
+             files.back()->get_size() == 0)
+      {
+        files.back()->remove();
+        files.pop_back();
+      }
+
+      if (files.empty())
+        return;
+
+      start_idx = files.front()->get_start_idx() - 1;
+      last_idx = start_idx;
+      committed_idx = start_idx;
+
+      for (auto& f : files)
+      {
+        if (f->get_start_idx() != last_idx + 1)
+          throw std::logic_error(fmt::format(
+            "Ledger chunks in {} are not contiguous at {}", dir, last_idx));
+
+        if (f->is_committed())
+        {
+          if (committed_idx != last_idx)
+            throw std::logic_error(fmt::format(
+              "Committed ledger chunk in {} follows uncommitted chunk at {}",
+              dir,
+              last_idx));
+
+          committed_idx = f->get_last_idx();
+        }
+
+        last_idx = f->get_last_idx();
+      }
+
+      durable_idx = last_idx;
+      signature_idx = last_idx;
+    }
+
+  public:
+    Ledger(
+      const std::string& dir_,
+      ringbuffer::AbstractWriterFactory& writer_factory,
+      size_t chunk_threshold_ = 5 * 1024 * 1024,
+      const LedgerSyncPolicy& sync_policy_ = {},
+      size_t cache_size = 16 * 1024 * 1024,
+      int compression_level_ = 0) :
+      dir(dir_),
+      chunk_threshold(chunk_threshold_),
+      compression_level(compression_level_),
+      sync_policy(sync_policy_),
+      cache(cache_size),
+      to_enclave(writer_factory.create_writer_to_inside()),
+      self(std::make_shared<Ledger*>(this))
+    {
+      if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+        throw std::logic_error(fmt::format(
+          "Unable to create ledger directory {}: {}", dir, strerror(errno)));
+
+      load();
+      cache.clear(last_idx + 1);
+
+      LOG_INFO_FMT(
+        "Ledger {}: {} chunks, entries {} to {}, committed up to {}",
+        dir,
+        files.size(),
+        start_idx + 1,
+        last_idx,
+        committed_idx);
+    }
+
+    Ledger(const Ledger& that) = delete;
+
+    ~Ledger()
+    {
+      // Compressions still in flight complete without touching this ledger
+      *self = nullptr;
     }
 
     size_t get_last_idx()
     {
-      return positions.size();
+      return last_idx;
     }
 
-    const std::vector<uint8_t> read_entry(size_t idx)
+    size_t get_start_idx()
     {
-      if ((idx == 0) || (idx > positions.size()))
-        return {};
+      return start_idx;
+    }
 
-      auto len = entry_size(idx);
-      std::vector<uint8_t> entry(len);
-      fseeko(file, positions.at(idx - 1) + frame_header_size, SEEK_SET);
+    size_t get_committed_idx()
+    {
+      return committed_idx;
+    }
 
-      if (fread(entry.data(), len, 1, file) != 1)
-        throw std::logic_error("Failed to read from file");
+    size_t get_durable_idx()
+    {
+      return durable_idx;
+    }
+
+    size_t get_chunk_count()
+    {
+      return files.size();
+    }
+
+    const std::vector<uint8_t> read_entry(size_t idx)
+    {
+      std::vector<uint8_t> entry;
+      read_framed_entries(idx, idx, [&entry](const uint8_t* data, size_t size) {
+        entry.assign(data + frame_header_size, data + size);
+      });
 
       return entry;
     }
 
-    const std::vector<uint8_t> read_framed_entries(size_t from, size_t to)
+    /** Call f on each contiguous range of the framed entries from index
+     * from to index to
+     *
+     * Ranges that are in sealed chunks are read in place, without a copy,
+     * once the chunk is decompressed if it is compressed.
+     *
+     * @return false if the entries are not all in the ledger
+     */
+    template <typename F>
+    bool read_framed_entries(size_t from, size_t to, F&& f)
     {
-      auto framed_size = framed_entries_size(from, to);
+      if ((from <= start_idx) || (to < from) || (to > last_idx))
+        return false;
+
+      if (cache.read_framed_entries(from, to, f))
+        return true;
+
+      while (from <= to)
+      {
+        auto file = find_file(from);
+        auto last = std::min(to, file->get_last_idx());
+        touch(file);
+        file->read_framed_entries(from, last, f);
+        from = last + 1;
+      }
 
-      std::vector<uint8_t> framed_entries(framed_size);
-      if (framed_size == 0)
-        return framed_entries;
+      return true;
+    }
 
-      fseeko(file, positions.at(from - 1), SEEK_SET);
+    const std::vector<uint8_t> read_framed_entries(size_t from, size_t to)
+    {
+      std::vector<uint8_t> framed_entries;
+      framed_entries.reserve(framed_entries_size(from, to));
 
-      if (fread(framed_entries.data(), framed_size, 1, file) != 1)
-        throw std::logic_error("Failed to read from file");
+      read_framed_entries(from, to, [&](const uint8_t* data, size_t size) {
+        framed_entries.insert(framed_entries.end(), data, data + size);
+      });
 
       return framed_entries;
     }
 
     size_t framed_entries_size(size_t from, size_t to)
     {
-      if ((from == 0) || (to < from) || (to > positions.size()))
+      if ((from <= start_idx) || (to < from) || (to > last_idx))
         return 0;
 
-      if (to == positions.size())
-      {
-        return total_len - positions.at(from - 1);
-      }
-      else
+      auto cached_size = cache.framed_entries_size(from, to);
+      if (cached_size.has_value())
+        return cached_size.value();
+
+      size_t size = 0;
+      while (from <= to)
       {
-        return positions.at(to) - positions.at(from - 1);
+        auto file = find_file(from);
+        auto last = std::min(to, file->get_last_idx());
+        size += file->framed_entries_size(from, last);
+        from = last + 1;
       }
+
+      return size;
     }
 
     size_t entry_size(size_t idx)
@@ -149,54 +1252,172 @@ namespace asynchost
 
     void write_entry(const uint8_t* data, size_t size)
     {
-      fseeko(file, total_len, SEEK_SET);
-      positions.push_back(total_len);
+      if (
+        files.empty() || files.back()->is_committed() ||
+        files.back()->get_size() >= chunk_threshold)
+      {
+        files.push_back(std::make_unique<LedgerFile>(dir, last_idx + 1));
+      }
 
-      LOG_DEBUG_FMT("Ledger write {}: {} bytes", positions.size(), size);
+      files.back()->write_entry(data, size);
+      last_idx++;
+      cache.write_entry(last_idx, data, size);
 
-      total_len += (size + frame_header_size);
+      if (sync_policy.max_delay.count() > 0 && !first_unsynced.has_value())
+        first_unsynced = std::chrono::steady_clock::now();
 
-      uint32_t frame = (uint32_t)size;
+      LOG_DEBUG_FMT("Ledger write {}: {} bytes", last_idx, size);
+    }
 
-      if (fwrite(&frame, frame_header_size, 1, file) != 1)
-        throw std::logic_error("Failed to write to file");
+    /** Record that the entry at idx is a signature transaction
+     *
+     * @param idx Index of the signature
+     */
+    void signature(size_t idx)
+    {
+      signature_idx = std::max(signature_idx, idx);
+    }
 
-      if (fwrite(data, size, 1, file) != 1)
-        throw std::logic_error("Failed to write to file");
+    /** Write all staged entries, and sync them if the policy requires it
+     *
+     * This is called once per host loop iteration, after the messages from
+     * the enclave have been processed, so that all the entries appended in
+     * an iteration are written together.
+     */
+    void flush()
+    {
+      for_each_open_file([](LedgerFile& f) { f.flush(); });
+
+      if (durable_idx >= last_idx)
+        return;
+
+      bool sync_required =
+        (sync_policy.max_entries > 0 &&
+         last_idx - durable_idx >= sync_policy.max_entries) ||
+        (sync_policy.on_signature && signature_idx > durable_idx) ||
+        (first_unsynced.has_value() &&
+         std::chrono::steady_clock::now() - first_unsynced.value() >=
+           sync_policy.max_delay);
+
+      if (sync_required)
+        sync();
+    }
+
+    /** Make all entries durable, and report it to the enclave
+     */
+    void sync()
+    {
+      for_each_open_file([](LedgerFile& f) { f.sync(); });
+
+      durable_idx = last_idx;
+      first_unsynced.reset();
+
+      LOG_DEBUG_FMT("Ledger durable: {}", durable_idx);
+
+      RINGBUFFER_WRITE_MESSAGE(
+        consensus::ledger_durable,
+        to_enclave,
+        static_cast<consensus::Index>(durable_idx));
     }
 
-    void truncate(size_t last_idx)
+    void truncate(size_t idx)
     {
-      LOG_DEBUG_FMT("Ledger truncate: {}/{}", last_idx, positions.size());
+      LOG_DEBUG_FMT("Ledger truncate: {}/{}", idx, last_idx);
 
-      // positions[last_idx - 1] is the position of the specified
-      // final index. Truncate the ledger at position[last_idx].
-      if (last_idx >= positions.size())
+      if (idx >= last_idx)
         return;
 
-      total_len = positions.at(last_idx);
-      positions.resize(last_idx);
+      idx = std::max(idx, start_idx);
+
+      if (idx < committed_idx)
+        throw std::logic_error(fmt::format(
+          "Cannot truncate ledger at {}, committed up to {}",
+          idx,
+          committed_idx));
 
-      if (fflush(file) != 0)
+      // Only the chunks that are still open are touched
+      while (!files.empty() && files.back()->get_start_idx() > idx)
       {
-        std::stringstream ss;
-        ss << "Failed to flush file: " << strerror(errno);
-        throw std::logic_error(ss.str());
+        files.back()->remove();
+        files.pop_back();
       }
 
-      if (ftruncate(fileno(file), total_len))
-        throw std::logic_error("Failed to truncate file");
+      if (!files.empty())
+        files.back()->truncate(idx);
+
+      cache.truncate(idx);
+      last_idx = idx;
+      durable_idx = std::min(durable_idx, idx);
+      signature_idx = std::min(signature_idx, idx);
+    }
+
+    /** Mark all entries up to idx as committed
+     *
+     * Chunks that are no longer written to and whose entries are all
+     * committed are sealed. If compression is enabled, they are then
+     * compressed on the libuv thread pool, and remain readable uncompressed
+     * until that completes.
+     */
+    void commit(size_t idx)
+    {
+      LOG_DEBUG_FMT("Ledger commit: {}/{}", idx, last_idx);
 
-      fseeko(file, total_len, SEEK_SET);
+      if (idx <= committed_idx)
+        return;
+
+      committed_idx = std::min(idx, last_idx);
+
+      // Find the first chunk that has not been sealed yet
+      auto it = files.end();
+      while (it != files.begin() && !(*std::prev(it))->is_committed())
+        --it;
+
+      for (; it != files.end(); ++it)
+      {
+        auto& f = *it;
+        bool complete = (std::next(it) != files.end()) ||
+          (f->get_size() >= chunk_threshold);
+
+        if (!complete || f->get_last_idx() > committed_idx)
+          break;
+
+        f->commit();
+        if (compression_level > 0)
+          compress(*f);
+      }
+    }
+
+    void init(size_t idx)
+    {
+      // The node has started from a snapshot at idx and will only ever write
+      // entries after it, so all existing chunks are discarded. The next
+      // chunk starts at idx + 1, which persists the start of the ledger.
+      LOG_INFO_FMT("Ledger init: {}", idx);
+
+      for (auto& f : files)
+        f->remove();
+      files.clear();
+      decompressed.clear();
+
+      start_idx = idx;
+      last_idx = idx;
+      committed_idx = idx;
+      durable_idx = idx;
+      signature_idx = idx;
+      first_unsynced.reset();
+      cache.clear(idx + 1);
     }
 
     void register_message_handlers(
       messaging::Dispatcher<ringbuffer::Message>& disp)
     {
-      DISPATCHER_SET_MESSAGE_HANDLER(
+      DISPATCHER_SET_BATCH_HANDLER(
         disp,
         consensus::ledger_append,
-        [this](const uint8_t* data, size_t size) { write_entry(data, size); });
+        [this](const ringbuffer::Batch& batch) {
+          for (const auto& entry : batch)
+            write_entry(entry.data, entry.size);
+        });
 
       DISPATCHER_SET_MESSAGE_HANDLER(
         disp,
@@ -206,24 +1427,76 @@ namespace asynchost
           truncate(idx);
         });
 
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        disp,
+        consensus::ledger_signature,
+        [this](const uint8_t* data, size_t size) {
+          auto idx = serialized::read<consensus::Index>(data, size);
+          signature(idx);
+        });
+
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        disp,
+        consensus::ledger_commit,
+        [this](const uint8_t* data, size_t size) {
+          auto idx = serialized::read<consensus::Index>(data, size);
+          commit(idx);
+        });
+
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        disp,
+        consensus::ledger_init,
+        [this](const uint8_t* data, size_t size) {
+          auto idx = serialized::read<consensus::Index>(data, size);
+          init(idx);
+        });
+
       DISPATCHER_SET_MESSAGE_HANDLER(
         disp, consensus::ledger_get, [&](const uint8_t* data, size_t size) {
           // The enclave has asked for a ledger entry.
           auto [idx] =
             ringbuffer::read_message<consensus::ledger_get>(data, size);
 
-          auto& entry = read_entry(idx);
+          auto found = read_framed_entries(
+            idx, idx, [this](const uint8_t* entry, size_t entry_size) {
+              serializer::ByteRange e = {entry + frame_header_size,
+                                         entry_size - frame_header_size};
+              RINGBUFFER_WRITE_MESSAGE(consensus::ledger_entry, to_enclave, e);
+            });
 
-          if (entry.size() > 0)
+          if (!found)
           {
-            RINGBUFFER_WRITE_MESSAGE(
-              consensus::ledger_entry, to_enclave, entry);
+            RINGBUFFER_WRITE_MESSAGE(consensus::ledger_no_entry, to_enclave);
           }
-          else
+        });
+
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        disp,
+        consensus::ledger_get_range,
+        [&](const uint8_t* data, size_t size) {
+          // The enclave is reading ahead through the ledger. Reply with as
+          // many of the requested entries as fit in a message.
+          auto [token, from, to] =
+            ringbuffer::read_message<consensus::ledger_get_range>(data, size);
+
+          std::vector<uint8_t> entries;
+          for (auto idx = from;
+               idx <= to && entries.size() < max_read_range_size;
+               ++idx)
           {
-            RINGBUFFER_WRITE_MESSAGE(consensus::ledger_no_entry, to_enclave);
+            auto found = read_framed_entries(
+              idx, idx, [&entries](const uint8_t* entry, size_t entry_size) {
+                entries.insert(entries.end(), entry, entry + entry_size);
+              });
+
+            if (!found)
+              break;
           }
+
+          serializer::ByteRange e = {entries.data(), entries.size()};
+          RINGBUFFER_WRITE_MESSAGE(
+            consensus::ledger_entries, to_enclave, token, from, e);
         });
     }
   };
-}
\ No newline at end of file
+}
@@ -0,0 +1,27 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "everyio.h"
+#include "ledger.h"
+
+namespace asynchost
+{
+  class LedgerFlushImpl
+  {
+  private:
+    Ledger& ledger;
+
+  public:
+    LedgerFlushImpl(Ledger& ledger) : ledger(ledger) {}
+
+    void every()
+    {
+      // Write (and possibly sync) all the entries appended to the ledger in
+      // this loop iteration at once
+      ledger.flush();
+    }
+  };
+
+  using LedgerFlush = proxy_ptr<EveryIO<LedgerFlushImpl>>;
+}
@@ -8,11 +8,15 @@
 #include "ds/oversized.h"
 #include "enclave.h"
 #include "handle_ringbuffer.h"
+#include "ledgerflush.h"
+#include "merklestore.h"
 #include "nodeconnections.h"
 #include "notifyconnections.h"
 #include "rpcconnections.h"
 #include "sigterm.h"
+#include "snapshot.h"
 #include "ticker.h"
+#include "tracesink.h"
 
 #include <CLI11/CLI11.hpp>
 #include <codecvt>
@@ -88,8 +92,95 @@ int main(int argc, char** argv)
     "Address to advertise publicly to clients (defaults to same as "
     "--rpc-address)");
 
-  std::string ledger_file("ccf.ledger");
-  app.add_option("--ledger-file", ledger_file, "Ledger file", true);
+  std::string ledger_dir("ledger");
+  app.add_option("--ledger-dir", ledger_dir, "Ledger directory", true);
+
+  size_t ledger_chunk_bytes = 5 * 1024 * 1024;
+  app.add_option(
+    "--ledger-chunk-bytes",
+    ledger_chunk_bytes,
+    "Size (bytes) after which a new ledger chunk file is started. Chunks are "
+    "sealed once all their entries are committed",
+    true);
+
+  size_t ledger_cache_bytes = 16 * 1024 * 1024;
+  app.add_option(
+    "--ledger-cache-bytes",
+    ledger_cache_bytes,
+    "Size (bytes) of the in-memory cache of the most recent ledger entries, "
+    "from which lagging nodes are sent entries",
+    true);
+
+  int ledger_compression_level = 0;
+  app
+    .add_option(
+      "--ledger-compression-level",
+      ledger_compression_level,
+      "zlib level (1 to 9) at which sealed ledger chunks are compressed, 0 to "
+      "leave them uncompressed. Compressed chunks are always readable. Chunks "
+      "are compressed in the background, but reading an entry from a "
+      "compressed chunk decompresses the whole chunk on the host's main loop",
+      true)
+    ->check(CLI::Range(0, 9));
+
+  asynchost::LedgerSyncPolicy ledger_sync_policy;
+  app.add_option(
+    "--ledger-sync-tx",
+    ledger_sync_policy.max_entries,
+    "Sync the ledger to disk once this many entries have been written since "
+    "the last sync (0 to disable)",
+    true);
+
+  size_t ledger_sync_ms = 0;
+  app.add_option(
+    "--ledger-sync-ms",
+    ledger_sync_ms,
+    "Sync the ledger to disk once the oldest entry written since the last sync "
+    "is this old (0 to disable)",
+    true);
+
+  app.add_flag(
+    "--ledger-sync-signatures",
+    ledger_sync_policy.on_signature,
+    "Sync the ledger to disk once a signature transaction has been written");
+
+  std::string snapshot_dir("snapshots");
+  app.add_option(
+    "--snapshot-dir",
+    snapshot_dir,
+    "Directory where snapshots are written to, and read from when joining",
+    true);
+
+  std::string merkle_dir("merkle");
+  app.add_option(
+    "--merkle-dir",
+    merkle_dir,
+    "Directory where the Merkle tree nodes flushed from the enclave are "
+    "stored, to produce receipts for old transactions",
+    true);
+
+  size_t snapshot_tx_interval = 0;
+  app.add_option(
+    "--snapshot-tx-interval",
+    snapshot_tx_interval,
+    "Minimum number of transactions between snapshots (0 to disable)",
+    true);
+
+  size_t trace_sample_interval = 0;
+  app.add_option(
+    "--trace-sample-interval",
+    trace_sample_interval,
+    "Trace one request in every this many, from its reception to its global "
+    "commit (0 to disable)",
+    true);
+
+  std::string trace_file("traces.json");
+  app.add_option(
+    "--trace-file",
+    trace_file,
+    "Path to which request traces are written, in the Chrome trace event "
+    "format",
+    true);
 
   std::string host_log_level("info");
   app.add_set(
@@ -377,6 +468,9 @@ int main(int argc, char** argv)
   asynchost::HandleRingbuffer handle_ringbuffer(
     bp, circuit.read_from_inside(), non_blocking_factory);
 
+  // send the small TCP writes made in each loop iteration together
+  asynchost::TCPFlush tcp_flush;
+
   // graceful shutdown on sigterm
   asynchost::Sigterm sigterm(writer_factory);
 
@@ -397,12 +491,16 @@ int main(int argc, char** argv)
   enclave_config.debug_config = {memory_reserve_startup};
 #endif
 
+  asynchost::Snapshots snapshots(snapshot_dir);
+
   CCFConfig ccf_config;
   ccf_config.consensus_config = {raft_timeout,
                                  raft_election_timeout,
                                  pbft_view_change_timeout,
                                  pbft_status_interval};
   ccf_config.signature_intervals = {sig_max_tx, sig_max_ms};
+  ccf_config.snapshot_tx_interval = snapshot_tx_interval;
+  ccf_config.trace_sample_interval = trace_sample_interval;
   ccf_config.node_info_network = {rpc_address.hostname,
                                   public_rpc_address.hostname,
                                   node_address.hostname,
@@ -444,6 +542,7 @@ int main(int argc, char** argv)
     ccf_config.joining.target_port = target_rpc_address.port;
     ccf_config.joining.network_cert = files::slurp(network_cert_file);
     ccf_config.joining.join_timer = join_timer;
+    ccf_config.joining.snapshot = snapshots.read_latest_snapshot();
   }
   else if (*recover)
   {
@@ -464,8 +563,28 @@ int main(int argc, char** argv)
   LOG_INFO_FMT("Created new node");
 
   // ledger
-  asynchost::Ledger ledger(ledger_file, writer_factory);
+  ledger_sync_policy.max_delay = std::chrono::milliseconds(ledger_sync_ms);
+  asynchost::Ledger ledger(
+    ledger_dir,
+    writer_factory,
+    ledger_chunk_bytes,
+    ledger_sync_policy,
+    ledger_cache_bytes,
+    ledger_compression_level);
   ledger.register_message_handlers(bp.get_dispatcher());
+  asynchost::LedgerFlush ledger_flush(ledger);
+
+  snapshots.register_message_handlers(bp.get_dispatcher());
+
+  asynchost::MerkleStore merkle_store(merkle_dir, writer_factory);
+  merkle_store.register_message_handlers(bp.get_dispatcher());
+
+  std::unique_ptr<asynchost::TraceSink> trace_sink;
+  if (trace_sample_interval > 0)
+  {
+    trace_sink = std::make_unique<asynchost::TraceSink>(trace_file);
+    trace_sink->register_message_handlers(bp.get_dispatcher());
+  }
 
   asynchost::NodeConnections node(
     ledger, writer_factory, node_address.hostname, node_address.port);
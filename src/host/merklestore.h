@@ -0,0 +1,208 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "ds/logger.h"
+#include "ds/messaging.h"
+#include "ds/serialized.h"
+#include "node/merklestoretypes.h"
+
+#include <algorithm>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <optional>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <vector>
+
+namespace asynchost
+{
+  // The Merkle store is a directory holding one file per level of the tree:
+  // - merkle_<level> holds the hashes of the nodes of that level, in order,
+  // so that each node is read with a single pread.
+  // Nodes are only ever appended, as they are flushed from the enclave's
+  // Merkle tree once committed.
+  static constexpr auto merkle_prefix = "merkle_";
+
+  class MerkleStore
+  {
+  public:
+    static constexpr size_t HASH_SIZE = 32;
+
+  private:
+    const std::string dir;
+    ringbuffer::WriterPtr to_enclave;
+
+    struct Level
+    {
+      int fd = -1;
+      // Number of nodes in the file, including any gap before the first one
+      // written, which reads as zeroes
+      uint64_t size = 0;
+    };
+    std::vector<Level> levels;
+
+    Level& get_level(uint32_t level)
+    {
+      if (level >= levels.size())
+        levels.resize(level + 1);
+
+      auto& l = levels[level];
+      if (l.fd != -1)
+        return l;
+
+      const auto path = fmt::format("{}/{}{}", dir, merkle_prefix, level);
+      l.fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+      if (l.fd == -1)
+      {
+        throw std::logic_error(fmt::format(
+          "Unable to open Merkle store file {}: {}", path, strerror(errno)));
+      }
+
+      struct stat st;
+      if (fstat(l.fd, &st) != 0)
+      {
+        throw std::logic_error(fmt::format(
+          "Unable to stat Merkle store file {}: {}", path, strerror(errno)));
+      }
+      l.size = st.st_size / HASH_SIZE;
+      return l;
+    }
+
+  public:
+    MerkleStore(
+      const std::string& dir_,
+      ringbuffer::AbstractWriterFactory& writer_factory) :
+      dir(dir_),
+      to_enclave(writer_factory.create_writer_to_inside())
+    {
+      if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+      {
+        throw std::logic_error(fmt::format(
+          "Unable to create Merkle store directory {}: {}",
+          dir,
+          strerror(errno)));
+      }
+    }
+
+    MerkleStore(const MerkleStore&) = delete;
+
+    ~MerkleStore()
+    {
+      for (auto& l : levels)
+      {
+        if (l.fd != -1)
+          close(l.fd);
+      }
+    }
+
+    /** Write consecutive nodes of one level. Nodes already in the store are
+     * overwritten, which is a no-op when the same tree is flushed again.
+     *
+     * @param level Level of the nodes
+     * @param first Index of the first node in the level
+     * @param data Hashes of the nodes
+     * @param size Size of data
+     */
+    void append(
+      uint32_t level, uint64_t first, const uint8_t* data, size_t size)
+    {
+      auto& l = get_level(level);
+      const auto offset = first * HASH_SIZE;
+
+      size_t written = 0;
+      while (written < size)
+      {
+        auto r =
+          pwrite(l.fd, data + written, size - written, offset + written);
+        if (r == -1)
+        {
+          throw std::logic_error(fmt::format(
+            "Unable to write to Merkle store level {}: {}",
+            level,
+            strerror(errno)));
+        }
+        written += r;
+      }
+
+      l.size = std::max(l.size, first + size / HASH_SIZE);
+    }
+
+    /** Read nodes
+     *
+     * @param nodes Positions of the nodes
+     *
+     * @return Hashes of the nodes, in order, or nullopt if any of them is
+     * not in the store
+     */
+    std::optional<std::vector<uint8_t>> read(
+      const std::vector<ccf::MerkleNode>& nodes)
+    {
+      std::vector<uint8_t> hashes(nodes.size() * HASH_SIZE);
+      auto p = hashes.data();
+
+      for (const auto& [level, index] : nodes)
+      {
+        auto& l = get_level(level);
+        if (index >= l.size)
+          return std::nullopt;
+
+        auto r = pread(l.fd, p, HASH_SIZE, index * HASH_SIZE);
+        if (r != (ssize_t)HASH_SIZE)
+        {
+          LOG_FAIL_FMT(
+            "Unable to read node {} from Merkle store level {}: {}",
+            index,
+            level,
+            strerror(errno));
+          return std::nullopt;
+        }
+        p += HASH_SIZE;
+      }
+
+      return hashes;
+    }
+
+    void register_message_handlers(
+      messaging::Dispatcher<ringbuffer::Message>& disp)
+    {
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        disp, ccf::merkle_append, [this](const uint8_t* data, size_t size) {
+          auto [level, first, hashes] =
+            ringbuffer::read_message<ccf::merkle_append>(data, size);
+          append(level, first, hashes.data(), hashes.size());
+        });
+
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        disp, ccf::merkle_get, [this](const uint8_t* data, size_t size) {
+          auto [token, body] =
+            ringbuffer::read_message<ccf::merkle_get>(data, size);
+
+          std::vector<ccf::MerkleNode> nodes;
+          const uint8_t* p = body.data();
+          size_t s = body.size();
+          while (s > 0)
+          {
+            auto level = serialized::read<uint32_t>(p, s);
+            auto index = serialized::read<uint64_t>(p, s);
+            nodes.emplace_back(level, index);
+          }
+
+          auto hashes = read(nodes);
+          if (hashes.has_value())
+          {
+            RINGBUFFER_WRITE_MESSAGE(
+              ccf::merkle_nodes, to_enclave, token, hashes.value());
+          }
+          else
+          {
+            RINGBUFFER_WRITE_MESSAGE(
+              ccf::merkle_nodes, to_enclave, token, std::vector<uint8_t>());
+          }
+        });
+    }
+  };
+}
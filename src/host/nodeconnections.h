@@ -246,10 +246,14 @@ namespace asynchost
             node.value()->write(sizeof(uint32_t), (uint8_t*)&frame);
             node.value()->write(size_to_send, data_to_send);
 
-            auto framed_entries =
-              ledger.read_framed_entries(ae.prev_idx + 1, ae.idx);
-            frame = (uint32_t)framed_entries.size();
-            node.value()->write(frame, framed_entries.data());
+            // Entries in sealed ledger chunks are written to the connection
+            // straight from the mapped files
+            ledger.read_framed_entries(
+              ae.prev_idx + 1,
+              ae.idx,
+              [&node](const uint8_t* entries, size_t entries_size) {
+                node.value()->write(entries_size, entries);
+              });
           }
           else
           {
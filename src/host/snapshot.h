@@ -0,0 +1,121 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "consensus/ledgerenclavetypes.h"
+#include "ds/files.h"
+#include "ds/logger.h"
+#include "ds/messaging.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <dirent.h>
+#include <errno.h>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <vector>
+
+namespace asynchost
+{
+  class Snapshots
+  {
+  private:
+    static constexpr auto snapshot_prefix = "snapshot_";
+
+    const std::string dir;
+
+    std::string snapshot_path(consensus::Index idx) const
+    {
+      return fmt::format("{}/{}{}", dir, snapshot_prefix, idx);
+    }
+
+    // Returns the indices of all snapshots in the directory
+    std::vector<consensus::Index> list_snapshots() const
+    {
+      std::vector<consensus::Index> indices;
+      auto d = opendir(dir.c_str());
+      if (d == nullptr)
+        return indices;
+
+      const std::string prefix(snapshot_prefix);
+      for (auto e = readdir(d); e != nullptr; e = readdir(d))
+      {
+        std::string name(e->d_name);
+        if (name.size() <= prefix.size() || name.rfind(prefix, 0) != 0)
+          continue;
+
+        auto suffix = name.substr(prefix.size());
+        if (suffix.find_first_not_of("0123456789") != std::string::npos)
+          continue;
+
+        indices.push_back(std::stoull(suffix));
+      }
+
+      closedir(d);
+      return indices;
+    }
+
+  public:
+    Snapshots(const std::string& dir_) : dir(dir_)
+    {
+      if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+      {
+        throw std::logic_error(fmt::format(
+          "Unable to create snapshot directory {}: {}", dir, strerror(errno)));
+      }
+    }
+
+    /** Read the snapshot with the highest index, if any
+     *
+     * @return Serialised snapshot, empty if there is none
+     */
+    std::vector<uint8_t> read_latest_snapshot() const
+    {
+      auto indices = list_snapshots();
+      if (indices.empty())
+        return {};
+
+      auto idx = *std::max_element(indices.begin(), indices.end());
+      LOG_INFO_FMT("Found snapshot at {} in {}", idx, dir);
+      return files::slurp(snapshot_path(idx));
+    }
+
+    void write_snapshot(
+      consensus::Index idx, const std::vector<uint8_t>& snapshot)
+    {
+      // Write to a temporary file first so that an interrupted write is never
+      // mistaken for a complete snapshot
+      auto path = snapshot_path(idx);
+      auto tmp_path = path + ".tmp";
+      files::dump(snapshot, tmp_path);
+
+      if (rename(tmp_path.c_str(), path.c_str()) != 0)
+      {
+        LOG_FAIL_FMT(
+          "Could not write snapshot at {}: {}", idx, strerror(errno));
+        return;
+      }
+
+      LOG_INFO_FMT("Wrote snapshot at {} ({} bytes)", idx, snapshot.size());
+
+      // Only the latest snapshot is needed to start a node
+      for (auto i : list_snapshots())
+      {
+        if (i < idx)
+          ::remove(snapshot_path(i).c_str());
+      }
+    }
+
+    void register_message_handlers(
+      messaging::Dispatcher<ringbuffer::Message>& disp)
+    {
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        disp, consensus::snapshot, [this](const uint8_t* data, size_t size) {
+          auto [idx, snapshot] =
+            ringbuffer::read_message<consensus::snapshot>(data, size);
+          write_snapshot(idx, snapshot);
+        });
+    }
+  };
+}
@@ -3,9 +3,15 @@
 #pragma once
 
 #include "../ds/logger.h"
+#include "beforeio.h"
+#include "bufferpool.h"
 #include "dns.h"
 #include "proxy.h"
 
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
 namespace asynchost
 {
   class TCPImpl;
@@ -30,8 +36,17 @@ namespace asynchost
   private:
     friend class close_ptr<TCPImpl>;
 
+    friend class TCPFlushImpl;
+
     static constexpr int backlog = 128;
-    static constexpr size_t max_read_size = 16384;
+
+    // Smaller writes are copied and coalesced, larger ones are written from
+    // the caller's memory when the socket can take them immediately
+    static constexpr size_t direct_write_size = 4096;
+
+    // Set while a TCPFlush exists. Otherwise, writes are sent immediately.
+    static inline bool coalesce_writes = false;
+    static inline std::vector<TCPImpl*> to_flush;
 
     enum Status
     {
@@ -48,27 +63,30 @@ namespace asynchost
       RECONNECTING
     };
 
-    struct PendingWrite
+    // Bytes [offset, len) of a pooled buffer, still to be written
+    struct Chunk
     {
-      uv_write_t* req;
+      uint8_t* data;
+      size_t offset;
       size_t len;
+    };
 
-      PendingWrite(uv_write_t* req, size_t len) : req(req), len(len) {}
-
-      PendingWrite(PendingWrite&& that) : req(that.req), len(that.len)
-      {
-        that.req = nullptr;
-      }
+    struct WriteReq
+    {
+      uv_write_t req;
+      std::vector<Chunk> chunks;
 
-      ~PendingWrite()
+      ~WriteReq()
       {
-        free_write(req);
+        release(chunks);
       }
     };
 
     Status status;
     std::unique_ptr<TCPBehaviour> behaviour;
-    std::vector<PendingWrite> pending_writes;
+    // Copies of written data not yet handed to libuv
+    std::vector<Chunk> pending;
+    bool flush_queued = false;
 
     std::string host;
     std::string service;
@@ -87,6 +105,11 @@ namespace asynchost
     {
       if (addr_base != nullptr)
         uv_freeaddrinfo(addr_base);
+
+      release(pending);
+
+      if (flush_queued)
+        to_flush.erase(std::find(to_flush.begin(), to_flush.end(), this));
     }
 
   public:
@@ -140,14 +163,13 @@ namespace asynchost
       return resolve(host, service, false);
     }
 
+    /** Write data to the socket
+     *
+     * data is not referenced once this returns. Small writes are coalesced
+     * and sent once per loop iteration if a TCPFlush exists.
+     */
     bool write(size_t len, const uint8_t* data)
     {
-      auto req = new uv_write_t;
-      char* copy = new char[len];
-      if (data)
-        memcpy(copy, data, len);
-      req->data = copy;
-
       switch (status)
       {
         case CONNECTING_RESOLVING:
@@ -155,12 +177,23 @@ namespace asynchost
         case RESOLVING_FAILED:
         case CONNECTING_FAILED:
         {
-          pending_writes.emplace_back(req, len);
+          append(len, data);
           break;
         }
 
         case CONNECTED:
-          return send_write(req, len);
+        {
+          if (len >= direct_write_size || !coalesce_writes)
+            return flush(len, data);
+
+          append(len, data);
+          if (!flush_queued)
+          {
+            flush_queued = true;
+            to_flush.push_back(this);
+          }
+          break;
+        }
 
         case DISCONNECTED:
         {
@@ -200,28 +233,134 @@ namespace asynchost
       return true;
     }
 
-    bool send_write(uv_write_t* req, size_t len)
+    static void release(std::vector<Chunk>& chunks)
     {
-      char* copy = (char*)req->data;
+      auto& pool = BufferPool::instance();
+      for (auto& c : chunks)
+        pool.put(c.data);
+      chunks.clear();
+    }
 
-      uv_buf_t buf;
-      buf.base = copy;
-      buf.len = len;
+    // Copy data to the end of pending, in pooled buffers
+    void append(size_t len, const uint8_t* data)
+    {
+      while (len > 0)
+      {
+        if (pending.empty() || pending.back().len == BufferPool::buffer_size)
+          pending.push_back({BufferPool::instance().get(), 0, 0});
 
-      int rc;
+        auto& c = pending.back();
+        auto n = std::min(len, BufferPool::buffer_size - c.len);
+        if (data != nullptr)
+        {
+          memcpy(c.data + c.len, data, n);
+          data += n;
+        }
+        else
+        {
+          memset(c.data + c.len, 0, n);
+        }
+        c.len += n;
+        len -= n;
+      }
+    }
+
+    static void flush_all()
+    {
+      std::vector<TCPImpl*> connections;
+      connections.swap(to_flush);
+
+      for (auto t : connections)
+      {
+        t->flush_queued = false;
+        if (t->status == CONNECTED)
+          t->flush();
+      }
+    }
+
+    // Hand pending data, followed by data, to the socket. As much as the
+    // socket accepts is written immediately with a single scatter-gather
+    // write, straight from the buffers. Only what remains of data is copied,
+    // to be written asynchronously.
+    bool flush(size_t len = 0, const uint8_t* data = nullptr)
+    {
+      if (data == nullptr)
+      {
+        append(len, data);
+        len = 0;
+      }
+
+      if (pending.empty() && len == 0)
+        return true;
+
+      std::vector<uv_buf_t> bufs;
+      bufs.reserve(pending.size() + 1);
+      for (auto& c : pending)
+        bufs.push_back(uv_buf_init((char*)c.data + c.offset, c.len - c.offset));
+      if (len > 0)
+        bufs.push_back(uv_buf_init((char*)data, len));
+
+      auto rc = uv_try_write((uv_stream_t*)&uv_handle, bufs.data(), bufs.size());
+      if (rc < 0 && rc != UV_EAGAIN)
+      {
+        LOG_FAIL_FMT("uv_try_write failed: {}", uv_strerror(rc));
+        return on_write_failed();
+      }
+
+      size_t written = rc < 0 ? 0 : rc;
+
+      auto& pool = BufferPool::instance();
+      auto it = pending.begin();
+      while (it != pending.end() && written >= it->len - it->offset)
+      {
+        written -= it->len - it->offset;
+        pool.put(it->data);
+        ++it;
+      }
+      if (it != pending.end())
+      {
+        it->offset += written;
+        written = 0;
+      }
+      pending.erase(pending.begin(), it);
+
+      append(len - written, data + written);
+
+      if (pending.empty())
+        return true;
+
+      auto req = new WriteReq;
+      req->req.data = req;
+      req->chunks.swap(pending);
 
-      if ((rc = uv_write(req, (uv_stream_t*)&uv_handle, &buf, 1, on_write)) < 0)
+      bufs.clear();
+      for (auto& c : req->chunks)
+        bufs.push_back(uv_buf_init((char*)c.data + c.offset, c.len - c.offset));
+
+      if (
+        (rc = uv_write(
+           &req->req,
+           (uv_stream_t*)&uv_handle,
+           bufs.data(),
+           bufs.size(),
+           on_write)) < 0)
       {
-        free_write(req);
+        delete req;
         LOG_FAIL_FMT("uv_write failed: {}", uv_strerror(rc));
-        assert_status(CONNECTED, DISCONNECTED);
-        behaviour->on_disconnect();
-        return false;
+        return on_write_failed();
       }
 
       return true;
     }
 
+    bool on_write_failed()
+    {
+      release(pending);
+      assert_status(CONNECTED, DISCONNECTED);
+      behaviour->on_disconnect();
+      return false;
+    }
+
     void listen_resolved()
     {
       int rc;
@@ -426,13 +565,9 @@ namespace asynchost
         if (!read_start())
           return;
 
-        for (auto& w : pending_writes)
-        {
-          send_write(w.req, w.len);
-          w.req = nullptr;
-        }
+        if (!flush())
+          return;
 
-        std::vector<PendingWrite>().swap(pending_writes);
         behaviour->on_connect();
       }
     }
@@ -463,15 +598,14 @@ namespace asynchost
 
     void on_alloc(size_t suggested_size, uv_buf_t* buf)
     {
-      auto alloc_size = std::min(suggested_size, max_read_size);
-      buf->base = new char[alloc_size];
-      buf->len = alloc_size;
+      buf->base = (char*)BufferPool::instance().get();
+      buf->len = BufferPool::buffer_size;
     }
 
     void on_free(const uv_buf_t* buf)
     {
       if (buf->base != nullptr)
-        delete[] buf->base;
+        BufferPool::instance().put((uint8_t*)buf->base);
     }
 
     static void on_read(uv_stream_t* handle, ssize_t sz, const uv_buf_t* buf)
@@ -508,17 +642,7 @@ namespace asynchost
     static void on_write(uv_write_t* req, int rc)
     {
       (void)rc;
-      free_write(req);
-    }
-
-    static void free_write(uv_write_t* req)
-    {
-      if (req == nullptr)
-        return;
-
-      char* copy = (char*)req->data;
-      delete[] copy;
-      delete req;
+      delete static_cast<WriteReq*>(req->data);
     }
 
     static void on_reconnect(uv_handle_t* handle)
@@ -541,4 +665,27 @@ namespace asynchost
       connect_resolved();
     }
   };
+
+  // Sends the writes coalesced by all connections, once per loop iteration
+  class TCPFlushImpl
+  {
+  public:
+    TCPFlushImpl()
+    {
+      TCPImpl::coalesce_writes = true;
+    }
+
+    ~TCPFlushImpl()
+    {
+      TCPImpl::coalesce_writes = false;
+      TCPImpl::flush_all();
+    }
+
+    void before_io()
+    {
+      TCPImpl::flush_all();
+    }
+  };
+
+  using TCPFlush = proxy_ptr<BeforeIO<TCPFlushImpl>>;
 }
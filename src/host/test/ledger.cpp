@@ -5,6 +5,7 @@
 
 #include <doctest/doctest.h>
 #include <string>
+#include <thread>
 
 TEST_CASE("Read/Write test")
 {
@@ -15,7 +16,7 @@ TEST_CASE("Read/Write test")
   const std::vector<uint8_t> e2 = {5, 5, 6, 7};
   {
     asynchost::Ledger l("testlog", wf);
-    l.truncate(0);
+    l.init(0);
     REQUIRE(l.get_last_idx() == 0);
     l.write_entry(e1.data(), e1.size());
     l.write_entry(e2.data(), e2.size());
@@ -38,7 +39,7 @@ TEST_CASE("Entry sizes")
   const std::vector<uint8_t> e2 = {5, 5, 6, 7};
 
   asynchost::Ledger l("testlog", wf);
-  l.truncate(0);
+  l.init(0);
   REQUIRE(l.get_last_idx() == 0);
   l.write_entry(e1.data(), e1.size());
   l.write_entry(e2.data(), e2.size());
@@ -48,6 +49,14 @@ TEST_CASE("Entry sizes")
   REQUIRE(l.entry_size(0) == 0);
   REQUIRE(l.entry_size(3) == 0);
 
+  INFO("Empty entries are framed");
+  l.write_entry(nullptr, 0);
+  REQUIRE(l.get_last_idx() == 3);
+  REQUIRE(l.entry_size(3) == 0);
+  REQUIRE(l.read_entry(3).empty());
+  REQUIRE(l.framed_entries_size(3, 3) == sizeof(uint32_t));
+  REQUIRE(l.entry_size(4) == 0);
+
   REQUIRE(l.framed_entries_size(1, 1) == (e1.size() + sizeof(uint32_t)));
   REQUIRE(
     l.framed_entries_size(1, 2) ==
@@ -58,4 +67,418 @@ TEST_CASE("Entry sizes")
     for (auto c : e)
       std::cout << std::hex << (int)c;
     std::cout << std::endl;*/
-}
\ No newline at end of file
+}
+
+TEST_CASE("Start after snapshot")
+{
+  ringbuffer::Circuit eio(2);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  const std::vector<uint8_t> e1 = {1, 2, 3};
+  const std::vector<uint8_t> e2 = {5, 5, 6, 7};
+  const size_t snapshot_idx = 10;
+
+  asynchost::Ledger l("testlog", wf);
+  l.init(0);
+  l.write_entry(e1.data(), e1.size());
+
+  INFO("Existing entries are discarded");
+  l.init(snapshot_idx);
+  REQUIRE(l.get_start_idx() == snapshot_idx);
+  REQUIRE(l.get_last_idx() == snapshot_idx);
+  REQUIRE(l.read_entry(1).empty());
+
+  INFO("Entries are indexed after the snapshot");
+  l.write_entry(e1.data(), e1.size());
+  l.write_entry(e2.data(), e2.size());
+  REQUIRE(l.get_last_idx() == snapshot_idx + 2);
+  REQUIRE(l.read_entry(snapshot_idx).empty());
+  REQUIRE(l.read_entry(snapshot_idx + 1) == e1);
+  REQUIRE(l.read_entry(snapshot_idx + 2) == e2);
+  REQUIRE(l.entry_size(snapshot_idx + 2) == e2.size());
+  REQUIRE(
+    l.framed_entries_size(snapshot_idx + 1, snapshot_idx + 2) ==
+    (e1.size() + sizeof(uint32_t) + e2.size() + sizeof(uint32_t)));
+  REQUIRE(l.framed_entries_size(snapshot_idx, snapshot_idx + 1) == 0);
+
+  INFO("Truncation is relative to the snapshot");
+  l.truncate(snapshot_idx + 1);
+  REQUIRE(l.get_last_idx() == snapshot_idx + 1);
+  REQUIRE(l.read_entry(snapshot_idx + 1) == e1);
+  l.truncate(snapshot_idx);
+  REQUIRE(l.get_last_idx() == snapshot_idx);
+}
+
+TEST_CASE("Chunks")
+{
+  ringbuffer::Circuit eio(2);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  // Each chunk holds two framed 4-byte entries
+  const size_t chunk_threshold = 10;
+  const std::string dir = "testlog_chunks";
+  const std::vector<uint8_t> e = {1, 2, 3, 4};
+  const size_t framed_size = e.size() + sizeof(uint32_t);
+  const std::string index_file = dir + "/ledger_1-2.index";
+
+  {
+    asynchost::Ledger l(dir, wf, chunk_threshold);
+    l.init(0);
+
+    for (size_t i = 0; i < 5; ++i)
+      l.write_entry(e.data(), e.size());
+
+    REQUIRE(l.get_last_idx() == 5);
+    REQUIRE(l.get_chunk_count() == 3);
+
+    INFO("Entries are read across chunks");
+    REQUIRE(l.read_entry(3) == e);
+    REQUIRE(l.framed_entries_size(2, 5) == 4 * framed_size);
+    REQUIRE(l.read_framed_entries(2, 5).size() == 4 * framed_size);
+
+    INFO("Only complete chunks are sealed");
+    l.commit(3);
+    REQUIRE(l.get_committed_idx() == 3);
+    REQUIRE(files::slurp(index_file, true).size() == 3 * sizeof(uint64_t));
+    REQUIRE(l.read_entry(1) == e);
+
+    INFO("Truncating at the end of a sealed chunk only drops later chunks");
+    l.commit(4);
+    l.truncate(4);
+    REQUIRE(l.get_last_idx() == 4);
+    REQUIRE(l.get_chunk_count() == 2);
+    REQUIRE(l.read_entry(4) == e);
+    l.write_entry(e.data(), e.size());
+    REQUIRE(l.get_chunk_count() == 3);
+
+    l.commit(5);
+    REQUIRE(l.get_committed_idx() == 5);
+    REQUIRE(l.read_entry(4) == e);
+
+    INFO("Committed entries cannot be truncated");
+    REQUIRE_THROWS_AS(l.truncate(4), std::logic_error);
+  }
+
+  INFO("Sealed chunks are not scanned on startup");
+  {
+    asynchost::Ledger l(dir, wf, chunk_threshold);
+    REQUIRE(l.get_last_idx() == 5);
+    REQUIRE(l.get_committed_idx() == 4);
+    REQUIRE(l.get_chunk_count() == 3);
+    REQUIRE(l.read_entry(2) == e);
+    REQUIRE(l.read_framed_entries(1, 5).size() == 5 * framed_size);
+
+    INFO("Truncation only affects open chunks");
+    l.write_entry(e.data(), e.size());
+    l.write_entry(e.data(), e.size());
+    REQUIRE(l.get_chunk_count() == 4);
+    l.truncate(5);
+    REQUIRE(l.get_last_idx() == 5);
+    REQUIRE(l.get_chunk_count() == 3);
+    REQUIRE(l.read_entry(6).empty());
+    REQUIRE(l.read_entry(5) == e);
+  }
+
+  INFO("Missing indices are rebuilt");
+  {
+    REQUIRE(::remove(index_file.c_str()) == 0);
+    asynchost::Ledger l(dir, wf, chunk_threshold);
+    REQUIRE(l.read_entry(1) == e);
+    REQUIRE(l.framed_entries_size(1, 2) == 2 * framed_size);
+    REQUIRE(files::slurp(index_file, true).size() == 3 * sizeof(uint64_t));
+  }
+
+  INFO("Starting from a snapshot discards all chunks");
+  {
+    asynchost::Ledger l(dir, wf, chunk_threshold);
+    l.init(10);
+    l.write_entry(e.data(), e.size());
+  }
+
+  {
+    asynchost::Ledger l(dir, wf, chunk_threshold);
+    REQUIRE(l.get_start_idx() == 10);
+    REQUIRE(l.get_last_idx() == 11);
+    REQUIRE(l.get_chunk_count() == 1);
+  }
+}
+
+TEST_CASE("Group commit")
+{
+  ringbuffer::Circuit eio(1024);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  const std::vector<uint8_t> e = {1, 2, 3, 4};
+
+  auto read_durable = [&eio]() {
+    std::optional<consensus::Index> durable = std::nullopt;
+    eio.read_from_outside().read(
+      -1, [&durable](ringbuffer::Message m, const uint8_t* data, size_t size) {
+        REQUIRE(m == consensus::ledger_durable);
+        auto [idx] =
+          ringbuffer::read_message<consensus::ledger_durable>(data, size);
+        durable = idx;
+      });
+    return durable;
+  };
+
+  INFO("Sync every N entries");
+  {
+    asynchost::LedgerSyncPolicy policy;
+    policy.max_entries = 3;
+    asynchost::Ledger l("testlog_sync", wf, 1024, policy);
+    l.init(0);
+
+    l.write_entry(e.data(), e.size());
+    l.write_entry(e.data(), e.size());
+    l.flush();
+    REQUIRE(l.get_durable_idx() == 0);
+    REQUIRE(!read_durable().has_value());
+
+    INFO("Staged entries are readable");
+    REQUIRE(l.read_entry(2) == e);
+
+    l.write_entry(e.data(), e.size());
+    l.write_entry(e.data(), e.size());
+    l.flush();
+    REQUIRE(l.get_durable_idx() == 4);
+    REQUIRE(read_durable() == 4);
+
+    INFO("Truncation rolls back durability");
+    l.truncate(2);
+    REQUIRE(l.get_durable_idx() == 2);
+  }
+
+  INFO("Sync on signature");
+  {
+    asynchost::LedgerSyncPolicy policy;
+    policy.on_signature = true;
+    asynchost::Ledger l("testlog_sync", wf, 1024, policy);
+    l.init(0);
+
+    for (size_t i = 0; i < 5; ++i)
+      l.write_entry(e.data(), e.size());
+    l.flush();
+    REQUIRE(!read_durable().has_value());
+
+    l.signature(5);
+    l.write_entry(e.data(), e.size());
+    l.flush();
+    REQUIRE(read_durable() == 6);
+
+    l.flush();
+    REQUIRE(!read_durable().has_value());
+  }
+
+  INFO("Sync after a delay");
+  {
+    asynchost::LedgerSyncPolicy policy;
+    policy.max_delay = std::chrono::milliseconds(10);
+    asynchost::Ledger l("testlog_sync", wf, 1024, policy);
+    l.init(0);
+
+    l.write_entry(e.data(), e.size());
+    l.flush();
+    REQUIRE(!read_durable().has_value());
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    l.flush();
+    REQUIRE(read_durable() == 1);
+  }
+
+  INFO("Staged entries are written on destruction");
+  {
+    asynchost::Ledger l("testlog_sync", wf);
+    REQUIRE(l.get_last_idx() == 1);
+    l.write_entry(e.data(), e.size());
+  }
+  {
+    asynchost::Ledger l("testlog_sync", wf);
+    REQUIRE(l.get_last_idx() == 2);
+    REQUIRE(l.read_entry(2) == e);
+  }
+}
+
+TEST_CASE("Cache")
+{
+  ringbuffer::Circuit eio(1024);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  // The reference ledger has no cache, so all its entries are read from the
+  // files
+  const size_t cache_size = 64;
+  asynchost::Ledger l("testlog_cache", wf, 1024, {}, cache_size);
+  asynchost::Ledger ref("testlog_cache_ref", wf, 1024, {}, 0);
+  l.init(0);
+  ref.init(0);
+
+  auto write = [&](uint8_t i) {
+    const std::vector<uint8_t> e(i % 16, i);
+    l.write_entry(e.data(), e.size());
+    ref.write_entry(e.data(), e.size());
+  };
+
+  auto check = [&]() {
+    REQUIRE(l.get_last_idx() == ref.get_last_idx());
+    for (size_t from = 1; from <= l.get_last_idx(); ++from)
+    {
+      for (size_t to = from; to <= l.get_last_idx(); ++to)
+      {
+        REQUIRE(
+          l.framed_entries_size(from, to) == ref.framed_entries_size(from, to));
+        REQUIRE(
+          l.read_framed_entries(from, to) == ref.read_framed_entries(from, to));
+      }
+    }
+  };
+
+  INFO("Entries are read from the cache as it wraps around");
+  for (uint8_t i = 1; i <= 40; ++i)
+  {
+    write(i);
+    check();
+  }
+
+  INFO("Entries larger than the cache are read from the files");
+  {
+    const std::vector<uint8_t> e(cache_size, 0xff);
+    l.write_entry(e.data(), e.size());
+    ref.write_entry(e.data(), e.size());
+    check();
+    write(41);
+    check();
+  }
+
+  INFO("Truncated entries are dropped from the cache");
+  {
+    l.truncate(38);
+    ref.truncate(38);
+    check();
+    for (uint8_t i = 42; i <= 50; ++i)
+    {
+      write(i);
+      check();
+    }
+
+    l.truncate(10);
+    ref.truncate(10);
+    check();
+    write(51);
+    check();
+  }
+}
+
+TEST_CASE("Compression")
+{
+  ringbuffer::Circuit eio(2);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  // Each chunk holds two framed entries, that compress well. The ledger has
+  // no cache, so that entries are read from the files.
+  const size_t chunk_threshold = 100;
+  const int compression_level = 1;
+  const std::string dir = "testlog_compression";
+  const std::vector<uint8_t> e(64, 'a');
+  const size_t framed_size = e.size() + sizeof(uint32_t);
+  const std::string compressed_file = dir + "/ledger_1-2.committed.z";
+  const std::string uncompressed_file = dir + "/ledger_1-2.committed";
+  const std::string index_file = dir + "/ledger_1-2.index";
+
+  std::vector<uint8_t> uncompressed;
+  {
+    asynchost::Ledger l(dir, wf, chunk_threshold, {}, 0, compression_level);
+    l.init(0);
+
+    for (size_t i = 0; i < 5; ++i)
+      l.write_entry(e.data(), e.size());
+    REQUIRE(l.get_chunk_count() == 3);
+    uncompressed = l.read_framed_entries(1, 2);
+
+    INFO("Sealed chunks are readable while they are compressed");
+    l.commit(5);
+    REQUIRE(l.get_committed_idx() == 5);
+    REQUIRE(!files::slurp(uncompressed_file, true).empty());
+    REQUIRE(l.read_framed_entries(1, 2) == uncompressed);
+
+    INFO("Sealed chunks are compressed");
+    uv_run(uv_default_loop(), UV_RUN_DEFAULT);
+    const auto compressed = files::slurp(compressed_file, true);
+    REQUIRE(!compressed.empty());
+    REQUIRE(compressed.size() < 2 * framed_size);
+    REQUIRE(files::slurp(uncompressed_file, true).empty());
+
+    INFO("Entries are read from compressed chunks");
+    REQUIRE(l.read_entry(1) == e);
+    REQUIRE(l.read_entry(4) == e);
+    REQUIRE(l.framed_entries_size(1, 5) == 5 * framed_size);
+    REQUIRE(l.read_framed_entries(1, 5).size() == 5 * framed_size);
+    REQUIRE(l.read_framed_entries(1, 2) == uncompressed);
+  }
+
+  INFO("Compressed chunks are read without compression enabled");
+  {
+    asynchost::Ledger l(dir, wf, chunk_threshold, {}, 0);
+    REQUIRE(l.get_last_idx() == 5);
+    REQUIRE(l.get_committed_idx() == 4);
+    REQUIRE(l.get_chunk_count() == 3);
+    REQUIRE(l.framed_entries_size(1, 4) == 4 * framed_size);
+    REQUIRE(l.read_framed_entries(1, 2) == uncompressed);
+  }
+
+  INFO("Missing indices of compressed chunks are rebuilt");
+  {
+    REQUIRE(::remove(index_file.c_str()) == 0);
+    asynchost::Ledger l(dir, wf, chunk_threshold, {}, 0);
+    REQUIRE(l.read_entry(2) == e);
+    REQUIRE(files::slurp(index_file, true).size() == 3 * sizeof(uint64_t));
+  }
+
+  INFO("Uncompressed chunks left by an interrupted compression are removed");
+  {
+    auto f = fopen(uncompressed_file.c_str(), "wb");
+    REQUIRE(f != nullptr);
+    fwrite(uncompressed.data(), uncompressed.size(), 1, f);
+    fclose(f);
+
+    asynchost::Ledger l(dir, wf, chunk_threshold, {}, 0);
+    REQUIRE(l.get_chunk_count() == 3);
+    REQUIRE(l.read_framed_entries(1, 2) == uncompressed);
+    REQUIRE(files::slurp(uncompressed_file, true).empty());
+  }
+
+  INFO("Chunks that do not compress are left uncompressed");
+  {
+    asynchost::Ledger l(dir, wf, chunk_threshold, {}, 0, compression_level);
+    l.init(0);
+
+    std::vector<uint8_t> random(64);
+    for (size_t i = 0; i < 3; ++i)
+    {
+      for (auto& c : random)
+        c = rand();
+      l.write_entry(random.data(), random.size());
+    }
+    l.commit(3);
+    uv_run(uv_default_loop(), UV_RUN_DEFAULT);
+    REQUIRE(files::slurp(compressed_file, true).empty());
+    REQUIRE(!files::slurp(uncompressed_file, true).empty());
+  }
+
+  INFO("Compressions outlive the ledger that started them");
+  {
+    {
+      asynchost::Ledger l(dir, wf, chunk_threshold, {}, 0, compression_level);
+      l.init(0);
+
+      for (size_t i = 0; i < 3; ++i)
+        l.write_entry(e.data(), e.size());
+      l.commit(3);
+    }
+    uv_run(uv_default_loop(), UV_RUN_DEFAULT);
+    REQUIRE(!files::slurp(compressed_file, true).empty());
+
+    asynchost::Ledger l(dir, wf, chunk_threshold, {}, 0);
+    REQUIRE(files::slurp(uncompressed_file, true).empty());
+    REQUIRE(l.read_framed_entries(1, 2) == uncompressed);
+  }
+}
@@ -0,0 +1,102 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "ds/logger.h"
+#include "ds/messaging.h"
+#include "ds/tracing.h"
+
+#include <cstdio>
+#include <errno.h>
+#include <string>
+
+namespace asynchost
+{
+  /** Writes the request traces emitted by the enclave (see tracing.h) to a
+   * file, in the Chrome trace event format, so that they can be loaded in
+   * chrome://tracing or Perfetto.
+   *
+   * Each traced request is an async event, from the time it is received to
+   * its global commit, with one instant event per stage in between. Events
+   * are appended as they arrive, in the JSON array format, which does not
+   * require the array to be closed.
+   */
+  class TraceSink
+  {
+  private:
+    FILE* f;
+    bool first = true;
+
+    static const char* phase(tracing::Stage stage)
+    {
+      switch (stage)
+      {
+        case tracing::Stage::Recv:
+          return "b";
+        case tracing::Stage::GlobalCommit:
+          return "e";
+        default:
+          return "n";
+      }
+    }
+
+  public:
+    TraceSink(const std::string& path)
+    {
+      f = fopen(path.c_str(), "w");
+      if (f == nullptr)
+      {
+        throw std::logic_error(fmt::format(
+          "Unable to open trace file {}: {}", path, strerror(errno)));
+      }
+
+      fputs("[\n", f);
+    }
+
+    TraceSink(const TraceSink&) = delete;
+
+    ~TraceSink()
+    {
+      fputs("\n]\n", f);
+      fclose(f);
+    }
+
+    void write(
+      tracing::TraceId id,
+      tracing::Stage stage,
+      uint16_t thread_id,
+      uint64_t us,
+      uint64_t seqno)
+    {
+      const auto ph = phase(stage);
+      const auto name =
+        (*ph == 'n') ? tracing::stage_name(stage) : "request";
+
+      fmt::print(
+        f,
+        "{}{{\"name\":\"{}\",\"cat\":\"ccf\",\"ph\":\"{}\",\"id\":\"{:#x}\","
+        "\"ts\":{},\"pid\":0,\"tid\":{},\"args\":{{\"stage\":\"{}\","
+        "\"seqno\":{}}}}}",
+        first ? "" : ",\n",
+        name,
+        ph,
+        id,
+        us,
+        thread_id,
+        tracing::stage_name(stage),
+        seqno);
+      first = false;
+    }
+
+    void register_message_handlers(
+      messaging::Dispatcher<ringbuffer::Message>& disp)
+    {
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        disp, tracing::trace_event, [this](const uint8_t* data, size_t size) {
+          auto [id, stage, thread_id, us, seqno] =
+            ringbuffer::read_message<tracing::trace_event>(data, size);
+          write(id, static_cast<tracing::Stage>(stage), thread_id, us, seqno);
+        });
+    }
+  };
+}
@@ -3,6 +3,7 @@
 #pragma once
 
 #include "ds/logger.h"
+#include "ds/tracing.h"
 #include "enclave/clientendpoint.h"
 #include "enclave/rpcmap.h"
 #include "http_parser.h"
@@ -17,6 +18,12 @@ namespace http
     http::Parser& p;
     bool is_websocket = false;
 
+    // Only requests received by servers are traced. The trace is started
+    // when the first bytes of a request are received, and is handed to the
+    // request once it has been parsed.
+    bool trace_requests = false;
+    tracing::TraceId trace = tracing::NoTrace;
+
     HTTPEndpoint(
       http::Parser& p_,
       size_t session_id,
@@ -45,6 +52,11 @@ namespace http
 
     void recv_(const uint8_t* data, size_t size)
     {
+      if (trace_requests && trace == tracing::NoTrace)
+      {
+        trace = tracing::start();
+      }
+
       recv_buffered(data, size);
 
       LOG_TRACE_FMT("recv called with {} bytes", size);
@@ -125,6 +137,110 @@ namespace http
     size_t session_id;
     size_t request_index = 0;
 
+    // Responses to requests processed on other threads may complete out of
+    // order. They are held here until all earlier responses have been sent.
+    size_t next_response_index = 0;
+    std::map<size_t, std::optional<std::vector<uint8_t>>> completed_responses;
+
+    struct ProcessMsg
+    {
+      std::shared_ptr<enclave::Endpoint> self;
+      std::shared_ptr<enclave::RpcHandler> frontend;
+      std::shared_ptr<HttpRpcContext> rpc_ctx;
+      size_t index;
+      std::optional<std::vector<uint8_t>> response;
+      bool failed = false;
+    };
+
+    static std::vector<uint8_t> build_response(
+      const std::vector<uint8_t>& data,
+      http_status status,
+      const std::string& content_type)
+    {
+      if (data.empty() && status == HTTP_STATUS_OK)
+      {
+        status = HTTP_STATUS_NO_CONTENT;
+      }
+
+      auto response = http::Response(status);
+
+      if (status == HTTP_STATUS_NO_CONTENT)
+      {
+        return response.build_response(true);
+      }
+
+      response.set_header(http::headers::CONTENT_TYPE, content_type);
+      response.set_body(&data);
+
+      auto r = response.build_response(true);
+      r.insert(r.end(), data.begin(), data.end());
+      return r;
+    }
+
+    static std::vector<uint8_t> build_response(
+      const std::string& data,
+      http_status status = HTTP_STATUS_OK,
+      const std::string& content_type = http::headervalues::contenttype::TEXT)
+    {
+      return build_response(
+        std::vector<uint8_t>(data.begin(), data.end()), status, content_type);
+    }
+
+    void send_in_order(
+      size_t index, std::optional<std::vector<uint8_t>>&& response)
+    {
+      completed_responses.emplace(index, std::move(response));
+
+      auto it = completed_responses.begin();
+      while (
+        it != completed_responses.end() && it->first == next_response_index)
+      {
+        // Pending responses (e.g. forwarded RPCs) are sent separately
+        if (it->second.has_value())
+        {
+          send_buffered(it->second.value());
+        }
+        it = completed_responses.erase(it);
+        ++next_response_index;
+      }
+
+      flush();
+    }
+
+    // Runs on a worker thread
+    static void process_cb(std::unique_ptr<enclave::Tmsg<ProcessMsg>> msg)
+    {
+      try
+      {
+        msg->data.response = msg->data.frontend->process(msg->data.rpc_ctx);
+      }
+      catch (const std::exception& e)
+      {
+        msg->data.response = build_response(
+          fmt::format("Exception:\n{}\n", e.what()),
+          HTTP_STATUS_INTERNAL_SERVER_ERROR);
+        msg->data.failed = true;
+      }
+
+      // The response is sent from the session's own thread
+      auto self = static_cast<HTTPServerEndpoint*>(msg->data.self.get());
+      enclave::ThreadMessaging::ChangeTmsgCallback(msg, &respond_cb);
+      enclave::ThreadMessaging::thread_messaging.add_task<ProcessMsg>(
+        self->execution_thread, std::move(msg));
+    }
+
+    static void respond_cb(std::unique_ptr<enclave::Tmsg<ProcessMsg>> msg)
+    {
+      auto self = static_cast<HTTPServerEndpoint*>(msg->data.self.get());
+      self->send_in_order(msg->data.index, std::move(msg->data.response));
+
+      if (msg->data.failed)
+      {
+        LOG_TRACE_FMT("Closing connection due to exception");
+        self->close();
+      }
+    }
+
   public:
     HTTPServerEndpoint(
       std::shared_ptr<enclave::RPCMap> rpc_map,
@@ -135,7 +251,9 @@ namespace http
       request_parser(*this),
       rpc_map(rpc_map),
       session_id(session_id)
-    {}
+    {
+      trace_requests = true;
+    }
 
     void send(const std::vector<uint8_t>& data) override
     {
@@ -156,24 +274,7 @@ namespace http
       http_status status = HTTP_STATUS_OK,
       const std::string& content_type = http::headervalues::contenttype::JSON)
     {
-      if (data.empty() && status == HTTP_STATUS_OK)
-      {
-        status = HTTP_STATUS_NO_CONTENT;
-      }
-
-      auto response = http::Response(status);
-
-      if (status == HTTP_STATUS_NO_CONTENT)
-      {
-        send_raw(response.build_response(true));
-        return;
-      }
-
-      response.set_header(http::headers::CONTENT_TYPE, content_type);
-      response.set_body(&data);
-
-      send_raw(response.build_response(true));
-      send_raw(data);
+      send_raw(build_response(data, status, content_type));
     }
 
     void handle_request(
@@ -210,30 +311,37 @@ namespace http
             std::make_shared<enclave::SessionContext>(session_id, peer_cert());
         }
 
+        const auto index = request_index++;
         std::shared_ptr<HttpRpcContext> rpc_ctx = nullptr;
         try
         {
           rpc_ctx = std::make_shared<HttpRpcContext>(
-            request_index++,
+            index,
             session_ctx,
             verb,
             path,
             query,
             std::move(headers),
             std::move(body));
+          rpc_ctx->trace_id = std::exchange(trace, tracing::NoTrace);
+          tracing::record(rpc_ctx->trace_id, tracing::Stage::HandleRequest);
         }
         catch (std::exception& e)
         {
-          send_response(e.what(), HTTP_STATUS_BAD_REQUEST);
+          send_in_order(
+            index, build_response(e.what(), HTTP_STATUS_BAD_REQUEST));
+          return;
         }
 
         const auto actor_opt = http::extract_actor(*rpc_ctx);
         if (!actor_opt.has_value())
         {
-          send_response(fmt::format(
-            "Request path must contain '/[actor]/[method]'. Unable to parse "
-            "'{}'.\n",
-            rpc_ctx->get_method()));
+          send_in_order(
+            index,
+            build_response(fmt::format(
+              "Request path must contain '/[actor]/[method]'. Unable to parse "
+              "'{}'.\n",
+              rpc_ctx->get_method())));
           return;
         }
 
@@ -242,33 +350,47 @@ namespace http
         auto search = rpc_map->find(actor);
         if (actor == ccf::ActorsType::unknown || !search.has_value())
         {
-          send_response(
-            fmt::format("Unknown session '{}'.\n", actor_s),
-            HTTP_STATUS_NOT_FOUND);
+          send_in_order(
+            index,
+            build_response(
+              fmt::format("Unknown session '{}'.\n", actor_s),
+              HTTP_STATUS_NOT_FOUND));
           return;
         }
 
-        if (!search.value()->is_open())
+        auto frontend = search.value();
+        if (!frontend->is_open())
         {
-          send_response(
-            fmt::format("Session '{}' is not open.\n", actor_s),
-            HTTP_STATUS_NOT_FOUND);
+          send_in_order(
+            index,
+            build_response(
+              fmt::format("Session '{}' is not open.\n", actor_s),
+              HTTP_STATUS_NOT_FOUND));
           return;
         }
 
-        auto response = search.value()->process(rpc_ctx);
-
-        if (!response.has_value())
-        {
-          // If the RPC is pending, hold the connection.
-          LOG_TRACE_FMT("Pending");
-          return;
-        }
-        else
+        // Worker threads are all but the main thread
+        const auto thread_count = enclave::ThreadMessaging::thread_count.load();
+        if (thread_count > 1)
         {
-          send_buffered(response.value());
-          flush();
+          const auto worker = frontend->schedule(rpc_ctx, thread_count - 1);
+          if (worker.has_value() && worker.value() + 1u != execution_thread)
+          {
+            auto msg = std::make_unique<enclave::Tmsg<ProcessMsg>>(&process_cb);
+            msg->data.self = this->shared_from_this();
+            msg->data.frontend = frontend;
+            msg->data.rpc_ctx = rpc_ctx;
+            msg->data.index = index;
+
+            enclave::ThreadMessaging::thread_messaging.add_task<ProcessMsg>(
+              worker.value() + 1, std::move(msg));
+            return;
+          }
         }
+
+        // If the RPC is pending, the connection is held and the response is
+        // sent once it is available
+        send_in_order(index, frontend->process(rpc_ctx));
       }
       catch (const std::exception& e)
       {
@@ -0,0 +1,175 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <msgpack-c/msgpack.hpp>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace kv
+{
+  /** Immutable byte string, for use as a key or value of a map
+   *
+   * A Blob shares ownership of the buffer its bytes are in, rather than
+   * owning a copy of them. Blobs read by the flat deserialiser (see
+   * flatserialise.h) point into the serialised write set they were read
+   * from, so that the keys and values of a transaction, and the map states
+   * they are then applied to, are not copied one by one. Note that a single
+   * Blob keeps the whole of that buffer alive.
+   */
+  class Blob
+  {
+  private:
+    std::shared_ptr<const std::vector<uint8_t>> buffer;
+    const uint8_t* p = nullptr;
+    size_t n = 0;
+
+  public:
+    Blob() = default;
+
+    Blob(std::vector<uint8_t>&& v) :
+      buffer(std::make_shared<const std::vector<uint8_t>>(std::move(v))),
+      p(buffer->data()),
+      n(buffer->size())
+    {}
+
+    Blob(const uint8_t* data_, size_t size_) :
+      Blob(std::vector<uint8_t>(data_, data_ + size_))
+    {}
+
+    Blob(const std::vector<uint8_t>& v) : Blob(v.data(), v.size()) {}
+
+    Blob(const std::string& s) : Blob((const uint8_t*)s.data(), s.size()) {}
+
+    Blob(const char* s) : Blob(std::string(s)) {}
+
+    /** Bytes in a buffer, without copying them
+     *
+     * @param buffer_ Buffer holding the bytes
+     * @param data_ First byte, in buffer_
+     * @param size_ Number of bytes
+     */
+    Blob(
+      std::shared_ptr<const std::vector<uint8_t>> buffer_,
+      const uint8_t* data_,
+      size_t size_) :
+      buffer(std::move(buffer_)),
+      p(data_),
+      n(size_)
+    {}
+
+    const uint8_t* data() const
+    {
+      return p;
+    }
+
+    size_t size() const
+    {
+      return n;
+    }
+
+    bool empty() const
+    {
+      return n == 0;
+    }
+
+    const uint8_t* begin() const
+    {
+      return p;
+    }
+
+    const uint8_t* end() const
+    {
+      return p + n;
+    }
+
+    std::string_view str() const
+    {
+      return {(const char*)p, n};
+    }
+
+    std::vector<uint8_t> to_vector() const
+    {
+      return {begin(), end()};
+    }
+
+    bool operator==(const Blob& other) const
+    {
+      return n == other.n && (n == 0 || std::memcmp(p, other.p, n) == 0);
+    }
+
+    bool operator!=(const Blob& other) const
+    {
+      return !(*this == other);
+    }
+
+    bool operator<(const Blob& other) const
+    {
+      return str() < other.str();
+    }
+  };
+
+  inline void to_json(nlohmann::json& j, const Blob& b)
+  {
+    j = b.to_vector();
+  }
+
+  inline void from_json(const nlohmann::json& j, Blob& b)
+  {
+    b = Blob(j.get<std::vector<uint8_t>>());
+  }
+}
+
+namespace std
+{
+  template <>
+  struct hash<kv::Blob>
+  {
+    size_t operator()(const kv::Blob& b) const
+    {
+      return std::hash<std::string_view>()(b.str());
+    }
+  };
+}
+
+namespace msgpack
+{
+  MSGPACK_API_VERSION_NAMESPACE(MSGPACK_DEFAULT_API_NS)
+  {
+    namespace adaptor
+    {
+      template <>
+      struct pack<kv::Blob>
+      {
+        template <typename Stream>
+        msgpack::packer<Stream>& operator()(
+          msgpack::packer<Stream>& o, const kv::Blob& b) const
+        {
+          o.pack_bin(b.size());
+          o.pack_bin_body(reinterpret_cast<const char*>(b.data()), b.size());
+          return o;
+        }
+      };
+
+      template <>
+      struct convert<kv::Blob>
+      {
+        const msgpack::object& operator()(
+          const msgpack::object& o, kv::Blob& b) const
+        {
+          if (o.type != msgpack::type::BIN)
+            throw msgpack::type_error();
+
+          b = kv::Blob((const uint8_t*)o.via.bin.ptr, o.via.bin.size);
+          return o;
+        }
+      };
+    }
+  }
+}
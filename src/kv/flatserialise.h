@@ -0,0 +1,254 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "../ds/msgpack_adaptor_nlohmann.h"
+#include "blob.h"
+#include "genericserialisewrapper.h"
+#include "kvtypes.h"
+
+#include <cstring>
+#include <limits>
+#include <msgpack-c/msgpack.hpp>
+#include <type_traits>
+
+namespace kv
+{
+  class FlatWriter;
+  template <typename W>
+  class GenericSerialiseWrapper;
+  using FlatStoreSerialiser = GenericSerialiseWrapper<FlatWriter>;
+
+  class FlatReader;
+  template <typename W>
+  class GenericDeserialiseWrapper;
+  using FlatStoreDeserialiser = GenericDeserialiseWrapper<FlatReader>;
+
+  /** Flat serialisation of write sets
+   *
+   * An alternative to the msgpack serialiser, selected per store with
+   * Store<FlatStoreSerialiser, FlatStoreDeserialiser>. Each item (version,
+   * map name, key, value...) is written as its size followed by its bytes.
+   * The framing of a serialised domain is validated once, when it is
+   * deserialised, and items are then read in place: integers, enums,
+   * strings and byte vectors are stored raw and need no decoding, and Blobs
+   * all point into a single copy of the serialised domain rather than each
+   * being copied. Items of other types are packed with msgpack.
+   */
+  namespace flat
+  {
+    using Size = uint32_t;
+
+    // Lets msgpack pack directly at the end of a byte vector
+    struct VectorStream
+    {
+      std::vector<uint8_t>& v;
+
+      void write(const char* data, size_t size)
+      {
+        v.insert(v.end(), data, data + size);
+      }
+    };
+
+    template <typename T, typename = void>
+    struct Codec
+    {
+      static void write(std::vector<uint8_t>& buf, const T& t)
+      {
+        VectorStream s{buf};
+        msgpack::pack(s, t);
+      }
+
+      static T read(const uint8_t* data, size_t size)
+      {
+        auto oh = msgpack::unpack((const char*)data, size);
+        return oh->as<T>();
+      }
+    };
+
+    template <typename T>
+    struct Codec<
+      T,
+      std::enable_if_t<std::is_arithmetic_v<T> || std::is_enum_v<T>>>
+    {
+      static void write(std::vector<uint8_t>& buf, const T& t)
+      {
+        const auto p = reinterpret_cast<const uint8_t*>(&t);
+        buf.insert(buf.end(), p, p + sizeof(T));
+      }
+
+      static T read(const uint8_t* data, size_t size)
+      {
+        if (size != sizeof(T))
+        {
+          throw KvSerialiserException(fmt::format(
+            "Flat item of size {} cannot be read as a value of size {}",
+            size,
+            sizeof(T)));
+        }
+
+        T t;
+        std::memcpy(&t, data, sizeof(T));
+        return t;
+      }
+    };
+
+    template <typename T>
+    struct Codec<
+      T,
+      std::enable_if_t<
+        std::is_same_v<T, std::string> ||
+        std::is_same_v<T, std::vector<uint8_t>> || std::is_same_v<T, Blob>>>
+    {
+      static void write(std::vector<uint8_t>& buf, const T& t)
+      {
+        const auto p = reinterpret_cast<const uint8_t*>(t.data());
+        buf.insert(buf.end(), p, p + t.size());
+      }
+
+      static T read(const uint8_t* data, size_t size)
+      {
+        if constexpr (std::is_same_v<T, Blob>)
+          return Blob(data, size);
+        else
+          return T(data, data + size);
+      }
+    };
+  }
+
+  class FlatWriter
+  {
+  private:
+    std::vector<uint8_t> buf;
+
+  public:
+    template <typename T>
+    void append(T&& t)
+    {
+      const auto start = buf.size();
+      buf.resize(start + sizeof(flat::Size));
+      flat::Codec<std::decay_t<T>>::write(buf, t);
+
+      const auto size = buf.size() - start - sizeof(flat::Size);
+      if (size > std::numeric_limits<flat::Size>::max())
+      {
+        throw KvSerialiserException(
+          fmt::format("Item of size {} is too large to serialise", size));
+      }
+      const auto s = static_cast<flat::Size>(size);
+      std::memcpy(buf.data() + start, &s, sizeof(s));
+    }
+
+    void clear()
+    {
+      buf.clear();
+    }
+
+    bool is_empty()
+    {
+      return buf.empty();
+    }
+
+    std::vector<uint8_t> get_raw_data()
+    {
+      return buf;
+    }
+  };
+
+  class FlatReader
+  {
+  private:
+    const uint8_t* data_ptr;
+    size_t data_offset;
+    size_t data_size;
+
+    // Copy of the data shared by the Blobs read from it, only made if any
+    // are read, since the data itself is not owned by the reader
+    std::shared_ptr<const std::vector<uint8_t>> owner;
+
+    std::pair<const uint8_t*, flat::Size> next()
+    {
+      if (data_offset >= data_size)
+        throw KvSerialiserException("Unexpected end of flat write set");
+
+      flat::Size size;
+      std::memcpy(&size, data_ptr + data_offset, sizeof(size));
+      const auto item = data_ptr + data_offset + sizeof(size);
+      data_offset += sizeof(size) + size;
+      return {item, size};
+    }
+
+    template <typename T>
+    T decode(const uint8_t* item, flat::Size size)
+    {
+      if constexpr (std::is_same_v<T, Blob>)
+      {
+        if (owner == nullptr)
+        {
+          owner = std::make_shared<const std::vector<uint8_t>>(
+            data_ptr, data_ptr + data_size);
+        }
+        return Blob(owner, owner->data() + (item - data_ptr), size);
+      }
+      else
+      {
+        return flat::Codec<T>::read(item, size);
+      }
+    }
+
+  public:
+    FlatReader(const FlatReader& other) = delete;
+    FlatReader& operator=(const FlatReader& other) = delete;
+
+    FlatReader(const uint8_t* data_in_ptr = nullptr, size_t data_in_size = 0)
+    {
+      init(data_in_ptr, data_in_size);
+    }
+
+    void init(const uint8_t* data_in_ptr, size_t data_in_size)
+    {
+      data_offset = 0;
+      data_ptr = data_in_ptr;
+      data_size = data_in_size;
+      owner.reset();
+
+      // Check once that all items are within the data, so that they can
+      // then be read without any further bounds checks
+      size_t offset = 0;
+      while (offset < data_size)
+      {
+        flat::Size size;
+        if (data_size - offset < sizeof(size))
+          throw KvSerialiserException("Truncated flat item size");
+
+        std::memcpy(&size, data_ptr + offset, sizeof(size));
+        offset += sizeof(size);
+
+        if (data_size - offset < size)
+          throw KvSerialiserException("Truncated flat item");
+        offset += size;
+      }
+    }
+
+    template <typename T>
+    T read_next()
+    {
+      const auto [item, size] = next();
+      return decode<T>(item, size);
+    }
+
+    template <typename T>
+    T peek_next()
+    {
+      const auto before_offset = data_offset;
+      const auto [item, size] = next();
+      data_offset = before_offset;
+      return decode<T>(item, size);
+    }
+
+    bool is_eos()
+    {
+      return data_offset >= data_size;
+    }
+  };
+}
@@ -196,43 +196,44 @@ namespace kv
       const std::vector<uint8_t>& serialised_private_domain =
         std::vector<uint8_t>())
     {
-      std::vector<uint8_t> serialised_tx;
-      std::vector<uint8_t> serialised_hdr;
-      std::vector<uint8_t> encrypted_private_domain(
-        serialised_private_domain.size());
-
-      crypto_util->encrypt(
-        serialised_private_domain,
-        serialised_public_domain,
-        serialised_hdr,
-        encrypted_private_domain,
-        version);
-
       // Serialise entire tx
       // Format: gcm hdr (iv + tag) + len of public domain + public domain +
       // encrypted privated domain
-      auto space = serialised_hdr.size() + sizeof(size_t) +
-        serialised_public_domain.size() + encrypted_private_domain.size();
-      serialised_tx.resize(space);
-      auto data_ = serialised_tx.data();
+      // The private domain is encrypted in place, followed by the padding
+      // that the encryptor needs, which is removed afterwards
+      const auto hdr_size = crypto_util->get_header_length();
+      const auto padding = crypto_util->get_padding_length();
+      auto space = hdr_size + sizeof(size_t) +
+        serialised_public_domain.size() + serialised_private_domain.size();
+      std::vector<uint8_t> serialised_tx(space + padding);
+      auto hdr = serialised_tx.data();
+      auto data_ = hdr + hdr_size;
+      space -= hdr_size;
 
-      serialized::write(
-        data_, space, serialised_hdr.data(), serialised_hdr.size());
       serialized::write(data_, space, serialised_public_domain.size());
+      auto public_domain = data_;
       serialized::write(
         data_,
         space,
         serialised_public_domain.data(),
         serialised_public_domain.size());
-      if (encrypted_private_domain.size() > 0)
+      auto private_domain = data_;
+      if (serialised_private_domain.size() > 0)
       {
         serialized::write(
           data_,
           space,
-          encrypted_private_domain.data(),
-          encrypted_private_domain.size());
+          serialised_private_domain.data(),
+          serialised_private_domain.size());
       }
 
+      crypto_util->encrypt_in_place(
+        {public_domain, serialised_public_domain.size()},
+        {private_domain, serialised_private_domain.size()},
+        hdr,
+        version);
+
+      serialised_tx.resize(serialised_tx.size() - padding);
       return serialised_tx;
     }
   };
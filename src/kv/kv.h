@@ -6,8 +6,12 @@
 #include "ds/dllist.h"
 #include "ds/logger.h"
 #include "ds/spinlock.h"
+#include "ds/tracing.h"
 #include "kvtypes.h"
 
+#include <algorithm>
+#include <atomic>
+#include <deque>
 #include <functional>
 #include <iostream>
 #include <limits>
@@ -55,6 +59,9 @@ namespace kv
   template <class S, class D>
   class Tx;
 
+  template <class S, class D>
+  class ReadOnlyTx;
+
   template <class S, class D>
   class Store;
 
@@ -76,7 +83,8 @@ namespace kv
       VersionV(Version ver, V val) : version(ver), value(val) {}
     };
 
-    using State = champ::Map<K, VersionV, H>;
+    // States are shared with transactions running on other threads
+    using State = champ::Map<K, VersionV, H, champ::ThreadSafe>;
     using Read = std::unordered_map<K, Version, H>;
     using Write = std::unordered_map<K, VersionV, H>;
     /// Signature for transaction commit handlers
@@ -117,6 +125,27 @@ namespace kv
 
     LocalCommits empty_commits;
 
+    // Keys removed from the current state, in the order they were removed.
+    // Once a removal is globally committed, its deleted entry is only needed
+    // to detect conflicts with transactions that started before it, and is
+    // dropped from the state on compaction so that the state does not keep
+    // growing with every key ever written.
+    std::deque<std::pair<Version, K>> tombstones;
+
+    // State of the map as of its last commit, read by ReadOnlyTx. It is only
+    // written while sl is held, but readers take published_lock instead, and
+    // only for as long as it takes to copy the state, so that they do not wait
+    // for commits to the map.
+    SpinLock published_lock;
+    Version published_version = 0;
+    State published_state;
+
+    // Version of the commit being applied to the map, NoVersion while that
+    // version is not yet known, or the maximum version if there is none.
+    // Read-only transactions at or after this version cannot use the
+    // published state.
+    std::atomic<Version> publishing{std::numeric_limits<Version>::max()};
+
     Map(
       Store<S, D>* store_,
       std::string name_,
@@ -222,6 +251,18 @@ namespace kv
       return replicated;
     }
 
+    /** Get the number of entries in the current state of the Map
+     *
+     * This includes deleted entries that have not yet been compacted.
+     *
+     * @return Number of entries
+     */
+    size_t get_state_size()
+    {
+      std::lock_guard<SpinLock> guard(sl);
+      return roll->get_tail()->state.size();
+    }
+
     bool operator==(const AbstractMap<S, D>& that) const override
     {
       auto p = dynamic_cast<const This*>(&that);
@@ -616,6 +657,7 @@ namespace kv
               {
                 changes = true;
                 state = state.put(it->first, VersionV{-v, V()});
+                map.tombstones.emplace_back(v, it->first);
               }
             }
           }
@@ -736,44 +778,122 @@ namespace kv
       }
     };
 
+    /** View of the map in a ReadOnlyTx
+     *
+     * This reads the state of the map pinned by the transaction. It keeps no
+     * read set, and cannot write.
+     */
+    class ReadOnlyTxView
+    {
+      friend ReadOnlyTx<S, D>;
+
+    private:
+      State state;
+
+      ReadOnlyTxView(const State& s) : state(s) {}
+
+    public:
+      using KeyType = K;
+      using ValueType = V;
+
+      /** Get value for key
+       *
+       * @param key Key
+       *
+       * @return optional containing value, empty if the key doesn't exist
+       */
+      std::optional<V> get(const K& key) const
+      {
+        auto search = state.getp(key);
+        if (search == nullptr || deleted(search->version))
+          return {};
+
+        return search->value;
+      }
+
+      /** Iterate over all entries in the map
+       *
+       * @param F functor, taking a key and a value, return value determines
+       * whether the iteration should continue (true) or stop (false)
+       */
+      template <class F>
+      bool foreach(F&& f) const
+      {
+        return state.foreach([&f](const K& k, const VersionV& v) {
+          if (!deleted(v.version))
+            return f(k, v.value);
+          return true;
+        });
+      }
+    };
+
   private:
     friend TxView;
     friend Tx<S, D>;
+    friend ReadOnlyTx<S, D>;
     friend Store<S, D>;
 
-    TxView* create_view(Version version) override
+    LocalCommit* get_commit(Version version)
     {
-      lock();
-
-      // Find the last entry committed at or before this version.
-      TxView* view = nullptr;
-
+      // Find the last entry committed at or before this version, or the
+      // oldest one if they are all more recent. The Map expects to be locked.
       for (auto current = roll->get_tail(); current != nullptr;
            current = current->prev)
       {
         if (current->version <= version)
-        {
-          view = new TxView(
-            *this, current->state, current->version, rollback_counter);
-          break;
-        }
+          return current;
       }
 
-      if (view == nullptr)
-      {
-        view = new TxView(
-          *this,
-          roll->get_head()->state,
-          roll->get_head()->version,
-          rollback_counter);
-      }
+      return roll->get_head();
+    }
+
+    TxView* create_view(Version version) override
+    {
+      lock();
+
+      auto c = get_commit(version);
+      auto view = new TxView(*this, c->state, c->version, rollback_counter);
 
       unlock();
       return view;
     }
 
+    State get_published_state(Version version)
+    {
+      if (publishing.load() > version)
+      {
+        std::lock_guard<SpinLock> guard(published_lock);
+        if (published_version <= version)
+          return published_state;
+      }
+
+      // The map is being committed to at or before this version, or has been
+      // committed to since, so it is read as a Tx would read it.
+      std::lock_guard<SpinLock> guard(sl);
+      return get_commit(version)->state;
+    }
+
+    void start_publish(Version v) override
+    {
+      publishing.store(v);
+    }
+
+    void publish() override
+    {
+      // The Map expects to be locked while its state is published.
+      auto tail = roll->get_tail();
+      {
+        std::lock_guard<SpinLock> guard(published_lock);
+        published_version = tail->version;
+        published_state = tail->state;
+      }
+      publishing.store(std::numeric_limits<Version>::max());
+    }
+
     void compact(Version v) override
     {
+      collect_tombstones(v);
+
       // This discards available rollback state before version v, and populates
       // the commit_deltas to be passed to the global commit hook, if there is
       // one, up to version v. The Map expects to be locked during compaction.
@@ -819,6 +939,46 @@ namespace kv
       }
     }
 
+    void collect_tombstones(Version v)
+    {
+      // A transaction that read a deleted entry which is then dropped fails to
+      // commit, as if the key had been written again, and a transaction that
+      // did not see the key still does not. Only the current state is
+      // collected: earlier states are discarded by later compactions.
+      auto tail = roll->get_tail();
+
+      while (!tombstones.empty() && tombstones.front().first <= v)
+      {
+        const auto& k = tombstones.front().second;
+        auto search = tail->state.get(k);
+
+        // The key may have been written again since it was removed
+        if (
+          search.has_value() && deleted(search->version) &&
+          -search->version <= v)
+        {
+          tail->state = tail->state.remove(k);
+        }
+
+        tombstones.pop_front();
+      }
+    }
+
+    void rebuild_tombstones()
+    {
+      tombstones.clear();
+      roll->get_tail()->state.foreach([this](const K& k, const VersionV& v) {
+        if (deleted(v.version))
+          tombstones.emplace_back(-v.version, k);
+        return true;
+      });
+
+      std::sort(
+        tombstones.begin(), tombstones.end(), [](const auto& a, const auto& b) {
+          return a.first < b.first;
+        });
+    }
+
     void post_compact() override
     {
       if (global_hook)
@@ -832,6 +992,89 @@ namespace kv
       commit_deltas.clear();
     }
 
+    class Snapshot : public AbstractMap<S, D>::Snapshot
+    {
+    private:
+      const std::string name;
+      const SecurityDomain security_domain;
+      State state;
+
+    public:
+      Snapshot(
+        const std::string& name_,
+        SecurityDomain security_domain_,
+        State state_) :
+        name(name_),
+        security_domain(security_domain_),
+        state(std::move(state_))
+      {}
+
+      void serialise(S& s) override
+      {
+        s.start_map(name, security_domain);
+        state.foreach([&s](const K& k, const VersionV& v) {
+          // Deleted entries are not needed to rebuild the state
+          if (!deleted(v.version))
+            s.serialise_write_version(k, v.value, v.version);
+          return true;
+        });
+      }
+    };
+
+    std::unique_ptr<typename AbstractMap<S, D>::Snapshot> snapshot(
+      Version v) override
+    {
+      // Capturing the state is cheap since State is a persistent map. The Map
+      // expects to be locked while the snapshot is taken.
+      return std::make_unique<Snapshot>(
+        name, security_domain, get_commit(v)->state);
+    }
+
+    bool deserialise_snapshot(D& d, Version v) override
+    {
+      // This replaces the entire content of the map with the state read from
+      // the snapshot, which becomes the only available (compacted) state. The
+      // Map expects to be locked during deserialisation.
+      State state;
+      Write writes;
+
+      for (auto r = d.template deserialise_write_version<K, V, Version>();
+           r.has_value();
+           r = d.template deserialise_write_version<K, V, Version>())
+      {
+        auto& w = r.value();
+        if (w.is_remove || deleted(w.version) || w.version > v)
+        {
+          LOG_FAIL_FMT("Unexpected entry in snapshot of {} at {}", name, v);
+          return false;
+        }
+
+        VersionV vv(w.version, w.value);
+        state = state.put(w.key, vv);
+        writes[w.key] = vv;
+      }
+
+      roll->clear();
+      roll->insert_back(CreateNewLocalCommit(v, state, writes));
+      rollback_counter++;
+      tombstones.clear();
+
+      // Derived state is rebuilt by presenting the whole map as written at v
+      if (local_hook && !writes.empty())
+        local_hook(v, state, writes);
+
+      if (global_hook && !writes.empty())
+        commit_deltas.insert_back(
+          CreateNewLocalCommit(v, state, std::move(writes)));
+
+      return true;
+    }
+
+    void post_deserialise_snapshot() override
+    {
+      post_compact();
+    }
+
     void rollback(Version v) override
     {
       // This rolls the current state back to version v.
@@ -853,7 +1096,10 @@ namespace kv
       }
 
       if (advance)
+      {
         rollback_counter++;
+        rebuild_tombstones();
+      }
     }
 
     void clear() override
@@ -863,6 +1109,7 @@ namespace kv
       roll->clear();
       roll->insert_back(CreateNewLocalCommit(0, State(), Write()));
       rollback_counter = 0;
+      tombstones.clear();
     }
 
     void lock() override
@@ -884,6 +1131,7 @@ namespace kv
 
       std::swap(rollback_counter, map->rollback_counter);
       std::swap(roll, map->roll);
+      std::swap(tombstones, map->tombstones);
     }
   };
 
@@ -1163,14 +1411,39 @@ namespace kv
 
       if (ok && has_writes)
       {
+        // Read-only transactions must not use the published states of the
+        // maps until this commit has been published, if it is at or before
+        // the version they read.
+        for (auto it = views.begin(); it != views.end(); ++it)
+        {
+          if (it->second.view->has_writes())
+            it->second.map->start_publish(NoVersion);
+        }
+
         // Get the version number to be used for this commit.
         version = f();
 
+        for (auto it = views.begin(); it != views.end(); ++it)
+        {
+          if (it->second.view->has_writes())
+            it->second.map->start_publish(version);
+        }
+
         for (auto it = views.begin(); it != views.end(); ++it)
           it->second.view->commit(version);
 
         for (auto it = views.begin(); it != views.end(); ++it)
           it->second.view->post_commit();
+
+        for (auto it = views.begin(); it != views.end(); ++it)
+        {
+          if (it->second.view->has_writes())
+            it->second.map->publish();
+        }
+
+        auto store =
+          static_cast<Store<S, D>*>(views.begin()->second.map->get_store());
+        store->publish(version);
       }
 
       for (auto it = views.begin(); it != views.end(); ++it)
@@ -1281,10 +1554,14 @@ namespace kv
   template <class S, class D>
   class Store : public AbstractStore
   {
+    friend Tx<S, D>;
+    friend ReadOnlyTx<S, D>;
+
   public:
     template <class K, class V, class H = std::hash<K>>
     using Map = Map<K, V, H, S, D>;
     using Tx = Tx<S, D>;
+    using ReadOnlyTx = ReadOnlyTx<S, D>;
 
   private:
     // All collections of Map must be ordered so that we lock their contained
@@ -1295,12 +1572,38 @@ namespace kv
     std::shared_ptr<Consensus> consensus = nullptr;
     std::shared_ptr<TxHistory> history = nullptr;
     std::shared_ptr<AbstractTxEncryptor> encryptor = nullptr;
+    std::shared_ptr<AbstractSnapshotter> snapshotter = nullptr;
     Version version = 0;
     Version compacted = 0;
 
     SpinLock maps_lock;
     SpinLock version_lock;
 
+    // Last version published by the maps for read-only transactions
+    std::atomic<Version> published_version{0};
+
+    // Record that the maps changed at version v have published their states.
+    // The maps must still be locked.
+    void publish(Version v)
+    {
+      auto current = published_version.load();
+      while (current < v)
+      {
+        if (published_version.compare_exchange_weak(current, v))
+          break;
+      }
+    }
+
+    // Publish the states of all the maps at version v, after the store has
+    // been rolled back or replaced. All maps must be locked.
+    void republish(Version v)
+    {
+      for (auto& [name, map] : maps)
+        map->publish();
+
+      published_version.store(v);
+    }
+
     std::unordered_map<Version, std::pair<PendingTx, bool>> pending_txs;
     Version last_replicated = 0;
     Version last_committable = 0;
@@ -1323,6 +1626,65 @@ namespace kv
       return grouped_maps;
     }
 
+    class StoreSnapshot : public AbstractStore::Snapshot
+    {
+    private:
+      Version version;
+      std::vector<uint8_t> tree;
+      std::vector<std::unique_ptr<typename AbstractMap<S, D>::Snapshot>>
+        snapshots;
+
+    public:
+      StoreSnapshot(Version version_) : version(version_) {}
+
+      void add_map_snapshot(
+        std::unique_ptr<typename AbstractMap<S, D>::Snapshot> snapshot)
+      {
+        snapshots.push_back(std::move(snapshot));
+      }
+
+      void set_tree(std::vector<uint8_t>&& tree_)
+      {
+        tree = std::move(tree_);
+      }
+
+      Version get_version() const override
+      {
+        return version;
+      }
+
+      const std::vector<uint8_t>& get_tree() const override
+      {
+        return tree;
+      }
+
+      std::vector<uint8_t> serialise(
+        std::shared_ptr<AbstractTxEncryptor> encryptor) override
+      {
+        S serialiser(encryptor, version);
+
+        for (auto& s : snapshots)
+          s->serialise(serialiser);
+
+        return serialiser.get_raw_data();
+      }
+    };
+
+    std::unique_ptr<StoreSnapshot> snapshot_internal(Version v)
+    {
+      // Only replicated maps are snapshotted, derived maps are rebuilt by the
+      // hooks of the replicated maps. The maps must be locked.
+      auto s = std::make_unique<StoreSnapshot>(v);
+
+      for (auto& map : maps)
+      {
+        if (map.second->is_replicated())
+          s->add_map_snapshot(map.second->snapshot(v));
+      }
+
+      return s;
+    }
+
     DeserialiseSuccess commit_deserialised(
       OrderedViews<S, D>& views, Version& v)
     {
@@ -1397,6 +1759,16 @@ namespace kv
       return encryptor;
     }
 
+    /** Set the snapshotter consulted on every compaction
+     *
+     * @param snapshotter_ Snapshotter deciding when to capture the state of
+     * the store and what to do with it
+     */
+    void set_snapshotter(std::shared_ptr<AbstractSnapshotter> snapshotter_)
+    {
+      snapshotter = snapshotter_;
+    }
+
     template <class K, class V, class H = std::hash<K>>
     Map<K, V, H>* get(std::string name)
     {
@@ -1506,6 +1878,10 @@ namespace kv
       for (auto& map : maps)
         map.second->compact(v);
 
+      std::unique_ptr<StoreSnapshot> s = nullptr;
+      if (snapshotter && snapshotter->requires_snapshot(v))
+        s = snapshot_internal(v);
+
       for (auto& map : maps)
         map.second->unlock();
 
@@ -1515,7 +1891,13 @@ namespace kv
 
         auto h = get_history();
         if (h)
+        {
+          // The tree must be captured before it is flushed
+          if (s)
+            s->set_tree(h->serialise_tree(v));
+
           h->compact(v);
+        }
 
         auto e = get_encryptor();
         if (e)
@@ -1524,6 +1906,137 @@ namespace kv
 
       for (auto& map : maps)
         map.second->post_compact();
+
+      if (s)
+        snapshotter->snapshot(std::move(s));
+    }
+
+    /** Capture the state of all replicated maps at a version
+     *
+     * The returned snapshot is cheap to create and can be serialised later,
+     * outside of any lock.
+     *
+     * @param v Version of the snapshot, which must not be older than the last
+     * compacted version
+     *
+     * @return Snapshot of the store at v
+     */
+    std::unique_ptr<AbstractStore::Snapshot> snapshot(Version v) override
+    {
+      std::lock_guard<SpinLock> mguard(maps_lock);
+
+      if (v < commit_version())
+        throw std::logic_error(fmt::format(
+          "Cannot snapshot at {} which is earlier than compacted version {}",
+          v,
+          commit_version()));
+
+      if (v > current_version())
+        throw std::logic_error(fmt::format(
+          "Cannot snapshot at {} which is later than current version {}",
+          v,
+          current_version()));
+
+      for (auto& map : maps)
+        map.second->lock();
+
+      auto s = snapshot_internal(v);
+
+      for (auto& map : maps)
+        map.second->unlock();
+
+      auto h = get_history();
+      if (h)
+        s->set_tree(h->serialise_tree(v));
+
+      return s;
+    }
+
+    /** Replace the content of the store with a serialised snapshot
+     *
+     * On success, the store is compacted at the version of the snapshot and
+     * the hooks of all deserialised maps have been run.
+     *
+     * @param data Serialised snapshot, as returned by Snapshot::serialise()
+     * @param public_only If true, only public maps are deserialised
+     *
+     * @return PASS if the snapshot was installed, FAILED otherwise
+     */
+    DeserialiseSuccess deserialise_snapshot(
+      const std::vector<uint8_t>& data, bool public_only = false) override
+    {
+      auto e = get_encryptor();
+      auto d = std::make_unique<D>(
+        e,
+        public_only ? kv::SecurityDomain::PUBLIC :
+                      std::optional<kv::SecurityDomain>());
+
+      if (!d->init(data.data(), data.size()))
+      {
+        LOG_FAIL_FMT("Initialisation of snapshot deserialiser failed");
+        return DeserialiseSuccess::FAILED;
+      }
+
+      Version v = d->template deserialise_version<Version>();
+
+      std::lock_guard<SpinLock> mguard(maps_lock);
+
+      for (auto& map : maps)
+        map.second->lock();
+
+      std::vector<AbstractMap<S, D>*> deserialised;
+      bool success = true;
+
+      for (auto r = d->start_map(); r.has_value(); r = d->start_map())
+      {
+        const auto map_name = r.value();
+
+        auto search = maps.find(map_name);
+        if (search == maps.end())
+        {
+          LOG_FAIL_FMT("No such map {} in snapshot at {}", map_name, v);
+          success = false;
+          break;
+        }
+
+        if (!search->second->deserialise_snapshot(*d, v))
+        {
+          LOG_FAIL_FMT(
+            "Could not deserialise snapshot of map {} at {}", map_name, v);
+          success = false;
+          break;
+        }
+
+        deserialised.push_back(search->second.get());
+      }
+
+      if (success && !d->end())
+      {
+        LOG_FAIL_FMT("Unexpected content in snapshot at {}", v);
+        success = false;
+      }
+
+      republish(v);
+
+      for (auto& map : maps)
+        map.second->unlock();
+
+      if (!success)
+        return DeserialiseSuccess::FAILED;
+
+      {
+        std::lock_guard<SpinLock> vguard(version_lock);
+        version = v;
+        compacted = v;
+        last_replicated = v;
+        last_committable = v;
+        pending_txs.clear();
+      }
+
+      for (auto map : deserialised)
+        map->post_deserialise_snapshot();
+
+      return DeserialiseSuccess::PASS;
     }
 
     void rollback(Version v) override
@@ -1539,12 +2052,16 @@ namespace kv
       if (v < commit_version())
         return;
 
+      tracing::Versions::get().rollback(v);
+
       for (auto& map : maps)
         map.second->lock();
 
       for (auto& map : maps)
         map.second->rollback(v);
 
+      republish(v);
+
       for (auto& map : maps)
         map.second->unlock();
 
@@ -1562,6 +2079,243 @@ namespace kv
         e->rollback(v);
     }
 
+    /** A transaction from the ledger, decoded but not yet applied
+     *
+     * Produced by decode, which may run on any thread, and applied in ledger
+     * order by apply.
+     */
+    class DecodedTx
+    {
+      friend Store;
+
+      std::vector<uint8_t> data;
+      bool public_only;
+
+      // Unset if the transaction could not be decoded ahead of time, in
+      // which case it is decoded again when it is applied
+      std::optional<Version> version;
+      Version rollback_count = 0;
+      OrderedViews<S, D> views;
+
+      // If set, appended to the history instead of hashing data again
+      std::optional<crypto::Sha256Hash> digest;
+
+      DecodedTx(std::vector<uint8_t>&& data, bool public_only) :
+        data(std::move(data)),
+        public_only(public_only)
+      {}
+
+    public:
+      const std::vector<uint8_t>& get_data() const
+      {
+        return data;
+      }
+
+      /** Set the digest of the transaction, as computed by
+       * crypto::Sha256Hash::batch, for instance when many transactions are
+       * hashed at once
+       */
+      void set_digest(const crypto::Sha256Hash& d)
+      {
+        digest = d;
+      }
+    };
+
+  private:
+    // Create a view of each map written by the transaction in d, and
+    // deserialise its writes into it. This only locks the maps briefly, and
+    // does not depend on the transactions before v having been applied.
+    bool decode_views(
+      D& d, Version v, Version deserialise_version, OrderedViews<S, D>& views)
+    {
+      for (auto r = d.start_map(); r.has_value(); r = d.start_map())
+      {
+        const auto map_name = r.value();
+
+        AbstractMap<S, D>* map = nullptr;
+        {
+          std::lock_guard<SpinLock> mguard(maps_lock);
+          auto search = maps.find(map_name);
+          if (search != maps.end())
+            map = search->second.get();
+        }
+
+        if (map == nullptr)
+        {
+          LOG_FAIL_FMT("No such map {} at version {}", map_name, v);
+          return false;
+        }
+
+        auto view_search = views.find(map_name);
+        if (view_search != views.end())
+        {
+          LOG_FAIL_FMT("Multiple writes on {} at version {}", map_name, v);
+          return false;
+        }
+
+        auto view = map->create_view(v);
+        views[map_name] = {map, std::unique_ptr<AbstractTxView<S, D>>(view)};
+
+        if (!view->deserialise(d, deserialise_version))
+        {
+          LOG_FAIL_FMT(
+            "Could not deserialise Tx for map {} at version {}",
+            map_name,
+            deserialise_version);
+          return false;
+        }
+      }
+
+      if (!d.end())
+      {
+        LOG_FAIL_FMT("Unexpected content in Tx at version {}", v);
+        return false;
+      }
+
+      return true;
+    }
+
+    // Commit the decoded views of the transaction at v, which must be the next
+    // version, and append it to the history
+    DeserialiseSuccess apply_views(
+      OrderedViews<S, D>& views,
+      Version v,
+      const std::vector<uint8_t>& data,
+      Term* term,
+      const crypto::Sha256Hash* digest = nullptr)
+    {
+      auto success = commit_deserialised(views, v);
+      if (success == DeserialiseSuccess::FAILED)
+      {
+        return success;
+      }
+      auto h = get_history();
+      if (h)
+      {
+        auto search = views.find("ccf.signatures");
+        if (search != views.end())
+        {
+          // Transactions containing a signature must only contain
+          // a signature and must be verified
+          if (views.size() > 1)
+          {
+            LOG_FAIL_FMT("Unexpected contents in signature transaction {}", v);
+            return DeserialiseSuccess::FAILED;
+          }
+
+          if (!h->verify(term))
+          {
+            LOG_FAIL_FMT("Signature in transaction {} failed to verify", v);
+            return DeserialiseSuccess::FAILED;
+          }
+          success = DeserialiseSuccess::PASS_SIGNATURE;
+        }
+
+        if (digest != nullptr)
+          h->append(*digest);
+        else
+          h->append(data.data(), data.size());
+      }
+
+      return success;
+    }
+
+  public:
+    /** Decode a transaction, without applying it
+     *
+     * This decrypts the private domain and deserialises the writes of each
+     * map. It does not modify the store, and may be called from any thread,
+     * concurrently with other transactions being decoded or applied. A
+     * transaction that cannot be decoded yet (for instance because the
+     * transactions before it rotate the ledger key) is decoded again by
+     * apply.
+     *
+     * @param data Serialised transaction
+     * @param public_only If true, only public maps are deserialised
+     */
+    std::unique_ptr<DecodedTx> decode(
+      std::vector<uint8_t> data, bool public_only = false)
+    {
+      auto tx = std::unique_ptr<DecodedTx>(
+        new DecodedTx(std::move(data), public_only));
+
+      {
+        std::lock_guard<SpinLock> vguard(version_lock);
+        tx->rollback_count = rollback_count;
+      }
+
+      try
+      {
+        auto d = std::make_unique<D>(
+          get_encryptor(),
+          public_only ? kv::SecurityDomain::PUBLIC :
+                        std::optional<kv::SecurityDomain>());
+
+        if (!d->init(tx->data.data(), tx->data.size()))
+          return tx;
+
+        Version v = d->template deserialise_version<Version>();
+        if (decode_views(*d, v, v, tx->views))
+          tx->version = v;
+      }
+      catch (const std::exception& e)
+      {
+        // Reported when the transaction is decoded again by apply
+        LOG_DEBUG_FMT("Could not decode transaction ahead: {}", e.what());
+      }
+
+      if (!tx->version.has_value())
+        tx->views.clear();
+
+      return tx;
+    }
+
+    /** Apply a decoded transaction
+     *
+     * Transactions must be applied in order, as by deserialise. If the store
+     * has been rolled back since the transaction was decoded, or it could not
+     * be decoded, it is decoded again first.
+     */
+    DeserialiseSuccess apply(DecodedTx& tx, Term* term = nullptr)
+    {
+      if (!tx.version.has_value())
+        return deserialise_views(tx.data, tx.public_only, term);
+
+      auto v = tx.version.value();
+
+      // Throw away any local commits that have not propagated via the
+      // consensus.
+      rollback(v - 1);
+
+      auto cv = current_version();
+      if (cv != (v - 1))
+      {
+        LOG_FAIL_FMT(
+          "Tried to deserialise {} but current_version is {}", v, cv);
+        return DeserialiseSuccess::FAILED;
+      }
+
+      bool rolled_back;
+      {
+        std::lock_guard<SpinLock> vguard(version_lock);
+        rolled_back = rollback_count != tx.rollback_count;
+      }
+
+      if (rolled_back)
+      {
+        // The views were created before a rollback, and cannot be committed
+        tx.views.clear();
+        return deserialise_views(tx.data, tx.public_only, term);
+      }
+
+      return apply_views(
+        tx.views,
+        v,
+        tx.data,
+        term,
+        tx.digest.has_value() ? &tx.digest.value() : nullptr);
+    }
+
     DeserialiseSuccess deserialise_views(
       const std::vector<uint8_t>& data,
       bool public_only = false,
@@ -1612,48 +2366,14 @@ namespace kv
       // rather than with the actual value read. As a result, they don't
       // need snapshot isolation on the map state, and so do not need to
       // lock all the maps before creating the transaction.
-      std::lock_guard<SpinLock> mguard(maps_lock);
       OrderedViews<S, D> views;
 
-      for (auto r = d->start_map(); r.has_value(); r = d->start_map())
-      {
-        const auto map_name = r.value();
-
-        auto search = maps.find(map_name);
-        if (search == maps.end())
-        {
-          LOG_FAIL_FMT("No such map {} at version {}", map_name, v);
-          return DeserialiseSuccess::FAILED;
-        }
-
-        auto view_search = views.find(map_name);
-        if (view_search != views.end())
-        {
-          LOG_FAIL_FMT("Multiple writes on {} at version {}", map_name, v);
-          return DeserialiseSuccess::FAILED;
-        }
-
-        auto view = search->second->create_view(v);
-        // if we are not committing now then use NoVersion to deserialise
-        // otherwise the view will be considered as having a committed
-        // version
-        auto deserialise_version = (commit ? v : NoVersion);
-        if (!view->deserialise(*d, deserialise_version))
-        {
-          LOG_FAIL_FMT(
-            "Could not deserialise Tx for map {} at version {}",
-            map_name,
-            deserialise_version);
-          return DeserialiseSuccess::FAILED;
-        }
-
-        views[map_name] = {search->second.get(),
-                           std::unique_ptr<AbstractTxView<S, D>>(view)};
-      }
-
-      if (!d->end())
+      // if we are not committing now then use NoVersion to deserialise
+      // otherwise the view will be considered as having a committed
+      // version
+      auto deserialise_version = (commit ? v : NoVersion);
+      if (!decode_views(*d, v, deserialise_version, views))
       {
-        LOG_FAIL_FMT("Unexpected content in Tx at version {}", v);
         return DeserialiseSuccess::FAILED;
       }
 
@@ -1661,36 +2381,11 @@ namespace kv
 
       if (commit)
       {
-        success = commit_deserialised(views, v);
+        success = apply_views(views, v, data, term);
         if (success == DeserialiseSuccess::FAILED)
         {
           return success;
         }
-        auto h = get_history();
-        if (h)
-        {
-          auto search = views.find("ccf.signatures");
-          if (search != views.end())
-          {
-            // Transactions containing a signature must only contain
-            // a signature and must be verified
-            if (views.size() > 1)
-            {
-              LOG_FAIL_FMT(
-                "Unexpected contents in signature transaction {}", v);
-              return DeserialiseSuccess::FAILED;
-            }
-
-            if (!h->verify(term))
-            {
-              LOG_FAIL_FMT("Signature in transaction {} failed to verify", v);
-              return DeserialiseSuccess::FAILED;
-            }
-            success = DeserialiseSuccess::PASS_SIGNATURE;
-          }
-
-          h->append(data.data(), data.size());
-        }
       }
       else
       {
@@ -1790,6 +2485,10 @@ namespace kv
         version,
         (globally_committable ? " globally_committable" : ""));
 
+      // Attribute the version to the traced request committing it, if any, so
+      // that its replication and global commit are traced too
+      tracing::Versions::get().add(version);
+
       BatchVector batch;
       Version previous_last_replicated = 0;
       Version next_last_replicated = 0;
@@ -1893,6 +2592,8 @@ namespace kv
       for (auto& map : maps)
         map.second->clear();
 
+      republish(0);
+
       for (auto& map : maps)
         map.second->unlock();
 
@@ -1968,8 +2669,13 @@ namespace kv
       for (auto& [name, lhs, rhs] : entries)
       {
         lhs->swap(rhs);
+        lhs->publish();
+        rhs->publish();
       }
 
+      publish(current_version());
+      store.publish(store.current_version());
+
       for (auto& [name, lhs, rhs] : entries)
       {
         lhs->unlock();
@@ -1977,4 +2683,86 @@ namespace kv
       }
     }
   };
+
+  /** Read-only transaction
+   *
+   * Reads the maps of a store as of its last published commit, like a Tx that
+   * only reads, without keeping a read set or committing. Every commit
+   * publishes the new states of the maps it wrote, and a view copies the
+   * published state of its map without taking the lock held by commits to
+   * that map. A map that is committed to at or after the version read by the
+   * transaction while the view is created is read as a Tx would read it
+   * instead, from its local commits, under its lock. As for a Tx, a map that
+   * has been compacted past that version is read at its oldest state.
+   */
+  template <class S, class D>
+  class ReadOnlyTx
+  {
+  private:
+    Store<S, D>* store = nullptr;
+    Version read_version = NoVersion;
+
+    template <class M>
+    std::tuple<typename M::ReadOnlyTxView> get_tuple(M& m)
+    {
+      if (store == nullptr)
+      {
+        store = m.store;
+        read_version = store->published_version.load();
+      }
+      else if (store != m.store)
+      {
+        throw std::logic_error(
+          "Transaction must be over maps in the same store");
+      }
+
+      return std::make_tuple(
+        typename M::ReadOnlyTxView(m.get_published_state(read_version)));
+    }
+
+    template <class M, class... Ms>
+    std::tuple<typename M::ReadOnlyTxView, typename Ms::ReadOnlyTxView...>
+    get_tuple(M& m, Ms&... ms)
+    {
+      return std::tuple_cat(get_tuple(m), get_tuple(ms...));
+    }
+
+  public:
+    ReadOnlyTx() = default;
+    ReadOnlyTx(const ReadOnlyTx& that) = delete;
+
+    /** Get a read-only view on a map.
+     *
+     * The first view sets the version at which all the maps are read.
+     *
+     * @param m Map
+     */
+    template <class M>
+    typename M::ReadOnlyTxView get_view(M& m)
+    {
+      return std::get<0>(get_tuple(m));
+    }
+
+    /** Get read-only views over multiple maps.
+     *
+     * @param m Map
+     * @param ms Map
+     */
+    template <class M, class... Ms>
+    std::tuple<typename M::ReadOnlyTxView, typename Ms::ReadOnlyTxView...>
+    get_view(M& m, Ms&... ms)
+    {
+      return std::tuple_cat(get_tuple(m), get_tuple(ms...));
+    }
+
+    /** Version of the state read by the transaction
+     *
+     * @return Version of the last published commit when the first view was
+     * created, or `kv::NoVersion` if there is no view yet
+     */
+    Version get_read_version()
+    {
+      return read_version;
+    }
+  };
 }
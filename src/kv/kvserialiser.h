@@ -8,3 +8,5 @@
 #else
 #  include "kv/msgpackserialise.h"
 #endif
+
+#include "kv/flatserialise.h"
@@ -77,6 +77,22 @@ namespace kv
     }
   };
 
+  // Thrown when the data needed to produce a receipt has been requested
+  // from the host, and the receipt should be requested again later
+  class ReceiptPending : public std::exception
+  {
+  private:
+    std::string msg;
+
+  public:
+    ReceiptPending(const std::string& msg_) : msg(msg_) {}
+
+    virtual const char* what() const throw()
+    {
+      return msg.c_str();
+    }
+  };
+
   class Syncable
   {
   public:
@@ -119,6 +135,9 @@ namespace kv
     virtual ~TxHistory() {}
     virtual void append(const std::vector<uint8_t>& replicated) = 0;
     virtual void append(const uint8_t* replicated, size_t replicated_size) = 0;
+    // Append an entry whose digest, as computed by
+    // crypto::Sha256Hash::batch, is already known
+    virtual void append(const crypto::Sha256Hash& digest) = 0;
     virtual bool verify(Term* term = nullptr) = 0;
     virtual void emit_signature() = 0;
     virtual bool add_request(
@@ -150,6 +169,11 @@ namespace kv
     virtual crypto::Sha256Hash get_replicated_state_root() = 0;
     virtual std::vector<uint8_t> get_receipt(Version v) = 0;
     virtual bool verify_receipt(const std::vector<uint8_t>& receipt) = 0;
+    virtual std::vector<uint8_t> get_receipts(
+      const std::vector<Version>& v) = 0;
+    virtual bool verify_receipts(const std::vector<uint8_t>& receipts) = 0;
+    virtual std::vector<uint8_t> serialise_tree(Version v) = 0;
+    virtual void deserialise_tree(const std::vector<uint8_t>& tree) = 0;
   };
 
   class Consensus
@@ -239,6 +263,18 @@ namespace kv
     virtual void set_f(ccf::NodeId f) = 0;
     virtual void emit_signature() = 0;
     virtual ConsensusType type() = 0;
+
+    // Start as a backup whose state up to seqno (in view) was installed from
+    // a snapshot rather than replayed from the ledger
+    virtual void init_as_backup(SeqNo seqno, View view) {}
+
+    // On a backup, call cb with true once reading the local store is
+    // linearizable, or with false if that cannot be established. Returns
+    // false if this is not supported, in which case cb is never called
+    virtual bool read_index(std::function<void(bool)> cb)
+    {
+      return false;
+    }
   };
 
   struct PendingTxInfo
@@ -304,6 +340,11 @@ namespace kv
       std::vector<uint8_t>& serialised_header,
       std::vector<uint8_t>& cipher,
       kv::Version version) = 0;
+    virtual void encrypt_in_place(
+      CBuffer additional_data,
+      Buffer data,
+      uint8_t* serialised_header,
+      kv::Version version) = 0;
     virtual bool decrypt(
       const std::vector<uint8_t>& cipher,
       const std::vector<uint8_t>& additional_data,
@@ -312,6 +353,7 @@ namespace kv
       kv::Version version) = 0;
     virtual void set_view(Consensus::View view) = 0;
     virtual size_t get_header_length() = 0;
+    virtual size_t get_padding_length() = 0;
     virtual void update_encryption_key(
       Version version, const std::vector<uint8_t>& raw_ledger_key) = 0;
   };
@@ -319,6 +361,16 @@ namespace kv
   class AbstractStore
   {
   public:
+    class Snapshot
+    {
+    public:
+      virtual ~Snapshot() {}
+      virtual Version get_version() const = 0;
+      virtual const std::vector<uint8_t>& get_tree() const = 0;
+      virtual std::vector<uint8_t> serialise(
+        std::shared_ptr<AbstractTxEncryptor> encryptor) = 0;
+    };
+
     virtual ~AbstractStore() {}
     virtual Version next_version() = 0;
     virtual Version current_version() = 0;
@@ -335,6 +387,22 @@ namespace kv
     virtual CommitSuccess commit(
       Version v, PendingTx pt, bool globally_committable) = 0;
     virtual size_t commit_gap() = 0;
+    virtual std::unique_ptr<Snapshot> snapshot(Version v) = 0;
+    virtual DeserialiseSuccess deserialise_snapshot(
+      const std::vector<uint8_t>& data, bool public_only = false) = 0;
+  };
+
+  class AbstractSnapshotter
+  {
+  public:
+    virtual ~AbstractSnapshotter() {}
+
+    // Called on compaction, with all maps locked, to decide whether the state
+    // at version v should be captured
+    virtual bool requires_snapshot(Version v) = 0;
+
+    // Called once compaction has completed and all maps have been unlocked
+    virtual void snapshot(std::unique_ptr<AbstractStore::Snapshot> s) = 0;
   };
 
   template <class S, class D>
@@ -358,6 +426,13 @@ namespace kv
   class AbstractMap
   {
   public:
+    class Snapshot
+    {
+    public:
+      virtual ~Snapshot() {}
+      virtual void serialise(S& s) = 0;
+    };
+
     virtual ~AbstractMap() {}
     virtual bool operator==(const AbstractMap<S, D>& that) const = 0;
     virtual bool operator!=(const AbstractMap<S, D>& that) const = 0;
@@ -373,6 +448,13 @@ namespace kv
     virtual bool is_replicated() = 0;
     virtual void clear() = 0;
 
+    virtual std::unique_ptr<Snapshot> snapshot(Version v) = 0;
+    virtual bool deserialise_snapshot(D& d, Version v) = 0;
+    virtual void post_deserialise_snapshot() = 0;
+
+    virtual void start_publish(Version v) = 0;
+    virtual void publish() = 0;
+
     virtual AbstractMap<S, D>* clone(AbstractStore* store) = 0;
     virtual void swap(AbstractMap<S, D>* map) = 0;
   };
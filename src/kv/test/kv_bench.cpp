@@ -1,16 +1,24 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the Apache 2.0 License.
-#define PICOBENCH_IMPLEMENT_WITH_MAIN
+#define PICOBENCH_IMPLEMENT
 
 #include "consensus/test/stub_consensus.h"
 #include "kv/kv.h"
+#include "kv/kvserialiser.h"
 #include "node/encryptor.h"
 
 #include <picobench/picobench.hpp>
 #include <string>
 
+extern "C"
+{
+#include <evercrypt/EverCrypt_AutoConfig2.h>
+}
+
 using namespace ccf;
 
+using FlatStore = kv::Store<kv::FlatStoreSerialiser, kv::FlatStoreDeserialiser>;
+
 inline void clobber_memory()
 {
   asm volatile("" : : : "memory");
@@ -28,19 +36,19 @@ std::shared_ptr<ccf::LedgerSecrets> create_ledger_secrets()
 }
 
 // Test functions
-template <kv::SecurityDomain SD>
-static void serialise(picobench::state& s)
+template <typename StoreT, kv::SecurityDomain SD>
+static void serialise_store(picobench::state& s)
 {
   logger::config::level() = logger::INFO;
 
-  Store kv_store;
+  StoreT kv_store;
   auto secrets = create_ledger_secrets();
   auto encryptor = std::make_shared<ccf::RaftTxEncryptor>(1, secrets);
   kv_store.set_encryptor(encryptor);
 
-  auto& map0 = kv_store.create<std::string, std::string>("map0", SD);
-  auto& map1 = kv_store.create<std::string, std::string>("map1", SD);
-  Store::Tx tx;
+  auto& map0 = kv_store.template create<std::string, std::string>("map0", SD);
+  auto& map1 = kv_store.template create<std::string, std::string>("map1", SD);
+  typename StoreT::Tx tx;
   auto [tx0, tx1] = tx.get_view(map0, map1);
 
   for (int i = 0; i < s.iterations(); i++)
@@ -57,25 +65,25 @@ static void serialise(picobench::state& s)
   s.stop_timer();
 }
 
-template <kv::SecurityDomain SD>
-static void deserialise(picobench::state& s)
+template <typename StoreT, kv::SecurityDomain SD>
+static void deserialise_store(picobench::state& s)
 {
   logger::config::level() = logger::INFO;
 
   auto consensus = std::make_shared<kv::StubConsensus>();
-  Store kv_store(consensus);
-  Store kv_store2;
+  StoreT kv_store(consensus);
+  StoreT kv_store2;
 
   auto secrets = create_ledger_secrets();
   auto encryptor = std::make_shared<ccf::RaftTxEncryptor>(1, secrets);
   kv_store.set_encryptor(encryptor);
   kv_store2.set_encryptor(encryptor);
 
-  auto& map0 = kv_store.create<std::string, std::string>("map0", SD);
-  auto& map1 = kv_store.create<std::string, std::string>("map1", SD);
-  auto& map0_ = kv_store2.create<std::string, std::string>("map0", SD);
-  auto& map1_ = kv_store2.create<std::string, std::string>("map1", SD);
-  Store::Tx tx;
+  auto& map0 = kv_store.template create<std::string, std::string>("map0", SD);
+  auto& map1 = kv_store.template create<std::string, std::string>("map1", SD);
+  auto& map0_ = kv_store2.template create<std::string, std::string>("map0", SD);
+  auto& map1_ = kv_store2.template create<std::string, std::string>("map1", SD);
+  typename StoreT::Tx tx;
   auto [tx0, tx1] = tx.get_view(map0, map1);
 
   for (int i = 0; i < s.iterations(); i++)
@@ -94,6 +102,30 @@ static void deserialise(picobench::state& s)
   s.stop_timer();
 }
 
+template <kv::SecurityDomain SD>
+static void serialise(picobench::state& s)
+{
+  serialise_store<Store, SD>(s);
+}
+
+template <kv::SecurityDomain SD>
+static void serialise_flat(picobench::state& s)
+{
+  serialise_store<FlatStore, SD>(s);
+}
+
+template <kv::SecurityDomain SD>
+static void deserialise(picobench::state& s)
+{
+  deserialise_store<Store, SD>(s);
+}
+
+template <kv::SecurityDomain SD>
+static void deserialise_flat(picobench::state& s)
+{
+  deserialise_store<FlatStore, SD>(s);
+}
+
 template <size_t S>
 static void commit_latency(picobench::state& s)
 {
@@ -145,6 +177,12 @@ PICOBENCH(serialise<SD::PUBLIC>)
   .samples(sample_size)
   .baseline();
 PICOBENCH(serialise<SD::PRIVATE>).iterations(tx_count).samples(sample_size);
+PICOBENCH(serialise_flat<SD::PUBLIC>)
+  .iterations(tx_count)
+  .samples(sample_size);
+PICOBENCH(serialise_flat<SD::PRIVATE>)
+  .iterations(tx_count)
+  .samples(sample_size);
 
 PICOBENCH_SUITE("deserialise");
 PICOBENCH(deserialise<SD::PUBLIC>)
@@ -152,3 +190,19 @@ PICOBENCH(deserialise<SD::PUBLIC>)
   .samples(sample_size)
   .baseline();
 PICOBENCH(deserialise<SD::PRIVATE>).iterations(tx_count).samples(sample_size);
+PICOBENCH(deserialise_flat<SD::PUBLIC>)
+  .iterations(tx_count)
+  .samples(sample_size);
+PICOBENCH(deserialise_flat<SD::PRIVATE>)
+  .iterations(tx_count)
+  .samples(sample_size);
+
+// We need an explicit main to initialize EverCrypt, which backs AES-GCM if
+// the CPU supports it
+int main(int argc, char* argv[])
+{
+  ::EverCrypt_AutoConfig2_init();
+  picobench::runner runner;
+  runner.parse_cmd_line(argc, argv);
+  return runner.run();
+}
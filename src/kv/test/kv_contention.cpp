@@ -203,3 +203,92 @@ DOCTEST_TEST_CASE("Concurrent kv access" * doctest::test_suite("concurrency"))
     compact_thread.join();
   }
 }
+
+DOCTEST_TEST_CASE(
+  "Concurrent read-only transactions" * doctest::test_suite("concurrency"))
+{
+  // Writers increment a counter in two maps in the same transaction, while
+  // another writer commits to an unrelated map. Read-only transactions must
+  // always read the same count in both maps, whether the maps were being
+  // committed to, or had been committed to since the version they read
+  Store kv_store;
+
+  using MapType = Store::Map<size_t, size_t>;
+  auto& map_a = kv_store.create<MapType>("a", kv::SecurityDomain::PUBLIC);
+  auto& map_b = kv_store.create<MapType>("b", kv::SecurityDomain::PUBLIC);
+  auto& map_c = kv_store.create<MapType>("c", kv::SecurityDomain::PUBLIC);
+
+  constexpr size_t k = 0;
+  constexpr size_t writer_count = 4;
+  constexpr size_t tx_count = 1000;
+  constexpr size_t reader_count = 4;
+
+  std::atomic<size_t> active_writers(writer_count + 1);
+  std::atomic<size_t> inconsistent_reads(0);
+  std::atomic<size_t> reads(0);
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0u; i < writer_count; ++i)
+  {
+    threads.emplace_back([&]() {
+      for (size_t j = 0u; j < tx_count; ++j)
+      {
+        while (true)
+        {
+          Store::Tx tx;
+          auto [view_a, view_b] = tx.get_view(map_a, map_b);
+          const auto count = view_a->get(k).value_or(0);
+          view_a->put(k, count + 1);
+          view_b->put(k, count + 1);
+          if (tx.commit() == kv::CommitSuccess::OK)
+          {
+            break;
+          }
+        }
+      }
+      --active_writers;
+    });
+  }
+
+  threads.emplace_back([&]() {
+    for (size_t j = 0u; j < writer_count * tx_count; ++j)
+    {
+      Store::Tx tx;
+      auto view_c = tx.get_view(map_c);
+      view_c->put(k, j);
+      DOCTEST_REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    }
+    --active_writers;
+  });
+
+  for (size_t i = 0u; i < reader_count; ++i)
+  {
+    threads.emplace_back([&]() {
+      while (active_writers.load() > 0)
+      {
+        Store::ReadOnlyTx tx;
+        auto view_a = tx.get_view(map_a);
+        std::this_thread::yield();
+        auto view_b = tx.get_view(map_b);
+        if (view_a.get(k) != view_b.get(k))
+        {
+          ++inconsistent_reads;
+        }
+        ++reads;
+      }
+    });
+  }
+
+  for (auto& thread : threads)
+  {
+    thread.join();
+  }
+
+  DOCTEST_REQUIRE(reads.load() > 0);
+  DOCTEST_REQUIRE(inconsistent_reads.load() == 0);
+
+  Store::ReadOnlyTx tx;
+  auto [view_a, view_b] = tx.get_view(map_a, map_b);
+  DOCTEST_REQUIRE(view_a.get(k) == writer_count * tx_count);
+  DOCTEST_REQUIRE(view_b.get(k) == writer_count * tx_count);
+}
@@ -10,6 +10,7 @@
 #include <doctest/doctest.h>
 #include <msgpack-c/msgpack.hpp>
 #include <string>
+#include <thread>
 #include <vector>
 
 using namespace ccf;
@@ -318,6 +319,188 @@ bool corrupt_serialised_tx(
   return false;
 }
 
+TEST_CASE(
+  "Decode transactions ahead and apply them in order" *
+  doctest::test_suite("serialisation"))
+{
+  auto consensus = std::make_shared<kv::StubConsensus>();
+  auto encryptor = std::make_shared<ccf::NullTxEncryptor>();
+
+  Store kv_store(consensus);
+  kv_store.set_encryptor(encryptor);
+
+  auto& pub_map = kv_store.create<std::string, std::string>(
+    "pub_map", kv::SecurityDomain::PUBLIC);
+  auto& priv_map = kv_store.create<std::string, std::string>("priv_map");
+
+  std::vector<std::vector<uint8_t>> entries;
+  for (size_t i = 0; i < 3; ++i)
+  {
+    Store::Tx tx;
+    auto [view_pub, view_priv] = tx.get_view(pub_map, priv_map);
+    view_pub->put("pubk", "pubv" + std::to_string(i));
+    view_priv->put("privk" + std::to_string(i), "privv");
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    entries.push_back(consensus->get_latest_data().first);
+  }
+
+  Store kv_store_target;
+  kv_store_target.set_encryptor(encryptor);
+  kv_store_target.clone_schema(kv_store);
+
+  INFO("Transactions can be decoded in any order, on any thread");
+  std::vector<std::unique_ptr<Store::DecodedTx>> decoded(entries.size());
+  {
+    std::thread t([&]() { decoded[2] = kv_store_target.decode(entries[2]); });
+    decoded[1] = kv_store_target.decode(entries[1]);
+    decoded[0] = kv_store_target.decode(entries[0]);
+    t.join();
+
+    REQUIRE(kv_store_target.current_version() == 0);
+  }
+
+  INFO("Decoded transactions must be applied in order");
+  {
+    REQUIRE(
+      kv_store_target.apply(*decoded[1]) == kv::DeserialiseSuccess::FAILED);
+    REQUIRE(kv_store_target.apply(*decoded[0]) == kv::DeserialiseSuccess::PASS);
+    REQUIRE(kv_store_target.apply(*decoded[1]) == kv::DeserialiseSuccess::PASS);
+    REQUIRE(kv_store_target.apply(*decoded[2]) == kv::DeserialiseSuccess::PASS);
+
+    Store::Tx tx;
+    auto [view_pub, view_priv] = tx.get_view(
+      *kv_store_target.get<std::string, std::string>("pub_map"),
+      *kv_store_target.get<std::string, std::string>("priv_map"));
+    REQUIRE(view_pub->get("pubk") == "pubv2");
+    for (size_t i = 0; i < entries.size(); ++i)
+      REQUIRE(view_priv->get("privk" + std::to_string(i)) == "privv");
+  }
+
+  INFO("Transactions decoded before a rollback are decoded again");
+  {
+    Store kv_store_rollback;
+    kv_store_rollback.set_encryptor(encryptor);
+    kv_store_rollback.clone_schema(kv_store);
+
+    auto d = kv_store_rollback.decode(entries[0]);
+
+    // This local commit is rolled back when the decoded transaction is applied
+    Store::Tx tx;
+    auto view = tx.get_view(
+      *kv_store_rollback.get<std::string, std::string>("pub_map"));
+    view->put("pubk", "local");
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+
+    REQUIRE(kv_store_rollback.apply(*d) == kv::DeserialiseSuccess::PASS);
+
+    Store::Tx tx2;
+    auto view2 = tx2.get_view(
+      *kv_store_rollback.get<std::string, std::string>("pub_map"));
+    REQUIRE(view2->get("pubk") == "pubv0");
+  }
+
+  INFO("Public only decoding skips private maps");
+  {
+    Store kv_store_public;
+    kv_store_public.set_encryptor(encryptor);
+    kv_store_public.clone_schema(kv_store);
+
+    auto d = kv_store_public.decode(entries[0], true);
+    REQUIRE(kv_store_public.apply(*d) == kv::DeserialiseSuccess::PASS);
+
+    Store::Tx tx;
+    auto view = tx.get_view(
+      *kv_store_public.get<std::string, std::string>("priv_map"));
+    REQUIRE_FALSE(view->get("privk0").has_value());
+  }
+}
+
+TEST_CASE("Flat serialisation" * doctest::test_suite("serialisation"))
+{
+  using FlatStore =
+    kv::Store<kv::FlatStoreSerialiser, kv::FlatStoreDeserialiser>;
+
+  auto consensus = std::make_shared<kv::StubConsensus>();
+  auto encryptor = std::make_shared<ccf::NullTxEncryptor>();
+
+  FlatStore kv_store(consensus);
+  FlatStore kv_store_target;
+  kv_store.set_encryptor(encryptor);
+  kv_store_target.set_encryptor(encryptor);
+
+  auto& pub_map = kv_store.create<std::string, std::string>(
+    "pub_map", kv::SecurityDomain::PUBLIC);
+  auto& custom_map = kv_store.create<size_t, CustomClass>("custom_map");
+  auto& blob_map = kv_store.create<kv::Blob, kv::Blob>("blob_map");
+  kv_store_target.clone_schema(kv_store);
+
+  INFO("Commit to maps of raw and msgpack-encoded types in source store");
+  {
+    FlatStore::Tx tx;
+    auto [view_pub, view_custom, view_blob] =
+      tx.get_view(pub_map, custom_map, blob_map);
+
+    view_pub->put("pubk1", "pubv1");
+    view_pub->put("pubk2", "");
+    view_custom->put(42, CustomClass(7));
+    view_blob->put("blobk1", "blobv1");
+    view_blob->put("blobk2", std::vector<uint8_t>{0, 1, 2});
+
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+
+  INFO("Deserialise transaction in target store");
+  {
+    REQUIRE(
+      kv_store_target.deserialise(consensus->get_latest_data().first) ==
+      kv::DeserialiseSuccess::PASS);
+
+    FlatStore::Tx tx;
+    auto [view_pub, view_custom, view_blob] = tx.get_view(
+      *kv_store_target.get<std::string, std::string>("pub_map"),
+      *kv_store_target.get<size_t, CustomClass>("custom_map"),
+      *kv_store_target.get<kv::Blob, kv::Blob>("blob_map"));
+
+    REQUIRE(view_pub->get("pubk1") == "pubv1");
+    REQUIRE(view_pub->get("pubk2") == "");
+    REQUIRE(view_custom->get(42).value().get() == 7);
+    REQUIRE(view_blob->get("blobk1") == kv::Blob("blobv1"));
+    REQUIRE(
+      view_blob->get("blobk2").value().to_vector() ==
+      std::vector<uint8_t>{0, 1, 2});
+  }
+
+  INFO("Removals are deserialised");
+  {
+    FlatStore::Tx tx;
+    tx.get_view(blob_map)->remove("blobk1");
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+
+    REQUIRE(
+      kv_store_target.deserialise(consensus->get_latest_data().first) ==
+      kv::DeserialiseSuccess::PASS);
+
+    FlatStore::Tx tx_target;
+    auto view_target =
+      tx_target.get_view(*kv_store_target.get<kv::Blob, kv::Blob>("blob_map"));
+    REQUIRE(!view_target->get("blobk1").has_value());
+    REQUIRE(view_target->get("blobk2").has_value());
+  }
+
+  INFO("Truncated transactions are rejected before anything is read");
+  {
+    FlatStore::Tx tx;
+    tx.get_view(custom_map)->put(43, CustomClass(8));
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+
+    auto data = consensus->get_latest_data().first;
+    data.pop_back();
+    REQUIRE_THROWS_AS(
+      kv_store_target.deserialise(data), kv::KvSerialiserException);
+    REQUIRE(kv_store_target.current_version() == 2);
+  }
+}
+
 TEST_CASE("Integrity" * doctest::test_suite("serialisation"))
 {
   SUBCASE("Public and Private")
@@ -0,0 +1,232 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#include "consensus/test/stub_consensus.h"
+#include "ds/logger.h"
+#include "enclave/appinterface.h"
+#include "kv/kv.h"
+#include "kv/kvserialiser.h"
+#include "node/encryptor.h"
+
+#include <doctest/doctest.h>
+#include <string>
+#include <vector>
+
+using namespace ccf;
+
+using MapTypes = Store::Map<std::string, std::string>;
+
+class TestSnapshotter : public kv::AbstractSnapshotter
+{
+public:
+  kv::Version interval;
+  std::vector<std::unique_ptr<kv::AbstractStore::Snapshot>> snapshots;
+
+  TestSnapshotter(kv::Version interval_) : interval(interval_) {}
+
+  bool requires_snapshot(kv::Version v) override
+  {
+    return (v % interval) == 0;
+  }
+
+  void snapshot(std::unique_ptr<kv::AbstractStore::Snapshot> s) override
+  {
+    snapshots.push_back(std::move(s));
+  }
+};
+
+TEST_CASE("Simple snapshot" * doctest::test_suite("snapshot"))
+{
+  Store store;
+  auto encryptor = std::make_shared<ccf::NullTxEncryptor>();
+  store.set_encryptor(encryptor);
+
+  auto& string_map = store.create<MapTypes>("string_map");
+  auto& public_map =
+    store.create<MapTypes>("public_map", kv::SecurityDomain::PUBLIC);
+
+  kv::Version first_snapshot_version = kv::NoVersion;
+
+  INFO("Apply transactions to original store");
+  {
+    Store::Tx tx1;
+    auto [view_1, view_2] = tx1.get_view(string_map, public_map);
+    view_1->put("foo", "bar");
+    view_1->put("baz", "hello");
+    view_2->put("pubk", "pubv");
+    REQUIRE(tx1.commit() == kv::CommitSuccess::OK);
+
+    Store::Tx tx2;
+    auto view = tx2.get_view(string_map);
+    view->remove("baz");
+    REQUIRE(tx2.commit() == kv::CommitSuccess::OK);
+    first_snapshot_version = tx2.commit_version();
+
+    Store::Tx tx3;
+    auto view_3 = tx3.get_view(string_map);
+    view_3->put("foo", "baz");
+    REQUIRE(tx3.commit() == kv::CommitSuccess::OK);
+  }
+
+  INFO("Snapshot at an earlier version");
+  {
+    auto snapshot = store.snapshot(first_snapshot_version);
+    REQUIRE(snapshot->get_version() == first_snapshot_version);
+    auto serialised_snapshot = snapshot->serialise(encryptor);
+
+    Store new_store;
+    new_store.clone_schema(store);
+    new_store.set_encryptor(encryptor);
+
+    REQUIRE(
+      new_store.deserialise_snapshot(serialised_snapshot) ==
+      kv::DeserialiseSuccess::PASS);
+    REQUIRE(new_store.current_version() == first_snapshot_version);
+    REQUIRE(new_store.commit_version() == first_snapshot_version);
+
+    Store::Tx tx;
+    auto [view_1, view_2] = tx.get_view(
+      *new_store.get<MapTypes>("string_map"),
+      *new_store.get<MapTypes>("public_map"));
+    REQUIRE(view_1->get("foo") == "bar");
+    REQUIRE(!view_1->get("baz").has_value());
+    REQUIRE(view_2->get("pubk") == "pubv");
+  }
+
+  INFO("Snapshot at the latest version and keep using the new store");
+  {
+    auto snapshot = store.snapshot(store.current_version());
+    auto serialised_snapshot = snapshot->serialise(encryptor);
+
+    Store new_store;
+    new_store.clone_schema(store);
+    new_store.set_encryptor(encryptor);
+
+    REQUIRE(
+      new_store.deserialise_snapshot(serialised_snapshot) ==
+      kv::DeserialiseSuccess::PASS);
+    REQUIRE(new_store.current_version() == store.current_version());
+
+    auto& new_string_map = *new_store.get<MapTypes>("string_map");
+    {
+      Store::Tx tx;
+      auto view = tx.get_view(new_string_map);
+      REQUIRE(view->get("foo") == "baz");
+      view->put("foo", "qux");
+      REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+      REQUIRE(tx.commit_version() == store.current_version() + 1);
+    }
+  }
+
+  INFO("Public only snapshot deserialisation");
+  {
+    auto snapshot = store.snapshot(store.current_version());
+    auto serialised_snapshot = snapshot->serialise(encryptor);
+
+    Store new_store;
+    new_store.clone_schema(store);
+    new_store.set_encryptor(encryptor);
+
+    REQUIRE(
+      new_store.deserialise_snapshot(serialised_snapshot, true) ==
+      kv::DeserialiseSuccess::PASS);
+
+    Store::Tx tx;
+    auto [view_1, view_2] = tx.get_view(
+      *new_store.get<MapTypes>("string_map"),
+      *new_store.get<MapTypes>("public_map"));
+    REQUIRE(!view_1->get("foo").has_value());
+    REQUIRE(view_2->get("pubk") == "pubv");
+  }
+
+  INFO("Cannot snapshot at future or compacted versions");
+  {
+    REQUIRE_THROWS_AS(
+      store.snapshot(store.current_version() + 1), std::logic_error);
+
+    store.compact(store.current_version());
+    REQUIRE_THROWS_AS(store.snapshot(first_snapshot_version), std::logic_error);
+  }
+}
+
+TEST_CASE("Snapshot runs hooks" * doctest::test_suite("snapshot"))
+{
+  Store store;
+  auto& string_map =
+    store.create<MapTypes>("string_map", kv::SecurityDomain::PUBLIC);
+
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(string_map);
+    view->put("foo", "bar");
+    view->put("baz", "hello");
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+
+  auto snapshot_version = store.current_version();
+  auto serialised_snapshot =
+    store.snapshot(snapshot_version)->serialise(nullptr);
+
+  Store new_store;
+  std::vector<MapTypes::Write> local_writes;
+  std::vector<MapTypes::Write> global_writes;
+  kv::Version local_version = kv::NoVersion;
+  new_store.create<MapTypes>(
+    "string_map",
+    kv::SecurityDomain::PUBLIC,
+    [&](kv::Version v, const MapTypes::State&, const MapTypes::Write& w) {
+      local_version = v;
+      local_writes.push_back(w);
+    },
+    [&](kv::Version v, const MapTypes::State&, const MapTypes::Write& w) {
+      global_writes.push_back(w);
+    });
+
+  REQUIRE(
+    new_store.deserialise_snapshot(serialised_snapshot) ==
+    kv::DeserialiseSuccess::PASS);
+
+  REQUIRE(local_version == snapshot_version);
+  REQUIRE(local_writes.size() == 1);
+  REQUIRE(local_writes[0].size() == 2);
+  REQUIRE(global_writes.size() == 1);
+  REQUIRE(global_writes[0].at("foo").value == "bar");
+}
+
+TEST_CASE(
+  "Snapshots are taken on compaction" * doctest::test_suite("snapshot"))
+{
+  auto consensus = std::make_shared<kv::StubConsensus>();
+  Store store(consensus);
+  auto encryptor = std::make_shared<ccf::NullTxEncryptor>();
+  store.set_encryptor(encryptor);
+  auto snapshotter = std::make_shared<TestSnapshotter>(2);
+  store.set_snapshotter(snapshotter);
+
+  auto& string_map = store.create<MapTypes>("string_map");
+
+  constexpr size_t tx_count = 5;
+  for (size_t i = 0; i < tx_count; ++i)
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(string_map);
+    view->put("key", std::to_string(i));
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    store.compact(tx.commit_version());
+  }
+
+  REQUIRE(snapshotter->snapshots.size() == tx_count / 2);
+
+  auto& last = snapshotter->snapshots.back();
+  REQUIRE(last->get_version() == 4);
+
+  Store new_store;
+  new_store.clone_schema(store);
+  new_store.set_encryptor(encryptor);
+  REQUIRE(
+    new_store.deserialise_snapshot(last->serialise(encryptor)) ==
+    kv::DeserialiseSuccess::PASS);
+
+  Store::Tx tx;
+  auto view = tx.get_view(*new_store.get<MapTypes>("string_map"));
+  REQUIRE(view->get("key") == "3");
+}
@@ -203,6 +203,112 @@ TEST_CASE("Rollback and compact")
   }
 }
 
+TEST_CASE("Deleted entries are dropped on compaction")
+{
+  Store kv_store;
+  auto& map = kv_store.create<std::string, std::string>(
+    "map", kv::SecurityDomain::PUBLIC);
+
+  constexpr auto k1 = "key1";
+  constexpr auto k2 = "key2";
+  constexpr auto v1 = "value1";
+
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    view->put(k1, v1);
+    view->put(k2, v1);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+
+  Store::Tx tx_before;
+  auto view_before = tx_before.get_view(map);
+  REQUIRE(view_before->get(k1) == v1);
+
+  kv::Version remove_version;
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    REQUIRE(view->remove(k1));
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    remove_version = tx.commit_version();
+  }
+
+  Store::Tx tx_deleted;
+  auto view_deleted = tx_deleted.get_view(map);
+  REQUIRE(!view_deleted->get(k1).has_value());
+
+  INFO("Deleted entries are kept until the removal is compacted");
+  {
+    REQUIRE(map.get_state_size() == 2);
+    kv_store.compact(remove_version - 1);
+    REQUIRE(map.get_state_size() == 2);
+    kv_store.compact(remove_version);
+    REQUIRE(map.get_state_size() == 1);
+  }
+
+  INFO("Removed key is still absent");
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    REQUIRE(!view->get(k1).has_value());
+    REQUIRE(!view->get_globally_committed(k1).has_value());
+    REQUIRE(view->get(k2) == v1);
+    size_t count = 0;
+    view->foreach([&count](const auto&, const auto&) {
+      count++;
+      return true;
+    });
+    REQUIRE(count == 1);
+  }
+
+  INFO("Transactions that read the key before compaction still conflict");
+  {
+    view_before->put(k2, "other");
+    REQUIRE(tx_before.commit() == kv::CommitSuccess::CONFLICT);
+
+    view_deleted->put(k2, "other");
+    REQUIRE(tx_deleted.commit() == kv::CommitSuccess::CONFLICT);
+  }
+
+  INFO("Key can be written again");
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    REQUIRE(!view->remove(k1));
+    view->put(k1, v1);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+
+    Store::Tx tx2;
+    auto view2 = tx2.get_view(map);
+    REQUIRE(view2->get(k1) == v1);
+    REQUIRE(map.get_state_size() == 2);
+  }
+
+  INFO("Deleted entries are restored by rollback");
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    REQUIRE(view->remove(k2));
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    auto v = tx.commit_version();
+
+    Store::Tx tx2;
+    auto view2 = tx2.get_view(map);
+    view2->put(k1, "other");
+    REQUIRE(tx2.commit() == kv::CommitSuccess::OK);
+
+    kv_store.rollback(v);
+    kv_store.compact(v);
+    REQUIRE(map.get_state_size() == 1);
+
+    Store::Tx tx3;
+    auto view3 = tx3.get_view(map);
+    REQUIRE(view3->get(k1) == v1);
+    REQUIRE(!view3->get(k2).has_value());
+  }
+}
+
 TEST_CASE("Clear entire store")
 {
   Store kv_store;
@@ -242,6 +348,108 @@ TEST_CASE("Clear entire store")
   }
 }
 
+TEST_CASE("Read-only transactions")
+{
+  Store kv_store;
+  auto& map1 = kv_store.create<std::string, std::string>(
+    "map1", kv::SecurityDomain::PUBLIC);
+  auto& map2 = kv_store.create<std::string, std::string>(
+    "map2", kv::SecurityDomain::PUBLIC);
+
+  constexpr auto k = "key";
+  constexpr auto v1 = "value1";
+  constexpr auto v2 = "value2";
+
+  INFO("Read maps that have never been written");
+  {
+    Store::ReadOnlyTx tx;
+    REQUIRE(tx.get_read_version() == kv::NoVersion);
+    auto view = tx.get_view(map1);
+    REQUIRE(!view.get(k).has_value());
+    REQUIRE(tx.get_read_version() == 0);
+  }
+
+  INFO("Read committed writes");
+  {
+    Store::Tx tx;
+    auto [view1, view2] = tx.get_view(map1, map2);
+    view1->put(k, v1);
+    view2->put(k, v1);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+
+    Store::ReadOnlyTx tx2;
+    auto [view1_, view2_] = tx2.get_view(map1, map2);
+    REQUIRE(view1_.get(k) == v1);
+    REQUIRE(view2_.get(k) == v1);
+    REQUIRE(tx2.get_read_version() == tx.commit_version());
+  }
+
+  INFO("All maps are read at the version of the first view");
+  {
+    Store::ReadOnlyTx tx;
+    auto view1 = tx.get_view(map1);
+
+    Store::Tx tx2;
+    auto [view1_, view2_] = tx2.get_view(map1, map2);
+    view1_->put(k, v2);
+    view2_->put(k, v2);
+    REQUIRE(tx2.commit() == kv::CommitSuccess::OK);
+
+    auto view2 = tx.get_view(map2);
+    REQUIRE(view1.get(k) == v1);
+    REQUIRE(view2.get(k) == v1);
+  }
+
+  INFO("Removed keys are not read");
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map1);
+    view->put("other_key", v1);
+    REQUIRE(view->remove(k));
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+
+    Store::ReadOnlyTx tx2;
+    auto view2 = tx2.get_view(map1);
+    REQUIRE(!view2.get(k).has_value());
+    size_t count = 0;
+    view2.foreach([&count](const auto& key, const auto& value) {
+      REQUIRE(key == "other_key");
+      ++count;
+      return true;
+    });
+    REQUIRE(count == 1);
+  }
+
+  INFO("Rolled back writes are not read");
+  {
+    Store::ReadOnlyTx tx;
+    auto view = tx.get_view(map1);
+
+    kv_store.rollback(1);
+
+    Store::ReadOnlyTx tx2;
+    auto [view1, view2] = tx2.get_view(map1, map2);
+    REQUIRE(view1.get(k) == v1);
+    REQUIRE(view2.get(k) == v1);
+    REQUIRE(!view1.get("other_key").has_value());
+    REQUIRE(tx2.get_read_version() == 1);
+
+    // Transactions that started before are not affected
+    REQUIRE(view.get("other_key") == v1);
+  }
+
+  INFO("Cleared maps are empty");
+  {
+    kv_store.clear();
+
+    Store::ReadOnlyTx tx;
+    auto [view1, view2] = tx.get_view(map1, map2);
+    REQUIRE(!view1.get(k).has_value());
+    REQUIRE(!view2.get(k).has_value());
+    REQUIRE(tx.get_read_version() == 0);
+  }
+}
+
 TEST_CASE("Local commit hooks")
 {
   using State = Store::Map<std::string, std::string>::State;
@@ -103,6 +103,73 @@ namespace ccf
 
       void _push_table() {}
 
+      static constexpr auto saved_tables_key = "ccf.saved_tables";
+      static constexpr auto saved_metatables_key = "ccf.saved_metatables";
+      static constexpr auto saved_upvalues_key = "ccf.saved_upvalues";
+
+      // Pushes a shallow copy of the table at idx
+      void push_copy(int idx)
+      {
+        idx = lua_absindex(l, idx);
+        prepare_push(3);
+        lua_newtable(l);
+        lua_pushnil(l);
+        while (lua_next(l, idx))
+        {
+          lua_pushvalue(l, -2);
+          lua_insert(l, -2);
+          lua_rawset(l, -4);
+        }
+      }
+
+      // Makes the table at idx equal to its shallow copy at copy_idx
+      void restore_table(int idx, int copy_idx)
+      {
+        idx = lua_absindex(l, idx);
+        copy_idx = lua_absindex(l, copy_idx);
+        prepare_push(3);
+
+        // Revert changed entries and remove added ones. Existing fields may be
+        // assigned during traversal.
+        lua_pushnil(l);
+        while (lua_next(l, idx))
+        {
+          lua_pushvalue(l, -2);
+          lua_rawget(l, copy_idx);
+          if (!lua_rawequal(l, -1, -2))
+          {
+            lua_pushvalue(l, -3);
+            lua_insert(l, -2);
+            lua_rawset(l, idx);
+            lua_pop(l, 1);
+          }
+          else
+          {
+            lua_pop(l, 2);
+          }
+        }
+
+        // Restore removed entries
+        lua_pushnil(l);
+        while (lua_next(l, copy_idx))
+        {
+          lua_pushvalue(l, -2);
+          lua_rawget(l, idx);
+          const auto removed = lua_isnil(l, -1);
+          lua_pop(l, 1);
+          if (removed)
+          {
+            lua_pushvalue(l, -2);
+            lua_insert(l, -2);
+            lua_rawset(l, idx);
+          }
+          else
+          {
+            lua_pop(l, 1);
+          }
+        }
+      }
+
     public:
       Interpreter() : execution_limit(1 << 22)
       {
@@ -126,6 +193,14 @@ namespace ccf
           lua_pop(l, 1); /* remove lib */
         }
 
+        // Hide the metatable shared by all strings from scripts, so that they
+        // cannot change it
+        lua_pushliteral(l, "");
+        lua_getmetatable(l, -1);
+        lua_pushboolean(l, false);
+        lua_setfield(l, -2, "__metatable");
+        lua_pop(l, 2);
+
         // lua's garbage collector is left in its default state. As long as
         // instances of this Interpreter remain reasonably short-lived their
         // memory use is unlikely to be a problem - either they are destroyed
@@ -362,6 +437,10 @@ namespace ccf
         lua_pushvalue(l, metatable); // dup metatable
         lua_setfield(l, field, "__index"); // metatable.__index = metatable
 
+        // Hide the metatable from scripts, so that they cannot change it
+        lua_pushboolean(l, false);
+        lua_setfield(l, field, "__metatable");
+
         lua_pop(l, 1); // remove metatable from stack
       }
 
@@ -373,6 +452,152 @@ namespace ccf
           UserData<T, X>::metatable_name(), funcs, skip_existing);
       }
 
+      /**
+       * @brief Save the global environment, so that restore_globals() can later
+       * undo the changes made to it by scripts.
+       *
+       * Every table and function reachable from the global table is saved:
+       * the entries and metatable of each table, and the upvalues of each
+       * function. The metatables of strings and registered userdata are
+       * protected instead, so scripts cannot reach them.
+       */
+      void save_globals()
+      {
+        prepare_push(8);
+        lua_newtable(l);
+        const auto tables = lua_gettop(l);
+        lua_newtable(l);
+        const auto metatables = lua_gettop(l);
+        lua_newtable(l);
+        const auto upvalues = lua_gettop(l);
+
+        // Tables and functions still to be saved
+        lua_newtable(l);
+        const auto pending = lua_gettop(l);
+        lua_Integer n_pending = 0;
+        const auto enqueue = [&](int idx) {
+          if (lua_istable(l, idx) || lua_isfunction(l, idx))
+          {
+            lua_pushvalue(l, idx);
+            lua_rawseti(l, pending, ++n_pending);
+          }
+        };
+
+        lua_pushglobaltable(l);
+        enqueue(-1);
+        lua_pop(l, 1);
+
+        while (n_pending > 0)
+        {
+          lua_rawgeti(l, pending, n_pending);
+          lua_pushnil(l);
+          lua_rawseti(l, pending, n_pending--);
+          const auto v = lua_gettop(l);
+          const auto saved = lua_istable(l, v) ? tables : upvalues;
+
+          lua_pushvalue(l, v);
+          const auto seen = lua_rawget(l, saved) != LUA_TNIL;
+          lua_pop(l, 1);
+          if (seen)
+          {
+            lua_pop(l, 1);
+            continue;
+          }
+
+          lua_pushvalue(l, v);
+          if (saved == tables)
+          {
+            push_copy(v);
+            lua_rawset(l, tables);
+
+            lua_pushvalue(l, v);
+            if (!lua_getmetatable(l, v))
+              lua_pushboolean(l, false);
+            enqueue(-1);
+            lua_rawset(l, metatables);
+
+            lua_pushnil(l);
+            while (lua_next(l, v))
+            {
+              enqueue(-2);
+              enqueue(-1);
+              lua_pop(l, 1);
+            }
+          }
+          else
+          {
+            lua_newtable(l);
+            int n = 0;
+            while (lua_getupvalue(l, v, n + 1) != nullptr)
+            {
+              enqueue(-1);
+              lua_rawseti(l, -2, ++n);
+            }
+            lua_pushinteger(l, n);
+            lua_setfield(l, -2, "n");
+            lua_rawset(l, upvalues);
+          }
+
+          lua_pop(l, 1);
+        }
+
+        lua_pop(l, 1);
+        lua_setfield(l, LUA_REGISTRYINDEX, saved_upvalues_key);
+        lua_setfield(l, LUA_REGISTRYINDEX, saved_metatables_key);
+        lua_setfield(l, LUA_REGISTRYINDEX, saved_tables_key);
+      }
+
+      /**
+       * @brief Restore the global environment saved by save_globals(), and
+       * clear the stack.
+       */
+      void restore_globals()
+      {
+        lua_settop(l, 0);
+        prepare_push(6);
+        if (
+          lua_getfield(l, LUA_REGISTRYINDEX, saved_tables_key) != LUA_TTABLE ||
+          lua_getfield(l, LUA_REGISTRYINDEX, saved_metatables_key) !=
+            LUA_TTABLE ||
+          lua_getfield(l, LUA_REGISTRYINDEX, saved_upvalues_key) != LUA_TTABLE)
+          throw lua::ex("No saved globals to restore");
+
+        lua_pushnil(l);
+        while (lua_next(l, 1))
+        {
+          restore_table(-2, -1);
+          lua_pop(l, 1);
+        }
+
+        lua_pushnil(l);
+        while (lua_next(l, 2))
+        {
+          if (!lua_istable(l, -1))
+          {
+            lua_pop(l, 1);
+            lua_pushnil(l);
+          }
+          lua_setmetatable(l, -2);
+        }
+
+        lua_pushnil(l);
+        while (lua_next(l, 3))
+        {
+          lua_getfield(l, -1, "n");
+          const auto n = lua_tointeger(l, -1);
+          lua_pop(l, 1);
+          for (lua_Integer i = 1; i <= n; ++i)
+          {
+            lua_rawgeti(l, -1, i);
+            if (lua_setupvalue(l, -3, i) == nullptr)
+              lua_pop(l, 1);
+          }
+          lua_pop(l, 1);
+        }
+
+        lua_settop(l, 0);
+      }
+
       /** Get the raw state object */
       auto get_state()
       {
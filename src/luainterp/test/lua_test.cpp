@@ -401,3 +401,93 @@ TEST_CASE("infinite loop prevention")
     REQUIRE_NOTHROW(interp.invoke(script));
   }
 }
+
+TEST_CASE("restore globals")
+{
+  Interpreter li;
+  li.invoke("env = {answer = 42}");
+  li.save_globals();
+
+  li.invoke(R"xxx(
+    x = 1
+    env.answer = 0
+    env.extra = true
+    string.foo = "bar"
+    math = nil
+    print = function() end
+  )xxx");
+  REQUIRE(li.invoke<int>("return x") == 1);
+  REQUIRE(li.invoke<bool>("return math == nil"));
+
+  li.restore_globals();
+  REQUIRE(lua_gettop(li.get_state()) == 0);
+  REQUIRE(li.invoke<bool>("return x == nil"));
+  REQUIRE(li.invoke<int>("return env.answer") == 42);
+  REQUIRE(li.invoke<bool>("return env.extra == nil"));
+  REQUIRE(li.invoke<bool>("return string.foo == nil"));
+  REQUIRE(li.invoke<bool>("return ('a').foo == nil"));
+  REQUIRE(li.invoke<int>("return math.floor(1.5)") == 1);
+  REQUIRE(li.invoke<bool>("return type(print) == 'function'"));
+
+  INFO("Globals can be restored repeatedly");
+  li.invoke("y = 2");
+  li.restore_globals();
+  REQUIRE(li.invoke<bool>("return y == nil"));
+
+  INFO("Nothing to restore without saved globals");
+  REQUIRE_THROWS_AS(Interpreter().restore_globals(), lua::ex);
+}
+
+TEST_CASE("restore nested tables, metatables and upvalues")
+{
+  Point p;
+  Interpreter li;
+  li.register_metatable<Point>(point_metatable_methods);
+  li.invoke(R"xxx(
+    env = {config = {limits = {max = 10}}}
+    Account = {}
+    Account.__index = Account
+    function Account.balance() return 0 end
+    local calls = 0
+    function env.count()
+      calls = calls + 1
+      return calls
+    end
+  )xxx");
+  li.save_globals();
+
+  INFO("One run changes nested tables, metatables and upvalues");
+  li.invoke(R"xxx(
+    env.config.limits.max = 0
+    env.config.limits.min = 5
+    env.config.extra = {}
+    Account.balance = function() return 100 end
+    Account.__index = function() return "leaked" end
+    setmetatable(env, {__index = function() return "leaked" end})
+    setmetatable(_G, {__newindex = function() end})
+    env.count()
+  )xxx");
+  REQUIRE(li.invoke<int>("return env.count()") == 2);
+
+  INFO("Metatables of strings and registered types cannot be reached");
+  REQUIRE_THROWS_AS(
+    li.invoke("getmetatable('').__index = {upper = function() end}"), lua::ex);
+  REQUIRE(li.invoke<bool>("return getmetatable('') == false"));
+  REQUIRE_THROWS_AS(
+    li.invoke("local p = ...; getmetatable(p).getX = nil", &p), lua::ex);
+  REQUIRE(li.invoke<bool>("return getmetatable(...) == false", &p));
+
+  INFO("The next run sees none of these changes");
+  li.restore_globals();
+  REQUIRE(li.invoke<int>("return env.config.limits.max") == 10);
+  REQUIRE(li.invoke<bool>("return env.config.limits.min == nil"));
+  REQUIRE(li.invoke<bool>("return env.config.extra == nil"));
+  REQUIRE(li.invoke<int>("return Account.balance()") == 0);
+  REQUIRE(li.invoke<bool>("return Account.__index == Account"));
+  REQUIRE(li.invoke<bool>("return getmetatable(env) == nil"));
+  REQUIRE(li.invoke<bool>("return env.missing == nil"));
+  REQUIRE(li.invoke<bool>("return getmetatable(_G) == nil"));
+  REQUIRE(li.invoke<int>("return env.count()") == 1);
+  REQUIRE(li.invoke<std::string>("return ('a'):upper()") == "A");
+  REQUIRE(li.invoke<int>("local p = ...; return p:getX()", &p) == p.x);
+}
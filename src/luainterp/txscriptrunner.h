@@ -1,11 +1,16 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the Apache 2.0 License.
 #pragma once
+#include "crypto/hash.h"
+#include "ds/spinlock.h"
 #include "luainterp/luainterp.h"
 #include "luainterp/luakv.h"
 #include "node/networktables.h"
 #include "node/rpc/rpcexception.h"
 
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <type_traits>
 #include <unordered_map>
@@ -128,6 +133,38 @@ namespace ccf
 
       const NetworkTables& network_tables;
 
+      /** An interpreter whose environment has been set up, kept between runs.
+       * Its globals are restored after each run, and the chunks it loaded are
+       * cached in its registry, keyed by digest.
+       */
+      struct PooledInterpreter
+      {
+        lua::Interpreter li;
+        std::optional<crypto::Sha256Hash> env_digest;
+        size_t generation;
+        size_t cached_chunks = 0;
+      };
+
+      static constexpr auto chunks_key = "ccf.chunks";
+      static constexpr size_t max_cached_chunks = 64;
+      static constexpr size_t max_pooled_interpreters = 16;
+
+      mutable SpinLock pool_lock;
+      mutable std::vector<std::unique_ptr<PooledInterpreter>> pool;
+      // Incremented on invalidate(), so that interpreters in use at that point
+      // are not returned to the pool
+      std::atomic<size_t> generation = 0;
+
+      static crypto::Sha256Hash digest(const Script& s)
+      {
+        if (s.bytecode)
+          return crypto::Sha256Hash({*s.bytecode});
+        else if (s.text)
+          return crypto::Sha256Hash({*s.text});
+        else
+          throw std::logic_error("no bytecode or string to load as script");
+      }
+
       static void load(lua::Interpreter& li, Script s)
       {
         if (s.bytecode)
@@ -138,6 +175,89 @@ namespace ccf
           throw std::logic_error("no bytecode or string to load as script");
       }
 
+      // Pushes the function compiled from s, loading it only if the
+      // interpreter has not already done so
+      static void load_cached(PooledInterpreter& pi, const Script& s)
+      {
+        auto l = pi.li.get_state();
+        const auto d = digest(s);
+
+        if (pi.cached_chunks >= max_cached_chunks)
+        {
+          lua_pushnil(l);
+          lua_setfield(l, LUA_REGISTRYINDEX, chunks_key);
+          pi.cached_chunks = 0;
+        }
+
+        if (lua_getfield(l, LUA_REGISTRYINDEX, chunks_key) != LUA_TTABLE)
+        {
+          lua_pop(l, 1);
+          lua_newtable(l);
+          lua_pushvalue(l, -1);
+          lua_setfield(l, LUA_REGISTRYINDEX, chunks_key);
+        }
+
+        lua_pushlstring(l, (const char*)d.h.data(), d.h.size());
+        if (lua_rawget(l, -2) == LUA_TFUNCTION)
+        {
+          lua_remove(l, -2);
+          return;
+        }
+        lua_pop(l, 1);
+
+        load(pi.li, s);
+        lua_pushlstring(l, (const char*)d.h.data(), d.h.size());
+        lua_pushvalue(l, -2);
+        lua_rawset(l, -4);
+        lua_remove(l, -2);
+        pi.cached_chunks++;
+      }
+
+      std::unique_ptr<PooledInterpreter> acquire(
+        const std::optional<Script>& env_script) const
+      {
+        std::optional<crypto::Sha256Hash> env_digest;
+        if (env_script)
+          env_digest = digest(*env_script);
+
+        const size_t current_generation = generation;
+        std::unique_ptr<PooledInterpreter> pi;
+        {
+          std::lock_guard<SpinLock> guard(pool_lock);
+          if (!pool.empty())
+          {
+            pi = std::move(pool.back());
+            pool.pop_back();
+          }
+        }
+
+        // Interpreters set up with a different environment, or before the
+        // scripts changed, are discarded
+        if (
+          pi != nullptr && pi->generation == current_generation &&
+          pi->env_digest == env_digest)
+          return pi;
+
+        pi = std::make_unique<PooledInterpreter>();
+        pi->env_digest = env_digest;
+        pi->generation = current_generation;
+        setup_environment(pi->li, env_script);
+        lua_settop(pi->li.get_state(), 0);
+        pi->li.save_globals();
+        return pi;
+      }
+
+      void release(std::unique_ptr<PooledInterpreter> pi) const
+      {
+        pi->li.restore_globals();
+
+        std::lock_guard<SpinLock> guard(pool_lock);
+        if (
+          pi->generation == generation &&
+          pool.size() < max_pooled_interpreters)
+          pool.push_back(std::move(pi));
+      }
+
       Whitelist get_whitelist(Store::Tx& tx, WlId id) const
       {
         const auto wl = tx.get_view(network_tables.whitelists)->get(id);
@@ -244,12 +364,12 @@ namespace ccf
       template <typename T, typename... Args>
       T run(Store::Tx& tx, const TxScript& txs, Args&&... args) const
       {
-        lua::Interpreter li;
+        // the optional environment script has already been run on pooled
+        // interpreters. If the script throws, the interpreter is discarded.
+        auto pi = acquire(txs.env_script);
+        auto& li = pi->li;
 
-        // run an optional environment script
-        setup_environment(li, txs.env_script);
-
-        load(li, txs.script);
+        load_cached(*pi, txs.script);
 
         // register writable and read-only tables with respect to the given
         // whitelists the table of writable tables will be pushed on the stack
@@ -278,10 +398,17 @@ namespace ccf
         {
           // no return if T == void
           if constexpr (std::is_same_v<T, void>)
+          {
             li.invoke_raw(n_registered_tables, std::forward<Args>(args)...);
+            release(std::move(pi));
+          }
           else
-            return li.template invoke_raw<T>(
+          {
+            auto r = li.template invoke_raw<T>(
               n_registered_tables, std::forward<Args>(args)...);
+            release(std::move(pi));
+            return r;
+          }
         }
         catch (const lua::ex& e)
         {
@@ -289,6 +416,21 @@ namespace ccf
         }
       }
 
+      /** Discard the interpreters and compiled chunks cached by this runner.
+       *
+       * Cached chunks and environments are keyed by the digest of their
+       * source, so this is not needed for correctness. It should be called
+       * when the scripts are written, to release interpreters that will not
+       * be used again.
+       */
+      void invalidate()
+      {
+        generation++;
+
+        std::lock_guard<SpinLock> guard(pool_lock);
+        pool.clear();
+      }
+
       TxScriptRunner(NetworkTables& network_tables) :
         network_tables(network_tables)
       {}
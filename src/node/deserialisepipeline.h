@@ -0,0 +1,388 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "consensus/ledgerenclavetypes.h"
+#include "consensus/raft/rafttypes.h"
+#include "crypto/hash.h"
+#include "ds/ringbuffer.h"
+#include "ds/spinlock.h"
+#include "ds/thread_messaging.h"
+#include "entities.h"
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace ccf
+{
+  // Hash decoded entries together, so that the history does not hash them
+  // one by one when they are applied
+  inline void set_digests(std::unique_ptr<Store::DecodedTx>* txs, size_t n)
+  {
+    std::vector<CBuffer> entries;
+    entries.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+      entries.emplace_back(txs[i]->get_data());
+
+    auto digests = crypto::Sha256Hash::batch(entries);
+    for (size_t i = 0; i < n; ++i)
+      txs[i]->set_digest(digests[i]);
+  }
+
+  /** Decodes ledger entries on worker threads, and hands them back on the
+   * main thread in the order in which they were submitted.
+   *
+   * Decoding (decryption and deserialisation of the writes, see
+   * Store::decode) runs concurrently for many entries. Only applying the
+   * decoded entries to the store is done in order. Without worker threads,
+   * entries are decoded on the main thread, between other tasks.
+   */
+  class DeserialisePipeline
+  {
+  public:
+    using Decoded = std::unique_ptr<Store::DecodedTx>;
+    // Called on the main thread, for each entry in order
+    using Apply = std::function<void(consensus::Index, Decoded)>;
+
+  private:
+    struct State
+    {
+      SpinLock lock;
+      Apply apply;
+
+      // Incremented by start and reset, so that the entries submitted before
+      // are dropped when they have been decoded
+      uint64_t generation = 0;
+      consensus::Index next_submit = 0;
+      consensus::Index next_apply = 0;
+      std::map<consensus::Index, Decoded> decoded;
+
+      State(Apply apply) : apply(apply) {}
+    };
+
+    std::shared_ptr<State> state;
+
+    struct DecodeMsg
+    {
+      std::shared_ptr<State> state;
+      std::shared_ptr<Store> store;
+      uint64_t generation;
+      consensus::Index idx;
+      std::vector<uint8_t> entry;
+      bool public_only;
+      Decoded decoded;
+    };
+
+    static void decode_cb(std::unique_ptr<enclave::Tmsg<DecodeMsg>> msg)
+    {
+      auto& d = msg->data;
+      d.decoded = d.store->decode(std::move(d.entry), d.public_only);
+      set_digests(&d.decoded, 1);
+      d.store.reset();
+
+      enclave::ThreadMessaging::ChangeTmsgCallback(msg, &decoded_cb);
+      enclave::ThreadMessaging::thread_messaging.add_task<DecodeMsg>(
+        enclave::ThreadMessaging::main_thread, std::move(msg));
+    }
+
+    static void decoded_cb(std::unique_ptr<enclave::Tmsg<DecodeMsg>> msg)
+    {
+      auto& d = msg->data;
+      auto& s = *d.state;
+
+      {
+        std::lock_guard<SpinLock> guard(s.lock);
+        if (d.generation != s.generation)
+          return;
+
+        s.decoded.emplace(d.idx, std::move(d.decoded));
+      }
+
+      // Apply all the entries that are now next, unless the pipeline is reset
+      // by one of them
+      while (true)
+      {
+        consensus::Index idx;
+        Decoded next;
+        {
+          std::lock_guard<SpinLock> guard(s.lock);
+          if (d.generation != s.generation)
+            return;
+
+          auto it = s.decoded.find(s.next_apply);
+          if (it == s.decoded.end())
+            return;
+
+          idx = it->first;
+          next = std::move(it->second);
+          s.decoded.erase(it);
+          ++s.next_apply;
+        }
+
+        s.apply(idx, std::move(next));
+      }
+    }
+
+  public:
+    DeserialisePipeline(Apply apply) : state(std::make_shared<State>(apply)) {}
+
+    /** Drop all entries in flight, and expect the next entry submitted to be
+     * at index first
+     */
+    void start(consensus::Index first)
+    {
+      std::lock_guard<SpinLock> guard(state->lock);
+      ++state->generation;
+      state->next_submit = first;
+      state->next_apply = first;
+      state->decoded.clear();
+    }
+
+    /** Drop all entries in flight
+     */
+    void reset()
+    {
+      std::lock_guard<SpinLock> guard(state->lock);
+      ++state->generation;
+      state->next_apply = state->next_submit;
+      state->decoded.clear();
+    }
+
+    /** Decode the next entry, against store
+     *
+     * @param store Store the entry will be applied to
+     * @param entry Serialised entry
+     * @param public_only If true, only public maps are deserialised
+     */
+    void submit(
+      std::shared_ptr<Store> store,
+      std::vector<uint8_t>&& entry,
+      bool public_only)
+    {
+      auto msg = std::make_unique<enclave::Tmsg<DecodeMsg>>(&decode_cb);
+      auto& d = msg->data;
+      d.state = state;
+      d.store = store;
+      d.entry = std::move(entry);
+      d.public_only = public_only;
+
+      {
+        std::lock_guard<SpinLock> guard(state->lock);
+        d.generation = state->generation;
+        d.idx = state->next_submit++;
+      }
+
+      const auto tid = enclave::ThreadMessaging::get_execution_thread(d.idx);
+      enclave::ThreadMessaging::thread_messaging.add_task<DecodeMsg>(
+        tid, std::move(msg));
+    }
+
+    /** Number of entries submitted but not yet applied
+     */
+    size_t pending()
+    {
+      std::lock_guard<SpinLock> guard(state->lock);
+      return state->next_submit - state->next_apply;
+    }
+  };
+
+  /** Decodes a batch of ledger entries concurrently, on the worker threads
+   * and on the calling thread, and returns once they are all decoded.
+   *
+   * The calling thread decodes entries too, rather than only waiting, so
+   * that the batch completes even if the workers are busy. Once it has no
+   * entries left to claim, it only waits a bounded time for the entries
+   * still being decoded by workers, and then decodes them itself, so that
+   * a slow or descheduled worker cannot stall it. Whichever decodes an
+   * entry first provides it. The digests of the entries are computed at the
+   * same time, a chunk at a time.
+   */
+  class BatchDecoder
+  {
+  public:
+    using Decoded = std::unique_ptr<Store::DecodedTx>;
+
+  private:
+    struct Batch
+    {
+      std::shared_ptr<Store> store;
+      bool public_only;
+      std::vector<std::vector<uint8_t>> entries;
+
+      // Set by whichever thread first decodes each entry
+      std::unique_ptr<std::atomic<Store::DecodedTx*>[]> decoded;
+
+      std::atomic<size_t> next_decode{0};
+      std::atomic<size_t> done{0};
+
+      // Entries are claimed in chunks, so that their digests can be
+      // computed together
+      static constexpr size_t chunk_size = crypto::Sha256Hash::AVX2_LANES;
+
+      // Pauses spent waiting for the workers before the calling thread
+      // decodes their entries itself
+      static constexpr size_t max_wait_spins = 1 << 12;
+
+      ~Batch()
+      {
+        // Entries decoded by workers after the calling thread returned
+        for (size_t i = 0; i < entries.size(); ++i)
+          delete decoded[i].load();
+      }
+
+      // The entries of a chunk may be decoded by two threads at once, in
+      // which case they are copied rather than moved
+      void decode_chunk(size_t first, bool copy)
+      {
+        const auto n = std::min(chunk_size, entries.size() - first);
+        Decoded chunk[chunk_size];
+        for (size_t j = 0; j < n; ++j)
+        {
+          auto& entry = entries[first + j];
+          chunk[j] = copy ?
+            store->decode(std::vector<uint8_t>(entry), public_only) :
+            store->decode(std::move(entry), public_only);
+        }
+
+        set_digests(chunk, n);
+
+        for (size_t j = 0; j < n; ++j)
+        {
+          Store::DecodedTx* expected = nullptr;
+          if (decoded[first + j].compare_exchange_strong(
+                expected, chunk[j].get()))
+          {
+            chunk[j].release();
+            ++done;
+          }
+        }
+      }
+
+      // Workers may have their chunks taken over by the calling thread, so
+      // copy their entries. The calling thread is the only one to decode
+      // the chunks it claims.
+      void decode_all(bool worker)
+      {
+        for (size_t i = next_decode.fetch_add(chunk_size); i < entries.size();
+             i = next_decode.fetch_add(chunk_size))
+          decode_chunk(i, worker);
+      }
+
+      void take_over()
+      {
+        for (size_t i = 0; i < entries.size(); i += chunk_size)
+        {
+          const auto n = std::min(chunk_size, entries.size() - i);
+          for (size_t j = i; j < i + n; ++j)
+          {
+            if (decoded[j].load() == nullptr)
+            {
+              decode_chunk(i, true);
+              break;
+            }
+          }
+        }
+      }
+    };
+
+    struct DecodeMsg
+    {
+      std::shared_ptr<Batch> batch;
+    };
+
+    static void decode_cb(std::unique_ptr<enclave::Tmsg<DecodeMsg>> msg)
+    {
+      msg->data.batch->decode_all(true);
+    }
+
+  public:
+    static std::vector<Decoded> decode(
+      std::shared_ptr<Store> store,
+      std::vector<std::vector<uint8_t>>& entries,
+      bool public_only)
+    {
+      auto batch = std::make_shared<Batch>();
+      batch->store = store;
+      batch->public_only = public_only;
+      batch->entries = std::move(entries);
+      const auto size = batch->entries.size();
+      batch->decoded =
+        std::make_unique<std::atomic<Store::DecodedTx*>[]>(size);
+      for (size_t i = 0; i < size; ++i)
+        batch->decoded[i] = nullptr;
+
+      // One chunk is left for this thread
+      const size_t chunks = (size + Batch::chunk_size - 1) / Batch::chunk_size;
+      const size_t workers = enclave::ThreadMessaging::thread_count - 1;
+      const size_t helpers = std::min(workers, std::max<size_t>(chunks, 1) - 1);
+      for (size_t i = 0; i < helpers; ++i)
+      {
+        auto msg = std::make_unique<enclave::Tmsg<DecodeMsg>>(&decode_cb);
+        msg->data.batch = batch;
+        enclave::ThreadMessaging::thread_messaging.add_task<DecodeMsg>(
+          enclave::ThreadMessaging::get_execution_thread(i), std::move(msg));
+      }
+
+      batch->decode_all(false);
+
+      // Wait briefly for the entries still being decoded by workers, and
+      // decode them here if they are not done by then
+      for (size_t spins = 0;
+           batch->done < size && spins < Batch::max_wait_spins;
+           ++spins)
+        CCF_PAUSE();
+
+      if (batch->done < size)
+        batch->take_over();
+
+      std::vector<Decoded> result;
+      result.reserve(size);
+      for (size_t i = 0; i < size; ++i)
+        result.emplace_back(batch->decoded[i].exchange(nullptr));
+      return result;
+    }
+  };
+
+  /** Consensus adaptor for the store, which decodes the entries replicated in
+   * each batch concurrently with BatchDecoder
+   */
+  class BatchDecodingAdaptor : public raft::Adaptor<Store, kv::DeserialiseSuccess>
+  {
+  public:
+    using raft::Adaptor<Store, kv::DeserialiseSuccess>::Adaptor;
+
+    std::vector<std::pair<kv::DeserialiseSuccess, raft::Term>>
+    deserialise_batch(
+      std::vector<std::vector<uint8_t>>& entries,
+      bool public_only = false) override
+    {
+      std::vector<std::pair<kv::DeserialiseSuccess, raft::Term>> results;
+
+      auto p = x.lock();
+      if (!p)
+        return results;
+
+      // A single entry is not worth handing to the workers
+      if (entries.size() < 2)
+        return raft::Adaptor<Store, kv::DeserialiseSuccess>::deserialise_batch(
+          entries, public_only);
+
+      auto decoded = BatchDecoder::decode(p, entries, public_only);
+      results.reserve(decoded.size());
+
+      for (auto& d : decoded)
+      {
+        raft::Term term = 0;
+        auto success = p->apply(*d, &term);
+        results.emplace_back(success, term);
+        if (success == kv::DeserialiseSuccess::FAILED)
+          break;
+      }
+
+      return results;
+    }
+  };
+}
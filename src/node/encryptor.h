@@ -30,6 +30,15 @@ namespace ccf
       cipher = plain;
     }
 
+    void encrypt_in_place(
+      CBuffer additional_data,
+      Buffer data,
+      uint8_t* serialised_header,
+      kv::Version version) override
+    {
+      memset(serialised_header, 0, get_header_length());
+    }
+
     bool decrypt(
       const std::vector<uint8_t>& cipher,
       const std::vector<uint8_t>& additional_data,
@@ -48,6 +57,11 @@ namespace ccf
       return crypto::GcmHeader<crypto::GCM_SIZE_IV>::RAW_DATA_SIZE;
     }
 
+    size_t get_padding_length() override
+    {
+      return 0;
+    }
+
     void update_encryption_key(
       kv::Version version, const std::vector<uint8_t>& raw_ledger_key) override
     {}
@@ -154,6 +168,41 @@ namespace ccf
       serialised_header = std::move(gcm_hdr.serialise());
     }
 
+    /**
+     * Encrypt data in place and write serialised GCM header.
+     *
+     * @param[in]     additional_data   Additional data to tag
+     * @param[in,out] data              Plaintext to encrypt, replaced by the
+     * ciphertext
+     * @param[out]    serialised_header Serialised header (iv + tag), of
+     * get_header_length() bytes
+     * @param[in]     version           Version used to retrieve the
+     * corresponding encryption key
+     *
+     * additional_data and data must each be followed by
+     * get_padding_length() bytes owned by the caller.
+     */
+    void encrypt_in_place(
+      CBuffer additional_data,
+      Buffer data,
+      uint8_t* serialised_header,
+      kv::Version version) override
+    {
+      crypto::GcmHeader<crypto::GCM_SIZE_IV> gcm_hdr;
+
+      // Set IV
+      set_iv(gcm_hdr, version);
+
+      get_encryption_key(version).encrypt_in_place(
+        gcm_hdr.get_iv(), data, additional_data, gcm_hdr.tag);
+
+      auto space = get_header_length();
+      serialized::write(
+        serialised_header, space, gcm_hdr.tag, sizeof(gcm_hdr.tag));
+      serialized::write(
+        serialised_header, space, gcm_hdr.iv, sizeof(gcm_hdr.iv));
+    }
+
     /**
      * Decrypt cipher and return plaintext.
      *
@@ -200,6 +249,17 @@ namespace ccf
       return crypto::GcmHeader<crypto::GCM_SIZE_IV>::RAW_DATA_SIZE;
     }
 
+    /**
+     * Return number of bytes that must follow the buffers given to
+     * encrypt_in_place.
+     *
+     * @return size_t length of padding
+     */
+    size_t get_padding_length() override
+    {
+      return crypto::GCM_SIZE_PADDING;
+    }
+
     void update_encryption_key(
       kv::Version version, const std::vector<uint8_t>& raw_ledger_key) override
     {
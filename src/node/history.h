@@ -8,13 +8,17 @@
 #include "ds/logger.h"
 #include "entities.h"
 #include "kv/kvtypes.h"
+#include "merklestoreenclave.h"
 #include "nodes.h"
 #include "signatures.h"
 #include "tls/tls.h"
 #include "tls/verifier.h"
 
+#include <algorithm>
 #include <array>
 #include <deque>
+#include <map>
+#include <optional>
 #include <string.h>
 
 extern "C"
@@ -109,6 +113,8 @@ namespace ccf
 
     void append(const uint8_t* replicated, size_t replicated_size) override {}
 
+    void append(const crypto::Sha256Hash& digest) override {}
+
     bool verify(kv::Term* term = nullptr) override
     {
       return true;
@@ -193,6 +199,24 @@ namespace ccf
     {
       return true;
     }
+
+    std::vector<uint8_t> get_receipts(
+      const std::vector<kv::Version>& indices) override
+    {
+      return {};
+    }
+
+    bool verify_receipts(const std::vector<uint8_t>& v) override
+    {
+      return true;
+    }
+
+    std::vector<uint8_t> serialise_tree(kv::Version v) override
+    {
+      return {};
+    }
+
+    void deserialise_tree(const std::vector<uint8_t>& tree) override {}
   };
 
   class Receipt
@@ -272,10 +296,298 @@ namespace ccf
     }
   };
 
+  /** Proof that several leaves are in the tree, in which the nodes shared
+   * by their paths appear once (a Merkle multi-proof).
+   *
+   * Nodes are numbered as in a tree with max_index leaves where, at each
+   * level, the incomplete subtree on the right is the last node, and a last
+   * node without a sibling is carried up unchanged. This gives the same
+   * root as mt_get_root.
+   */
+  class MultiReceipt
+  {
+  public:
+    // Sorted, without duplicates
+    std::vector<uint64_t> indices;
+    uint32_t max_index = 0;
+    crypto::Sha256Hash root;
+    // Hashes of the leaves at indices
+    std::vector<crypto::Sha256Hash> leaves;
+    // Hashes of the nodes returned by get_proof_nodes, in order
+    std::vector<crypto::Sha256Hash> proof;
+
+    /** Positions of the nodes, other than the leaves, needed to compute the
+     * root from the leaves at indices
+     *
+     * @param indices Sorted indices, without duplicates
+     * @param max_index Number of leaves in the tree
+     */
+    static std::vector<MerkleNode> get_proof_nodes(
+      const std::vector<uint64_t>& indices, uint32_t max_index)
+    {
+      std::vector<MerkleNode> nodes;
+      auto level = indices;
+      uint64_t size = max_index;
+      for (uint32_t lv = 0; size > 1; ++lv, size = (size + 1) / 2)
+      {
+        std::vector<uint64_t> parents;
+        for (size_t n = 0; n < level.size(); ++n)
+        {
+          const auto x = level[n];
+          if (x % 2 == 1)
+          {
+            nodes.emplace_back(lv, x - 1);
+          }
+          else if (n + 1 < level.size() && level[n + 1] == x + 1)
+          {
+            ++n;
+          }
+          else if (x + 1 < size)
+          {
+            nodes.emplace_back(lv, x + 1);
+          }
+          parents.push_back(x / 2);
+        }
+        level = std::move(parents);
+      }
+      return nodes;
+    }
+
+    /** Root computed from the leaves and the proof
+     *
+     * @return Root, or nullopt if the receipt is malformed
+     */
+    std::optional<crypto::Sha256Hash> compute_root() const
+    {
+      if (
+        indices.empty() || leaves.size() != indices.size() ||
+        indices.back() >= max_index ||
+        !std::is_sorted(indices.begin(), indices.end()) ||
+        std::adjacent_find(indices.begin(), indices.end()) != indices.end())
+        return std::nullopt;
+
+      auto hash = [](crypto::Sha256Hash l, crypto::Sha256Hash r) {
+        crypto::Sha256Hash h;
+        hash_2(l.h.data(), r.h.data(), h.h.data());
+        return h;
+      };
+
+      auto level = indices;
+      auto hashes = leaves;
+      auto next_proof = proof.begin();
+      uint64_t size = max_index;
+      for (; size > 1; size = (size + 1) / 2)
+      {
+        std::vector<uint64_t> parents;
+        std::vector<crypto::Sha256Hash> parent_hashes;
+        for (size_t n = 0; n < level.size(); ++n)
+        {
+          const auto x = level[n];
+          if (x % 2 == 1)
+          {
+            if (next_proof == proof.end())
+              return std::nullopt;
+            parent_hashes.push_back(hash(*next_proof++, hashes[n]));
+          }
+          else if (n + 1 < level.size() && level[n + 1] == x + 1)
+          {
+            parent_hashes.push_back(hash(hashes[n], hashes[n + 1]));
+            ++n;
+          }
+          else if (x + 1 < size)
+          {
+            if (next_proof == proof.end())
+              return std::nullopt;
+            parent_hashes.push_back(hash(hashes[n], *next_proof++));
+          }
+          else
+          {
+            parent_hashes.push_back(hashes[n]);
+          }
+          parents.push_back(x / 2);
+        }
+        level = std::move(parents);
+        hashes = std::move(parent_hashes);
+      }
+
+      if (next_proof != proof.end())
+        return std::nullopt;
+
+      return hashes[0];
+    }
+
+    bool verify() const
+    {
+      const auto r = compute_root();
+      return r.has_value() && r.value() == root;
+    }
+
+    std::vector<uint8_t> to_v() const
+    {
+      const auto count = static_cast<uint32_t>(indices.size());
+      size_t vs = sizeof(count) + sizeof(uint64_t) * count + sizeof(max_index) +
+        root.h.size() * (1 + leaves.size() + proof.size());
+      std::vector<uint8_t> v(vs);
+      uint8_t* buf = v.data();
+      serialized::write(buf, vs, count);
+      for (auto index : indices)
+        serialized::write(buf, vs, index);
+      serialized::write(buf, vs, max_index);
+      serialized::write(buf, vs, root.h.data(), root.h.size());
+      for (const auto& h : leaves)
+        serialized::write(buf, vs, h.h.data(), h.h.size());
+      for (const auto& h : proof)
+        serialized::write(buf, vs, h.h.data(), h.h.size());
+      return v;
+    }
+
+    static MultiReceipt from_v(const std::vector<uint8_t>& v)
+    {
+      MultiReceipt r;
+      const uint8_t* buf = v.data();
+      size_t s = v.size();
+
+      auto read_hash = [&buf, &s]() {
+        crypto::Sha256Hash h;
+        auto bytes = serialized::read(buf, s, h.h.size());
+        std::copy(bytes.begin(), bytes.end(), h.h.begin());
+        return h;
+      };
+
+      const auto count = serialized::read<uint32_t>(buf, s);
+      if (count > s / (sizeof(uint64_t) + crypto::Sha256Hash::SIZE))
+        throw std::logic_error("Malformed multi-receipt");
+
+      for (uint32_t i = 0; i < count; ++i)
+        r.indices.push_back(serialized::read<uint64_t>(buf, s));
+      r.max_index = serialized::read<decltype(max_index)>(buf, s);
+      r.root = read_hash();
+      for (uint32_t i = 0; i < count; ++i)
+        r.leaves.push_back(read_hash());
+
+      if (s % crypto::Sha256Hash::SIZE != 0)
+        throw std::logic_error("Malformed multi-receipt");
+      while (s > 0)
+        r.proof.push_back(read_hash());
+
+      return r;
+    }
+  };
+
   class MerkleTreeHistory
   {
     merkle_tree* tree;
 
+    // A hash on the path of a receipt: either a node of the tree, or, on
+    // the right edge of the tree, the hash of the incomplete subtree at that
+    // level
+    struct PathHash
+    {
+      MerkleNode node;
+      bool rhs;
+    };
+
+    // Positions of the hashes that mt_get_path returns for index, which may
+    // have been flushed
+    std::vector<PathHash> get_path_hashes(uint64_t index) const
+    {
+      if (index < tree->offset || index - tree->offset >= tree->j)
+      {
+        throw std::logic_error("Precondition to mt_get_path violated");
+      }
+
+      uint32_t k = index - tree->offset;
+      uint32_t j = tree->j;
+      bool actd = false;
+
+      std::vector<PathHash> path = {{{0, k}, false}};
+      for (uint32_t lv = 0; j != 0; ++lv, k /= 2, j /= 2)
+      {
+        if (k % 2 == 1)
+        {
+          path.push_back({{lv, k - 1}, false});
+        }
+        else if (k + 1 == j)
+        {
+          if (actd)
+            path.push_back({{lv, 0}, true});
+        }
+        else if (k != j)
+        {
+          path.push_back({{lv, k + 1}, false});
+        }
+
+        if (j % 2 == 1)
+          actd = true;
+      }
+      return path;
+    }
+
+    // The tree only holds the nodes of each level from the offset of its
+    // first leaf, shifted to that level
+    uint32_t first_in_tree(uint32_t level) const
+    {
+      return offset_of(tree->i >> level);
+    }
+
+    bool in_tree(const MerkleNode& node) const
+    {
+      return node.second >= first_in_tree(node.first);
+    }
+
+    // Hash of a node of the tree, or of the incomplete subtree on the right
+    // of its level if rhs is set, taken from the tree or from the flushed
+    // nodes provided. The tree's root must have been computed beforehand.
+    const uint8_t* get_hash(
+      const MerkleNode& node,
+      bool rhs,
+      const std::map<MerkleNode, crypto::Sha256Hash>& flushed) const
+    {
+      if (rhs)
+        return tree->rhs.vs[node.first];
+
+      if (in_tree(node))
+      {
+        const auto& level = tree->hs.vs[node.first];
+        return level.vs[node.second - first_in_tree(node.first)];
+      }
+
+      auto search = flushed.find(node);
+      if (search == flushed.end())
+      {
+        throw std::logic_error(fmt::format(
+          "Missing flushed node {} at level {}", node.second, node.first));
+      }
+      return search->second.h.data();
+    }
+
+    // Positions of the leaves at indices and of the nodes of their
+    // multi-proof, and whether each is the incomplete subtree on the right
+    // of its level
+    std::vector<PathHash> get_multi_path_hashes(
+      const std::vector<uint64_t>& indices) const
+    {
+      std::vector<PathHash> path;
+      for (auto index : indices)
+      {
+        if (index < tree->offset || index - tree->offset >= tree->j)
+          throw std::logic_error("Index is not in the tree");
+        path.push_back({{0, index - tree->offset}, false});
+      }
+
+      std::vector<uint64_t> positions;
+      for (const auto& p : path)
+        positions.push_back(p.node.second);
+
+      for (const auto& node :
+           MultiReceipt::get_proof_nodes(positions, tree->j))
+      {
+        const bool rhs = node.second == (tree->j >> node.first);
+        path.push_back({node, rhs});
+      }
+      return path;
+    }
+
   public:
     MerkleTreeHistory(MerkleTreeHistory const&) = delete;
 
@@ -306,6 +618,12 @@ namespace ccf
       mt_insert(tree, h);
     }
 
+    void append(const std::vector<crypto::Sha256Hash>& hashes)
+    {
+      for (const auto& hash : hashes)
+        append(hash);
+    }
+
     crypto::Sha256Hash get_root() const
     {
       crypto::Sha256Hash res;
@@ -334,6 +652,38 @@ namespace ccf
       mt_flush_to(tree, index);
     }
 
+    /** Nodes that flush(index) drops from the tree
+     *
+     * @return For each level, the position of the first node dropped, and
+     * the hashes of the nodes dropped
+     */
+    std::vector<std::pair<MerkleNode, std::vector<crypto::Sha256Hash>>>
+    get_flushed(uint64_t index) const
+    {
+      std::vector<std::pair<MerkleNode, std::vector<crypto::Sha256Hash>>>
+        flushed;
+      if (!mt_flush_to_pre(tree, index))
+        return flushed;
+
+      const uint32_t i = index - tree->offset;
+      for (uint32_t lv = 0; lv < tree->hs.sz; ++lv)
+      {
+        const auto first = first_in_tree(lv);
+        const auto end = offset_of(i >> lv);
+        if (first == end)
+          break;
+
+        std::vector<crypto::Sha256Hash> hashes(end - first);
+        for (uint32_t n = 0; n < hashes.size(); ++n)
+        {
+          const auto h = tree->hs.vs[lv].vs[n];
+          std::copy(h, h + crypto::Sha256Hash::SIZE, hashes[n].h.begin());
+        }
+        flushed.emplace_back(MerkleNode{lv, first}, std::move(hashes));
+      }
+      return flushed;
+    }
+
     void retract(uint64_t index)
     {
       if (!mt_retract_to_pre(tree, index))
@@ -348,6 +698,96 @@ namespace ccf
       return Receipt(tree, index);
     }
 
+    /** Nodes on the path of the receipt for index that have been flushed
+     * from the tree
+     */
+    std::vector<MerkleNode> get_flushed_path(uint64_t index) const
+    {
+      std::vector<MerkleNode> flushed;
+      for (const auto& p : get_path_hashes(index))
+      {
+        if (!p.rhs && !in_tree(p.node))
+          flushed.push_back(p.node);
+      }
+      return flushed;
+    }
+
+    /** Receipt for index, as serialised by Receipt::to_v, for which the
+     * nodes flushed from the tree are provided
+     *
+     * @param index Index of the leaf
+     * @param flushed Hashes of the nodes returned by get_flushed_path
+     */
+    std::vector<uint8_t> get_receipt(
+      uint64_t index, const std::map<MerkleNode, crypto::Sha256Hash>& flushed)
+    {
+      const auto path = get_path_hashes(index);
+      // Also computes the hashes of the incomplete subtrees on the path
+      const auto root = get_root();
+      const uint32_t max_index = tree->j;
+
+      size_t vs = sizeof(index) + sizeof(max_index) + root.h.size() +
+        (root.h.size() * path.size());
+      std::vector<uint8_t> v(vs);
+      uint8_t* buf = v.data();
+      serialized::write(buf, vs, index);
+      serialized::write(buf, vs, max_index);
+      serialized::write(buf, vs, root.h.data(), root.h.size());
+      for (const auto& p : path)
+      {
+        serialized::write(
+          buf, vs, get_hash(p.node, p.rhs, flushed), root.h.size());
+      }
+      return v;
+    }
+
+    /** Nodes of the multi-receipt for indices that have been flushed from
+     * the tree
+     *
+     * @param indices Sorted indices, without duplicates
+     */
+    std::vector<MerkleNode> get_flushed_path(
+      const std::vector<uint64_t>& indices) const
+    {
+      std::vector<MerkleNode> flushed;
+      for (const auto& p : get_multi_path_hashes(indices))
+      {
+        if (!p.rhs && !in_tree(p.node))
+          flushed.push_back(p.node);
+      }
+      return flushed;
+    }
+
+    /** Multi-receipt for indices, for which the nodes flushed from the tree
+     * are provided
+     *
+     * @param indices Sorted indices, without duplicates
+     * @param flushed Hashes of the nodes returned by get_flushed_path
+     */
+    MultiReceipt get_multi_receipt(
+      const std::vector<uint64_t>& indices,
+      const std::map<MerkleNode, crypto::Sha256Hash>& flushed)
+    {
+      const auto path = get_multi_path_hashes(indices);
+      MultiReceipt r;
+      r.indices = indices;
+      // Also computes the hashes of the incomplete subtrees
+      r.root = get_root();
+      r.max_index = tree->j;
+
+      for (size_t n = 0; n < path.size(); ++n)
+      {
+        crypto::Sha256Hash h;
+        const auto p = get_hash(path[n].node, path[n].rhs, flushed);
+        std::copy(p, p + h.SIZE, h.h.begin());
+        if (n < indices.size())
+          r.leaves.push_back(h);
+        else
+          r.proof.push_back(h);
+      }
+      return r;
+    }
+
     bool verify(const Receipt& r)
     {
       return r.verify(tree);
@@ -360,6 +800,26 @@ namespace ccf
       mt_serialize(tree, output.data(), output.capacity());
       return output;
     }
+
+    std::vector<uint8_t> serialise(uint64_t index)
+    {
+      // Serialise the tree as it was when index was its last leaf, leaving
+      // this tree untouched
+      MerkleTreeHistory retracted(serialise());
+      retracted.retract(index);
+      return retracted.serialise();
+    }
+
+    void deserialise(const std::vector<uint8_t>& serialised)
+    {
+      auto t = mt_deserialize(serialised.data(), serialised.size());
+      if (t == nullptr)
+      {
+        throw std::logic_error("Could not deserialise merkle tree");
+      }
+      mt_free(tree);
+      tree = t;
+    }
   };
 
   template <class T>
@@ -375,6 +835,10 @@ namespace ccf
 
     std::shared_ptr<kv::Consensus> consensus;
 
+    // Host store that nodes flushed from the tree are written to, and read
+    // back from for receipts
+    std::shared_ptr<MerkleStoreEnclave> merkle_store;
+
     std::map<RequestID, std::vector<uint8_t>> requests;
     std::map<RequestID, std::pair<kv::Version, crypto::Sha256Hash>> results;
     std::map<RequestID, std::vector<uint8_t>> responses;
@@ -428,6 +892,11 @@ namespace ccf
       id = id_;
     }
 
+    void set_merkle_store(std::shared_ptr<MerkleStoreEnclave> merkle_store_)
+    {
+      merkle_store = merkle_store_;
+    }
+
     crypto::Sha256Hash get_replicated_state_root() override
     {
       return replicated_state_tree.get_root();
@@ -445,6 +914,12 @@ namespace ccf
       replicated_state_tree.append(rh);
     }
 
+    void append(const crypto::Sha256Hash& digest) override
+    {
+      log_hash(digest, APPEND);
+      replicated_state_tree.append(digest);
+    }
+
     bool verify(kv::Term* term = nullptr) override
     {
       Store::Tx tx;
@@ -488,6 +963,12 @@ namespace ccf
     {
       if (v > MAX_HISTORY_LEN)
       {
+        if (merkle_store)
+        {
+          for (const auto& [first, hashes] :
+               replicated_state_tree.get_flushed(v - MAX_HISTORY_LEN))
+            merkle_store->put(first, hashes);
+        }
         replicated_state_tree.flush(v - MAX_HISTORY_LEN);
       }
       log_hash(replicated_state_tree.get_root(), COMPACT);
@@ -659,9 +1140,70 @@ namespace ccf
       responses[id] = response;
     }
 
+    // Hashes of nodes flushed from the tree, read from the host's store
+    MerkleStoreEnclave::Nodes read_flushed(
+      const std::vector<MerkleNode>& flushed)
+    {
+      if (!merkle_store)
+        throw std::logic_error("History has been flushed from the tree");
+
+      const auto nodes = merkle_store->get(flushed);
+      if (!nodes.has_value())
+        throw kv::ReceiptPending("Reading flushed history from the host");
+
+      return nodes.value();
+    }
+
     std::vector<uint8_t> get_receipt(kv::Version index) override
     {
-      return replicated_state_tree.get_receipt(index).to_v();
+      const auto flushed = replicated_state_tree.get_flushed_path(index);
+      if (flushed.empty())
+        return replicated_state_tree.get_receipt(index).to_v();
+
+      // The host is not trusted with the nodes it returns
+      auto v = replicated_state_tree.get_receipt(index, read_flushed(flushed));
+      auto r = Receipt::from_v(v);
+      if (!replicated_state_tree.verify(r))
+      {
+        merkle_store->evict(flushed);
+        throw std::logic_error(
+          "History read from the host does not match the root");
+      }
+      return v;
+    }
+
+    std::vector<uint8_t> get_receipts(
+      const std::vector<kv::Version>& indices) override
+    {
+      std::vector<uint64_t> sorted(indices.begin(), indices.end());
+      std::sort(sorted.begin(), sorted.end());
+      sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+      const auto flushed = replicated_state_tree.get_flushed_path(sorted);
+      if (flushed.empty())
+        return replicated_state_tree.get_multi_receipt(sorted, {}).to_v();
+
+      auto r =
+        replicated_state_tree.get_multi_receipt(sorted, read_flushed(flushed));
+      if (!r.verify())
+      {
+        merkle_store->evict(flushed);
+        throw std::logic_error(
+          "History read from the host does not match the root");
+      }
+      return r.to_v();
+    }
+
+    std::vector<uint8_t> serialise_tree(kv::Version v) override
+    {
+      return replicated_state_tree.serialise(v);
+    }
+
+    void deserialise_tree(const std::vector<uint8_t>& tree) override
+    {
+      replicated_state_tree.deserialise(tree);
+      LOG_DEBUG_FMT(
+        "History deserialised with root {}", replicated_state_tree.get_root());
     }
 
     bool verify_receipt(const std::vector<uint8_t>& v) override
@@ -669,6 +1211,11 @@ namespace ccf
       auto r = Receipt::from_v(v);
       return replicated_state_tree.verify(r);
     }
+
+    bool verify_receipts(const std::vector<uint8_t>& v) override
+    {
+      return MultiReceipt::from_v(v).verify();
+    }
   };
 
   using MerkleTxHistory = HashedTxHistory<MerkleTreeHistory>;
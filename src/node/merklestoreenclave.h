@@ -0,0 +1,264 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "crypto/hash.h"
+#include "ds/logger.h"
+#include "ds/serialized.h"
+#include "ds/spinlock.h"
+#include "merklestoretypes.h"
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <optional>
+#include <set>
+#include <vector>
+
+namespace ccf
+{
+  /** Enclave side of the host's Merkle store (see asynchost::MerkleStore).
+   *
+   * Nodes flushed from the in-enclave Merkle tree are written to the host,
+   * and read back on demand to produce receipts for flushed transactions.
+   * Nodes read from the host are not trusted: the receipts built from them
+   * must be verified against the in-enclave root before they are returned.
+   *
+   * The nodes of each lookup are gathered apart from the cache until they
+   * have all been read, so that lookups of more nodes than the cache holds
+   * complete. Only the most recent lookups are kept, since their callers
+   * may give up on them.
+   */
+  class MerkleStoreEnclave
+  {
+  public:
+    using Nodes = std::map<MerkleNode, crypto::Sha256Hash>;
+
+    // Number of nodes read from the host that are kept in the enclave
+    static constexpr size_t MAX_CACHED_NODES = 4096;
+
+    // Number of incomplete lookups whose nodes are kept until they complete
+    static constexpr size_t MAX_GATHERS = 4;
+
+    // Maximum number of nodes requested from the host in one message
+    static constexpr size_t MAX_NODES_PER_READ = 1024;
+
+  private:
+    ringbuffer::WriterPtr to_host;
+
+    SpinLock lock;
+    uint64_t next_token = 0;
+    // Nodes requested from the host, by token
+    std::map<uint64_t, std::vector<MerkleNode>> in_flight;
+    std::set<MerkleNode> requested;
+    // Nodes that the host reported missing from its store
+    std::set<MerkleNode> unavailable;
+
+    Nodes cache;
+    std::deque<MerkleNode> cache_order;
+
+    // Nodes of an incomplete lookup, found so far and still awaited
+    struct Gather
+    {
+      Nodes found;
+      std::set<MerkleNode> pending;
+    };
+    std::map<std::vector<MerkleNode>, Gather> gathers;
+    std::deque<std::vector<MerkleNode>> gather_order;
+
+    void insert_unsafe(const MerkleNode& node, const crypto::Sha256Hash& hash)
+    {
+      for (auto& [nodes, g] : gathers)
+      {
+        if (g.pending.erase(node) > 0)
+          g.found.emplace(node, hash);
+      }
+
+      if (!cache.emplace(node, hash).second)
+        return;
+
+      cache_order.push_back(node);
+      while (cache_order.size() > MAX_CACHED_NODES)
+      {
+        cache.erase(cache_order.front());
+        cache_order.pop_front();
+      }
+    }
+
+    Gather& start_gather_unsafe(const std::vector<MerkleNode>& nodes)
+    {
+      Gather g;
+      for (const auto& n : nodes)
+      {
+        auto it = cache.find(n);
+        if (it != cache.end())
+          g.found.emplace(n, it->second);
+        else
+          g.pending.insert(n);
+      }
+
+      gather_order.push_back(nodes);
+      while (gather_order.size() > MAX_GATHERS)
+      {
+        gathers.erase(gather_order.front());
+        gather_order.pop_front();
+      }
+
+      return gathers.emplace(nodes, std::move(g)).first->second;
+    }
+
+    void end_gather_unsafe(const std::vector<MerkleNode>& nodes)
+    {
+      gathers.erase(nodes);
+      gather_order.erase(
+        std::find(gather_order.begin(), gather_order.end(), nodes));
+    }
+
+    void request_unsafe(const std::vector<MerkleNode>& missing)
+    {
+      for (size_t i = 0; i < missing.size(); i += MAX_NODES_PER_READ)
+      {
+        const auto end = std::min(i + MAX_NODES_PER_READ, missing.size());
+        std::vector<MerkleNode> nodes(
+          missing.begin() + i, missing.begin() + end);
+
+        std::vector<uint8_t> body(
+          nodes.size() * (sizeof(uint32_t) + sizeof(uint64_t)));
+        auto p = body.data();
+        auto size = body.size();
+        for (const auto& n : nodes)
+        {
+          serialized::write(p, size, n.first);
+          serialized::write(p, size, n.second);
+          requested.insert(n);
+        }
+
+        const auto token = next_token++;
+        in_flight.emplace(token, std::move(nodes));
+        RINGBUFFER_WRITE_MESSAGE(ccf::merkle_get, to_host, token, body);
+      }
+    }
+
+  public:
+    MerkleStoreEnclave(ringbuffer::AbstractWriterFactory& writer_factory) :
+      to_host(writer_factory.create_writer_to_outside())
+    {}
+
+    /** Write consecutive nodes of one level to the host
+     *
+     * @param first Position of the first node
+     * @param hashes Hashes of the nodes
+     */
+    void put(
+      const MerkleNode& first, const std::vector<crypto::Sha256Hash>& hashes)
+    {
+      std::vector<uint8_t> data(hashes.size() * crypto::Sha256Hash::SIZE);
+      auto p = data.data();
+      for (const auto& h : hashes)
+      {
+        std::copy(h.h.begin(), h.h.end(), p);
+        p += crypto::Sha256Hash::SIZE;
+      }
+
+      RINGBUFFER_WRITE_MESSAGE(
+        ccf::merkle_append, to_host, first.first, first.second, data);
+    }
+
+    /** Look up nodes read from the host
+     *
+     * The nodes that have not been read yet are requested from the host.
+     *
+     * @param nodes Positions of the nodes
+     *
+     * @return Hashes of the nodes, or nullopt if some of them have not been
+     * read yet, in which case this should be called again later with the
+     * same nodes
+     */
+    std::optional<Nodes> get(const std::vector<MerkleNode>& nodes)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+
+      auto search = gathers.find(nodes);
+      auto& g = (search != gathers.end()) ? search->second :
+                                            start_gather_unsafe(nodes);
+
+      std::vector<MerkleNode> missing;
+      for (const auto& n : g.pending)
+      {
+        if (unavailable.erase(n) > 0)
+        {
+          end_gather_unsafe(nodes);
+          throw std::logic_error(fmt::format(
+            "Merkle tree node {} at level {} is not in the host's store",
+            n.second,
+            n.first));
+        }
+
+        if (requested.find(n) == requested.end())
+          missing.push_back(n);
+      }
+
+      if (g.pending.empty())
+      {
+        auto found = std::move(g.found);
+        end_gather_unsafe(nodes);
+        return found;
+      }
+
+      request_unsafe(missing);
+      return std::nullopt;
+    }
+
+    /** Receive nodes requested from the host
+     *
+     * @param token Token of the request
+     * @param data Hashes of the requested nodes, in order
+     * @param size Size of data, 0 if the nodes are not in the host's store
+     */
+    void recv_nodes(uint64_t token, const uint8_t* data, size_t size)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+
+      auto search = in_flight.find(token);
+      if (search == in_flight.end())
+        return;
+
+      auto nodes = std::move(search->second);
+      in_flight.erase(search);
+
+      const bool found = size == nodes.size() * crypto::Sha256Hash::SIZE;
+      if (!found)
+      {
+        LOG_FAIL_FMT(
+          "{} Merkle tree nodes are not in the host's store", nodes.size());
+      }
+
+      for (const auto& n : nodes)
+      {
+        requested.erase(n);
+
+        if (!found)
+        {
+          unavailable.insert(n);
+          continue;
+        }
+
+        crypto::Sha256Hash h;
+        std::copy(data, data + h.SIZE, h.h.begin());
+        data += h.SIZE;
+        insert_unsafe(n, h);
+      }
+    }
+
+    /** Drop nodes read from the host, so that they are read again
+     *
+     * @param nodes Positions of the nodes
+     */
+    void evict(const std::vector<MerkleNode>& nodes)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      for (const auto& n : nodes)
+        cache.erase(n);
+    }
+  };
+}
@@ -0,0 +1,45 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "ds/ringbuffer_types.h"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace ccf
+{
+  /// Position of a node in the Merkle tree: its level (0 for leaves) and its
+  /// index in that level
+  using MerkleNode = std::pair<uint32_t, uint64_t>;
+
+  /// Merkle store related ringbuffer messages
+  enum : ringbuffer::Message
+  {
+    /// Store the nodes flushed from the in-enclave Merkle tree for one
+    /// level. Enclave -> Host
+    DEFINE_RINGBUFFER_MSG_TYPE(merkle_append),
+
+    /// Request nodes from the Merkle store. Enclave -> Host
+    DEFINE_RINGBUFFER_MSG_TYPE(merkle_get),
+
+    /// Respond to merkle_get with the requested nodes, empty if any of them
+    /// is not in the store. Host -> Enclave
+    DEFINE_RINGBUFFER_MSG_TYPE(merkle_nodes),
+  };
+}
+
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  ccf::merkle_append,
+  uint32_t /* level */,
+  uint64_t /* first index */,
+  std::vector<uint8_t> /* hashes */);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  ccf::merkle_get,
+  uint64_t /* token */,
+  std::vector<uint8_t> /* serialised MerkleNodes */);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  ccf::merkle_nodes,
+  uint64_t /* token */,
+  std::vector<uint8_t> /* hashes */);
@@ -7,6 +7,7 @@
 #include "consensus/pbft/pbft.h"
 #include "consensus/raft/raftconsensus.h"
 #include "crypto/cryptobox.h"
+#include "deserialisepipeline.h"
 #include "ds/logger.h"
 #include "enclave/rpcsessions.h"
 #include "encryptor.h"
@@ -24,6 +25,7 @@
 #include "seal.h"
 #include "secretshare.h"
 #include "sharemanager.h"
+#include "snapshotter.h"
 #include "timer.h"
 #include "tls/25519.h"
 #include "tls/client.h"
@@ -167,6 +169,8 @@ namespace ccf
     ringbuffer::AbstractWriterFactory& writer_factory;
     ringbuffer::WriterPtr to_host;
     consensus::Config consensus_config;
+    // Last ledger entry that the host has made durable
+    std::atomic<consensus::Index> ledger_durable_idx{0};
 
     NetworkState& network;
 
@@ -180,10 +184,17 @@ namespace ccf
 
     std::shared_ptr<kv::TxHistory> history;
     std::shared_ptr<kv::AbstractTxEncryptor> encryptor;
+    std::shared_ptr<MerkleStoreEnclave> merkle_store;
 
     std::shared_ptr<Seal> seal;
     ShareManager share_manager;
 
+    //
+    // snapshots
+    //
+    std::shared_ptr<Snapshotter> snapshotter;
+    size_t snapshot_tx_interval = 0;
+
     //
     // join protocol
     //
@@ -203,6 +214,22 @@ namespace ccf
 
     consensus::Index ledger_idx = 0;
 
+    // Entries are read from the host ahead of being applied, in ranges of
+    // ledger_read_range entries, as long as fewer than max_ledger_read_ahead
+    // entries are waiting to be applied. They are decoded in parallel by
+    // recovery_pipeline.
+    static constexpr size_t ledger_read_range = 256;
+    static constexpr size_t max_ledger_read_ahead = 4096;
+
+    DeserialisePipeline recovery_pipeline;
+    // Identifies the current read, so that replies to earlier reads are
+    // ignored
+    uint64_t ledger_read_token = 0;
+    consensus::Index ledger_read_idx = 0;
+    bool ledger_read_in_flight = false;
+    // Index after the last entry in the ledger, once known
+    std::optional<consensus::Index> ledger_end_idx;
+
   public:
     NodeState(
       ringbuffer::AbstractWriterFactory& writer_factory,
@@ -220,8 +247,12 @@ namespace ccf
       rpcsessions(rpcsessions),
       notifier(notifier),
       timers(timers),
+      merkle_store(std::make_shared<MerkleStoreEnclave>(writer_factory)),
       seal(std::make_shared<Seal>(writer_factory)),
-      share_manager(network)
+      share_manager(network),
+      recovery_pipeline([this](consensus::Index idx, auto decoded) {
+        recover_ledger_entry(idx, std::move(decoded));
+      })
     {
       ::EverCrypt_AutoConfig2_init();
     }
@@ -257,6 +288,8 @@ namespace ccf
       create_node_cert(args.config);
       open_node_frontend();
 
+      snapshot_tx_interval = args.config.snapshot_tx_interval;
+
 #ifdef GET_QUOTE
       auto quote_opt = get_quote();
       if (!quote_opt.has_value())
@@ -279,6 +312,7 @@ namespace ccf
           setup_encryptor(network.consensus_type);
           setup_consensus(network.consensus_type, args.config);
           setup_history();
+          setup_snapshotter();
 
           // Become the primary and force replication
           consensus->force_become_primary();
@@ -427,6 +461,17 @@ namespace ccf
             setup_consensus(resp.consensus_type, args.config, resp.public_only);
             setup_history();
 
+            if (!resp.public_only)
+            {
+              // If the host has a snapshot, start from it rather than from
+              // the beginning of the ledger. Otherwise, or if the snapshot
+              // cannot be used, the whole ledger is replayed.
+              if (!args.config.joining.snapshot.empty())
+                install_snapshot(args.config.joining.snapshot);
+
+              setup_snapshotter();
+            }
+
             open_member_frontend();
 
             accept_network_tls_connections(args.config);
@@ -511,19 +556,17 @@ namespace ccf
       std::lock_guard<SpinLock> guard(lock);
       sm.expect(State::readingPublicLedger);
       LOG_INFO_FMT("Start public recovery");
-      read_ledger_idx(++ledger_idx);
+      start_reading_ledger_unsafe();
     }
 
-    void recover_public_ledger_entry(const std::vector<uint8_t>& ledger_entry)
+    void recover_public_ledger_entry_unsafe(Store::DecodedTx& ledger_entry)
     {
-      std::lock_guard<SpinLock> guard(lock);
       sm.expect(State::readingPublicLedger);
 
-      LOG_DEBUG_FMT(
-        "Deserialising public ledger entry ({})", ledger_entry.size());
+      LOG_DEBUG_FMT("Deserialising public ledger entry {}", ledger_idx);
 
       // When reading the public ledger, deserialise in the real store
-      auto result = network.tables->deserialise(ledger_entry, true);
+      auto result = network.tables->apply(ledger_entry);
       if (result == kv::DeserialiseSuccess::FAILED)
       {
         LOG_FAIL_FMT("Failed to deserialise entry in public ledger");
@@ -554,13 +597,12 @@ namespace ccf
           throw std::logic_error("Invalid signature");
         }
       }
-
-      read_ledger_idx(++ledger_idx);
     }
 
     void recover_public_ledger_end_unsafe()
     {
       sm.expect(State::readingPublicLedger);
+      stop_reading_ledger_unsafe();
 
       // When reaching the end of the public ledger, truncate to last signed
       // index and promote network secrets to this index
@@ -636,16 +678,14 @@ namespace ccf
     //
     // funcs in state "readingPrivateLedger"
     //
-    void recover_private_ledger_entry(const std::vector<uint8_t>& ledger_entry)
+    void recover_private_ledger_entry_unsafe(Store::DecodedTx& ledger_entry)
     {
-      std::lock_guard<SpinLock> guard(lock);
       sm.expect(State::readingPrivateLedger);
 
-      LOG_INFO_FMT(
-        "Deserialising private ledger entry ({})", ledger_entry.size());
+      LOG_DEBUG_FMT("Deserialising private ledger entry {}", ledger_idx);
 
       // When reading the private ledger, deserialise in the recovery store
-      auto result = recovery_store->deserialise(ledger_entry);
+      auto result = recovery_store->apply(ledger_entry);
       if (result == kv::DeserialiseSuccess::FAILED)
       {
         LOG_FAIL_FMT("Failed to deserialise entry in private ledger");
@@ -662,15 +702,12 @@ namespace ccf
         LOG_INFO_FMT("Reached recovery final version at {}", recovery_v);
         recover_private_ledger_end_unsafe();
       }
-      else
-      {
-        read_ledger_idx(++ledger_idx);
-      }
     }
 
     void recover_private_ledger_end_unsafe()
     {
       sm.expect(State::readingPrivateLedger);
+      stop_reading_ledger_unsafe();
 
       // When reaching the end of the private ledger, make sure the same
       // ledger has been read and swap in private state
@@ -720,10 +757,8 @@ namespace ccf
     //
     // funcs in state "readingPublicLedger" or "readingPrivateLedger"
     //
-    void recover_ledger_end()
+    void recover_ledger_end_unsafe()
     {
-      std::lock_guard<SpinLock> guard(lock);
-
       if (is_reading_public_ledger())
       {
         recover_public_ledger_end_unsafe();
@@ -740,6 +775,91 @@ namespace ccf
       }
     }
 
+    /** Receive entries read ahead from the ledger
+     *
+     * @param token Token of the read these entries are for
+     * @param from Index of the first entry
+     * @param data Framed entries, none if from is past the end of the ledger
+     * @param size Size of the framed entries
+     */
+    void recv_ledger_entries(
+      uint64_t token, consensus::Index from, const uint8_t* data, size_t size)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+
+      if (token != ledger_read_token)
+        return;
+
+      if (from != ledger_read_idx)
+      {
+        throw std::logic_error(fmt::format(
+          "Received ledger entries from {}, expected {}",
+          from,
+          ledger_read_idx));
+      }
+
+      ledger_read_in_flight = false;
+
+      if (size == 0)
+      {
+        ledger_end_idx = ledger_read_idx;
+
+        // All the entries in the ledger may have been applied already
+        if (ledger_idx + 1 == ledger_read_idx)
+          recover_ledger_end_unsafe();
+        return;
+      }
+
+      const bool public_only = is_reading_public_ledger();
+      auto store = public_only ? network.tables : recovery_store;
+
+      while (size > 0)
+      {
+        auto entry_size = serialized::read<uint32_t>(data, size);
+        // The size is checked against the message before the entry is copied
+        const auto entry_start = data;
+        serialized::skip(data, size, entry_size);
+        std::vector<uint8_t> entry(entry_start, entry_start + entry_size);
+
+        recovery_pipeline.submit(store, std::move(entry), public_only);
+        ++ledger_read_idx;
+      }
+
+      read_ledger_ahead_unsafe();
+    }
+
+    // Called by recovery_pipeline, for each entry in order
+    void recover_ledger_entry(
+      consensus::Index idx, std::unique_ptr<Store::DecodedTx> ledger_entry)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+
+      ledger_idx = idx;
+      const auto token = ledger_read_token;
+
+      if (is_reading_public_ledger())
+        recover_public_ledger_entry_unsafe(*ledger_entry);
+      else if (is_reading_private_ledger())
+        recover_private_ledger_entry_unsafe(*ledger_entry);
+      else
+      {
+        LOG_FAIL_FMT("Cannot recover ledger entry: Unexpected state");
+        return;
+      }
+
+      // Recovery may have ended with this entry
+      if (token != ledger_read_token)
+        return;
+
+      if (ledger_end_idx.has_value() && idx + 1 == ledger_end_idx.value())
+      {
+        recover_ledger_end_unsafe();
+        return;
+      }
+
+      read_ledger_ahead_unsafe();
+    }
+
     //
     // funcs in state "partOfPublicNetwork"
     //
@@ -752,12 +872,14 @@ namespace ccf
         recovery_store->get<Signatures>(Tables::SIGNATURES);
       Nodes* recovery_nodes_map = recovery_store->get<Nodes>(Tables::NODES);
 
-      recovery_history = std::make_shared<MerkleTxHistory>(
+      auto recovery_merkle_history = std::make_shared<MerkleTxHistory>(
         *recovery_store.get(),
         self,
         *node_sign_kp,
         *recovery_signature_map,
         *recovery_nodes_map);
+      recovery_merkle_history->set_merkle_store(merkle_store);
+      recovery_history = recovery_merkle_history;
 
 #ifdef USE_NULL_ENCRYPTOR
       recovery_encryptor = std::make_shared<NullTxEncryptor>();
@@ -843,7 +965,7 @@ namespace ccf
 
         // Start reading private security domain of ledger
         ledger_idx = 0;
-        read_ledger_idx(++ledger_idx);
+        start_reading_ledger_unsafe();
 
         sm.advance(State::readingPrivateLedger);
       }
@@ -873,7 +995,7 @@ namespace ccf
 
       // Start reading private security domain of ledger
       ledger_idx = 0;
-      read_ledger_idx(++ledger_idx);
+      start_reading_ledger_unsafe();
 
       sm.advance(State::readingPrivateLedger);
       return true;
@@ -953,6 +1075,22 @@ namespace ccf
       return sm.check(State::partOfPublicNetwork);
     }
 
+    void set_ledger_durable_idx(consensus::Index idx)
+    {
+      LOG_DEBUG_FMT("Ledger durable up to {}", idx);
+      ledger_durable_idx = idx;
+    }
+
+    void recv_merkle_nodes(uint64_t token, const uint8_t* data, size_t size)
+    {
+      merkle_store->recv_nodes(token, data, size);
+    }
+
+    consensus::Index get_ledger_durable_idx() const
+    {
+      return ledger_durable_idx;
+    }
+
     std::optional<std::vector<uint8_t>> get_quote()
     {
       std::vector<uint8_t> q;
@@ -1362,7 +1500,7 @@ namespace ccf
 
       // Start reading private security domain of ledger
       ledger_idx = 0;
-      read_ledger_idx(++ledger_idx);
+      start_reading_ledger_unsafe();
 
       sm.advance(State::readingPrivateLedger);
     }
@@ -1482,8 +1620,7 @@ namespace ccf
       setup_cmd_forwarder();
 
       auto raft = std::make_unique<RaftType>(
-        std::make_unique<raft::Adaptor<Store, kv::DeserialiseSuccess>>(
-          network.tables),
+        std::make_unique<BatchDecodingAdaptor>(network.tables),
         std::make_unique<consensus::LedgerEnclave>(writer_factory),
         n2n_channels,
         self,
@@ -1550,16 +1687,155 @@ namespace ccf
     {
       // This function can be called once the node has started up and before
       // it has joined the service.
-      history = std::make_shared<MerkleTxHistory>(
+      auto merkle_history = std::make_shared<MerkleTxHistory>(
         *network.tables.get(),
         self,
         *node_sign_kp,
         network.signatures,
         network.nodes);
+      merkle_history->set_merkle_store(merkle_store);
+      history = merkle_history;
 
       network.tables->set_history(history);
     }
 
+    void setup_snapshotter()
+    {
+      // Snapshots are only supported with Raft, since they rely on Raft
+      // signature transactions being the only globally committable versions
+      if (
+        network.consensus_type != ConsensusType::RAFT ||
+        snapshot_tx_interval == 0)
+        return;
+
+      snapshotter = std::make_shared<Snapshotter>(
+        writer_factory,
+        network.tables,
+        {network.identity->priv_key},
+        self,
+        snapshot_tx_interval);
+      snapshotter->set_last_snapshot_idx(network.tables->commit_version());
+
+      network.tables->set_snapshotter(snapshotter);
+    }
+
+    std::optional<kv::Term> verify_snapshot(const SignedSnapshot& ss)
+    {
+      // The snapshot must be signed with the identity of the network this
+      // node has joined, rather than by a node listed in the snapshot, which
+      // would let anyone produce a snapshot vouching for itself
+      auto d = ss.digest();
+      auto network_verifier = tls::make_verifier(network.identity->cert);
+      if (!network_verifier->verify_hash(
+            d.h.data(), d.h.size(), ss.sig.data(), ss.sig.size()))
+      {
+        LOG_FAIL_FMT(
+          "Snapshot at {} (from node {}) is not signed by the network",
+          ss.version,
+          ss.signer);
+        return {};
+      }
+
+      // The snapshot is then installed in a separate store, without any of
+      // the hooks of the network tables, so that its content can be checked
+      // before the node state is modified
+      auto snapshot_store = std::make_shared<Store>();
+      snapshot_store->clone_schema(*network.tables);
+      snapshot_store->set_encryptor(encryptor);
+
+      if (
+        snapshot_store->deserialise_snapshot(ss.store) ==
+        kv::DeserialiseSuccess::FAILED)
+      {
+        LOG_FAIL_FMT("Snapshot at {} could not be deserialised", ss.version);
+        return {};
+      }
+
+      if (snapshot_store->current_version() != ss.version)
+      {
+        LOG_FAIL_FMT(
+          "Snapshot at {} contains store at {}",
+          ss.version,
+          snapshot_store->current_version());
+        return {};
+      }
+
+      Store::Tx tx;
+      auto [sig_tv, ni_tv] = tx.get_view(
+        *snapshot_store->get<Signatures>(Tables::SIGNATURES),
+        *snapshot_store->get<Nodes>(Tables::NODES));
+
+      // Snapshots are taken at globally committed signature transactions, so
+      // the latest signature is the one at the snapshot version
+      auto sig = sig_tv->get(0);
+      if (!sig.has_value() || (kv::Version)sig->index != ss.version)
+      {
+        LOG_FAIL_FMT("No signature at snapshot version {}", ss.version);
+        return {};
+      }
+
+      auto sig_node = ni_tv->get(sig->node);
+      if (!sig_node.has_value())
+      {
+        LOG_FAIL_FMT("Unknown signature node {}", sig->node);
+        return {};
+      }
+
+      // The signature transaction signs the root of the tree before it is
+      // appended itself
+      MerkleTreeHistory tree(ss.tree);
+      MerkleTreeHistory signed_tree(tree.serialise(ss.version - 1));
+      auto root = signed_tree.get_root();
+      auto sig_verifier = tls::make_verifier(sig_node->cert);
+      if (
+        root != sig->root ||
+        !sig_verifier->verify_hash(
+          root.h.data(), root.h.size(), sig->sig.data(), sig->sig.size()))
+      {
+        LOG_FAIL_FMT("Snapshot at {} tree does not match", ss.version);
+        return {};
+      }
+
+      return sig->term;
+    }
+
+    void install_snapshot(const std::vector<uint8_t>& data)
+    {
+      SignedSnapshot ss;
+      try
+      {
+        ss = SignedSnapshot::deserialise(data);
+      }
+      catch (const std::exception& e)
+      {
+        LOG_FAIL_FMT("Snapshot could not be parsed: {}", e.what());
+        return;
+      }
+
+      auto term = verify_snapshot(ss);
+      if (!term.has_value())
+      {
+        LOG_FAIL_FMT("Ignoring snapshot at {}", ss.version);
+        return;
+      }
+
+      // From here, the state of the node is modified and the snapshot must
+      // be installed
+      if (
+        network.tables->deserialise_snapshot(ss.store) ==
+        kv::DeserialiseSuccess::FAILED)
+      {
+        throw std::logic_error(fmt::format(
+          "Verified snapshot at {} could not be installed", ss.version));
+      }
+
+      history->deserialise_tree(ss.tree);
+      consensus->init_as_backup(ss.version, term.value());
+
+      LOG_INFO_FMT(
+        "Installed snapshot at {} (term {})", ss.version, term.value());
+    }
+
     void setup_encryptor(ConsensusType consensus_type)
     {
       // This function makes use of network secrets and should be called once
@@ -1625,9 +1901,38 @@ namespace ccf
       }
     }
 
-    void read_ledger_idx(consensus::Index idx)
+    // Read the ledger from the entry after ledger_idx
+    void start_reading_ledger_unsafe()
     {
-      RINGBUFFER_WRITE_MESSAGE(consensus::ledger_get, to_host, idx);
+      ++ledger_read_token;
+      ledger_read_idx = ledger_idx + 1;
+      ledger_read_in_flight = false;
+      ledger_end_idx.reset();
+      recovery_pipeline.start(ledger_read_idx);
+      read_ledger_ahead_unsafe();
+    }
+
+    // Ignore the entries read or decoded ahead, that will not be applied
+    void stop_reading_ledger_unsafe()
+    {
+      ++ledger_read_token;
+      recovery_pipeline.reset();
+    }
+
+    void read_ledger_ahead_unsafe()
+    {
+      if (
+        ledger_read_in_flight || ledger_end_idx.has_value() ||
+        recovery_pipeline.pending() >= max_ledger_read_ahead)
+        return;
+
+      RINGBUFFER_WRITE_MESSAGE(
+        consensus::ledger_get_range,
+        to_host,
+        ledger_read_token,
+        ledger_read_idx,
+        ledger_read_idx + ledger_read_range - 1);
+      ledger_read_in_flight = true;
     }
 
     void ledger_truncate(consensus::Index idx)
@@ -7,6 +7,7 @@
 #include "node/nodes.h"
 #include "nodecalltypes.h"
 
+#include <map>
 #include <nlohmann/json.hpp>
 
 namespace ccf
@@ -36,10 +37,19 @@ namespace ccf
       nlohmann::json buckets = {};
     };
 
+    struct LatencyResults
+    {
+      HistogramResults execute;
+      HistogramResults commit;
+      HistogramResults global_commit;
+    };
+
     struct Out
     {
       HistogramResults histogram;
       nlohmann::json tx_rates;
+      // By method, for the methods that have been called
+      std::map<std::string, LatencyResults> latencies;
     };
   };
 
@@ -136,4 +146,33 @@ namespace ccf
       bool valid = false;
     };
   };
+
+  struct GetReceipts
+  {
+    // Maximum number of commits in one request
+    static constexpr size_t max_commits = 1024;
+
+    struct In
+    {
+      std::vector<int64_t> commits = {};
+    };
+
+    struct Out
+    {
+      std::vector<std::uint8_t> receipt = {};
+    };
+  };
+
+  struct VerifyReceipts
+  {
+    struct In
+    {
+      std::vector<std::uint8_t> receipt = {};
+    };
+
+    struct Out
+    {
+      bool valid = false;
+    };
+  };
 }
\ No newline at end of file
@@ -35,7 +35,8 @@ namespace ccf
     {
       HandlerRegistry::init_handlers(t);
 
-      auto get_commit = [this](Store::Tx& tx, nlohmann::json&& params) {
+      auto get_commit = [this](
+                          Store::ReadOnlyTx& tx, nlohmann::json&& params) {
         GetCommit::In in{};
         if (!params.is_null())
         {
@@ -57,9 +58,27 @@ namespace ccf
 
       auto get_metrics = [this](Store::Tx& tx, nlohmann::json&& params) {
         auto result = metrics.get_metrics();
+        for_each_handler([&result](const std::string& method, Handler& h) {
+          auto latencies = h.latencies->get_results();
+          if (latencies.has_value())
+            result.latencies[method] = latencies.value();
+        });
         return make_success(result);
       };
 
+      auto get_prometheus_metrics = [this](RequestArgs& args) {
+        std::stringstream ss;
+        metrics::Latencies::write_prometheus_header(ss);
+        for_each_handler([&ss](const std::string& method, Handler& h) {
+          h.latencies->write_prometheus(method, ss);
+        });
+
+        args.rpc_ctx->set_response_status(HTTP_STATUS_OK);
+        args.rpc_ctx->set_response_header(
+          http::headers::CONTENT_TYPE, http::headervalues::contenttype::TEXT);
+        args.rpc_ctx->set_response_body(ss.str());
+      };
+
       auto make_signature = [this](Store::Tx& tx, nlohmann::json&& params) {
         if (consensus != nullptr)
         {
@@ -198,6 +217,15 @@ namespace ccf
 
             return make_success(out);
           }
+          catch (const kv::ReceiptPending& e)
+          {
+            return make_error(
+              HTTP_STATUS_SERVICE_UNAVAILABLE,
+              fmt::format(
+                "Receipt for commit {} is not available yet, retry later: {}",
+                in.commit,
+                e.what()));
+          }
           catch (const std::exception& e)
           {
             return make_error(
@@ -237,6 +265,75 @@ namespace ccf
           HTTP_STATUS_INTERNAL_SERVER_ERROR, "Unable to verify receipt");
       };
 
+      auto get_receipts = [this](Store::Tx& tx, nlohmann::json&& params) {
+        const auto in = params.get<GetReceipts::In>();
+
+        if (in.commits.empty())
+        {
+          return make_error(
+            HTTP_STATUS_BAD_REQUEST, "At least one commit must be given");
+        }
+
+        if (in.commits.size() > GetReceipts::max_commits)
+        {
+          return make_error(
+            HTTP_STATUS_BAD_REQUEST,
+            fmt::format(
+              "At most {} commits can be given", GetReceipts::max_commits));
+        }
+
+        if (history != nullptr)
+        {
+          try
+          {
+            auto p = history->get_receipts(in.commits);
+            const GetReceipts::Out out{p};
+
+            return make_success(out);
+          }
+          catch (const kv::ReceiptPending& e)
+          {
+            return make_error(
+              HTTP_STATUS_SERVICE_UNAVAILABLE,
+              fmt::format(
+                "Receipts are not available yet, retry later: {}", e.what()));
+          }
+          catch (const std::exception& e)
+          {
+            return make_error(
+              HTTP_STATUS_INTERNAL_SERVER_ERROR,
+              fmt::format("Unable to produce receipts: {}", e.what()));
+          }
+        }
+
+        return make_error(
+          HTTP_STATUS_INTERNAL_SERVER_ERROR, "Unable to produce receipts");
+      };
+
+      auto verify_receipts = [this](Store::Tx& tx, nlohmann::json&& params) {
+        const auto in = params.get<VerifyReceipts::In>();
+
+        if (history != nullptr)
+        {
+          try
+          {
+            bool v = history->verify_receipts(in.receipt);
+            const VerifyReceipts::Out out{v};
+
+            return make_success(out);
+          }
+          catch (const std::exception& e)
+          {
+            return make_error(
+              HTTP_STATUS_INTERNAL_SERVER_ERROR,
+              fmt::format("Unable to verify receipts: {}", e.what()));
+          }
+        }
+
+        return make_error(
+          HTTP_STATUS_INTERNAL_SERVER_ERROR, "Unable to verify receipts");
+      };
+
       install_with_auto_schema<GetCommit>(
         GeneralProcs::GET_COMMIT, json_adapter(get_commit), Read);
       install_with_auto_schema<void, GetMetrics::Out>(
@@ -245,6 +342,14 @@ namespace ccf
         Read,
         false, // does not require client signature
         true); // executed locally
+      install(
+        GeneralProcs::GET_PROMETHEUS_METRICS,
+        get_prometheus_metrics,
+        Read,
+        nlohmann::json::object(),
+        nlohmann::json::object(),
+        false, // does not require client signature
+        true); // executed locally
       install_with_auto_schema<void, bool>(
         GeneralProcs::MK_SIGN, json_adapter(make_signature), Write);
       install_with_auto_schema<void, WhoAmI::Out>(
@@ -263,6 +368,10 @@ namespace ccf
         GeneralProcs::GET_RECEIPT, json_adapter(get_receipt), Read);
       install_with_auto_schema<VerifyReceipt>(
         GeneralProcs::VERIFY_RECEIPT, json_adapter(verify_receipt), Read);
+      install_with_auto_schema<GetReceipts>(
+        GeneralProcs::GET_RECEIPTS, json_adapter(get_receipts), Read);
+      install_with_auto_schema<VerifyReceipts>(
+        GeneralProcs::VERIFY_RECEIPTS, json_adapter(verify_receipts), Read);
     }
 
     void tick(std::chrono::milliseconds elapsed, size_t tx_count) override
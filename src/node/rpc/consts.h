@@ -9,6 +9,7 @@ namespace ccf
   {
     static constexpr auto GET_COMMIT = "getCommit";
     static constexpr auto GET_METRICS = "getMetrics";
+    static constexpr auto GET_PROMETHEUS_METRICS = "getPrometheusMetrics";
     static constexpr auto MK_SIGN = "mkSign";
     static constexpr auto GET_PRIMARY_INFO = "getPrimaryInfo";
     static constexpr auto GET_NETWORK_INFO = "getNetworkInfo";
@@ -18,6 +19,8 @@ namespace ccf
     static constexpr auto GET_SCHEMA = "getSchema";
     static constexpr auto GET_RECEIPT = "getReceipt";
     static constexpr auto VERIFY_RECEIPT = "verifyReceipt";
+    static constexpr auto GET_RECEIPTS = "getReceipts";
+    static constexpr auto VERIFY_RECEIPTS = "verifyReceipts";
   };
 
   struct MemberProcs
@@ -7,6 +7,7 @@
 #include "consts.h"
 #include "ds/buffer.h"
 #include "ds/spinlock.h"
+#include "ds/thread_messaging.h"
 #include "enclave/rpchandler.h"
 #include "forwarder.h"
 #include "node/clientsignatures.h"
@@ -33,6 +34,18 @@ namespace ccf
       request_storing_disabled = true;
     }
 
+    /** Spread incoming RPCs across all worker threads, rather than processing
+     * them on the thread of the session they were received on.
+     *
+     * Handlers are executed optimistically and retried if they conflict, so
+     * they must not rely on being executed one at a time per session. See
+     * HandlerRegistry::declare_access.
+     */
+    void enable_parallel_execution()
+    {
+      parallel_execution = true;
+    }
+
     virtual std::string invalid_caller_error_message() const
     {
       return "Could not find matching actor certificate";
@@ -40,6 +53,7 @@ namespace ccf
 
   private:
     std::map<CallerId, tls::VerifierPtr> verifiers;
+    SpinLock verifiers_lock;
     SpinLock lock;
     bool is_open_ = false;
 
@@ -48,6 +62,7 @@ namespace ccf
     pbft::RequestsMap* pbft_requests_map;
     kv::Consensus* consensus;
     std::shared_ptr<enclave::AbstractForwarder> cmd_forwarder;
+    std::shared_ptr<enclave::AbstractRPCResponder> rpcresponder;
     kv::TxHistory* history;
 
     size_t sig_max_tx = 1000;
@@ -55,6 +70,9 @@ namespace ccf
     std::chrono::milliseconds sig_max_ms = std::chrono::milliseconds(1000);
     std::chrono::milliseconds ms_to_sig = std::chrono::milliseconds(1000);
     bool request_storing_disabled = false;
+    bool parallel_execution = false;
+    TxScheduler scheduler;
+    metrics::GlobalCommitLatencies global_commit_latencies;
 
     void update_consensus()
     {
@@ -73,6 +91,65 @@ namespace ccf
       handlers.set_history(history);
     }
 
+    struct ReadIndexMsg
+    {
+      RpcFrontend* frontend;
+      std::shared_ptr<enclave::RpcContext> ctx;
+      bool reached;
+    };
+
+    static void read_index_cb(std::unique_ptr<enclave::Tmsg<ReadIndexMsg>> msg)
+    {
+      auto& d = msg->data;
+      d.ctx->read_index = d.reached ? enclave::ReadIndexState::Reached :
+                                      enclave::ReadIndexState::Failed;
+
+      auto rep = d.frontend->process(d.ctx);
+      if (rep.has_value())
+      {
+        d.frontend->rpcresponder->reply_async(
+          d.ctx->session->client_session_id, rep.value());
+      }
+    }
+
+    /** Whether a read on a backup can be executed now
+     *
+     * Reads that ask to be linearizable are executed once the local commit
+     * index reaches the primary's, at which point they are processed again.
+     * If the consensus cannot establish that, they are forwarded instead.
+     */
+    bool read_index_reached(std::shared_ptr<enclave::RpcContext> ctx)
+    {
+      const auto linearizable =
+        ctx->get_request_header(http::headers::CCF_LINEARIZABLE);
+      if (!linearizable.has_value() || linearizable.value() != "true")
+      {
+        return true;
+      }
+
+      if (
+        ctx->read_index == enclave::ReadIndexState::None &&
+        rpcresponder != nullptr)
+      {
+        ctx->read_index = enclave::ReadIndexState::Pending;
+        const bool waiting = consensus->read_index([this, ctx](bool reached) {
+          auto msg = std::make_unique<enclave::Tmsg<ReadIndexMsg>>(
+            &read_index_cb);
+          msg->data.frontend = this;
+          msg->data.ctx = ctx;
+          msg->data.reached = reached;
+          enclave::ThreadMessaging::thread_messaging.add_task<ReadIndexMsg>(
+            enclave::ThreadMessaging::main_thread, std::move(msg));
+        });
+        if (!waiting)
+        {
+          ctx->read_index = enclave::ReadIndexState::Failed;
+        }
+      }
+
+      return ctx->read_index == enclave::ReadIndexState::Reached;
+    }
+
     std::optional<nlohmann::json> forward_or_redirect_json(
       std::shared_ptr<enclave::RpcContext> ctx)
     {
@@ -130,14 +207,20 @@ namespace ccf
         return false;
       }
 
-      auto v = verifiers.find(caller_id);
-      if (v == verifiers.end())
+      tls::Verifier* verifier = nullptr;
       {
-        std::vector<uint8_t> caller_cert(caller);
-        verifiers.emplace(
-          std::make_pair(caller_id, tls::make_verifier(caller_cert)));
+        std::lock_guard<SpinLock> guard(verifiers_lock);
+        auto v = verifiers.find(caller_id);
+        if (v == verifiers.end())
+        {
+          std::vector<uint8_t> caller_cert(caller);
+          auto new_verifier = tls::make_verifier(caller_cert);
+          v = verifiers.emplace(caller_id, std::move(new_verifier)).first;
+        }
+        verifier = v->second.get();
       }
-      if (!verifiers[caller_id]->verify(
+
+      if (!verifier->verify(
             signed_request.req, signed_request.sig, signed_request.md))
       {
         return false;
@@ -188,6 +271,12 @@ namespace ccf
       cmd_forwarder = cmd_forwarder_;
     }
 
+    void set_rpc_responder(
+      std::shared_ptr<enclave::AbstractRPCResponder> rpcresponder_) override
+    {
+      rpcresponder = rpcresponder_;
+    }
+
     void open() override
     {
       std::lock_guard<SpinLock> mguard(lock);
@@ -206,6 +295,9 @@ namespace ccf
      *
      * If an RPC that requires writing to the kv store is processed on a
      * backup, the serialised RPC is forwarded to the current network primary.
+     * Linearizable reads on a backup are either forwarded, or processed again
+     * once the backup has caught up with the primary, and their response is
+     * then sent to the session.
      *
      * @param ctx Context for this RPC
      * @returns nullopt if the result is pending (to be forwarded, or still
@@ -226,7 +318,10 @@ namespace ccf
       }
       else
       {
-        caller_id = handlers.valid_caller(tx, ctx->session->caller_cert);
+        // Every RPC looks up its caller, so this does not wait for commits
+        // to the certs table
+        Store::ReadOnlyTx ro_tx;
+        caller_id = handlers.valid_caller(ro_tx, ctx->session->caller_cert);
       }
 
       if (!caller_id.has_value())
@@ -304,6 +399,14 @@ namespace ccf
       {
         auto rep = process_command(ctx, tx, caller_id.value());
 
+        // Linearizable reads waiting for the read index are processed later
+        if (
+          !rep.has_value() &&
+          ctx->read_index == enclave::ReadIndexState::Pending)
+        {
+          return std::nullopt;
+        }
+
         // If necessary, forward the RPC to the current primary
         if (!rep.has_value())
         {
@@ -329,6 +432,35 @@ namespace ccf
       }
     }
 
+    std::optional<uint16_t> schedule(
+      std::shared_ptr<enclave::RpcContext> ctx, uint16_t num_workers) override
+    {
+      if (!parallel_execution || num_workers == 0)
+      {
+        return std::nullopt;
+      }
+
+      // Only RPCs executed by a Raft primary, or without consensus, are
+      // scheduled. Others are forwarded, or ordered by PBFT.
+      update_consensus();
+      if (
+        consensus != nullptr &&
+        (consensus->type() != ConsensusType::RAFT || !consensus->is_primary()))
+      {
+        return std::nullopt;
+      }
+
+      const auto method = ctx->get_method();
+      const auto local_method = method.substr(method.find_first_not_of('/'));
+      auto handler = handlers.find_handler(local_method);
+      if (handler == nullptr)
+      {
+        return std::nullopt;
+      }
+
+      return scheduler.pick_worker(handler->access, num_workers);
+    }
+
     virtual std::vector<uint8_t> get_cert_to_forward(
       std::shared_ptr<enclave::RpcContext> ctx)
     {
@@ -483,6 +615,15 @@ namespace ccf
             {
               return forward_or_redirect_json(ctx);
             }
+            if (!read_index_reached(ctx))
+            {
+              if (ctx->read_index == enclave::ReadIndexState::Pending)
+              {
+                return std::nullopt;
+              }
+              ctx->session->is_forwarded = true;
+              return forward_or_redirect_json(ctx);
+            }
             break;
           }
 
@@ -505,13 +646,23 @@ namespace ccf
             {
               return forward_or_redirect_json(ctx);
             }
+            else if (!read_index_reached(ctx))
+            {
+              if (ctx->read_index == enclave::ReadIndexState::Pending)
+              {
+                return std::nullopt;
+              }
+              ctx->session->is_forwarded = true;
+              return forward_or_redirect_json(ctx);
+            }
             break;
           }
         }
       }
 
       auto func = handler->func;
-      auto args = RequestArgs{ctx, tx, caller_id};
+      Store::ReadOnlyTx ro_tx;
+      auto args = RequestArgs{ctx, tx, ro_tx, caller_id};
 
       tx_count++;
 
@@ -519,20 +670,46 @@ namespace ccf
       {
         try
         {
+          tracing::record(ctx->trace_id, tracing::Stage::Execute);
+          auto start = metrics::Latencies::Clock::now();
           func(args);
+          auto executed = metrics::Latencies::Clock::now();
+          handler->latencies->record(
+            metrics::Latencies::Execute, executed - start);
 
           if (ctx->response_is_error())
           {
             return ctx->serialise_response();
           }
 
-          switch (tx.commit())
+          tracing::record(ctx->trace_id, tracing::Stage::Commit);
+          kv::CommitSuccess result;
+          {
+            tracing::Scope trace_scope(ctx->trace_id);
+            result = tx.commit();
+          }
+          handler->latencies->record(
+            metrics::Latencies::Commit,
+            metrics::Latencies::Clock::now() - executed);
+
+          switch (result)
           {
             case kv::CommitSuccess::OK:
             {
+              scheduler.record_commit(handler->access);
+
+              if (consensus != nullptr && tx.commit_version() > 0)
+              {
+                global_commit_latencies.start(
+                  tx.commit_version(), handler->latencies);
+              }
+
               auto cv = tx.commit_version();
+              tracing::record(ctx->trace_id, tracing::Stage::Committed, cv);
               if (cv == 0)
                 cv = tx.get_read_version();
+              if (cv == kv::NoVersion)
+                cv = ro_tx.get_read_version();
               if (cv == kv::NoVersion)
                 cv = tables.current_version();
               ctx->set_response_header(http::headers::CCF_COMMIT, cv);
@@ -564,6 +741,7 @@ namespace ccf
 
             case kv::CommitSuccess::CONFLICT:
             {
+              scheduler.record_conflict(handler->access);
               break;
             }
 
@@ -610,6 +788,12 @@ namespace ccf
       update_consensus();
 
       handlers.tick(elapsed, tx_count);
+      scheduler.tick(elapsed);
+
+      if (consensus != nullptr)
+      {
+        global_commit_latencies.global_commit(consensus->get_commit_seqno());
+      }
 
       // reset tx_counter for next tick interval
       tx_count = 0;
@@ -4,8 +4,10 @@
 
 #include "ds/json_schema.h"
 #include "enclave/rpccontext.h"
+#include "metrics.h"
 #include "node/certs.h"
 #include "serialization.h"
+#include "txscheduler.h"
 
 #include <functional>
 #include <nlohmann/json.hpp>
@@ -16,6 +18,7 @@ namespace ccf
   {
     std::shared_ptr<enclave::RpcContext> rpc_ctx;
     Store::Tx& tx;
+    Store::ReadOnlyTx& ro_tx;
     CallerId caller_id;
   };
 
@@ -39,6 +42,9 @@ namespace ccf
       nlohmann::json result_schema;
       bool require_client_signature = false;
       bool execute_locally = false;
+      std::optional<MapAccess> access = std::nullopt;
+      std::shared_ptr<metrics::Latencies> latencies =
+        std::make_shared<metrics::Latencies>();
     };
 
   protected:
@@ -144,6 +150,30 @@ namespace ccf
         method, std::forward<Ts>(ts)...);
     }
 
+    /** Declare the maps read and written by an installed HandleFunction
+     *
+     * This is optional. Frontends executing transactions in parallel use it to
+     * keep transactions that frequently conflict on the same worker.
+     *
+     * @param method Method name
+     * @param reads Names of the maps the method may read
+     * @param writes Names of the maps the method may write
+     */
+    void declare_access(
+      const std::string& method,
+      std::set<std::string> reads,
+      std::set<std::string> writes)
+    {
+      auto search = handlers.find(method);
+      if (search == handlers.end())
+      {
+        throw std::logic_error(
+          fmt::format("Cannot declare access of unknown method {}", method));
+      }
+
+      search->second.access = MapAccess{std::move(reads), std::move(writes)};
+    }
+
     /** Set a default HandleFunction
      *
      * The default HandleFunction is only invoked if no specific HandleFunction
@@ -171,6 +201,25 @@ namespace ccf
       }
     }
 
+    /** Call f on each installed handler, including the default handler
+     *
+     * @param f Called with the method name of each handler, "default" for the
+     * default handler
+     */
+    template <typename F>
+    void for_each_handler(F&& f)
+    {
+      for (auto& [method, handler] : handlers)
+      {
+        f(method, handler);
+      }
+
+      if (default_handler)
+      {
+        f("default", default_handler.value());
+      }
+    }
+
     virtual void init_handlers(Store& tables) {}
 
     virtual Handler* find_handler(const std::string& method)
@@ -191,7 +240,7 @@ namespace ccf
     virtual void tick(std::chrono::milliseconds elapsed, size_t tx_count) {}
 
     virtual std::optional<CallerId> valid_caller(
-      Store::Tx& tx, const std::vector<uint8_t>& caller)
+      Store::ReadOnlyTx& tx, const std::vector<uint8_t>& caller)
     {
       if (certs == nullptr)
       {
@@ -204,7 +253,7 @@ namespace ccf
       }
 
       auto certs_view = tx.get_view(*certs);
-      auto caller_id = certs_view->get(caller);
+      auto caller_id = certs_view.get(caller);
 
       return caller_id;
     }
@@ -60,6 +60,9 @@ namespace ccf
    *      return make_success(result);
    *    }
    * });
+   *
+   * Handlers which only read the store can take a Store::ReadOnlyTx& instead,
+   * so that their reads do not wait for the commits to the maps they read.
    */
 
   namespace details
@@ -274,6 +277,19 @@ namespace ccf
     };
   }
 
+  using ReadOnlyHandlerJsonParamsOnly =
+    std::function<details::JsonAdapterResponse(
+      Store::ReadOnlyTx& tx, nlohmann::json&& params)>;
+
+  static HandleFunction json_adapter(const ReadOnlyHandlerJsonParamsOnly& f)
+  {
+    return [f](RequestArgs& args) {
+      auto [packing, params] = details::get_json_params(args.rpc_ctx);
+      details::set_response(
+        f(args.ro_tx, std::move(params)), args.rpc_ctx, packing);
+    };
+  }
+
   using HandlerJsonParamsAndCallerId =
     std::function<details::JsonAdapterResponse(
       Store::Tx& tx, CallerId caller_id, nlohmann::json&& params)>;
@@ -4,17 +4,310 @@
 
 #include "ds/histogram.h"
 #include "ds/logger.h"
+#include "ds/spinlock.h"
+#include "ds/thread_messaging.h"
+#include "kv/kvtypes.h"
 #include "serialization.h"
 
+#include <array>
+#include <atomic>
+#include <deque>
+#include <memory>
 #include <nlohmann/json.hpp>
+#include <optional>
+#include <sstream>
 
 #define HIST_MAX (1 << 17)
 #define HIST_MIN 1
 #define HIST_BUCKET_GRANULARITY 5
 #define TX_RATE_BUCKETS_LEN 4000
 
+#define LATENCY_MAX (1 << 24)
+#define LATENCY_MIN 1
+#define LATENCY_BUCKET_GRANULARITY 3
+
 namespace metrics
 {
+  template <class H>
+  ccf::GetMetrics::HistogramResults to_results(H& histogram)
+  {
+    ccf::GetMetrics::HistogramResults result;
+    result.low = histogram.get_low();
+    result.high = histogram.get_high();
+    result.overflow = histogram.get_overflow();
+    result.underflow = histogram.get_underflow();
+    auto range_counts = histogram.get_range_count();
+    nlohmann::json buckets;
+    for (auto const& e : range_counts)
+    {
+      const auto count = e.second;
+      if (count > 0)
+      {
+        buckets.push_back(e);
+      }
+    }
+    result.buckets = buckets;
+    return result;
+  }
+
+  /** Latencies, in microseconds, of the stages of the RPCs to one handler:
+   * - execute: running the handler, including parsing its parameters
+   * - commit: committing its transaction to the kv, which hands the
+   * transaction to consensus for replication
+   * - global_commit: from the kv commit until the transaction is globally
+   * committed, measured at the granularity of the frontend's ticks
+   *
+   * Each thread records into its own histograms, which are merged on read.
+   * Merges may run concurrently with recording, and are then snapshots that
+   * may miss the latencies being recorded (see histogram.h).
+   */
+  class Latencies
+  {
+  public:
+    enum Stage
+    {
+      Execute = 0,
+      Commit,
+      GlobalCommit,
+      NumStages
+    };
+
+    static constexpr std::array<const char*, NumStages> stage_names = {
+      "execute", "commit", "global_commit"};
+
+    using Clock = std::chrono::steady_clock;
+    using Hist = histogram::
+      Histogram<uint64_t, LATENCY_MIN, LATENCY_MAX, LATENCY_BUCKET_GRANULARITY>;
+
+  private:
+    std::array<histogram::Global<Hist>, NumStages> globals = {
+      histogram::Global<Hist>(stage_names[Execute], __FILE__, __LINE__),
+      histogram::Global<Hist>(stage_names[Commit], __FILE__, __LINE__),
+      histogram::Global<Hist>(stage_names[GlobalCommit], __FILE__, __LINE__)};
+
+    struct Local
+    {
+      Hist execute;
+      Hist commit;
+      Hist global_commit;
+
+      // Sums of the recorded latencies, by stage. Only written by the
+      // thread owning this, which is why they do not need to be
+      // incremented atomically.
+      std::array<std::atomic<uint64_t>, NumStages> sums = {};
+
+      Local(Latencies& l) :
+        execute(l.globals[Execute]),
+        commit(l.globals[Commit]),
+        global_commit(l.globals[GlobalCommit])
+      {}
+
+      Hist& get(Stage stage)
+      {
+        switch (stage)
+        {
+          case Execute:
+            return execute;
+          case Commit:
+            return commit;
+          default:
+            return global_commit;
+        }
+      }
+    };
+
+    // Indexed by thread, and only allocated by the thread itself
+    std::array<
+      std::atomic<Local*>,
+      enclave::ThreadMessaging::max_num_threads>
+      locals = {};
+
+    Local& get_local()
+    {
+      const auto tid = thread_ids[std::this_thread::get_id()];
+      auto& slot = locals[tid % locals.size()];
+      auto local = slot.load(std::memory_order_acquire);
+      if (local == nullptr)
+      {
+        local = new Local(*this);
+        slot.store(local, std::memory_order_release);
+      }
+      return *local;
+    }
+
+  public:
+    Latencies() = default;
+    Latencies(const Latencies&) = delete;
+
+    ~Latencies()
+    {
+      for (auto& slot : locals)
+        delete slot.load();
+    }
+
+    void record(Stage stage, Clock::duration d)
+    {
+      const auto us =
+        std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+      auto& local = get_local();
+      local.get(stage).record(us);
+      auto& sum = local.sums[stage];
+      sum.store(
+        sum.load(std::memory_order_relaxed) + us, std::memory_order_relaxed);
+    }
+
+    Hist merge(Stage stage)
+    {
+      Hist result;
+      globals[stage].merge(result);
+      return result;
+    }
+
+    uint64_t sum(Stage stage)
+    {
+      uint64_t result = 0;
+      for (auto& slot : locals)
+      {
+        auto local = slot.load(std::memory_order_acquire);
+        if (local != nullptr)
+          result += local->sums[stage].load(std::memory_order_relaxed);
+      }
+      return result;
+    }
+
+    /** Get the merged histograms of all stages
+     *
+     * @return nullopt if nothing has been recorded
+     */
+    std::optional<ccf::GetMetrics::LatencyResults> get_results()
+    {
+      auto execute = merge(Execute);
+      if (execute.get_low() > execute.get_high())
+        return std::nullopt;
+
+      ccf::GetMetrics::LatencyResults result;
+      result.execute = to_results(execute);
+      auto commit = merge(Commit);
+      result.commit = to_results(commit);
+      auto global_commit = merge(GlobalCommit);
+      result.global_commit = to_results(global_commit);
+      return result;
+    }
+
+    /** Write the metadata of the latency histograms in the Prometheus text
+     * format, once before the histograms of all handlers
+     *
+     * @param ss Stream to write to
+     */
+    static void write_prometheus_header(std::stringstream& ss)
+    {
+      ss << "# HELP ccf_rpc_latency_microseconds Latency of the stages of "
+            "RPCs, by method\n"
+         << "# TYPE ccf_rpc_latency_microseconds histogram\n";
+    }
+
+    /** Write the histograms of all stages in the Prometheus text format,
+     * unless nothing has been recorded. All buckets are written, including
+     * empty ones, so that the same series are exported by every scrape.
+     *
+     * @param method Method of the handler, used as a label
+     * @param ss Stream to write to
+     */
+    void write_prometheus(const std::string& method, std::stringstream& ss)
+    {
+      std::array<Hist, NumStages> hists = {
+        merge(Execute), merge(Commit), merge(GlobalCommit)};
+      if (hists[Execute].get_low() > hists[Execute].get_high())
+        return;
+
+      for (size_t s = 0; s < NumStages; ++s)
+      {
+        auto& h = hists[s];
+        const auto labels =
+          fmt::format("method=\"{}\",stage=\"{}\"", method, stage_names[s]);
+
+        // Buckets are cumulative, and values below the lowest bucket (under
+        // a microsecond) are in all of them
+        size_t total = h.get_underflow();
+        ss << fmt::format(
+          "ccf_rpc_latency_microseconds_bucket{{{},le=\"{}\"}} {}\n",
+          labels,
+          LATENCY_MIN - 1,
+          total);
+        for (size_t i = 0; i < h.get_buckets(); ++i)
+        {
+          // Values from LATENCY_MAX are counted as overflow, not in the
+          // buckets above it
+          if (h.get_range(i).first >= LATENCY_MAX)
+            break;
+
+          total += h.get_count(i);
+          ss << fmt::format(
+            "ccf_rpc_latency_microseconds_bucket{{{},le=\"{}\"}} {}\n",
+            labels,
+            h.get_range(i).second,
+            total);
+        }
+        total += h.get_overflow();
+        ss << fmt::format(
+          "ccf_rpc_latency_microseconds_bucket{{{},le=\"+Inf\"}} {}\n",
+          labels,
+          total);
+        ss << fmt::format(
+          "ccf_rpc_latency_microseconds_sum{{{}}} {}\n",
+          labels,
+          sum(static_cast<Stage>(s)));
+        ss << fmt::format(
+          "ccf_rpc_latency_microseconds_count{{{}}} {}\n", labels, total);
+      }
+    }
+  };
+
+  /** Records the global commit latency of transactions, once consensus
+   * reports them globally committed
+   */
+  class GlobalCommitLatencies
+  {
+  public:
+    // Transactions committed while this many are pending are not measured
+    static constexpr size_t max_pending = 4096;
+
+  private:
+    struct Pending
+    {
+      kv::Version version;
+      Latencies::Clock::time_point committed_at;
+      std::shared_ptr<Latencies> latencies;
+    };
+
+    SpinLock lock;
+    std::deque<Pending> pending;
+
+  public:
+    void start(kv::Version version, std::shared_ptr<Latencies> latencies)
+    {
+      const auto now = Latencies::Clock::now();
+      std::lock_guard<SpinLock> guard(lock);
+      if (pending.size() < max_pending)
+        pending.push_back({version, now, latencies});
+    }
+
+    void global_commit(kv::Version version)
+    {
+      const auto now = Latencies::Clock::now();
+      std::lock_guard<SpinLock> guard(lock);
+
+      // Versions are committed by worker threads concurrently, so they are
+      // only roughly in order
+      while (!pending.empty() && pending.front().version <= version)
+      {
+        auto& p = pending.front();
+        p.latencies->record(Latencies::GlobalCommit, now - p.committed_at);
+        pending.pop_front();
+      }
+    }
+  };
+
   class Metrics
   {
   private:
@@ -31,23 +324,7 @@ namespace metrics
 
     ccf::GetMetrics::HistogramResults get_histogram_results()
     {
-      ccf::GetMetrics::HistogramResults result;
-      result.low = histogram.get_low();
-      result.high = histogram.get_high();
-      result.overflow = histogram.get_overflow();
-      result.underflow = histogram.get_underflow();
-      auto range_counts = histogram.get_range_count();
-      nlohmann::json buckets;
-      for (auto const& e : range_counts)
-      {
-        const auto count = e.second;
-        if (count > 0)
-        {
-          buckets.push_back(e);
-        }
-      }
-      result.buckets = buckets;
-      return result;
+      return to_results(histogram);
     }
 
     nlohmann::json get_tx_rates()
@@ -74,9 +351,9 @@ namespace metrics
   public:
     ccf::GetMetrics::Out get_metrics()
     {
-      nlohmann::json result;
-      result["histogram"] = get_histogram_results();
-      result["tx_rates"] = get_tx_rates();
+      ccf::GetMetrics::Out result;
+      result.histogram = get_histogram_results();
+      result.tx_rates = get_tx_rates();
 
       return result;
     }
@@ -76,8 +76,11 @@ namespace ccf
   DECLARE_JSON_TYPE(GetMetrics::HistogramResults)
   DECLARE_JSON_REQUIRED_FIELDS(
     GetMetrics::HistogramResults, low, high, overflow, underflow, buckets)
+  DECLARE_JSON_TYPE(GetMetrics::LatencyResults)
+  DECLARE_JSON_REQUIRED_FIELDS(
+    GetMetrics::LatencyResults, execute, commit, global_commit)
   DECLARE_JSON_TYPE(GetMetrics::Out)
-  DECLARE_JSON_REQUIRED_FIELDS(GetMetrics::Out, histogram, tx_rates)
+  DECLARE_JSON_REQUIRED_FIELDS(GetMetrics::Out, histogram, tx_rates, latencies)
 
   DECLARE_JSON_TYPE(GetPrimaryInfo::Out)
   DECLARE_JSON_REQUIRED_FIELDS(
@@ -111,4 +114,14 @@ namespace ccf
   DECLARE_JSON_REQUIRED_FIELDS(VerifyReceipt::In, receipt)
   DECLARE_JSON_TYPE(VerifyReceipt::Out)
   DECLARE_JSON_REQUIRED_FIELDS(VerifyReceipt::Out, valid)
+
+  DECLARE_JSON_TYPE(GetReceipts::In)
+  DECLARE_JSON_REQUIRED_FIELDS(GetReceipts::In, commits)
+  DECLARE_JSON_TYPE(GetReceipts::Out)
+  DECLARE_JSON_REQUIRED_FIELDS(GetReceipts::Out, receipt)
+
+  DECLARE_JSON_TYPE(VerifyReceipts::In)
+  DECLARE_JSON_REQUIRED_FIELDS(VerifyReceipts::In, receipt)
+  DECLARE_JSON_TYPE(VerifyReceipts::Out)
+  DECLARE_JSON_REQUIRED_FIELDS(VerifyReceipts::Out, valid)
 }
\ No newline at end of file
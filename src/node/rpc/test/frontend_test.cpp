@@ -706,6 +706,95 @@ TEST_CASE("No certs table")
   CHECK(response.status == HTTP_STATUS_OK);
 }
 
+TEST_CASE("Latency metrics")
+{
+  prepare_callers();
+  TestUserFrontend frontend(*network.tables);
+
+  {
+    INFO("Methods that have not been called have no latencies");
+    auto rpc_ctx = enclave::make_rpc_context(
+      user_session,
+      create_simple_request(GeneralProcs::GET_METRICS).build_request());
+    auto response = parse_response(frontend.process(rpc_ctx).value());
+    CHECK(response.status == HTTP_STATUS_OK);
+    auto metrics = parse_response_body(response.body).get<GetMetrics::Out>();
+    CHECK(metrics.latencies.find("empty_function") == metrics.latencies.end());
+  }
+
+  const size_t n = 5;
+  for (size_t i = 0; i < n; ++i)
+  {
+    auto rpc_ctx = enclave::make_rpc_context(
+      user_session, create_simple_request().build_request());
+    auto response = parse_response(frontend.process(rpc_ctx).value());
+    CHECK(response.status == HTTP_STATUS_OK);
+  }
+
+  {
+    INFO("Latencies of each stage are recorded for each call");
+    auto rpc_ctx = enclave::make_rpc_context(
+      user_session,
+      create_simple_request(GeneralProcs::GET_METRICS).build_request());
+    auto response = parse_response(frontend.process(rpc_ctx).value());
+    auto metrics = parse_response_body(response.body).get<GetMetrics::Out>();
+    auto search = metrics.latencies.find("empty_function");
+    REQUIRE(search != metrics.latencies.end());
+
+    auto total = [](const GetMetrics::HistogramResults& h) {
+      size_t count = h.underflow + h.overflow;
+      for (const auto& bucket : h.buckets)
+        count += bucket[1].get<size_t>();
+      return count;
+    };
+    CHECK(total(search->second.execute) == n);
+    CHECK(total(search->second.commit) == n);
+  }
+
+  {
+    INFO("Latencies are exported in the Prometheus text format");
+    auto rpc_ctx = enclave::make_rpc_context(
+      user_session,
+      create_simple_request(GeneralProcs::GET_PROMETHEUS_METRICS)
+        .build_request());
+    auto response = parse_response(frontend.process(rpc_ctx).value());
+    CHECK(response.status == HTTP_STATUS_OK);
+    CHECK(
+      response.headers[http::headers::CONTENT_TYPE] ==
+      http::headervalues::contenttype::TEXT);
+    const std::string body(response.body.begin(), response.body.end());
+    CHECK(
+      body.find("# TYPE ccf_rpc_latency_microseconds histogram\n") !=
+      std::string::npos);
+    CHECK(
+      body.find(fmt::format(
+        "ccf_rpc_latency_microseconds_count{{method=\"empty_function\","
+        "stage=\"execute\"}} {}",
+        n)) != std::string::npos);
+    CHECK(
+      body.find("ccf_rpc_latency_microseconds_sum{method=\"empty_function\","
+                "stage=\"execute\"}") != std::string::npos);
+
+    INFO("All buckets are exported, including empty ones");
+    const std::string bucket =
+      "ccf_rpc_latency_microseconds_bucket{method=\"empty_function\","
+      "stage=\"global_commit\"";
+    size_t buckets = 0;
+    for (auto pos = body.find(bucket); pos != std::string::npos;
+         pos = body.find(bucket, pos + 1))
+      ++buckets;
+    // Including the buckets for underflow (le="0") and overflow (le="+Inf")
+    metrics::Latencies::Hist h;
+    size_t expected = 2;
+    for (size_t i = 0; i < h.get_buckets(); ++i)
+    {
+      if (h.get_range(i).first < LATENCY_MAX)
+        ++expected;
+    }
+    CHECK(buckets == expected);
+  }
+}
+
 TEST_CASE("Signed read requests can be executed on backup")
 {
   prepare_callers();
@@ -883,6 +972,106 @@ TEST_CASE("Forwarding" * doctest::test_suite("forwarding"))
   }
 }
 
+class ReadIndexStubConsensus : public kv::BackupStubConsensus
+{
+public:
+  bool supported = true;
+  std::vector<std::function<void(bool)>> pending;
+
+  bool read_index(std::function<void(bool)> cb) override
+  {
+    if (!supported)
+      return false;
+
+    pending.push_back(cb);
+    return true;
+  }
+};
+
+class StubRPCResponder : public enclave::AbstractRPCResponder
+{
+public:
+  std::vector<std::pair<size_t, std::vector<uint8_t>>> replies;
+
+  bool reply_async(size_t id, const std::vector<uint8_t>& data) override
+  {
+    replies.emplace_back(id, data);
+    return true;
+  }
+};
+
+TEST_CASE("Linearizable reads on backup" * doctest::test_suite("forwarding"))
+{
+  prepare_callers();
+  backup_user_session->is_forwarded = false;
+
+  TestUserFrontend user_frontend_backup(*network.tables);
+
+  auto channel_stub = std::make_shared<ChannelStubProxy>();
+  auto backup_forwarder = std::make_shared<Forwarder<ChannelStubProxy>>(
+    nullptr, channel_stub, nullptr);
+  user_frontend_backup.set_cmd_forwarder(backup_forwarder);
+
+  auto responder = std::make_shared<StubRPCResponder>();
+  user_frontend_backup.set_rpc_responder(responder);
+
+  auto backup_consensus = std::make_shared<ReadIndexStubConsensus>();
+  network.tables->set_consensus(backup_consensus);
+
+  auto simple_call = create_simple_request();
+  simple_call.set_header(http::headers::CCF_LINEARIZABLE, "true");
+  auto serialized_call = simple_call.build_request();
+
+  auto& thread_messaging = enclave::ThreadMessaging::thread_messaging;
+  auto& main_task =
+    thread_messaging.get_task(enclave::ThreadMessaging::main_thread);
+
+  {
+    INFO("Read is executed once the read index is reached");
+    auto ctx = enclave::make_rpc_context(backup_user_session, serialized_call);
+    REQUIRE(!user_frontend_backup.process(ctx).has_value());
+    REQUIRE(backup_consensus->pending.size() == 1);
+    REQUIRE(channel_stub->is_empty());
+    REQUIRE(responder->replies.empty());
+
+    backup_consensus->pending.back()(true);
+    backup_consensus->pending.clear();
+    REQUIRE(thread_messaging.run_one(main_task));
+
+    REQUIRE(responder->replies.size() == 1);
+    REQUIRE(channel_stub->is_empty());
+    const auto response = parse_response(responder->replies.back().second);
+    CHECK(response.status == HTTP_STATUS_OK);
+    responder->replies.clear();
+  }
+
+  {
+    INFO("Read is forwarded if the read index cannot be reached");
+    auto ctx = enclave::make_rpc_context(backup_user_session, serialized_call);
+    REQUIRE(!user_frontend_backup.process(ctx).has_value());
+    REQUIRE(backup_consensus->pending.size() == 1);
+
+    backup_consensus->pending.back()(false);
+    backup_consensus->pending.clear();
+    REQUIRE(thread_messaging.run_one(main_task));
+
+    REQUIRE(responder->replies.empty());
+    REQUIRE(channel_stub->size() == 1);
+    channel_stub->get_pop_back();
+  }
+
+  {
+    INFO("Read is forwarded if the consensus does not support read index");
+    backup_consensus->supported = false;
+    backup_user_session->is_forwarded = false;
+    auto ctx = enclave::make_rpc_context(backup_user_session, serialized_call);
+    REQUIRE(!user_frontend_backup.process(ctx).has_value());
+    REQUIRE(backup_consensus->pending.empty());
+    REQUIRE(channel_stub->size() == 1);
+    channel_stub->get_pop_back();
+  }
+}
+
 TEST_CASE("Nodefrontend forwarding" * doctest::test_suite("forwarding"))
 {
   prepare_callers();
@@ -0,0 +1,80 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#include "node/rpc/txscheduler.h"
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+#include <set>
+
+using namespace ccf;
+
+constexpr uint16_t num_workers = 4;
+
+TEST_CASE("Transactions are spread across workers")
+{
+  TxScheduler scheduler;
+
+  std::set<uint16_t> workers;
+  for (size_t i = 0; i < num_workers; ++i)
+  {
+    const auto w = scheduler.pick_worker(std::nullopt, num_workers);
+    REQUIRE(w < num_workers);
+    workers.insert(w);
+  }
+  REQUIRE(workers.size() == num_workers);
+
+  REQUIRE_THROWS_AS(scheduler.pick_worker(std::nullopt, 0), std::logic_error);
+}
+
+TEST_CASE("Transactions writing a contended map are sent to the same worker")
+{
+  TxScheduler scheduler;
+  const MapAccess hot{{"a", "b"}, {"b"}};
+  const MapAccess cold{{"a", "c"}, {"c"}};
+  const auto tick = TxScheduler::decay_interval;
+
+  INFO("Occasional conflicts do not change scheduling");
+  for (size_t i = 0; i < TxScheduler::min_conflicts; ++i)
+  {
+    scheduler.record_conflict(cold);
+    for (size_t j = 0; j < TxScheduler::max_commit_ratio + 1; ++j)
+    {
+      scheduler.record_commit(cold);
+    }
+  }
+  scheduler.tick(tick);
+  REQUIRE_FALSE(scheduler.is_contended("c"));
+
+  INFO("Frequent conflicts do");
+  for (size_t i = 0; i < TxScheduler::min_conflicts; ++i)
+  {
+    scheduler.record_conflict(hot);
+    scheduler.record_commit(hot);
+  }
+  scheduler.tick(tick / 2);
+  REQUIRE_FALSE(scheduler.is_contended("b"));
+  scheduler.tick(tick / 2);
+  REQUIRE(scheduler.is_contended("b"));
+
+  const auto w = scheduler.pick_worker(hot, num_workers);
+  for (size_t i = 0; i < 2 * num_workers; ++i)
+  {
+    REQUIRE(scheduler.pick_worker(hot, num_workers) == w);
+  }
+
+  INFO("Read-only and undeclared transactions are still spread");
+  std::set<uint16_t> workers;
+  for (size_t i = 0; i < num_workers; ++i)
+  {
+    workers.insert(scheduler.pick_worker(MapAccess{{"b"}, {}}, num_workers));
+  }
+  REQUIRE(workers.size() == num_workers);
+
+  INFO("Maps are no longer contended once conflicts stop");
+  for (size_t i = 0; i < 8 && scheduler.is_contended("b"); ++i)
+  {
+    scheduler.record_commit(hot);
+    scheduler.tick(tick);
+  }
+  REQUIRE_FALSE(scheduler.is_contended("b"));
+}
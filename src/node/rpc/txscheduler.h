@@ -0,0 +1,165 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+
+namespace ccf
+{
+  /** Names of the maps a handler may read and write.
+   *
+   * Declaring these is optional. The kv store only validates a transaction's
+   * reads in the maps it writes to, so only the write set determines which
+   * transactions can conflict with each other.
+   */
+  struct MapAccess
+  {
+    std::set<std::string> reads;
+    std::set<std::string> writes;
+  };
+
+  /** Assigns transactions to worker threads.
+   *
+   * Transactions are spread round-robin across workers and executed
+   * optimistically, the frontend retrying those that conflict at commit. For
+   * handlers that declare their write set, commits and conflicts are counted
+   * per map. While a map is contended, all transactions writing to it are sent
+   * to the same worker, where they run one after the other instead of
+   * repeatedly invalidating each other.
+   */
+  class TxScheduler
+  {
+  public:
+    // A map is contended once, over a decay interval, it has seen at least
+    // min_conflicts conflicts and at least one conflict per max_commit_ratio
+    // commits
+    static constexpr size_t min_conflicts = 16;
+    static constexpr size_t max_commit_ratio = 4;
+    static constexpr std::chrono::milliseconds decay_interval{100};
+
+  private:
+    // Maps are counted in a fixed number of buckets, so that recording does
+    // not need a lock. Maps sharing a bucket are scheduled together.
+    static constexpr size_t num_buckets = 64;
+
+    struct Counters
+    {
+      std::atomic<size_t> commits = 0;
+      std::atomic<size_t> conflicts = 0;
+      std::atomic<bool> contended = false;
+    };
+
+    std::array<Counters, num_buckets> buckets;
+    std::atomic<size_t> next_worker = 0;
+    std::chrono::milliseconds to_decay = decay_interval;
+
+    static size_t bucket_of(const std::string& name)
+    {
+      return std::hash<std::string>{}(name) % num_buckets;
+    }
+
+  public:
+    /** Pick the worker on which to execute a transaction
+     *
+     * @param access Maps accessed by the transaction, if declared
+     * @param num_workers Number of worker threads
+     *
+     * @return Index of the worker, in [0, num_workers)
+     */
+    uint16_t pick_worker(
+      const std::optional<MapAccess>& access, uint16_t num_workers)
+    {
+      if (num_workers == 0)
+      {
+        throw std::logic_error("Cannot schedule transaction without workers");
+      }
+
+      if (access.has_value())
+      {
+        // The write set is ordered, so transactions writing several contended
+        // maps are consistently sent to the worker of the first one
+        for (const auto& name : access->writes)
+        {
+          const auto b = bucket_of(name);
+          if (buckets[b].contended)
+          {
+            return b % num_workers;
+          }
+        }
+      }
+
+      return next_worker++ % num_workers;
+    }
+
+    /** Record that a transaction committed
+     *
+     * @param access Maps accessed by the transaction, if declared
+     */
+    void record_commit(const std::optional<MapAccess>& access)
+    {
+      if (access.has_value())
+      {
+        for (const auto& name : access->writes)
+        {
+          buckets[bucket_of(name)].commits++;
+        }
+      }
+    }
+
+    /** Record that a transaction conflicted and will be retried
+     *
+     * @param access Maps accessed by the transaction, if declared
+     */
+    void record_conflict(const std::optional<MapAccess>& access)
+    {
+      if (access.has_value())
+      {
+        for (const auto& name : access->writes)
+        {
+          buckets[bucket_of(name)].conflicts++;
+        }
+      }
+    }
+
+    bool is_contended(const std::string& name) const
+    {
+      return buckets[bucket_of(name)].contended;
+    }
+
+    /** Update which maps are contended, and decay counts so that maps which
+     * are no longer contended are eventually scheduled round-robin again.
+     *
+     * This must only be called from a single thread.
+     *
+     * @param elapsed Time since the previous tick
+     */
+    void tick(std::chrono::milliseconds elapsed)
+    {
+      if (elapsed < to_decay)
+      {
+        to_decay -= elapsed;
+        return;
+      }
+      to_decay = decay_interval;
+
+      for (auto& c : buckets)
+      {
+        const size_t conflicts = c.conflicts;
+        const size_t commits = c.commits;
+        c.contended = conflicts >= min_conflicts &&
+          conflicts * max_commit_ratio >= commits;
+
+        c.conflicts -= conflicts / 2;
+        c.commits -= commits / 2;
+      }
+    }
+  };
+}
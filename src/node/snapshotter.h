@@ -0,0 +1,162 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "consensus/ledgerenclavetypes.h"
+#include "crypto/hash.h"
+#include "ds/logger.h"
+#include "ds/thread_messaging.h"
+#include "entities.h"
+#include "kv/kvtypes.h"
+#include "tls/keypair.h"
+
+#include <msgpack-c/msgpack.hpp>
+
+namespace ccf
+{
+  // A snapshot of the replicated state of the store, as of a globally
+  // committed version. It contains the Merkle tree of the ledger up to that
+  // version so that a node starting from it can carry on appending to the
+  // history. It is signed with the network identity, which only the nodes
+  // that are part of the network hold, so that a joining node can check it
+  // against the network certificate it joins with.
+  struct SignedSnapshot
+  {
+    kv::Version version = 0;
+    std::vector<uint8_t> tree;
+    // Serialised (and encrypted) store
+    std::vector<uint8_t> store;
+    // Node that produced the snapshot, for diagnostics only
+    NodeId signer = INVALID_ID;
+    std::vector<uint8_t> sig;
+
+    MSGPACK_DEFINE(version, tree, store, signer, sig);
+
+    crypto::Sha256Hash digest() const
+    {
+      return crypto::Sha256Hash({asCb(version), tree, store});
+    }
+
+    std::vector<uint8_t> serialise() const
+    {
+      msgpack::sbuffer sb;
+      msgpack::pack(sb, *this);
+      return {sb.data(), sb.data() + sb.size()};
+    }
+
+    static SignedSnapshot deserialise(const std::vector<uint8_t>& data)
+    {
+      msgpack::object_handle oh =
+        msgpack::unpack((const char*)data.data(), data.size());
+      return oh.get().as<SignedSnapshot>();
+    }
+  };
+
+  class Snapshotter : public kv::AbstractSnapshotter
+  {
+  private:
+    ringbuffer::WriterPtr to_host;
+    std::shared_ptr<kv::AbstractStore> store;
+    // Private key of the network identity
+    tls::Pem network_key;
+    NodeId id;
+
+    // Minimum number of transactions between two snapshots. 0 disables
+    // snapshotting.
+    const size_t snapshot_tx_interval;
+    kv::Version last_snapshot_idx = 0;
+
+    struct SnapshotMsg
+    {
+      std::unique_ptr<kv::AbstractStore::Snapshot> snapshot;
+      std::shared_ptr<kv::AbstractTxEncryptor> encryptor;
+      tls::Pem network_key;
+      ringbuffer::WriterPtr to_host;
+      SignedSnapshot ss;
+    };
+
+    static void serialise_cb(std::unique_ptr<enclave::Tmsg<SnapshotMsg>> msg)
+    {
+      auto& d = msg->data;
+      d.ss.version = d.snapshot->get_version();
+      d.ss.tree = d.snapshot->get_tree();
+      d.ss.store = d.snapshot->serialise(d.encryptor);
+      d.snapshot.reset();
+
+      // Each snapshot is signed with its own key pair, since a key pair must
+      // not be used by several threads at once
+      auto network_kp = tls::make_key_pair(d.network_key);
+      auto digest = d.ss.digest();
+      d.ss.sig = network_kp->sign_hash(digest.h.data(), digest.h.size());
+
+      enclave::ThreadMessaging::ChangeTmsgCallback(msg, &serialised_cb);
+      enclave::ThreadMessaging::thread_messaging.add_task<SnapshotMsg>(
+        enclave::ThreadMessaging::main_thread, std::move(msg));
+    }
+
+    static void serialised_cb(std::unique_ptr<enclave::Tmsg<SnapshotMsg>> msg)
+    {
+      auto& d = msg->data;
+
+      LOG_INFO_FMT(
+        "Snapshot at {} ({} bytes)", d.ss.version, d.ss.store.size());
+
+      RINGBUFFER_WRITE_MESSAGE(
+        consensus::snapshot,
+        d.to_host,
+        (consensus::Index)d.ss.version,
+        d.ss.serialise());
+    }
+
+  public:
+    Snapshotter(
+      ringbuffer::AbstractWriterFactory& writer_factory,
+      std::shared_ptr<kv::AbstractStore> store_,
+      const tls::Pem& network_key_,
+      NodeId id_,
+      size_t snapshot_tx_interval_) :
+      to_host(writer_factory.create_writer_to_outside()),
+      store(store_),
+      network_key(network_key_),
+      id(id_),
+      snapshot_tx_interval(snapshot_tx_interval_)
+    {}
+
+    void set_last_snapshot_idx(kv::Version idx)
+    {
+      last_snapshot_idx = idx;
+    }
+
+    bool requires_snapshot(kv::Version v) override
+    {
+      // Compaction only happens on globally committed versions, which in
+      // Raft are always signature transactions
+      if (snapshot_tx_interval == 0)
+        return false;
+
+      return (v - last_snapshot_idx) >= (kv::Version)snapshot_tx_interval;
+    }
+
+    void snapshot(std::unique_ptr<kv::AbstractStore::Snapshot> s) override
+    {
+      // This runs on the consensus thread, while the store is being
+      // compacted. The snapshot only holds the roots of the maps, so it is
+      // serialised and signed on a worker thread, and handed back to this
+      // thread to be written to the host.
+      last_snapshot_idx = s->get_version();
+
+      auto msg = std::make_unique<enclave::Tmsg<SnapshotMsg>>(&serialise_cb);
+      auto& d = msg->data;
+      d.snapshot = std::move(s);
+      d.encryptor = store->get_encryptor();
+      d.network_key = network_key;
+      d.to_host = to_host;
+      d.ss.signer = id;
+
+      const auto tid =
+        enclave::ThreadMessaging::get_execution_thread(last_snapshot_idx);
+      enclave::ThreadMessaging::thread_messaging.add_task<SnapshotMsg>(
+        tid, std::move(msg));
+    }
+  };
+}
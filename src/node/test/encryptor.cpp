@@ -124,6 +124,48 @@ TEST_CASE("Additional data")
   REQUIRE(decrypted_cipher2.empty());
 }
 
+TEST_CASE("In place encryption")
+{
+  auto secrets = std::make_shared<ccf::LedgerSecrets>();
+  secrets->set_secret(1, std::vector<uint8_t>(32, 0x42));
+  // The IV only depends on the view and version, so that in place and regular
+  // encryption can be compared
+  auto encryptor = std::make_shared<ccf::PbftTxEncryptor>(secrets);
+  kv::Version version = 10;
+
+  const auto padding = encryptor->get_padding_length();
+  const auto hdr_size = encryptor->get_header_length();
+
+  // Sizes that do not end on an AES block boundary
+  for (size_t size : {0, 1, 17, 130})
+  {
+    std::vector<uint8_t> plain(size, 0x42);
+    std::vector<uint8_t> additional_data(33, 0x10);
+    std::vector<uint8_t> cipher;
+    std::vector<uint8_t> serialised_header;
+    encryptor->encrypt(
+      plain, additional_data, serialised_header, cipher, version);
+
+    std::vector<uint8_t> data(size + padding, 0x42);
+    std::vector<uint8_t> padded_additional_data(33 + padding, 0x10);
+    std::vector<uint8_t> header(hdr_size);
+    encryptor->encrypt_in_place(
+      {padded_additional_data.data(), 33},
+      {data.data(), size},
+      header.data(),
+      version);
+    data.resize(size);
+
+    REQUIRE(data == cipher);
+    REQUIRE(header == serialised_header);
+
+    std::vector<uint8_t> decrypted_cipher;
+    REQUIRE(encryptor->decrypt(
+      data, additional_data, header, decrypted_cipher, version));
+    REQUIRE(plain == decrypted_cipher);
+  }
+}
+
 TEST_CASE("Encryption/decryption with multiple ledger secrets")
 {
   // Setting 2 ledger secrets, valid from version 1 and 4
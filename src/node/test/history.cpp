@@ -4,6 +4,7 @@
 #include "node/history.h"
 
 #include "consensus/test/stub_consensus.h"
+#include "host/merklestore.h"
 #include "enclave/appinterface.h"
 #include "kv/kv.h"
 #include "node/encryptor.h"
@@ -441,6 +442,283 @@ TEST_CASE(
   }
 }
 
+TEST_CASE("Receipts for flushed indices from the Merkle store")
+{
+  ringbuffer::Circuit eio(1024);
+  auto wf = ringbuffer::WriterFactory(eio);
+  asynchost::MerkleStore merkle_store("testmerkle", wf);
+
+  // Reference tree, which is never flushed
+  MerkleTreeHistory full_tree;
+  MerkleTreeHistory tree;
+
+  const size_t n = 1000;
+  const size_t flush_interval = 37;
+  size_t spilled = 0;
+  for (size_t i = 1; i <= n; ++i)
+  {
+    crypto::Sha256Hash h;
+    for (auto& b : h.h)
+      b = rand();
+    // Appending overwrites the hash, which is used as an accumulator
+    auto h_copy = h;
+    full_tree.append(h);
+    tree.append(h_copy);
+
+    if (i % flush_interval == 0)
+    {
+      for (const auto& [first, hashes] : tree.get_flushed(i - 10))
+      {
+        std::vector<uint8_t> data;
+        for (const auto& h : hashes)
+          data.insert(data.end(), h.h.begin(), h.h.end());
+        merkle_store.append(
+          first.first, first.second, data.data(), data.size());
+        spilled += hashes.size();
+      }
+      tree.flush(i - 10);
+    }
+  }
+  REQUIRE(spilled > 0);
+
+  auto read_flushed = [&](const std::vector<MerkleNode>& nodes) {
+    auto hashes = merkle_store.read(nodes);
+    REQUIRE(hashes.has_value());
+    std::map<MerkleNode, crypto::Sha256Hash> flushed;
+    for (size_t k = 0; k < nodes.size(); ++k)
+    {
+      crypto::Sha256Hash h;
+      std::copy_n(hashes->data() + k * h.SIZE, h.SIZE, h.h.begin());
+      flushed.emplace(nodes[k], h);
+    }
+    return flushed;
+  };
+
+  INFO("Receipts built from flushed nodes match those of the full tree");
+  {
+    for (uint64_t index = 0; index <= n; ++index)
+    {
+      auto flushed = tree.get_flushed_path(index);
+      auto v = tree.get_receipt(index, read_flushed(flushed));
+      REQUIRE(v == full_tree.get_receipt(index).to_v());
+
+      auto r = Receipt::from_v(v);
+      REQUIRE(tree.verify(r));
+    }
+  }
+
+  INFO("Receipts built from modified nodes do not verify");
+  {
+    const uint64_t index = 5;
+    auto flushed_path = tree.get_flushed_path(index);
+    REQUIRE(!flushed_path.empty());
+    auto flushed = read_flushed(flushed_path);
+    flushed.begin()->second.h[0] ^= 1;
+
+    auto v = tree.get_receipt(index, flushed);
+    auto r = Receipt::from_v(v);
+    REQUIRE(!tree.verify(r));
+  }
+
+  INFO("Nodes beyond the store are not read");
+  {
+    REQUIRE(!merkle_store.read({{0, n + 1}}).has_value());
+  }
+}
+
+TEST_CASE("Multi-receipts")
+{
+  auto random_hash = []() {
+    crypto::Sha256Hash h;
+    for (auto& b : h.h)
+      b = rand();
+    return h;
+  };
+
+  INFO("Multi-receipts verify against the root for any tree size");
+  {
+    MerkleTreeHistory tree;
+    for (uint32_t size = 2; size <= 70; ++size)
+    {
+      auto h = random_hash();
+      tree.append(h);
+
+      for (size_t attempt = 0; attempt < 10; ++attempt)
+      {
+        std::vector<uint64_t> indices;
+        for (uint64_t i = 0; i < size; ++i)
+        {
+          if (rand() % 3 == 0)
+            indices.push_back(i);
+        }
+        if (indices.empty())
+          indices.push_back(rand() % size);
+
+        auto r = tree.get_multi_receipt(indices, {});
+        REQUIRE(r.max_index == size);
+        REQUIRE(r.root == tree.get_root());
+        REQUIRE(r.verify());
+
+        auto v = r.to_v();
+        auto r2 = MultiReceipt::from_v(v);
+        REQUIRE(r2.verify());
+        REQUIRE(r2.to_v() == v);
+
+        // Leaves match those of the individual receipts
+        for (size_t n = 0; n < indices.size(); ++n)
+        {
+          auto single = tree.get_receipt(indices[n]).to_v();
+          const auto leaf_offset =
+            sizeof(uint64_t) + sizeof(uint32_t) + crypto::Sha256Hash::SIZE;
+          REQUIRE(std::equal(
+            r.leaves[n].h.begin(),
+            r.leaves[n].h.end(),
+            single.begin() + leaf_offset));
+        }
+
+        r2.leaves.back().h[0] ^= 1;
+        REQUIRE(!r2.verify());
+      }
+    }
+  }
+
+  INFO("Nodes are shared between the paths of contiguous indices");
+  {
+    MerkleTreeHistory tree;
+    for (size_t i = 0; i < 1000; ++i)
+    {
+      auto h = random_hash();
+      tree.append(h);
+    }
+
+    std::vector<uint64_t> indices;
+    size_t single_size = 0;
+    for (uint64_t i = 100; i < 200; ++i)
+    {
+      indices.push_back(i);
+      single_size += tree.get_receipt(i).to_v().size();
+    }
+
+    auto v = tree.get_multi_receipt(indices, {}).to_v();
+    REQUIRE(MultiReceipt::from_v(v).verify());
+    REQUIRE(v.size() * 5 < single_size);
+  }
+
+  INFO("Multi-receipts for flushed indices");
+  {
+    MerkleTreeHistory tree;
+    std::map<MerkleNode, crypto::Sha256Hash> spilled;
+    for (size_t i = 1; i <= 500; ++i)
+    {
+      auto h = random_hash();
+      tree.append(h);
+      if (i % 50 == 0)
+      {
+        for (const auto& [first, hashes] : tree.get_flushed(i - 10))
+        {
+          for (size_t k = 0; k < hashes.size(); ++k)
+            spilled.emplace(
+              MerkleNode{first.first, first.second + k}, hashes[k]);
+        }
+        tree.flush(i - 10);
+      }
+    }
+
+    const std::vector<uint64_t> indices = {3, 4, 5, 17, 250, 499, 500};
+    auto flushed_path = tree.get_flushed_path(indices);
+    REQUIRE(!flushed_path.empty());
+
+    std::map<MerkleNode, crypto::Sha256Hash> flushed;
+    for (const auto& n : flushed_path)
+      flushed.emplace(n, spilled.at(n));
+
+    auto r = tree.get_multi_receipt(indices, flushed);
+    REQUIRE(r.root == tree.get_root());
+    REQUIRE(r.verify());
+  }
+}
+
+TEST_CASE("Lookups of more flushed nodes than the enclave caches complete")
+{
+  ringbuffer::Circuit eio(1 << 20);
+  auto wf = ringbuffer::WriterFactory(eio);
+  asynchost::MerkleStore host_store("testmerkle_lookup", wf);
+  MerkleStoreEnclave enclave_store(wf);
+
+  MerkleTreeHistory tree;
+  const size_t n = 6000;
+  for (size_t i = 1; i <= n; ++i)
+  {
+    crypto::Sha256Hash h;
+    for (auto& b : h.h)
+      b = rand();
+    tree.append(h);
+
+    if (i % 100 == 0)
+    {
+      for (const auto& [first, hashes] : tree.get_flushed(i - 10))
+        enclave_store.put(first, hashes);
+      tree.flush(i - 10);
+    }
+  }
+
+  // Answer the enclave's requests as the host would
+  size_t requested = 0;
+  auto serve = [&]() {
+    eio.read_from_inside().read(
+      -1, [&](ringbuffer::Message m, const uint8_t* data, size_t size) {
+        if (m == ccf::merkle_append)
+        {
+          auto [level, first, hashes] =
+            ringbuffer::read_message<ccf::merkle_append>(data, size);
+          host_store.append(level, first, hashes.data(), hashes.size());
+          return;
+        }
+
+        REQUIRE(m == ccf::merkle_get);
+        auto [token, body] =
+          ringbuffer::read_message<ccf::merkle_get>(data, size);
+        std::vector<MerkleNode> nodes;
+        const uint8_t* p = body.data();
+        size_t s = body.size();
+        while (s > 0)
+        {
+          auto level = serialized::read<uint32_t>(p, s);
+          auto index = serialized::read<uint64_t>(p, s);
+          nodes.emplace_back(level, index);
+        }
+        requested += nodes.size();
+
+        auto hashes = host_store.read(nodes);
+        REQUIRE(hashes.has_value());
+        enclave_store.recv_nodes(token, hashes->data(), hashes->size());
+      });
+  };
+  serve();
+
+  std::vector<uint64_t> indices;
+  for (uint64_t i = 0; i < n - 100; ++i)
+    indices.push_back(i);
+  const auto flushed = tree.get_flushed_path(indices);
+  REQUIRE(flushed.size() > MerkleStoreEnclave::MAX_CACHED_NODES);
+
+  std::optional<MerkleStoreEnclave::Nodes> nodes;
+  for (size_t attempt = 0; attempt < 10 && !nodes.has_value(); ++attempt)
+  {
+    nodes = enclave_store.get(flushed);
+    serve();
+  }
+  REQUIRE(nodes.has_value());
+  REQUIRE(nodes->size() == flushed.size());
+
+  INFO("Each node is only read from the host once");
+  REQUIRE(requested == flushed.size());
+
+  auto r = tree.get_multi_receipt(indices, nodes.value());
+  REQUIRE(r.root == tree.get_root());
+  REQUIRE(r.verify());
+}
+
 // We need an explicit main to initialize kremlib and EverCrypt
 int main(int argc, char** argv)
 {
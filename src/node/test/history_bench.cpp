@@ -62,6 +62,31 @@ static void hash_only(picobench::state& s)
   s.stop_timer();
 }
 
+template <size_t S>
+static void hash_batch(picobench::state& s)
+{
+  ::srand(42);
+
+  std::vector<std::vector<uint8_t>> txs;
+  for (size_t i = 0; i < s.iterations(); i++)
+  {
+    std::vector<uint8_t> tx;
+    for (size_t j = 0; j < S; j++)
+    {
+      tx.push_back(::rand() % 256);
+    }
+    txs.push_back(tx);
+  }
+
+  std::vector<CBuffer> inputs(txs.begin(), txs.end());
+
+  s.start_timer();
+  auto hs = crypto::Sha256Hash::batch(inputs);
+  do_not_optimize(hs);
+  clobber_memory();
+  s.stop_timer();
+}
+
 template <size_t S>
 static void hash_mbedtls_sha256(picobench::state& s)
 {
@@ -162,6 +187,46 @@ static void append(picobench::state& s)
   s.stop_timer();
 }
 
+template <size_t S>
+static void append_batch(picobench::state& s)
+{
+  ::srand(42);
+
+  Store store;
+  auto& nodes = store.create<ccf::Nodes>(ccf::Tables::NODES);
+  auto& signatures = store.create<ccf::Signatures>(ccf::Tables::SIGNATURES);
+
+  auto kp = tls::make_key_pair();
+
+  std::shared_ptr<kv::Consensus> consensus = std::make_shared<DummyConsensus>();
+  store.set_consensus(consensus);
+
+  std::shared_ptr<kv::TxHistory> history =
+    std::make_shared<ccf::MerkleTxHistory>(store, 0, *kp, signatures, nodes);
+  store.set_history(history);
+
+  std::vector<std::vector<uint8_t>> txs;
+  for (size_t i = 0; i < s.iterations(); i++)
+  {
+    std::vector<uint8_t> tx;
+    for (size_t j = 0; j < S; j++)
+    {
+      tx.push_back(::rand() % 256);
+    }
+    txs.push_back(tx);
+  }
+
+  std::vector<CBuffer> inputs(txs.begin(), txs.end());
+
+  s.start_timer();
+  for (const auto& digest : crypto::Sha256Hash::batch(inputs))
+  {
+    history->append(digest);
+    clobber_memory();
+  }
+  s.stop_timer();
+}
+
 template <size_t S>
 static void append_compact(picobench::state& s)
 {
@@ -211,6 +276,11 @@ PICOBENCH(hash_only<10>).iterations(sizes).samples(10).baseline();
 PICOBENCH(hash_only<100>).iterations(sizes).samples(10);
 PICOBENCH(hash_only<1000>).iterations(sizes).samples(10);
 
+PICOBENCH_SUITE("hash_batch");
+PICOBENCH(hash_batch<10>).iterations(sizes).samples(10).baseline();
+PICOBENCH(hash_batch<100>).iterations(sizes).samples(10);
+PICOBENCH(hash_batch<1000>).iterations(sizes).samples(10);
+
 PICOBENCH_SUITE("hash_mbedtls_sha256");
 PICOBENCH(hash_mbedtls_sha256<10>).iterations(sizes).samples(10).baseline();
 PICOBENCH(hash_mbedtls_sha256<100>).iterations(sizes).samples(10);
@@ -226,6 +296,11 @@ PICOBENCH(append<10>).iterations(sizes).samples(10).baseline();
 PICOBENCH(append<100>).iterations(sizes).samples(10);
 PICOBENCH(append<1000>).iterations(sizes).samples(10);
 
+PICOBENCH_SUITE("append_batch");
+PICOBENCH(append_batch<10>).iterations(sizes).samples(10).baseline();
+PICOBENCH(append_batch<100>).iterations(sizes).samples(10);
+PICOBENCH(append_batch<1000>).iterations(sizes).samples(10);
+
 PICOBENCH_SUITE("append_compact");
 PICOBENCH(append_compact<10>).iterations(sizes).samples(10).baseline();
 PICOBENCH(append_compact<100>).iterations(sizes).samples(10);
@@ -3,9 +3,13 @@
 #define PICOBENCH_IMPLEMENT
 #include "../history.h"
 
+#include "ds/ringbuffer.h"
+#include "host/merklestore.h"
+
 #define FMT_HEADER_ONLY
 #include <algorithm>
 #include <fmt/format.h>
+#include <numeric>
 #include <picobench/picobench.hpp>
 #include <random>
 
@@ -90,6 +94,45 @@ static void append_flush(picobench::state& s)
   s.stop_timer();
 }
 
+static void append_batch_flush(picobench::state& s)
+{
+  ccf::MerkleTreeHistory t;
+  vector<crypto::Sha256Hash> hashes;
+  std::random_device r;
+
+  for (size_t i = 0; i < s.iterations(); ++i)
+  {
+    crypto::Sha256Hash h;
+    for (size_t j = 0; j < crypto::Sha256Hash::SIZE; j++)
+      h.h[j] = r();
+
+    hashes.emplace_back(h);
+  }
+
+  // Hashes are appended in batches of 100, as a backup would for the
+  // entries of an append entries message
+  const size_t batch_size = 100;
+  vector<vector<crypto::Sha256Hash>> batches;
+  for (size_t index = 0; index < hashes.size(); index += batch_size)
+  {
+    const auto end = std::min(index + batch_size, hashes.size());
+    batches.emplace_back(hashes.begin() + index, hashes.begin() + end);
+  }
+
+  size_t index = 0;
+  s.start_timer();
+  for (const auto& batch : batches)
+  {
+    t.append(batch);
+    index += batch.size();
+    if (index % 1000 == 0)
+      t.flush(index - 1000);
+
+    clobber_memory();
+  }
+  s.stop_timer();
+}
+
 static void append_get_receipt_verify(picobench::state& s)
 {
   ccf::MerkleTreeHistory t;
@@ -155,6 +198,133 @@ static void append_get_receipt_verify_v(picobench::state& s)
   s.stop_timer();
 }
 
+// Receipts for indices flushed from the tree, whose nodes are read from the
+// host's Merkle store
+static void get_flushed_receipt_verify(picobench::state& s)
+{
+  ringbuffer::Circuit eio(1024);
+  auto wf = ringbuffer::WriterFactory(eio);
+  asynchost::MerkleStore store("merkle_bench_store", wf);
+
+  ccf::MerkleTreeHistory t;
+  std::random_device r;
+
+  const size_t leaves = 100000;
+  for (size_t i = 1; i <= leaves; ++i)
+  {
+    crypto::Sha256Hash h;
+    for (size_t j = 0; j < crypto::Sha256Hash::SIZE; j++)
+      h.h[j] = r();
+    t.append(h);
+
+    if (i % 1000 == 0)
+    {
+      for (const auto& [first, hashes] : t.get_flushed(i - 1000))
+      {
+        vector<uint8_t> data;
+        for (const auto& h : hashes)
+          data.insert(data.end(), h.h.begin(), h.h.end());
+        store.append(first.first, first.second, data.data(), data.size());
+      }
+      t.flush(i - 1000);
+    }
+  }
+
+  vector<uint64_t> indices;
+  std::mt19937 gen(r());
+  std::uniform_int_distribution<uint64_t> dist(0, leaves - 2000);
+  for (size_t i = 0; i < s.iterations(); ++i)
+    indices.push_back(dist(gen));
+
+  size_t index = 0;
+  s.start_timer();
+  for (auto _ : s)
+  {
+    (void)_;
+    const auto i = indices[index++];
+    const auto nodes = t.get_flushed_path(i);
+    auto hashes = store.read(nodes);
+    if (!hashes.has_value())
+      throw std::runtime_error("Missing nodes");
+
+    std::map<ccf::MerkleNode, crypto::Sha256Hash> flushed;
+    for (size_t n = 0; n < nodes.size(); ++n)
+    {
+      crypto::Sha256Hash h;
+      std::copy_n(hashes->data() + n * h.SIZE, h.SIZE, h.h.begin());
+      flushed.emplace(nodes[n], h);
+    }
+
+    auto v = t.get_receipt(i, flushed);
+    auto p = ccf::Receipt::from_v(v);
+    if (!t.verify(p))
+      throw std::runtime_error("Bad path");
+
+    clobber_memory();
+  }
+  s.stop_timer();
+
+  std::cout << fmt::format(
+                 "flushed receipts n={} : {:.0f} receipts/s",
+                 s.iterations(),
+                 s.iterations() * 1e9 / s.duration_ns())
+            << std::endl;
+}
+
+// Receipts for ranges of 100 consecutive indices, as one multi-receipt per
+// range, or as 100 individual receipts
+template <bool multi>
+static void get_range_receipts_verify(picobench::state& s)
+{
+  ccf::MerkleTreeHistory t;
+  std::random_device r;
+
+  for (size_t i = 0; i < s.iterations(); ++i)
+  {
+    crypto::Sha256Hash h;
+    for (size_t j = 0; j < crypto::Sha256Hash::SIZE; j++)
+      h.h[j] = r();
+    t.append(h);
+  }
+
+  const size_t range = 100;
+  size_t bytes = 0;
+  s.start_timer();
+  for (size_t first = 0; first + range <= s.iterations(); first += range)
+  {
+    if constexpr (multi)
+    {
+      vector<uint64_t> indices(range);
+      std::iota(indices.begin(), indices.end(), first);
+      auto v = t.get_multi_receipt(indices, {}).to_v();
+      bytes += v.size();
+      if (!ccf::MultiReceipt::from_v(v).verify())
+        throw std::runtime_error("Bad multi-receipt");
+    }
+    else
+    {
+      for (size_t i = first; i < first + range; ++i)
+      {
+        auto v = t.get_receipt(i).to_v();
+        bytes += v.size();
+        auto p = ccf::Receipt::from_v(v);
+        if (!t.verify(p))
+          throw std::runtime_error("Bad path");
+      }
+    }
+
+    clobber_memory();
+  }
+  s.stop_timer();
+
+  std::cout << fmt::format(
+                 "{} receipts n={} : {} bytes",
+                 multi ? "multi" : "single",
+                 s.iterations(),
+                 bytes)
+            << std::endl;
+}
+
 static void serialise_deserialise(picobench::state& s)
 {
   ccf::MerkleTreeHistory t;
@@ -207,10 +377,19 @@ PICOBENCH_SUITE("append_retract");
 PICOBENCH(append_retract).iterations(sizes).samples(10).baseline();
 PICOBENCH_SUITE("append_flush");
 PICOBENCH(append_flush).iterations(sizes).samples(10).baseline();
+PICOBENCH_SUITE("append_batch_flush");
+PICOBENCH(append_batch_flush).iterations(sizes).samples(10).baseline();
 PICOBENCH_SUITE("append_get_receipt_verify");
 PICOBENCH(append_get_receipt_verify).iterations(sizes).samples(10).baseline();
 PICOBENCH_SUITE("append_get_receipt_verify_v");
 PICOBENCH(append_get_receipt_verify_v).iterations(sizes).samples(10).baseline();
+PICOBENCH_SUITE("get_flushed_receipt_verify");
+PICOBENCH(get_flushed_receipt_verify).iterations(sizes).samples(10).baseline();
+PICOBENCH_SUITE("get_range_receipts_verify");
+auto single_receipts = get_range_receipts_verify<false>;
+PICOBENCH(single_receipts).iterations(sizes).samples(10).baseline();
+auto multi_receipts = get_range_receipts_verify<true>;
+PICOBENCH(multi_receipts).iterations(sizes).samples(10);
 PICOBENCH_SUITE("serialise_deserialise");
 PICOBENCH(serialise_deserialise).iterations(sizes).samples(10).baseline();
 // Checks the size of serialised tree, timing results are irrelevant here
@@ -2,12 +2,18 @@
 # Licensed under the Apache 2.0 License.
 import io
 import msgpack
+import os
 import struct
+import zlib
 
 GCM_SIZE_TAG = 16
 GCM_SIZE_IV = 12
 LEDGER_TRANSACTION_SIZE = 4
 LEDGER_DOMAIN_SIZE = 8
+LEDGER_CHUNK_PREFIX = "ledger_"
+LEDGER_CHUNK_INDEX_SUFFIX = ".index"
+LEDGER_CHUNK_COMPRESSED_SUFFIX = ".z"
+LEDGER_CHUNK_COMPRESSED_HEADER_SIZE = 8
 
 
 def to_uint_32(buffer):
@@ -93,7 +99,16 @@ class Transaction:
     gcm_header = None
 
     def __init__(self, filename):
-        self._file = open(filename, mode="rb")
+        if filename.endswith(LEDGER_CHUNK_COMPRESSED_SUFFIX):
+            # Compressed chunks hold the size of their contents, followed by
+            # the zlib stream of these contents
+            with open(filename, mode="rb") as f:
+                data = f.read()
+            self._file = io.BytesIO(
+                zlib.decompress(data[LEDGER_CHUNK_COMPRESSED_HEADER_SIZE:])
+            )
+        else:
+            self._file = open(filename, mode="rb")
         self._file.seek(0, 2)
         self._file_size = self._file.tell()
         self._file.seek(0, 0)
@@ -140,12 +155,31 @@ class Transaction:
             raise StopIteration()
 
 
-class Ledger:
+def _chunk_start_index(filename):
+    return int(filename[len(LEDGER_CHUNK_PREFIX) :].split("-")[0].split(".")[0])
 
-    _filename = None
 
-    def __init__(self, filename):
-        self._filename = filename
+class Ledger:
+
+    _filenames = []
+
+    def __init__(self, directory):
+        # Chunks are named ledger_<start>, or ledger_<start>-<end>.committed
+        # once sealed, with a .z suffix if compressed. Index files are
+        # skipped, as are uncompressed chunks that have been compressed.
+        names = os.listdir(directory)
+        chunks = [
+            f
+            for f in names
+            if f.startswith(LEDGER_CHUNK_PREFIX)
+            and not f.endswith(LEDGER_CHUNK_INDEX_SUFFIX)
+            and not f.endswith(".tmp")
+            and f + LEDGER_CHUNK_COMPRESSED_SUFFIX not in names
+        ]
+        self._filenames = [
+            os.path.join(directory, f) for f in sorted(chunks, key=_chunk_start_index)
+        ]
 
     def __iter__(self):
-        return Transaction(self._filename)
+        for filename in self._filenames:
+            yield from Transaction(filename)
@@ -18,7 +18,9 @@ from loguru import logger as LOG
 
 
 @reqs.description("Running transactions against logging app")
-@reqs.supports_methods("getReceipt", "verifyReceipt", "LOG_get")
+@reqs.supports_methods(
+    "getReceipt", "verifyReceipt", "getReceipts", "verifyReceipts", "LOG_get"
+)
 @reqs.at_least_n_nodes(2)
 def test(network, args, notifications_queue=None):
     primary, backup = network.find_primary_and_any_backup()
@@ -43,6 +45,23 @@ def test(network, args, notifications_queue=None):
             invalid[-3] += 1
             check(c.rpc("verifyReceipt", {"receipt": invalid}), result={"valid": False})
 
+            LOG.info("Batched receipts for several commits")
+            commits = []
+            for i in range(5):
+                r = c.rpc("LOG_record", {"id": 43 + i, "msg": msg})
+                check_commit(r, result=True)
+                commits.append(r.commit)
+            r = c.rpc("getReceipts", {"commits": commits})
+            check(
+                c.rpc("verifyReceipts", {"receipt": r.result["receipt"]}),
+                result={"valid": True},
+            )
+            invalid = r.result["receipt"]
+            invalid[-3] += 1
+            check(
+                c.rpc("verifyReceipts", {"receipt": invalid}), result={"valid": False}
+            )
+
     return network
 
 